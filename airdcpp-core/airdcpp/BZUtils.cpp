@@ -21,6 +21,7 @@
 
 #include "Exception.h"
 #include "ResourceManager.h"
+#include "Streams.h"
 
 namespace dcpp {
 	
@@ -101,4 +102,130 @@ bool UnBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& o
 	return err == BZ_OK;
 }
 
+// Compressed stream format: "BZh" + block size, blocks (bit aligned), end of stream marker (48 bits), combined CRC (32 bits), padding
+static const char BZ_STREAM_HEADER[] = { 'B', 'Z', 'h', '9' };
+static const size_t BZ_STREAM_HEADER_SIZE = sizeof(BZ_STREAM_HEADER);
+static const uint64_t BZ_BLOCK_MAGIC = 0x314159265359ULL;
+static const uint64_t BZ_STREAM_END_MAGIC = 0x177245385090ULL;
+
+static uint64_t readBits(const string& aData, uint64_t aPos, int aCount) noexcept {
+	uint64_t ret = 0;
+	for (int i = 0; i < aCount; ++i) {
+		auto pos = aPos + i;
+		ret = (ret << 1) | ((static_cast<uint8_t>(aData[static_cast<size_t>(pos / 8)]) >> (7 - pos % 8)) & 1);
+	}
+
+	return ret;
+}
+
+const size_t BZBlockList::MAX_BLOCK_INPUT;
+
+void BZBlockList::compress(const void* aData, size_t aSize) {
+	auto data = static_cast<const char*>(aData);
+	for (size_t pos = 0; pos < aSize; pos += MAX_BLOCK_INPUT) {
+		auto len = min(aSize - pos, MAX_BLOCK_INPUT);
+
+		// Compress as a separate stream containing a single block
+		string out;
+		out.resize(len + len / 100 + 600);
+		auto outLen = static_cast<unsigned int>(out.size());
+		if (BZ2_bzBuffToBuffCompress(&out[0], &outLen, const_cast<char*>(data + pos), static_cast<unsigned int>(len), 9, 0, 30) != BZ_OK) {
+			throw Exception(STRING(COMPRESSION_ERROR));
+		}
+
+		out.resize(outLen);
+
+		// Locate the end of stream marker (the stream is padded to full bytes)
+		const uint64_t headerBits = BZ_STREAM_HEADER_SIZE * 8;
+		if (out.size() < BZ_STREAM_HEADER_SIZE + 20 || readBits(out, headerBits, 48) != BZ_BLOCK_MAGIC) {
+			throw Exception(STRING(COMPRESSION_ERROR));
+		}
+
+		auto crc = static_cast<uint32_t>(readBits(out, headerBits + 48, 32));
+
+		uint64_t blockBits = 0;
+		for (int padding = 0; padding < 8; ++padding) {
+			auto endPos = static_cast<uint64_t>(out.size()) * 8 - padding - 80;
+			if (readBits(out, endPos, 48) == BZ_STREAM_END_MAGIC && readBits(out, endPos + 48, 32) == crc && readBits(out, endPos + 80, padding) == 0) {
+				blockBits = endPos - headerBits;
+				break;
+			}
+		}
+
+		if (blockBits == 0) {
+			throw Exception(STRING(COMPRESSION_ERROR));
+		}
+
+		out.erase(0, BZ_STREAM_HEADER_SIZE);
+		out.resize(static_cast<size_t>((blockBits + 7) / 8));
+		blocks.push_back({ move(out), blockBits, crc });
+	}
+}
+
+void BZBlockList::append(BZBlockList&& aList) noexcept {
+	std::move(aList.blocks.begin(), aList.blocks.end(), back_inserter(blocks));
+	aList.blocks.clear();
+}
+
+size_t BZBlockList::getCompressedSize() const noexcept {
+	size_t ret = 0;
+	for (const auto& b : blocks) {
+		ret += b.data.size();
+	}
+
+	return ret;
+}
+
+BZBlockWriter::BZBlockWriter(OutputStream* aStream) : os(aStream) {
+	buf.append(BZ_STREAM_HEADER, BZ_STREAM_HEADER_SIZE);
+}
+
+void BZBlockWriter::writeBits(uint32_t aValue, int aCount) {
+	bitBuffer = (bitBuffer << aCount) | (aValue & ((1ULL << aCount) - 1));
+	bitCount += aCount;
+	while (bitCount >= 8) {
+		bitCount -= 8;
+		buf.push_back(static_cast<char>((bitBuffer >> bitCount) & 0xFF));
+	}
+}
+
+void BZBlockWriter::write(const BZBlockList& aBlocks) {
+	for (const auto& b : aBlocks.blocks) {
+		auto fullBytes = static_cast<size_t>(b.bits / 8);
+		if (bitCount == 0) {
+			buf.append(b.data, 0, fullBytes);
+		} else {
+			for (size_t i = 0; i < fullBytes; ++i) {
+				writeBits(static_cast<uint8_t>(b.data[i]), 8);
+			}
+		}
+
+		auto remainingBits = static_cast<int>(b.bits % 8);
+		if (remainingBits > 0) {
+			writeBits(static_cast<uint8_t>(b.data[fullBytes]) >> (8 - remainingBits), remainingBits);
+		}
+
+		combinedCRC = ((combinedCRC << 1) | (combinedCRC >> 31)) ^ b.crc;
+		flush(false);
+	}
+}
+
+void BZBlockWriter::finish() {
+	writeBits(static_cast<uint32_t>(BZ_STREAM_END_MAGIC >> 24), 24);
+	writeBits(static_cast<uint32_t>(BZ_STREAM_END_MAGIC & 0xFFFFFF), 24);
+	writeBits(combinedCRC, 32);
+	if (bitCount > 0) {
+		writeBits(0, 8 - bitCount);
+	}
+
+	flush(true);
+}
+
+void BZBlockWriter::flush(bool aForce) {
+	if (!buf.empty() && (aForce || buf.size() >= 64 * 1024)) {
+		os->write(buf.data(), buf.size());
+		buf.clear();
+	}
+}
+
 } // namespace dcpp
\ No newline at end of file
@@ -21,6 +21,8 @@
 
 #include <bzlib.h>
 
+#include "typedefs.h"
+
 namespace dcpp {
 
 class BZFilter {
@@ -57,6 +59,66 @@ private:
 	bz_stream zs;
 };
 
+/**
+* List of independently compressed bzip2 blocks
+*
+* The blocks can be joined into a single bzip2 stream with BZBlockWriter, which allows compressing different parts
+* of the data in parallel and reusing the compressed parts later.
+*/
+class BZBlockList {
+public:
+	// Maximum amount of input data that always fits in a single block with the maximum block size
+	// (the initial run-length encoding may expand the data by 25%)
+	static const size_t MAX_BLOCK_INPUT = 700 * 1024;
+
+	/**
+	* Compress data and append the created blocks in the list.
+	* @param aData Input data (split in multiple blocks if it exceeds MAX_BLOCK_INPUT)
+	*/
+	void compress(const void* aData, size_t aSize);
+
+	// Move all blocks from another list to the end of this list
+	void append(BZBlockList&& aList) noexcept;
+
+	size_t getCompressedSize() const noexcept;
+	size_t getBlockCount() const noexcept { return blocks.size(); }
+private:
+	friend class BZBlockWriter;
+
+	struct Block {
+		// Starts from the block header, the last byte may be incomplete
+		string data;
+		uint64_t bits;
+		uint32_t crc;
+	};
+
+	vector<Block> blocks;
+};
+
+/**
+* Writes a single bzip2 stream from compressed blocks
+*/
+class BZBlockWriter {
+public:
+	BZBlockWriter(OutputStream* aStream);
+
+	void write(const BZBlockList& aBlocks);
+
+	// Write the stream footer, no blocks can be added after this
+	void finish();
+private:
+	void writeBits(uint32_t aValue, int aCount);
+	void flush(bool aForce);
+
+	OutputStream* os;
+
+	string buf;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+
+	uint32_t combinedCRC = 0;
+};
+
 } // namespace dcpp
 
 #endif // !defined(DCPLUSPLUS_DCPP_BZUTILS_H)
\ No newline at end of file
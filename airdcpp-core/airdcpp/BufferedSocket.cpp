@@ -36,19 +36,29 @@ namespace dcpp {
 using std::min;
 using std::max;
 
-// Polling is used for tasks...should be fixed...
+// Safety interval for resuming tasks that are waiting for socket events
 #define POLL_TIMEOUT 250
 
+// Retry interval when there are no tokens available for a throttled socket
+#define THROTTLE_RETRY 100
+
+// Maximum number of reads/writes for a socket before letting the other sockets of the loop to be processed
+#define MAX_IO_ROUNDS 16
+
+// Maximum number of bytes to send directly from a file with a single call (the kernel may send less)
+#define SENDFILE_SIZE (4*1024*1024)
+
 BufferedSocket::BufferedSocket(char aSeparator, bool v4only) :
 separator(aSeparator), useLimiter(false), mode(MODE_LINE), dataBytes(0), rollback(0), state(STARTING),
-disconnecting(false), v4only(v4only)
+disconnecting(false), v4only(v4only), id(++nextId)
 {
-	start();
+	loop = SocketReactor::getInstance()->addSocket(this);
 
 	++sockets;
 }
 
 atomic<long> BufferedSocket::sockets(0);
+atomic<uint64_t> BufferedSocket::nextId(0);
 
 BufferedSocket::~BufferedSocket() {
 	--sockets;
@@ -124,78 +134,160 @@ void BufferedSocket::connect(const Socket::AddressInfo& aAddress, const string&
 
 #define LONG_TIMEOUT 30000
 #define SHORT_TIMEOUT 1000
-void BufferedSocket::threadConnect(const Socket::AddressInfo& aAddr, const string& aPort, const string& localPort, NatRoles natRole, bool proxy) {
-	dcassert(state == STARTING);
-
-	fire(BufferedSocketListener::Connecting());
+void BufferedSocket::startConnectHelper(ConnectInfo& aInfo, function<void ()>&& aF) noexcept {
+	aInfo.helperRunning = true;
+	aInfo.helperDone = false;
+	aInfo.helperError.clear();
+
+	auto info = &aInfo;
+	auto socketLoop = loop;
+	auto socketId = id;
+	SocketReactor::getInstance()->callBlocking([info, socketLoop, socketId, f = move(aF)] {
+		try {
+			f();
+		} catch (const Exception& e) {
+			info->helperError = e.getError();
+		}
 
-	const uint64_t endTime = GET_TICK() + LONG_TIMEOUT;
-	state = RUNNING;
+		// The socket may be deleted after this
+		info->helperDone = true;
+		socketLoop->schedule(socketId);
+	});
+}
 
-	while (GET_TICK() < endTime) {
-		//dcdebug("threadConnect attempt %s %s:%s\n", localPort.c_str(), aAddr.c_str(), aPort.c_str());
-		try {
+bool BufferedSocket::threadConnect(ConnectInfo& aInfo) {
+	if (aInfo.helperRunning) {
+		if (!aInfo.helperDone) {
+			// The thread will schedule the socket when it has finished
+			return false;
+		}
 
-			if(proxy) {
-				sock->socksConnect(aAddr, aPort, LONG_TIMEOUT);
-			} else {
-				sock->connect(aAddr, aPort, localPort);
+		aInfo.helperRunning = false;
+		if (!aInfo.helperError.empty()) {
+			if (aInfo.natRole == NAT_NONE) {
+				throw SocketException(aInfo.helperError);
 			}
 
+			aInfo.retryTime = GET_TICK() + SHORT_TIMEOUT;
+		} else if (aInfo.proxy) {
+			aInfo.connecting = true;
 			setOptions();
+			addHandles(true);
+		}
+	}
+
+	if (disconnecting)
+		return true;
+
+	auto tick = GET_TICK();
+	if (!aInfo.connecting) {
+		if (tick >= aInfo.endTime) {
+			throw SocketException(STRING(CONNECTION_TIMEOUT));
+		}
+
+		if (tick < aInfo.retryTime) {
+			scheduleAt(aInfo.retryTime);
+			return false;
+		}
+	}
 
-			bool connSucceeded;
-			while(!(connSucceeded = sock->waitConnected(POLL_TIMEOUT)) && endTime >= GET_TICK()) {
-				if(disconnecting) return;
+	try {
+		if (!aInfo.connecting) {
+			//dcdebug("threadConnect attempt %s %s:%s\n", localPort.c_str(), aAddr.c_str(), aPort.c_str());
+			if (aInfo.proxy) {
+				// The SOCKS5 handshake is blocking
+				auto info = &aInfo;
+				startConnectHelper(aInfo, [this, info] {
+					try {
+						sock->socksConnect(info->addr, info->port, LONG_TIMEOUT);
+					} catch (const Exception& e) {
+						throw SocketException(e.getError().empty() ? STRING(SOCKS_FAILED) : e.getError());
+					}
+				});
+
+				return false;
 			}
 
-			if (connSucceeded) {
-				inbuf.resize(sock->getSocketOptInt(SO_RCVBUF));
+			if (aInfo.addr.getType() == Socket::AddressInfo::TYPE_URL) {
+				// Host names are resolved in a separate thread, the connection attempt is continued with the numeric addresses
+				auto info = &aInfo;
+				startConnectHelper(aInfo, [this, info] {
+					info->addr = sock->resolveHost(info->addr.getV4CompatibleAddress(), info->port);
+				});
 
-				fire(BufferedSocketListener::Connected());
-				return;
+				return false;
 			}
+
+			sock->connect(aInfo.addr, aInfo.port, aInfo.localPort);
+
+			setOptions();
+			aInfo.connecting = true;
+			addHandles(true);
 		}
-		catch (const SSLSocketException&) {
-			throw;
-		} catch (const SocketException&) {
-			if (natRole == NAT_NONE)
-				throw;
-			Thread::sleep(SHORT_TIMEOUT);
+
+		if (sock->waitConnected(0)) {
+			// One of the handles may have been closed
+			addHandles(false);
+
+			inbuf.resize(sock->getSocketOptInt(SO_RCVBUF));
+
+			fire(BufferedSocketListener::Connected());
+			return true;
 		}
+	} catch (const SSLSocketException&) {
+		throw;
+	} catch (const SocketException&) {
+		if (aInfo.natRole == NAT_NONE)
+			throw;
+
+		aInfo.connecting = false;
+		aInfo.retryTime = tick + SHORT_TIMEOUT;
+		scheduleAt(aInfo.retryTime);
+		return false;
 	}
 
-	throw SocketException(STRING(CONNECTION_TIMEOUT));
-}
+	if (tick >= aInfo.endTime) {
+		throw SocketException(STRING(CONNECTION_TIMEOUT));
+	}
 
-void BufferedSocket::threadAccept() {
-	dcassert(state == STARTING);
+	wantWrite = true;
+	scheduleAt(min(aInfo.endTime, tick + POLL_TIMEOUT));
+	return false;
+}
 
+bool BufferedSocket::threadAccept() {
 	//dcdebug("threadAccept\n");
 
-	state = RUNNING;
-
-	inbuf.resize(sock->getSocketOptInt(SO_RCVBUF));
+	if (disconnecting)
+		return true;
 
-	uint64_t startTime = GET_TICK();
-	while(!sock->waitAccepted(POLL_TIMEOUT)) {
-		if(disconnecting)
-			return;
+	if (sock->waitAccepted(0)) {
+		return true;
+	}
 
-		if((startTime + 30000) < GET_TICK()) {
-			throw SocketException(STRING(CONNECTION_TIMEOUT));
-		}
+	auto tick = GET_TICK();
+	if ((taskStarted + LONG_TIMEOUT) < tick) {
+		throw SocketException(STRING(CONNECTION_TIMEOUT));
 	}
+
+	scheduleAt(tick + POLL_TIMEOUT);
+	return false;
 }
 
-void BufferedSocket::threadRead() {
+bool BufferedSocket::threadRead() {
 	if(state != RUNNING)
-		return;
+		return false;
 
-	int left = (mode == MODE_DATA && useLimiter) ? ThrottleManager::getInstance()->read(sock.get(), &inbuf[0], inbuf.size()) : sock->read(&inbuf[0], inbuf.size());
+	auto throttled = mode == MODE_DATA && useLimiter;
+	int left = throttled ? ThrottleManager::getInstance()->read(sock.get(), throttleStream, &inbuf[0], inbuf.size()) : sock->read(&inbuf[0], inbuf.size());
 	if(left == -1) {
 		// EWOULDBLOCK, no data received...
-		return;
+		if (throttled) {
+			// No tokens either? Try again later
+			wantRead = false;
+			scheduleAt(GET_TICK() + THROTTLE_RETRY);
+		}
+		return false;
 	} else if(left == 0) {
 		// This socket has been closed...
 		throw SocketException(STRING(CONNECTION_CLOSED));
@@ -292,101 +384,130 @@ void BufferedSocket::threadRead() {
 	if(mode == MODE_LINE && line.size() > static_cast<size_t>(SETTING(MAX_COMMAND_LENGTH))) {
 		throw SocketException(STRING(COMMAND_TOO_LONG));
 	}
+
+	return true;
 }
 
-void BufferedSocket::threadSendFile(InputStream* file) {
-	if(state != RUNNING)
-		return;
+void BufferedSocket::readData() {
+	for (int i = 0; i < MAX_IO_ROUNDS; ++i) {
+		if (readPaused) {
+			// The socket will be processed again after reading is resumed
+			wantRead = false;
+			return;
+		}
 
-	if(disconnecting)
-		return;
-	dcassert(file != NULL);
-	size_t sockSize = (size_t)sock->getSocketOptInt(SO_SNDBUF);
-	size_t bufSize = max(sockSize, (size_t)64*1024);
+		if (!threadRead()) {
+			return;
+		}
+	}
+
+	// There may be more data
+	loop->schedule(id);
+}
+
+bool BufferedSocket::threadSendFile(SendFileInfo& aInfo) {
+	dcassert(aInfo.stream != NULL);
+	if (aInfo.file) {
+		return threadSendFileDirect(aInfo);
+	}
+
+	for (int i = 0; i < MAX_IO_ROUNDS; ++i) {
+		if(disconnecting)
+			return true;
 
-	ByteVector readBuf(bufSize);
-	ByteVector writeBufTmp(bufSize);
+		if(aInfo.pos == aInfo.buf.size()) {
+			if(aInfo.readDone) {
+				fire(BufferedSocketListener::TransmitDone());
+				return true;
+			}
 
-	size_t readPos = 0;
+			// Fill the buffer
+			aInfo.buf.resize(max(aInfo.sockSize, (size_t)64*1024));
 
-	bool readDone = false;
-	//dcdebug("Starting threadSend\n");
-	while(!disconnecting) {
-		if(!readDone && readBuf.size() > readPos) {
-			// Fill read buffer
-			size_t bytesRead = readBuf.size() - readPos;
-			size_t actual = file->read(&readBuf[readPos], bytesRead);
+			size_t bytesRead = aInfo.buf.size();
+			size_t actual = aInfo.stream->read(&aInfo.buf[0], bytesRead);
 
 			if(bytesRead > 0) {
 				fire(BufferedSocketListener::BytesSent(), bytesRead, 0);
 			}
 
 			if(actual == 0) {
-				readDone = true;
-			} else {
-				readPos += actual;
+				aInfo.readDone = true;
 			}
+
+			aInfo.buf.resize(actual);
+			aInfo.pos = 0;
+			continue;
 		}
 
-		if(readDone && readPos == 0) {
-			fire(BufferedSocketListener::TransmitDone());
-			return;
+		int written;
+		if(aInfo.writeFailed) {
+			// workaround for OpenSSL (crashes when previous write failed and now retrying with different writeSize)
+			written = sock->write(&aInfo.buf[aInfo.pos], static_cast<int>(aInfo.writeSize));
+		} else {
+			aInfo.writeSize = min(aInfo.sockSize / 2, aInfo.buf.size() - aInfo.pos);
+			written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), throttleStream, &aInfo.buf[aInfo.pos], aInfo.writeSize) :
+				sock->write(&aInfo.buf[aInfo.pos], static_cast<int>(aInfo.writeSize));
 		}
 
-		readBuf.swap(writeBufTmp);
-		readBuf.resize(bufSize);
-		writeBufTmp.resize(readPos);
-		readPos = 0;
+		if(written > 0) {
+			aInfo.writeFailed = false;
+			aInfo.pos += written;
 
-		size_t writePos = 0, writeSize = 0;
-		int written = 0;
+			fire(BufferedSocketListener::BytesSent(), 0, written);
+		} else if(written == -1) {
+			// Wait until the socket is writable
+			aInfo.writeFailed = true;
+			wantWrite = true;
+			scheduleAt(GET_TICK() + POLL_TIMEOUT);
+			return false;
+		} else {
+			// No tokens available
+			scheduleAt(GET_TICK() + THROTTLE_RETRY);
+			return false;
+		}
+	}
 
-		while(writePos < writeBufTmp.size()) {
-			if(disconnecting)
-				return;
-			
-			if(written == -1) {
-				// workaround for OpenSSL (crashes when previous write failed and now retrying with different writeSize)
-				written = sock->write(&writeBufTmp[writePos], writeSize);
-			} else {
-				writeSize = min(sockSize / 2, writeBufTmp.size() - writePos);
-				written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), &writeBufTmp[writePos], writeSize) : sock->read(&inbuf[0], inbuf.size());
-			}
-			
-			if(written > 0) {
-				writePos += written;
+	loop->schedule(id);
+	return false;
+}
 
-				fire(BufferedSocketListener::BytesSent(), 0, written);
+bool BufferedSocket::threadSendFileDirect(SendFileInfo& aInfo) {
+	for (int i = 0; i < MAX_IO_ROUNDS; ++i) {
+		if(disconnecting)
+			return true;
 
-			} else if(written == -1) {
-				if(!readDone && readPos < readBuf.size()) {
-					// Read a little since we're blocking anyway...
-					size_t bytesRead = min(readBuf.size() - readPos, readBuf.size() / 2);
-					size_t actual = file->read(&readBuf[readPos], bytesRead);
+		if(aInfo.fileBytesLeft == 0) {
+			fire(BufferedSocketListener::TransmitDone());
+			return true;
+		}
 
-					if(bytesRead > 0) {
-						fire(BufferedSocketListener::BytesSent(), bytesRead, 0);
-					}
+		auto len = static_cast<size_t>(min(aInfo.fileBytesLeft, static_cast<int64_t>(SENDFILE_SIZE)));
+		int written = useLimiter ? ThrottleManager::getInstance()->sendFile(sock.get(), throttleStream, *aInfo.file, aInfo.filePos, len) :
+			sock->sendFile(*aInfo.file, aInfo.filePos, static_cast<int>(len));
 
-					if(actual == 0) {
-						readDone = true;
-					} else {
-						readPos += actual;
-					}
-				} else {
-					while(!disconnecting) {
-						auto w = sock->wait(POLL_TIMEOUT, true, true);
-						if(w.first) {
-							threadRead();
-						}
-						if(w.second) {
-							break;
-						}
-					}
-				}
-			}
+		if(written > 0) {
+			aInfo.fileBytesLeft -= written;
+
+			// The data doesn't pass through a buffer
+			fire(BufferedSocketListener::BytesSent(), written, written);
+		} else if(written == -1) {
+			// Wait until the socket is writable
+			wantWrite = true;
+			scheduleAt(GET_TICK() + POLL_TIMEOUT);
+			return false;
+		} else if(len == 0) {
+			// No tokens available
+			scheduleAt(GET_TICK() + THROTTLE_RETRY);
+			return false;
+		} else {
+			// The file was truncated, handle it in the same way as the end of stream in threadSendFile
+			aInfo.fileBytesLeft = 0;
 		}
 	}
+
+	loop->schedule(id);
+	return false;
 }
 
 void BufferedSocket::write(const char* aBuf, size_t aLen) noexcept {
@@ -399,50 +520,118 @@ void BufferedSocket::write(const char* aBuf, size_t aLen) noexcept {
 	writeBuf.insert(writeBuf.end(), aBuf, aBuf+aLen);
 }
 
-void BufferedSocket::threadSendData() {
-	if(state != RUNNING)
-		return;
+bool BufferedSocket::threadSendData() {
+	while(sendPos < sendBuf.size()) {
+		if(disconnecting) {
+			sendBuf.clear();
+			return true;
+		}
 
-	{
-		Lock l(cs);
-		if(writeBuf.empty())
-			return;
+		int n = sock->write(&sendBuf[sendPos], static_cast<int>(sendBuf.size() - sendPos));
+		if(n <= 0) {
+			// Wait until the socket is writable
+			wantWrite = true;
+			scheduleAt(GET_TICK() + POLL_TIMEOUT);
+			return false;
+		}
 
-		writeBuf.swap(sendBuf);
+		sendPos += n;
 	}
 
-	size_t left = sendBuf.size();
-	size_t done = 0;
-	while(left > 0) {
-		if(disconnecting) {
-			return;
-		}
+	sendBuf.clear();
+	return true;
+}
+
+void BufferedSocket::startTask(pair<Tasks, unique_ptr<TaskData> >&& aTask) {
+	currentTask = std::move(aTask);
+	taskRunning = true;
+	taskStarted = GET_TICK();
+
+	switch(currentTask.first) {
+		case CONNECT: {
+			dcassert(state == STARTING);
+			auto& info = static_cast<ConnectInfo&>(*currentTask.second);
 
-		auto w = sock->wait(POLL_TIMEOUT, true, true);
+			fire(BufferedSocketListener::Connecting());
 
-		if(w.first) {
-			threadRead();
+			info.endTime = taskStarted + LONG_TIMEOUT;
+			state = RUNNING;
+			break;
 		}
+		case ACCEPTED: {
+			dcassert(state == STARTING);
+			state = RUNNING;
 
-		if(w.second) {
-			int n = sock->write(&sendBuf[done], left);
-			if(n > 0) {
-				left -= n;
-				done += n;
+			inbuf.resize(sock->getSocketOptInt(SO_RCVBUF));
+			addHandles(true);
+			break;
+		}
+		case SEND_DATA: {
+			sendBuf.clear();
+			sendPos = 0;
+
+			Lock l(cs);
+			writeBuf.swap(sendBuf);
+			break;
+		}
+		case SEND_FILE: {
+			auto& info = static_cast<SendFileInfo&>(*currentTask.second);
+			info.sockSize = static_cast<size_t>(sock->getSocketOptInt(SO_SNDBUF));
+
+			// Avoid copying the data through user space when possible
+			if (sock->isSendFileSupported()) {
+				info.fileBytesLeft = numeric_limits<int64_t>::max();
+				info.file = info.stream->getSourceFile(info.filePos, info.fileBytesLeft);
 			}
+			break;
+		}
+		case BLOCKING_CALL: {
+			auto info = static_cast<BlockingCallData*>(currentTask.second.get());
+			auto socketLoop = loop;
+			auto socketId = id;
+			SocketReactor::getInstance()->callBlocking([info, socketLoop, socketId] {
+				info->f();
+
+				// The socket may be deleted after this
+				info->done = true;
+				socketLoop->schedule(socketId);
+			});
+			break;
 		}
+		default: dcassert(0);
 	}
-	sendBuf.clear();
 }
 
 bool BufferedSocket::checkEvents() {
-	while(state == RUNNING ? taskSem.wait(0) : taskSem.wait()) {
+	for (;;) {
+		if (taskRunning) {
+			bool done = true;
+			switch(currentTask.first) {
+				case CONNECT: done = threadConnect(static_cast<ConnectInfo&>(*currentTask.second)); break;
+				case ACCEPTED: done = threadAccept(); break;
+				case SEND_DATA: done = threadSendData(); break;
+				case SEND_FILE: done = threadSendFile(static_cast<SendFileInfo&>(*currentTask.second)); break;
+				case BLOCKING_CALL: done = static_cast<BlockingCallData&>(*currentTask.second).done; break;
+				default: dcassert(0);
+			}
+
+			if (!done) {
+				return true;
+			}
+
+			taskRunning = false;
+			currentTask.second.reset();
+		}
+
 		pair<Tasks, unique_ptr<TaskData> > p;
 		{
 			Lock l(cs);
-			dcassert(!tasks.empty());
-			p = move(tasks.front());
-			tasks.erase(tasks.begin());
+			if (tasks.empty()) {
+				return true;
+			}
+
+			p = std::move(tasks.front());
+			tasks.pop_front();
 		}
 
 		if(p.first == SHUTDOWN) {
@@ -455,19 +644,14 @@ bool BufferedSocket::checkEvents() {
 		}
 
 		if(state == STARTING) {
-			if(p.first == CONNECT) {
-				ConnectInfo* ci = static_cast<ConnectInfo*>(p.second.get());
-				threadConnect(ci->addr, ci->port, ci->localPort, ci->natRole, ci->proxy);
-			} else if(p.first == ACCEPTED) {
-				threadAccept();
+			if(p.first == CONNECT || p.first == ACCEPTED) {
+				startTask(std::move(p));
 			} else {
 				dcdebug("%d unexpected in STARTING state\n", p.first);
 			}
 		} else if(state == RUNNING) {
-			if(p.first == SEND_DATA) {
-				threadSendData();
-			} else if(p.first == SEND_FILE) {
-				threadSendFile(static_cast<SendFileInfo*>(p.second.get())->stream); break;
+			if(p.first == SEND_DATA || p.first == SEND_FILE || p.first == BLOCKING_CALL) {
+				startTask(std::move(p));
 			} else if(p.first == DISCONNECT) {
 				fail(STRING(DISCONNECTED));
 			} else {
@@ -475,38 +659,87 @@ bool BufferedSocket::checkEvents() {
 			}
 		}
 	}
-	return true;
 }
 
-void BufferedSocket::checkSocket() {
-	auto w = sock->wait(POLL_TIMEOUT, true, false);
+/**
+ * Main task dispatcher for the buffered socket abstraction.
+ */
+bool BufferedSocket::process() noexcept {
+	wantRead = true;
+	wantWrite = false;
+
+	try {
+		if(!checkEvents()) {
+			return false;
+		}
+
+		// Incoming data is also being handled while sending
+		if(state == RUNNING && (!taskRunning || currentTask.first == SEND_DATA || currentTask.first == SEND_FILE)) {
+			readData();
+		}
+	} catch(const Exception& e) {
+		taskRunning = false;
+		currentTask.second.reset();
+
+		fail(e.getError());
+
+		// Handle the remaining tasks
+		loop->schedule(id);
+	}
 
-	if(w.first) {
-		threadRead();
+	// Handles may not be accessed while a proxy connection is being established
+	if(sock && !(taskRunning && currentTask.first == CONNECT)) {
+		addHandles(false);
 	}
+
+	return true;
 }
 
-/**
- * Main task dispatcher for the buffered socket abstraction.
- * @todo Fix the polling...
- */
-int BufferedSocket::run() {
-	//dcdebug("BufferedSocket::run() start %p\n", (void*)this);
-	while(true) {
-		try {
-			if(!checkEvents()) {
-				break;
+void BufferedSocket::abort() noexcept {
+	if (taskRunning) {
+		// Helper threads may still access the task data and the socket
+		if (currentTask.first == CONNECT) {
+			auto& info = static_cast<ConnectInfo&>(*currentTask.second);
+			while (info.helperRunning && !info.helperDone) {
+				Thread::sleep(10);
 			}
-			if(state == RUNNING) {
-				checkSocket();
+		} else if (currentTask.first == BLOCKING_CALL) {
+			auto& info = static_cast<BlockingCallData&>(*currentTask.second);
+			while (!info.done) {
+				Thread::sleep(10);
 			}
-		} catch(const Exception& e) {
-			fail(e.getError());
 		}
 	}
-	//dcdebug("BufferedSocket::run() end %p\n", (void*)this);
-	delete this;
-	return 0;
+
+	decltype(tasks) pending;
+
+	{
+		Lock l(cs);
+		pending.swap(tasks);
+	}
+
+	for (const auto& p : pending) {
+		if (p.first == SHUTDOWN && p.second) {
+			static_cast<CallData*>(p.second.get())->f();
+		}
+	}
+}
+
+void BufferedSocket::scheduleAt(uint64_t aTick) noexcept {
+	if (deadline == 0 || aTick < deadline) {
+		deadline = aTick;
+	}
+}
+
+void BufferedSocket::addHandles(bool aForce) noexcept {
+	auto current = sock->getHandles();
+	for (auto h : current) {
+		if (aForce || find(handles.begin(), handles.end(), h) == handles.end()) {
+			loop->addHandle(h, id);
+		}
+	}
+
+	handles = std::move(current);
 }
 
 void BufferedSocket::fail(const string& aError) {
@@ -528,7 +761,8 @@ void BufferedSocket::shutdown(function<void ()> f) {
 
 void BufferedSocket::addTask(Tasks task, TaskData* data) {
 	dcassert(task == DISCONNECT || task == SHUTDOWN || sock.get());
-	tasks.emplace_back(task, unique_ptr<TaskData>(data)); taskSem.signal();
+	tasks.emplace_back(task, unique_ptr<TaskData>(data));
+	loop->schedule(id);
 }
 
 } // namespace dcpp
@@ -25,10 +25,10 @@
 #include "typedefs.h"
 
 #include "BufferedSocketListener.h"
-#include "Semaphore.h"
-#include "Thread.h"
 #include "Speaker.h"
 #include "Socket.h"
+#include "SocketReactor.h"
+#include "ThrottleManager.h"
 
 namespace dcpp {
 
@@ -37,7 +37,14 @@ using std::function;
 using std::pair;
 using std::unique_ptr;
 
-class BufferedSocket : public Speaker<BufferedSocketListener>, public Thread {
+/*
+* Socket with task and line/data buffering
+*
+* All socket I/O, tasks and listener events are handled by the SocketReactor loop thread that the socket is assigned to.
+* Tasks are run in the order in which they were added: a task that can't be completed without blocking (connecting, sending data or a file)
+* will be resumed when the socket is ready, and the following tasks will wait until it has finished.
+*/
+class BufferedSocket : public Speaker<BufferedSocketListener> {
 public:
 	enum Modes {
 		MODE_LINE,
@@ -100,8 +107,18 @@ public:
 	/** Send the file f over this socket. */
 	void transmitFile(InputStream* f) { Lock l(cs); addTask(SEND_FILE, new SendFileInfo(f)); }
 
-	/** Call a function from the socket's thread. */
+	/** Call a function from the socket's loop thread. */
 	void callAsync(function<void ()> f) { Lock l(cs); addTask(ASYNC_CALL, new CallData(f)); }
+	/**
+	 * Call a function that may block (e.g. disk access) from a separate thread.
+	 * Incoming data and the following tasks are handled only after the function has returned.
+	 */
+	void callBlocking(function<void ()> f) { Lock l(cs); addTask(BLOCKING_CALL, new BlockingCallData(f)); }
+
+	/** Stop reading incoming data until resumeReading is called. Must be called from the socket's loop thread. */
+	void pauseReading() noexcept { readPaused = true; }
+	/** May be called from any thread. */
+	void resumeReading() noexcept { callAsync([this] { readPaused = false; }); }
 
 	void disconnect(bool graceless = false) noexcept { Lock l(cs); if(graceless) disconnecting = true; addTask(DISCONNECT, 0); }
 
@@ -111,7 +128,11 @@ public:
 
 	GETSET(char, separator, Separator);
 	GETSET(bool, useLimiter, UseLimiter);
+
+	void setThrottleClass(ThrottleManager::ThrottleClass aClass) noexcept { throttleStream.throttleClass = aClass; }
 private:
+	friend class SocketReactor::Loop;
+
 	enum Tasks {
 		CONNECT,
 		DISCONNECT,
@@ -119,7 +140,8 @@ private:
 		SEND_FILE,
 		SHUTDOWN,
 		ACCEPTED,
-		ASYNC_CALL
+		ASYNC_CALL,
+		BLOCKING_CALL
 	};
 
 	enum State {
@@ -138,15 +160,45 @@ private:
 		string localPort;
 		NatRoles natRole;
 		bool proxy;
+
+		// Connection state
+		uint64_t endTime = 0;
+		uint64_t retryTime = 0;
+		bool connecting = false;
+
+		// Host names are resolved and SOCKS5 connections are established in a separate thread
+		bool helperRunning = false;
+		atomic<bool> helperDone { false };
+		string helperError;
 	};
 	struct SendFileInfo : public TaskData {
 		SendFileInfo(InputStream* stream_) : stream(stream_) { }
 		InputStream* stream;
+
+		// Data that has been read from the stream but not sent yet
+		ByteVector buf;
+		size_t pos = 0;
+		bool readDone = false;
+
+		size_t sockSize = 0;
+
+		// OpenSSL requires retrying a failed write with the same buffer length
+		size_t writeSize = 0;
+		bool writeFailed = false;
+
+		// Set if the data can be sent directly from the file
+		File* file = nullptr;
+		int64_t filePos = 0;
+		int64_t fileBytesLeft = 0;
 	};
 	struct CallData : public TaskData {
 		CallData(function<void ()> f) : f(f) { }
 		function<void ()> f;
 	};
+	struct BlockingCallData : public CallData {
+		BlockingCallData(function<void ()> f) : CallData(f) { }
+		atomic<bool> done { false };
+	};
 
 	BufferedSocket(char aSeparator, bool v4only);
 
@@ -154,10 +206,15 @@ private:
 
 	CriticalSection cs;
 
-	Semaphore taskSem;
 	deque<pair<Tasks, unique_ptr<TaskData> > > tasks;
 
+	// Task that is waiting for the socket to become ready
+	pair<Tasks, unique_ptr<TaskData> > currentTask;
+	bool taskRunning = false;
+	uint64_t taskStarted = 0;
+
 	Modes mode;
+	ThrottleManager::Stream throttleStream;
 	std::unique_ptr<UnZFilter> filterIn;
 	int64_t dataBytes;
 	size_t rollback;
@@ -165,25 +222,59 @@ private:
 	ByteVector inbuf;
 	ByteVector writeBuf;
 	ByteVector sendBuf;
+	size_t sendPos = 0;
 
 	std::unique_ptr<Socket> sock;
 	State state;
 	bool disconnecting;
 	bool v4only;
 
-	virtual int run();
+	// Reactor
+	const uint64_t id;
+	SocketReactor::Loop* loop = nullptr;
+
+	// Handles that have been added in the loop
+	vector<socket_t> handles;
+
+	// Time when the socket should be processed even if there are no events (0 = none)
+	uint64_t deadline = 0;
+
+	// Wanted events when the socket handles are polled
+	bool wantRead = true;
+	bool wantWrite = false;
+
+	// Incoming data can't be handled at the moment
+	bool readPaused = false;
+
+	// Called by the loop, returns false if the socket should be deleted
+	bool process() noexcept;
+
+	// Called by the loop when it's being stopped, runs the pending shutdown callback (the socket is deleted afterwards)
+	void abort() noexcept;
+
+	// Process the socket again after the wanted delay (without events)
+	void scheduleAt(uint64_t aTick) noexcept;
+	void addHandles(bool aForce) noexcept;
+
+	// The following return true when the task has been completed (or aborted) and false if it should be resumed later
+	bool threadConnect(ConnectInfo& aInfo);
+	void startConnectHelper(ConnectInfo& aInfo, function<void ()>&& aF) noexcept;
+	bool threadAccept();
+	bool threadSendFile(SendFileInfo& aInfo);
+	bool threadSendFileDirect(SendFileInfo& aInfo);
+	bool threadSendData();
+
+	// Returns true if data was read (more may be available)
+	bool threadRead();
+	void readData();
 
-	void threadConnect(const Socket::AddressInfo& aAddr, const string& aPort, const string& localPort, NatRoles natRole, bool proxy);
-	void threadAccept();
-	void threadRead();
-	void threadSendFile(InputStream* is);
-	void threadSendData();
+	void startTask(pair<Tasks, unique_ptr<TaskData> >&& aTask);
 
 	void fail(const string& aError);
 	static atomic<long> sockets;
+	static atomic<uint64_t> nextId;
 
 	bool checkEvents();
-	void checkSocket();
 
 	void setSocket(std::unique_ptr<Socket>&& s);
 	void setOptions();
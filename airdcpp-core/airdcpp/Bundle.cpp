@@ -47,6 +47,7 @@ Bundle::Bundle(const QueueItemPtr& qi, time_t aFileDate, QueueToken aToken /*0*/
 
 	if (!qi->isDownloaded()) {
 		addFinishedSegment(qi->getDownloadedSegments());
+		setDirty();
 		setDownloadedBytes(qi->getDownloadedBytes());
 		setAutoPriority(qi->getAutoPriority());
 	}
@@ -168,7 +169,6 @@ void Bundle::addFinishedSegment(int64_t aSize) noexcept {
 	dcassert(currentDownloaded >= 0);
 	dcassert(currentDownloaded <= size);
 	dcassert(finishedSegments <= size);
-	setDirty();
 }
 
 void Bundle::removeFinishedSegment(int64_t aSize) noexcept{
@@ -232,6 +232,18 @@ void Bundle::getItems(const UserPtr& aUser, QueueItemList& ql) const noexcept {
 		if(j != userQueue[i].end()) {
 			copy(j->second, back_inserter(ql));
 		}
+
+		auto k = blockedQueue[i].find(aUser);
+		if (k != blockedQueue[i].end()) {
+			for (const auto& items: k->second | map_values) {
+				copy(items, back_inserter(ql));
+			}
+		}
+
+		auto r = runningItems[i].find(aUser);
+		if (r != runningItems[i].end()) {
+			copy(r->second, back_inserter(ql));
+		}
 	}
 }
 
@@ -248,6 +260,7 @@ void Bundle::addFinishedItem(QueueItemPtr& qi, bool aFinished) noexcept {
 	if (!aFinished) {
 		increaseSize(qi->getSize());
 		addFinishedSegment(qi->getSize());
+		setDirty();
 	}
 }
 
@@ -273,10 +286,12 @@ void Bundle::addQueue(QueueItemPtr& qi) noexcept {
 	dcassert(qi->getTimeFinished() == 0);
 	dcassert(!qi->isCompleted() && !qi->segmentsDone());
 	dcassert(find(queueItems, qi) == queueItems.end());
+	dcassert(!qi->usesSmallSlot());
 
 	queueItems.push_back(qi);
 	increaseSize(qi->getSize());
 	addFinishedSegment(qi->getDownloadedSegments());
+	setDirty();
 }
 
 void Bundle::removeQueue(QueueItemPtr& aQI, bool aFileCompleted) noexcept {
@@ -319,22 +334,15 @@ void Bundle::addUserQueue(const QueueItemPtr& qi) noexcept {
 }
 
 bool Bundle::addUserQueue(const QueueItemPtr& qi, const HintedUser& aUser, bool isBad /*false*/) noexcept {
-	auto& l = userQueue[static_cast<int>(qi->getPriority())][aUser.user];
-	dcassert(find(l, qi) == l.end());
-
-	if (l.size() > 1) {
-		if (!seqOrder) {
-			/* Randomize the downloading order for each user if the bundle dir date is newer than 7 days to boost partial bundle sharing */
-			l.push_back(qi);
-			swap(l[Util::rand((uint32_t)l.size())], l[l.size()-1]);
-		} else {
-			/* Sequential order */
-			l.insert(upper_bound(l.begin(), l.end(), qi, QueueItem::AlphaSortOrder()), qi);
-		}
-	} else {
+	if (qi->isRunning()) {
+		auto& l = runningItems[static_cast<int>(qi->getPriority())][aUser.user];
+		dcassert(find(l, qi) == l.end());
 		l.push_back(qi);
+	} else {
+		insertUserQueue(qi, aUser.user);
 	}
 
+	FastLock l(cs);
 	if (isBad) {
 		auto i = find(badSources, aUser);
 		dcassert(i != badSources.end());
@@ -359,18 +367,163 @@ bool Bundle::addUserQueue(const QueueItemPtr& qi, const HintedUser& aUser, bool
 	}
 }
 
+void Bundle::insertUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexcept {
+	// The source can't be blocked while the item is waiting, so the item stays in the same list until it's removed
+	auto p = static_cast<int>(qi->getPriority());
+	auto blockedHubs = qi->getBlockedHubs(aUser);
+	auto& l = blockedHubs.empty() ? userQueue[p][aUser] : blockedQueue[p][aUser][blockedHubs];
+	dcassert(find(l, qi) == l.end());
+
+	if (l.size() > 1) {
+		if (!seqOrder) {
+			/* Randomize the downloading order for each user if the bundle dir date is newer than 7 days to boost partial bundle sharing */
+			l.push_back(qi);
+			swap(l[Util::rand((uint32_t)l.size())], l[l.size()-1]);
+		} else {
+			/* Sequential order */
+			l.insert(upper_bound(l.begin(), l.end(), qi, QueueItem::AlphaSortOrder()), qi);
+		}
+	} else {
+		l.push_back(qi);
+	}
+}
+
+template<class MapT, class KeyT>
+bool Bundle::eraseItem(MapT& aMap, const KeyT& aKey, const QueueItemPtr& qi) noexcept {
+	auto j = aMap.find(aKey);
+	if (j == aMap.end()) {
+		return false;
+	}
+
+	auto& l = j->second;
+	auto s = find(l, qi);
+	if (s == l.end()) {
+		return false;
+	}
+
+	l.erase(s);
+	if (l.empty()) {
+		aMap.erase(j);
+	}
+
+	return true;
+}
+
+bool Bundle::eraseUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexcept {
+	auto p = static_cast<int>(qi->getPriority());
+	if (eraseItem(userQueue[p], aUser, qi)) {
+		return true;
+	}
+
+	auto j = blockedQueue[p].find(aUser);
+	if (j == blockedQueue[p].end() || !eraseItem(j->second, qi->getBlockedHubs(aUser), qi)) {
+		return false;
+	}
+
+	if (j->second.empty()) {
+		blockedQueue[p].erase(j);
+	}
+
+	return true;
+}
+
+bool Bundle::eraseRunningItem(const QueueItemPtr& qi, const UserPtr& aUser) noexcept {
+	return eraseItem(runningItems[static_cast<int>(qi->getPriority())], aUser, qi);
+}
+
+Bundle::WaitingItemList* Bundle::findWaitingItems(const QueueItemPtr& qi, const UserPtr& aUser) noexcept {
+	auto p = static_cast<int>(qi->getPriority());
+	auto blockedHubs = qi->getBlockedHubs(aUser);
+	if (blockedHubs.empty()) {
+		auto j = userQueue[p].find(aUser);
+		return j != userQueue[p].end() ? &j->second : nullptr;
+	}
+
+	auto j = blockedQueue[p].find(aUser);
+	if (j == blockedQueue[p].end()) {
+		return nullptr;
+	}
+
+	auto k = j->second.find(blockedHubs);
+	return k != j->second.end() ? &k->second : nullptr;
+}
+
+void Bundle::addRunningItem(const QueueItemPtr& qi) noexcept {
+	for (const auto& s: qi->getSources()) {
+		if (eraseUserQueue(qi, s.getUser())) {
+			runningItems[static_cast<int>(qi->getPriority())][s.getUser()].push_back(qi);
+		}
+	}
+}
+
+void Bundle::removeRunningItem(const QueueItemPtr& qi) noexcept {
+	for (const auto& s: qi->getSources()) {
+		if (eraseRunningItem(qi, s.getUser())) {
+			insertUserQueue(qi, s.getUser());
+		}
+	}
+}
+
 QueueItemPtr Bundle::getNextQI(const UserPtr& aUser, const OrderedStringSet& aOnlineHubs, string& aLastError, Priority aMinPrio, int64_t aWantedSize, int64_t aLastSpeed, QueueItemBase::DownloadType aType, bool aAllowOverlap) noexcept {
+	// The number of running items is limited by the number of connections so they can be checked one by one
+	// Within each priority, the running items are preferred over the waiting ones (the random/sequential order applies only to the waiting items)
+	// so that the files that have been started already are finished first
+	// The first waiting item in userQueue is always accepted by hasSegment (the source isn't blocked in any hub and there are no segments to scan).
+	// Items with blocked hubs are grouped by the blocked hubs, and a whole group is skipped when the source isn't online in any other hub.
+	// Choosing an item therefore doesn't depend on the number of queued items.
+	auto findItem = [&](const auto& aItems) -> QueueItemPtr {
+		dcassert(!aItems.empty());
+		for (auto& qi: aItems) {
+			if (qi->hasSegment(aUser, aOnlineHubs, aLastError, aWantedSize, aLastSpeed, aType, aAllowOverlap)) {
+				return qi;
+			}
+		}
+
+		return nullptr;
+	};
+
+	auto findUserItem = [&](const auto& aMap) -> QueueItemPtr {
+		auto i = aMap.find(aUser);
+		return i != aMap.end() ? findItem(i->second) : nullptr;
+	};
+
+	auto findBlockedItem = [&](int p) -> QueueItemPtr {
+		auto i = blockedQueue[p].find(aUser);
+		if (i == blockedQueue[p].end()) {
+			return nullptr;
+		}
+
+		for (const auto& g: i->second) {
+			if (includes(g.first.begin(), g.first.end(), aOnlineHubs.begin(), aOnlineHubs.end())) {
+				aLastError = STRING(NO_ACCESS_ONLINE_HUBS);
+				continue;
+			}
+
+			auto qi = findItem(g.second);
+			if (qi) {
+				return qi;
+			}
+		}
+
+		return nullptr;
+	};
+
 	int p = static_cast<int>(Priority::LAST) - 1;
 	do {
-		auto i = userQueue[p].find(aUser);
-		if(i != userQueue[p].end()) {
-			dcassert(!i->second.empty());
-			for(auto& qi: i->second) {
-				if (qi->hasSegment(aUser, aOnlineHubs, aLastError, aWantedSize, aLastSpeed, aType, aAllowOverlap)) {
-					return qi;
-				}
+		auto qi = findUserItem(runningItems[p]);
+
+		// Waiting items don't have segments that could be overlapped; they would have been picked without overlapping already
+		if (!qi && !aAllowOverlap) {
+			qi = findUserItem(userQueue[p]);
+			if (!qi) {
+				qi = findBlockedItem(p);
 			}
 		}
+
+		if (qi) {
+			return qi;
+		}
+
 		p--;
 	} while(p >= static_cast<int>(aMinPrio));
 
@@ -423,13 +576,12 @@ bool Bundle::isFailed() const noexcept {
 
 void Bundle::rotateUserQueue(QueueItemPtr& qi, const UserPtr& aUser) noexcept {
 	dcassert(qi->isSource(aUser));
-	auto& ulm = userQueue[static_cast<int>(qi->getPriority())];
-	auto j = ulm.find(aUser);
-	dcassert(j != ulm.end());
-	if (j == ulm.end()) {
+	auto items = findWaitingItems(qi, aUser);
+	if (!items) {
+		// Running
 		return;
 	}
-	auto& l = j->second;
+	auto& l = *items;
 	if (l.size() > 1) {
 		auto s = find(l, qi);
 		if (s != l.end()) {
@@ -448,23 +600,13 @@ bool Bundle::removeUserQueue(QueueItemPtr& qi, const UserPtr& aUser, Flags::Mask
 
 	//remove from UserQueue
 	dcassert(qi->isSource(aUser));
-	auto& ulm = userQueue[static_cast<int>(qi->getPriority())];
-	auto j = ulm.find(aUser);
-	dcassert(j != ulm.end());
-	if (j == ulm.end()) {
+	if (!eraseUserQueue(qi, aUser) && !eraseRunningItem(qi, aUser)) {
+		dcassert(0);
 		return false;
 	}
-	auto& l = j->second;
-	auto s = find(l, qi);
-	if (s != l.end()) {
-		l.erase(s);
-	}
-
-	if(l.empty()) {
-		ulm.erase(j);
-	}
 
 	//remove from bundle sources
+	FastLock l(cs);
 	auto m = find(sources, aUser);
 	dcassert(m != sources.end());
 
@@ -806,10 +948,8 @@ void Bundle::sendSizeUpdate() noexcept {
 /* ONLY CALLED FROM DOWNLOADMANAGER END */
 
 
-void Bundle::save() {
+void Bundle::save(OutputStream& f) {
 	{
-		File ff(getXmlFilePath() + ".tmp", File::WRITE, File::CREATE | File::TRUNCATE);
-		BufferedOutputStream<false> f(&ff);
 		f.write(SimpleXML::utf8Header);
 		string tmp;
 		string b32tmp;
@@ -873,9 +1013,6 @@ void Bundle::save() {
 		}
 	}
 
-	File::deleteFile(getXmlFilePath());
-	File::renameFile(getXmlFilePath() + ".tmp", getXmlFilePath());
-	
 	dirty = false;
 }
 
@@ -163,8 +163,8 @@ public:
 	static bool isFailedStatus(Status aStatus) noexcept;
 	bool isFailed() const noexcept;
 
-	// Throws on errors
-	void save();
+	// Writes the bundle in the XML format and clears the dirty flag
+	void save(OutputStream& aStream);
 
 	void addQueue(QueueItemPtr& qi) noexcept;
 	void removeQueue(QueueItemPtr& qi, bool aFinished) noexcept;
@@ -235,6 +235,12 @@ public:
 	void addUserQueue(const QueueItemPtr& qi) noexcept;
 	bool addUserQueue(const QueueItemPtr& qi, const HintedUser& aUser, bool isBad = false) noexcept;
 	QueueItemPtr getNextQI(const UserPtr& aUser, const OrderedStringSet& onlineHubs, string& aLastError, Priority minPrio, int64_t wantedSize, int64_t lastSpeed, QueueItemBase::DownloadType aType, bool allowOverlap) noexcept;
+
+	// Moves the item between the waiting and running items of all its sources
+	// Should be called when the first download is added for the item or the last one is removed
+	void addRunningItem(const QueueItemPtr& qi) noexcept;
+	void removeRunningItem(const QueueItemPtr& qi) noexcept;
+
 	void getItems(const UserPtr& aUser, QueueItemList& ql) const noexcept;
 
 	QueueItemList getFailedItems() const noexcept;
@@ -257,10 +263,23 @@ private:
 	bool dirty = false;
 	bool recent = false;
 
-	/** QueueItems by priority and user (this is where the download order is determined) */
-	unordered_map<UserPtr, deque<QueueItemPtr>, User::Hash> userQueue[static_cast<int>(Priority::LAST)];
-	/** Currently running downloads, a QueueItem is always either here or in the userQueue */
-	unordered_map<UserPtr, QueueItemList, User::Hash> runningItems;
+	typedef deque<QueueItemPtr> WaitingItemList;
+	typedef map<OrderedStringSet, WaitingItemList> BlockedItemMap;
+
+	/** Waiting QueueItems by priority and user (this is where the download order is determined) */
+	unordered_map<UserPtr, WaitingItemList, User::Hash> userQueue[static_cast<int>(Priority::LAST)];
+	/** Waiting QueueItems whose source has been blocked in some hubs by priority, user and the blocked hubs (checked after the other waiting items) */
+	unordered_map<UserPtr, BlockedItemMap, User::Hash> blockedQueue[static_cast<int>(Priority::LAST)];
+	/** Currently running downloads by priority and user, a QueueItem is always either here or in one of the waiting queues */
+	unordered_map<UserPtr, QueueItemList, User::Hash> runningItems[static_cast<int>(Priority::LAST)];
+
+	void insertUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexcept;
+	bool eraseUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexcept;
+	bool eraseRunningItem(const QueueItemPtr& qi, const UserPtr& aUser) noexcept;
+	WaitingItemList* findWaitingItems(const QueueItemPtr& qi, const UserPtr& aUser) noexcept;
+
+	template<class MapT, class KeyT>
+	static bool eraseItem(MapT& aMap, const KeyT& aKey, const QueueItemPtr& qi) noexcept;
 
 	UserIntMap runningUsers;					// running users and their connections cached
 	HintedUserList uploadReports;				// sources receiving UBN notifications (running only)
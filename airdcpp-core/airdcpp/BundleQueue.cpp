@@ -412,15 +412,22 @@ void BundleQueue::removeBundle(BundlePtr& aBundle) noexcept{
 	aBundle->deleteXmlFile();
 }
 
-void BundleQueue::saveQueue(bool aForce) noexcept {
-	for(auto& b: bundles | map_values) {
-		if (b->getDirty() || aForce) {
-			try {
-				b->save();
-			} catch(FileException& e) {
-				LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, b->getName() % e.getError()), LogMessage::SEV_ERROR);
+void BundleQueue::saveQueue(QueueJournal& aJournal, bool aForce) noexcept {
+	try {
+		if (aForce || aJournal.needsCompaction()) {
+			aJournal.compact(bundles);
+			return;
+		}
+
+		for (auto& b : bundles | map_values) {
+			if (b->getDirty()) {
+				aJournal.appendBundle(*b);
 			}
 		}
+
+		aJournal.flush();
+	} catch (FileException& e) {
+		LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, aJournal.getPath() % e.getError()), LogMessage::SEV_ERROR);
 	}
 }
 
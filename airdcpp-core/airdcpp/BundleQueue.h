@@ -26,6 +26,7 @@
 #include "DupeType.h"
 #include "HintedUser.h"
 #include "PrioritySearchQueue.h"
+#include "QueueJournal.h"
 #include "SortedVector.h"
 
 namespace dcpp {
@@ -76,7 +77,8 @@ public:
 
 	void removeBundle(BundlePtr& aBundle) noexcept;
 
-	void saveQueue(bool force) noexcept;
+	// Logs the dirty bundles in the journal (or compacts it when needed)
+	void saveQueue(QueueJournal& aJournal, bool aForce) noexcept;
 	QueueItemList getSearchItems(const BundlePtr& aBundle) const noexcept;
 
 	DupeType isAdcDirectoryQueued(const string& aPath, int64_t aSize) const noexcept;
@@ -21,6 +21,47 @@
 
 namespace dcpp {
 
+void InstrumentedSharedMutex::lock() {
+	locks++;
+	if (SharedMutex::try_lock()) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	SharedMutex::lock();
+	addWait(start);
+}
+
+void InstrumentedSharedMutex::lock_shared() {
+	locks++;
+	if (SharedMutex::try_lock_shared()) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	SharedMutex::lock_shared();
+	addWait(start);
+}
+
+void InstrumentedSharedMutex::addWait(std::chrono::steady_clock::time_point aStart) noexcept {
+	uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - aStart).count();
+
+	waits++;
+	waitTime += time;
+
+	auto prevMax = maxWaitTime.load();
+	while (time > prevMax && !maxWaitTime.compare_exchange_weak(prevMax, time)) { }
+}
+
+InstrumentedSharedMutex::Stats InstrumentedSharedMutex::getStats() const noexcept {
+	Stats ret;
+	ret.locks = locks;
+	ret.waits = waits;
+	ret.waitTime = waitTime;
+	ret.maxWaitTime = maxWaitTime;
+	return ret;
+}
+
 ConditionalRLock::ConditionalRLock(SharedMutex& aCS, bool aLock) : cs(&aCS), lock(aLock) {
 	if (lock)
 		aCS.lock_shared();
@@ -19,6 +19,8 @@
 #ifndef DCPLUSPLUS_DCPP_CRITICALSECTION_H
 #define DCPLUSPLUS_DCPP_CRITICALSECTION_H
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 
 #ifdef _WIN32
@@ -85,6 +87,39 @@ typedef std::unique_lock<std::shared_mutex> WLock;
 
 #endif
 
+// Shared mutex that keeps statistics of the lock operations that had to wait for other threads
+class InstrumentedSharedMutex : public SharedMutex {
+public:
+	struct Stats {
+		uint64_t locks = 0;
+		uint64_t waits = 0;
+
+		// Microseconds
+		uint64_t waitTime = 0;
+		uint64_t maxWaitTime = 0;
+	};
+
+	void lock();
+	void lock_shared();
+
+	Stats getStats() const noexcept;
+private:
+	void addWait(std::chrono::steady_clock::time_point aStart) noexcept;
+
+	std::atomic<uint64_t> locks { 0 };
+	std::atomic<uint64_t> waits { 0 };
+	std::atomic<uint64_t> waitTime { 0 };
+	std::atomic<uint64_t> maxWaitTime { 0 };
+};
+
+#ifndef _WIN32
+typedef boost::shared_lock<InstrumentedSharedMutex> InstrumentedRLock;
+typedef boost::unique_lock<InstrumentedSharedMutex> InstrumentedWLock;
+#else
+typedef std::shared_lock<InstrumentedSharedMutex> InstrumentedRLock;
+typedef std::unique_lock<InstrumentedSharedMutex> InstrumentedWLock;
+#endif
+
 class ConditionalRLock {
 public:
 	ConditionalRLock(SharedMutex& cs, bool lock);
@@ -33,6 +33,7 @@
 #include "DebugManager.h"
 #include "DirectoryListingManager.h"
 #include "DownloadManager.h"
+#include "DownloadWriter.h"
 #include "FavoriteManager.h"
 #include "GeoManager.h"
 #include "HashManager.h"
@@ -45,6 +46,7 @@
 #include "ShareManager.h"
 #include "SearchManager.h"
 #include "SettingsManager.h"
+#include "SocketReactor.h"
 #include "ThrottleManager.h"
 #include "UpdateManager.h"
 #include "UploadManager.h"
@@ -86,8 +88,10 @@ void startup(StepF stepF, MessageF messageF, Callback runWizard, ProgressF progr
 	ConnectionManager::newInstance();
 	PrivateChatManager::newInstance();
 	DownloadManager::newInstance();
+	DownloadWriter::newInstance();
 	UploadManager::newInstance();
 	ThrottleManager::newInstance();
+	SocketReactor::newInstance();
 	QueueManager::newInstance();
 	FavoriteManager::newInstance();
 	ADLSearchManager::newInstance();
@@ -201,6 +205,8 @@ void shutdown(StepF stepF, ProgressF progressF, Callback moduleDestroyF) {
 	DebugManager::deleteInstance();
 	ADLSearchManager::deleteInstance();
 	CryptoManager::deleteInstance();
+	SocketReactor::deleteInstance();
+	DownloadWriter::deleteInstance();
 	ThrottleManager::deleteInstance();
 	DirectoryListingManager::deleteInstance();
 	QueueManager::deleteInstance();
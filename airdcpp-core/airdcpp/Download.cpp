@@ -270,6 +270,13 @@ void Download::open(int64_t bytes, bool z, bool hasDownloadedBytes) {
 		setFlag(Download::FLAG_TTH_CHECK);
 	}
 
+	if(getType() == Transfer::TYPE_FILE) {
+		// Verify and write the data in the download writer threads
+		auto& conn = getUserConnection();
+		writer = new DownloadWriter::Stream(output.release(), [&conn] { conn.resumeReading(); });
+		output.reset(writer);
+	}
+
 	// Check that we don't get too many bytes
 	output.reset(new LimitedOutputStream<true>(output.release(), bytes));
 
@@ -281,7 +288,53 @@ void Download::open(int64_t bytes, bool z, bool hasDownloadedBytes) {
 
 void Download::close()
 {
+	if (writer) {
+		// Data that is still being written isn't counted as downloaded
+		writtenBytes = writer->getWrittenBytes();
+		if (writer->close(output.get())) {
+			// The writer thread will delete the output chain when it has finished
+			output.release();
+		}
+
+		writer = nullptr;
+	}
+
 	output.reset();
 }
 
+void Download::syncOutput() {
+	if (writer) {
+		writer->sync();
+	}
+}
+
+bool Download::flushOutput(function<void ()>&& aWrittenF) {
+	if (!writer) {
+		// Flushed when the download is removed
+		return false;
+	}
+
+	output->flushBuffers(false);
+
+	flushing = true;
+	writer->onIdle(move(aWrittenF));
+	return true;
+}
+
+bool Download::isOutputWritten() const noexcept {
+	return writer && flushing && writer->isIdle();
+}
+
+int64_t Download::getQueuedBytes() const noexcept {
+	return writer ? writer->getQueuedBytes() : 0;
+}
+
+int64_t Download::getWrittenPos() const noexcept {
+	if (writer) {
+		return min(getPos(), writer->getWrittenBytes());
+	}
+
+	return writtenBytes >= 0 ? min(getPos(), writtenBytes) : getPos();
+}
+
 } // namespace dcpp
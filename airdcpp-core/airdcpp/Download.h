@@ -24,6 +24,7 @@
 
 #include "forward.h"
 
+#include "DownloadWriter.h"
 #include "Flags.h"
 #include "GetSet.h"
 #include "MerkleTree.h"
@@ -77,6 +78,23 @@ public:
 	/** Release the target output */
 	void close();
 
+	/** Wait until the received data has been verified and written (throws if writing has failed) */
+	void syncOutput();
+
+	/**
+	 * Flush the output without blocking
+	 * @return false if the output was flushed synchronously, otherwise aWrittenF is called from another thread
+	 * after the received data has been verified and written (use isOutputWritten to check whether the download is still the same)
+	 */
+	bool flushOutput(function<void ()>&& aWrittenF);
+	bool isOutputWritten() const noexcept;
+
+	/** Received bytes that haven't been verified and written yet */
+	int64_t getQueuedBytes() const noexcept;
+
+	/** Position up to which the data has been passed to the target file */
+	int64_t getWrittenPos() const noexcept;
+
 	/** @internal */
 	TigerTree& getTigerTree() { return tt; }
 	const string& getPFS() const { return pfs; }
@@ -102,6 +120,12 @@ private:
 	const string& getDownloadTarget() const noexcept;
 
 	unique_ptr<OutputStream> output;
+
+	// Asynchronous part of the output chain (owned by the output)
+	DownloadWriter::Stream* writer = nullptr;
+	int64_t writtenBytes = -1;
+	bool flushing = false;
+
 	TigerTree tt;
 	string pfs;
 };
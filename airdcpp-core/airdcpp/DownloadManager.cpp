@@ -27,6 +27,7 @@
 #include "LogManager.h"
 #include "QueueManager.h"
 #include "ResourceManager.h"
+#include "ThrottleManager.h"
 #include "User.h"
 #include "UserConnection.h"
 
@@ -407,6 +408,9 @@ void DownloadManager::startData(UserConnection* aSource, int64_t start, int64_t
 	}
 	aSource->setState(UserConnection::STATE_RUNNING);
 
+	// file lists are shared through the class with the highest priority
+	aSource->setThrottleClass(d->getBundle() ? ThrottleManager::getDownloadClass(d->getBundle()->getPriority()) : ThrottleManager::CLASS_HIGH);
+
 	fire(DownloadManagerListener::Starting(), d);
 	if (d->getBundle()) {
 		startBundle(aSource, d->getBundle());
@@ -436,8 +440,22 @@ void DownloadManager::on(UserConnectionListener::Data, UserConnection* aSource,
 		d->tick();
 
 		if(d->getOutput()->eof()) {
-			endData(aSource);
+			// The segment can't be completed before all data has been verified and written
+			auto pending = d->flushOutput([aSource] {
+				aSource->callAsync([aSource] { DownloadManager::getInstance()->onOutputWritten(aSource); });
+			});
+
+			if (pending) {
+				// Handle the following commands after the segment has been completed
+				aSource->pauseReading();
+			} else {
+				endData(aSource);
+			}
+
 			aSource->setLineMode(0);
+		} else if(d->getQueuedBytes() >= DownloadWriter::Stream::MAX_QUEUED_BYTES) {
+			// Don't receive more data than the writer threads can handle
+			aSource->pauseReading();
 		}
 	} catch(const Exception& e) {
 		//d->resetPos(); // is there a better way than resetting the position?
@@ -445,6 +463,24 @@ void DownloadManager::on(UserConnectionListener::Data, UserConnection* aSource,
 	}
 }
 
+void DownloadManager::onOutputWritten(UserConnection* aSource) noexcept {
+	aSource->resumeReading();
+
+	auto d = aSource->getDownload();
+	if (!d || !d->isOutputWritten()) {
+		// Failed meanwhile
+		return;
+	}
+
+	try {
+		// Throws if writing has failed
+		d->syncOutput();
+		endData(aSource);
+	} catch(const Exception& e) {
+		failDownload(aSource, e.getError(), true);
+	}
+}
+
 /** Download finished! */
 void DownloadManager::endData(UserConnection* aSource) {
 	dcassert(aSource->getState() == UserConnection::STATE_RUNNING);
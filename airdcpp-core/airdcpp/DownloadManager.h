@@ -105,6 +105,9 @@ private:
 	void revive(UserConnection* uc);
 	void endData(UserConnection* aSource);
 
+	// The data of a finished segment has been written (called from the connection thread)
+	void onOutputWritten(UserConnection* aSource) noexcept;
+
 	void onFailed(UserConnection* aSource, const string& aError);
 
 	// UserConnectionListener
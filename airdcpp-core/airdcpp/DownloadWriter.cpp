@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "DownloadWriter.h"
+
+#include "Exception.h"
+
+#include <thread>
+
+namespace dcpp {
+
+const int64_t DownloadWriter::Stream::MAX_QUEUED_BYTES;
+
+DownloadWriter::DownloadWriter() noexcept {
+
+}
+
+DownloadWriter::~DownloadWriter() {
+	stopWorkers();
+}
+
+void DownloadWriter::schedule(Stream* aStream) noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		if (workers.empty()) {
+			// Hashing is the most expensive part so there's no use for more threads than there are cores
+			auto threads = min(max(std::thread::hardware_concurrency(), 2U), 8U);
+			for (unsigned int i = 0; i < threads; ++i) {
+				workers.push_back(make_unique<Worker>(*this));
+			}
+		}
+
+		streams.push_back(aStream);
+	}
+
+	streamCond.notify_one();
+}
+
+void DownloadWriter::stopWorkers() noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		stopping = true;
+	}
+
+	streamCond.notify_all();
+	for (auto& w : workers) {
+		w->join();
+	}
+
+	workers.clear();
+}
+
+int DownloadWriter::Worker::run() {
+	for (;;) {
+		Stream* stream = nullptr;
+
+		{
+			unique_lock<mutex> l(writer.mtx);
+			writer.streamCond.wait(l, [this] { return writer.stopping || !writer.streams.empty(); });
+			if (writer.streams.empty()) {
+				break;
+			}
+
+			stream = writer.streams.front();
+			writer.streams.pop_front();
+		}
+
+		// Delete the chain of a download that was closed while the data was being processed
+		delete stream->process();
+	}
+
+	return 0;
+}
+
+DownloadWriter::Stream::Stream(OutputStream* aStream, function<void ()>&& aDrainedF) noexcept : s(aStream), drainedF(move(aDrainedF)) {
+
+}
+
+DownloadWriter::Stream::~Stream() {
+	// The remaining data is still written (the queued data is counted as downloaded)
+	waitIdle();
+}
+
+size_t DownloadWriter::Stream::write(const void* buf, size_t len) {
+	{
+		lock_guard<mutex> l(mtx);
+		if (!error.empty()) {
+			throw FileException(error);
+		}
+
+		if (len == 0) {
+			return 0;
+		}
+
+		auto data = static_cast<const uint8_t*>(buf);
+		queue.emplace_back(data, data + len);
+
+		queuedBytes += len;
+		DownloadWriter::getInstance()->queuedBytes += len;
+		if (queuedBytes >= MAX_QUEUED_BYTES) {
+			full = true;
+		}
+
+		dirty = true;
+		if (!setScheduled()) {
+			return len;
+		}
+	}
+
+	DownloadWriter::getInstance()->schedule(this);
+	return len;
+}
+
+bool DownloadWriter::Stream::setScheduled() noexcept {
+	if (scheduled) {
+		return false;
+	}
+
+	scheduled = true;
+	return true;
+}
+
+OutputStream* DownloadWriter::Stream::process() noexcept {
+	for (;;) {
+		ByteVector data;
+		bool flush = false, force = false;
+
+		{
+			lock_guard<mutex> l(mtx);
+			if (full && (queuedBytes <= MAX_QUEUED_BYTES / 2 || !error.empty())) {
+				// Let the socket continue receiving (the error will be noticed when the next data is written)
+				full = false;
+				if (drainedF) {
+					drainedF();
+				}
+			}
+
+			if (!queue.empty()) {
+				data = move(queue.front());
+				queue.pop_front();
+			} else if (flushPending) {
+				flush = true;
+				force = flushForce;
+				flushPending = false;
+				flushForce = false;
+			} else {
+				scheduled = false;
+				idleCond.notify_all();
+
+				if (idleF) {
+					auto f = move(idleF);
+					idleF = nullptr;
+					f();
+				}
+
+				auto ret = closedOutput;
+				closedOutput = nullptr;
+				return ret;
+			}
+		}
+
+		if (flush) {
+			if (error.empty()) {
+				try {
+					s->flushBuffers(force);
+				} catch (const Exception& e) {
+					lock_guard<mutex> l(mtx);
+					error = e.getError();
+				}
+			}
+
+			continue;
+		}
+
+		if (error.empty()) {
+			try {
+				s->write(&data[0], data.size());
+				writtenBytes += data.size();
+			} catch (const Exception& e) {
+				lock_guard<mutex> l(mtx);
+				error = e.getError();
+			}
+		}
+
+		queuedBytes -= data.size();
+		DownloadWriter::getInstance()->queuedBytes -= data.size();
+	}
+}
+
+void DownloadWriter::Stream::waitIdle() noexcept {
+	unique_lock<mutex> l(mtx);
+	idleCond.wait(l, [this] { return !scheduled; });
+}
+
+void DownloadWriter::Stream::sync() {
+	waitIdle();
+
+	lock_guard<mutex> l(mtx);
+	if (!error.empty()) {
+		throw FileException(error);
+	}
+}
+
+void DownloadWriter::Stream::onIdle(function<void ()>&& aIdleF) noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		if (scheduled) {
+			idleF = move(aIdleF);
+			return;
+		}
+	}
+
+	aIdleF();
+}
+
+bool DownloadWriter::Stream::isIdle() const noexcept {
+	lock_guard<mutex> l(mtx);
+	return !scheduled;
+}
+
+bool DownloadWriter::Stream::close(OutputStream* aOutput) noexcept {
+	lock_guard<mutex> l(mtx);
+	drainedF = nullptr;
+	idleF = nullptr;
+
+	if (!scheduled) {
+		return false;
+	}
+
+	closedOutput = aOutput;
+	return true;
+}
+
+size_t DownloadWriter::Stream::flushBuffers(bool aForce) {
+	{
+		lock_guard<mutex> l(mtx);
+		if (!error.empty()) {
+			throw FileException(error);
+		}
+
+		if (!dirty && !aForce) {
+			return 0;
+		}
+
+		dirty = false;
+		flushPending = true;
+		flushForce = flushForce || aForce;
+		if (!setScheduled()) {
+			return 0;
+		}
+	}
+
+	DownloadWriter::getInstance()->schedule(this);
+	return 0;
+}
+
+OutputStream* DownloadWriter::Stream::releaseRootStream() {
+	waitIdle();
+
+	auto as = s.release();
+	return as->releaseRootStream();
+}
+
+} // namespace dcpp
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_DOWNLOAD_WRITER_H
+#define DCPLUSPLUS_DCPP_DOWNLOAD_WRITER_H
+
+#include "typedefs.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include "Singleton.h"
+#include "Streams.h"
+#include "Thread.h"
+
+namespace dcpp {
+
+/*
+* Worker threads that verify and write the data received by downloads
+*
+* The socket threads only queue the received data, the Tiger leaves are calculated and the data is written on disk by the workers.
+* The data of a single stream is processed in order by one worker at a time while different streams are processed in parallel.
+*/
+class DownloadWriter : public Singleton<DownloadWriter> {
+public:
+	/*
+	* Output stream that passes the written data to the underlying stream from the worker threads
+	* Errors from the underlying stream are rethrown from the next call to write, flushBuffers or sync
+	* Flushing is asynchronous as well (the underlying stream is flushed after the queued data has been written)
+	*/
+	class Stream : public OutputStream {
+	public:
+		// The caller should stop writing after the number of queued bytes exceeds this (until the drained callback is called)
+		static const int64_t MAX_QUEUED_BYTES = 8 * 1024 * 1024;
+
+		// aDrainedF is called from a worker thread after the queue of a full stream has been processed
+		Stream(OutputStream* aStream, function<void ()>&& aDrainedF) noexcept;
+		~Stream();
+
+		Stream(Stream&) = delete;
+		Stream& operator=(Stream&) = delete;
+
+		size_t write(const void* buf, size_t len) override;
+		size_t flushBuffers(bool aForce) override;
+		OutputStream* releaseRootStream() override;
+
+		// Wait until all queued data has been processed
+		// Throws FileException if writing has failed
+		void sync();
+
+		// aIdleF is called from a worker thread (or from the caller thread if the stream is idle already)
+		// after all queued data has been processed and flushed
+		void onIdle(function<void ()>&& aIdleF) noexcept;
+		bool isIdle() const noexcept;
+
+		// Stop calling the callbacks. Returns true if data is still being processed, in which case
+		// the output chain (that contains this stream) is deleted by the worker afterwards.
+		// Otherwise the caller should delete the chain.
+		bool close(OutputStream* aOutput) noexcept;
+
+		int64_t getQueuedBytes() const noexcept { return queuedBytes; }
+
+		// Bytes that have been passed to the underlying stream successfully
+		int64_t getWrittenBytes() const noexcept { return writtenBytes; }
+	private:
+		friend class DownloadWriter;
+
+		// Pass the queued data to the underlying stream (worker thread)
+		// Returns the closed output chain that should be deleted
+		OutputStream* process() noexcept;
+		void waitIdle() noexcept;
+
+		// Mark the stream as scheduled, returns false if it's being processed already (lock must be held)
+		bool setScheduled() noexcept;
+
+		unique_ptr<OutputStream> s;
+		function<void ()> drainedF;
+		function<void ()> idleF;
+
+		deque<ByteVector> queue;
+
+		// Queued for a worker or being processed
+		bool scheduled = false;
+
+		// The drained callback should be called when the queue gets shorter
+		bool full = false;
+
+		// Data has been written after the last flush
+		bool dirty = false;
+
+		// The underlying stream should be flushed after the queue has been processed
+		bool flushPending = false;
+		bool flushForce = false;
+
+		OutputStream* closedOutput = nullptr;
+
+		string error;
+
+		mutable mutex mtx;
+		condition_variable idleCond;
+
+		atomic<int64_t> queuedBytes { 0 };
+		atomic<int64_t> writtenBytes { 0 };
+	};
+
+	int64_t getQueuedBytes() const noexcept { return queuedBytes; }
+private:
+	friend class Singleton<DownloadWriter>;
+
+	class Worker : public Thread {
+	public:
+		Worker(DownloadWriter& aWriter) : writer(aWriter) { start(); }
+	private:
+		DownloadWriter& writer;
+		int run() override;
+	};
+
+	DownloadWriter() noexcept;
+	~DownloadWriter();
+
+	// Queue the stream for processing (the workers are started when the first stream is added)
+	void schedule(Stream* aStream) noexcept;
+	void stopWorkers() noexcept;
+
+	deque<Stream*> streams;
+	condition_variable streamCond;
+	bool stopping = false;
+
+	mutex mtx;
+	vector<unique_ptr<Worker>> workers;
+
+	// Total bytes queued by all streams
+	atomic<int64_t> queuedBytes { 0 };
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_DOWNLOAD_WRITER_H)
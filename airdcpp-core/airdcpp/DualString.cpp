@@ -27,8 +27,8 @@ using std::string;
 
 // Text::toLower should be used for initial conversion due to UTF-16 surrogate handling
 // Text::utf8ToWc should be sufficient for equality checks
-DualString::DualString(const string& aStr) : string(dcpp::Text::toLower(aStr)) {
-	int arrayPos = 0, bitPos = 0;
+DualString::DualString(const string& aStr) : string(dcpp::Text::toLower(aStr)), inlineCharSizes(0) {
+	size_t pos = 0;
 	auto a = aStr.c_str();
 	auto b = this->c_str();
 	while (*a) {
@@ -36,22 +36,13 @@ DualString::DualString(const string& aStr) : string(dcpp::Text::toLower(aStr)) {
 		int na = dcpp::Text::utf8ToWc(a, ca);
 		int nb = dcpp::Text::utf8ToWc(b, cb);
 		if (ca != cb) {
-			if (!charSizes) {
-				initSizeArray(aStr.size());
-			}
-			charSizes[arrayPos] |= (1 << bitPos);
+			setUpper(pos, aStr.size());
 		}
 
 		a += abs(na);
 		b += abs(nb);
 
-		bitPos += abs(na);
-
-		// move to the next array?
-		if (bitPos >= static_cast<int>(ARRAY_BITS)) {
-			bitPos = 0 + bitPos - ARRAY_BITS;
-			arrayPos++;
-		}
+		pos += abs(na);
 	}
 }
 
@@ -66,56 +57,99 @@ size_t DualString::initSizeArray(size_t strLen) {
 	return arrSize;
 }
 
+void DualString::setUpper(size_t aPos, size_t aStrLen) {
+	if (hasInlineMask()) {
+		// Positions after the end of the lowercase string are never read
+		if (aPos < INLINE_MASK_LENGTH) {
+			inlineCharSizes |= static_cast<uint64_t>(1) << aPos;
+		}
+
+		return;
+	}
+
+	if (!charSizes) {
+		initSizeArray(std::max(aStrLen, size()));
+	}
+
+	charSizes[aPos / ARRAY_BITS] |= (1 << (aPos % ARRAY_BITS));
+}
+
+bool DualString::isUpper(size_t aPos) const noexcept {
+	if (hasInlineMask()) {
+		return (inlineCharSizes & (static_cast<uint64_t>(1) << aPos)) != 0;
+	}
+
+	return charSizes && (charSizes[aPos / ARRAY_BITS] & (1 << (aPos % ARRAY_BITS)));
+}
+
+void DualString::clearMask() noexcept {
+	if (!hasInlineMask() && charSizes) {
+		delete[] charSizes;
+	}
+
+	inlineCharSizes = 0;
+}
+
 DualString& DualString::operator=(DualString&& rhs) {
+	clearMask();
+
 	assign(rhs.begin(), rhs.end());
-	charSizes = rhs.charSizes;
-	rhs.charSizes = nullptr;
+	inlineCharSizes = rhs.inlineCharSizes;
+	rhs.inlineCharSizes = 0;
 	return *this; 
 }
 
-DualString::DualString(DualString&& rhs) : charSizes(rhs.charSizes) {
+DualString::DualString(DualString&& rhs) : inlineCharSizes(rhs.inlineCharSizes) {
 	assign(rhs.begin(), rhs.end());
-	rhs.charSizes = nullptr;
+	rhs.inlineCharSizes = 0;
 }
 
 DualString::~DualString() { 
-	if (charSizes)
-		delete[] charSizes; 
+	clearMask();
 }
 
 string DualString::getNormal() const {
-	if (!charSizes)
+	if (lowerCaseOnly())
 		return *this;
 
 	string ret;
 	ret.reserve(size());
 
-	int bitPos = 0, arrayPos = 0;
-	const char* end = &c_str()[0] + string::size();
-	for (const char* p = &c_str()[0]; p < end;) {
-		if (charSizes[arrayPos] & (1 << bitPos)) {
+	const char* begin = c_str();
+	const char* end = begin + string::size();
+	for (const char* p = begin; p < end;) {
+		if (isUpper(p - begin)) {
 			wchar_t c = 0;
 			int n = dcpp::Text::utf8ToWc(p, c);
 
 			dcpp::Text::wcToUtf8(dcpp::Text::toUpper(c), ret);
-
-			bitPos += n;
 			p += n;
 		} else {
 			ret += p[0];
-			bitPos++;
 			p++;
 		}
-
-		if (bitPos >= static_cast<int>(ARRAY_BITS)) {
-			bitPos = 0 + bitPos-ARRAY_BITS;
-			arrayPos++;
-		}
 	}
 
 	return ret;
 }
 
 bool DualString::lowerCaseOnly() const noexcept {
-	return !charSizes; 
-}
\ No newline at end of file
+	return inlineCharSizes == 0;
+}
+
+size_t DualString::getAllocatedSize() const noexcept {
+	size_t ret = 0;
+
+	// Short strings are stored inside the string object
+	auto p = reinterpret_cast<const char*>(data());
+	auto self = reinterpret_cast<const char*>(static_cast<const string*>(this));
+	if (p < self || p >= self + sizeof(string)) {
+		ret += capacity() + 1;
+	}
+
+	if (!hasInlineMask() && charSizes) {
+		ret += ((size() + ARRAY_BITS - 1) / ARRAY_BITS) * sizeof(MaskType);
+	}
+
+	return ret;
+}
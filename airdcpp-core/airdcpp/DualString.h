@@ -31,6 +31,9 @@ class DualString : private string {
 public:
 	typedef uint32_t MaskType;
 
+	// Character sizes of strings up to this length (in bytes) are stored inline without a separate allocation
+	static const size_t INLINE_MASK_LENGTH = sizeof(uint64_t) * 8;
+
 	DualString(const string& aStr);
 	~DualString();
 
@@ -41,13 +44,25 @@ public:
 
 	bool lowerCaseOnly() const noexcept;
 
+	// Heap memory used by the string (excluding the object itself)
+	size_t getAllocatedSize() const noexcept;
+
 	DualString(DualString&& rhs);
 	DualString& operator=(DualString&&);
 	DualString(const DualString&) = delete;
 	DualString& operator= (const DualString& other) = delete;
 private:
 	size_t initSizeArray(size_t strLen);
-	MaskType* charSizes = nullptr;
+
+	bool hasInlineMask() const noexcept { return size() <= INLINE_MASK_LENGTH; }
+	bool isUpper(size_t aPos) const noexcept;
+	void setUpper(size_t aPos, size_t aStrLen);
+	void clearMask() noexcept;
+
+	union {
+		MaskType* charSizes;
+		uint64_t inlineCharSizes;
+	};
 };
 
 #endif
\ No newline at end of file
@@ -176,6 +176,23 @@ size_t File::read(void* buf, size_t& len) {
 	return x;
 }
 
+size_t File::readAt(void* buf, size_t len, int64_t aPos) {
+	OVERLAPPED over = { 0 };
+	over.Offset = (DWORD)(aPos & 0xffffffff);
+	over.OffsetHigh = (DWORD)(aPos >> 32);
+
+	DWORD x;
+	if(!::ReadFile(h, buf, (DWORD)len, &x, &over)) {
+		auto err = GetLastError();
+		if (err == ERROR_HANDLE_EOF) {
+			return 0;
+		}
+
+		throw FileException(Util::translateError(err));
+	}
+	return x;
+}
+
 size_t File::write(const void* buf, size_t len) {
 	DWORD x;
 	if(!::WriteFile(h, buf, (DWORD)len, &x, NULL)) {
@@ -456,6 +473,14 @@ size_t File::read(void* buf, size_t& len) {
 	return (size_t)result;
 }
 
+size_t File::readAt(void* buf, size_t len, int64_t aPos) {
+	ssize_t result = ::pread(h, buf, len, (off_t)aPos);
+	if (result == -1) {
+		throw FileException(Util::translateError(errno));
+	}
+	return (size_t)result;
+}
+
 size_t File::write(const void* buf, size_t len) {
 	ssize_t result;
 	char* pointer = (char*)buf;
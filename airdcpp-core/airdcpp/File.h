@@ -116,6 +116,15 @@ public:
 	size_t read(void* buf, size_t& len) override;
 	size_t write(const void* buf, size_t len) override;
 
+	// Reads from the specified position without using the current file position (safe to call from multiple threads)
+	size_t readAt(void* buf, size_t len, int64_t aPos);
+
+	File* getSourceFile(int64_t& pos_, int64_t& bytesLeft_) noexcept override {
+		pos_ = getPos();
+		bytesLeft_ = min(bytesLeft_, getSize() - pos_);
+		return this;
+	}
+
 	// This has no effect if aForce is false
 	// Generally the operating system should decide when the buffered data is written on disk
 	size_t flushBuffers(bool aForce = true) override;
@@ -44,6 +44,10 @@ size_t FileReader::read(const string& aPath, const DataCallback& callback) {
 
 	if(direct) {
 		ret = readDirect(aPath, callback);
+
+		if(ret == READ_FAILED) {
+			ret = readUring(aPath, callback);
+		}
 	}
 
 	if(ret == READ_FAILED) {
@@ -197,6 +201,10 @@ size_t FileReader::readDirect(const string& aPath, const DataCallback& callback)
 	return *((size_t*)&over.Offset);
 }
 
+size_t FileReader::readUring(const string& /*file*/, const DataCallback& /*callback*/) {
+	return READ_FAILED;
+}
+
 size_t FileReader::readMapped(const string& /*file*/, const DataCallback& /*callback*/) {
 	/** @todo mapped reads can fail on Windows by throwing an exception that may only be caught by
 	SEH. MinGW doesn't have that, thus making this method of reading prone to unrecoverable
@@ -272,11 +280,317 @@ size_t FileReader::readMapped(const string& /*file*/, const DataCallback& /*call
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 
 size_t FileReader::readDirect(const string& file, const DataCallback& callback) {
 	return READ_FAILED;
 }
 
+#ifdef HAVE_IO_URING_H
+
+namespace {
+
+// Minimal io_uring wrapper for reads (liburing isn't required)
+class UringReader : boost::noncopyable {
+public:
+	~UringReader() {
+		if (fd == -1) {
+			return;
+		}
+
+		// The kernel must not write in the buffers after they have been released
+		while (inFlight > 0) {
+			io_uring_cqe cqe;
+			if (!waitCompletion(cqe)) {
+				break;
+			}
+		}
+
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqesSize);
+		}
+
+		if (cqPtr != MAP_FAILED && cqPtr != sqPtr) {
+			munmap(cqPtr, cqSize);
+		}
+
+		if (sqPtr != MAP_FAILED) {
+			munmap(sqPtr, sqSize);
+		}
+
+		::close(fd);
+	}
+
+	// Returns false if io_uring isn't supported by the kernel (or it's not permitted to be used)
+	bool init(unsigned aEntries) noexcept {
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+
+		fd = static_cast<int>(syscall(__NR_io_uring_setup, aEntries, &p));
+		if (fd == -1) {
+			dcdebug("io_uring_setup failed: %s\n", Util::translateError(errno).c_str());
+			return false;
+		}
+
+		sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			sqSize = cqSize = std::max(sqSize, cqSize);
+		}
+
+		sqPtr = mmap(0, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqPtr == MAP_FAILED) {
+			return false;
+		}
+
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			cqPtr = sqPtr;
+		} else {
+			cqPtr = mmap(0, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cqPtr == MAP_FAILED) {
+				return false;
+			}
+		}
+
+		sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+		sqes = mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		auto sq = static_cast<uint8_t*>(sqPtr);
+		sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+		sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+		auto cq = static_cast<uint8_t*>(cqPtr);
+		cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+		sqEntries = p.sq_entries;
+		return true;
+	}
+
+	// Queue a read and submit it to the kernel
+	bool read(int aFileFd, void* aBuf, unsigned aLen, uint64_t aOffset, uint64_t aUserData) noexcept {
+		auto tail = *sqTail;
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+			return false;
+		}
+
+		auto index = tail & sqMask;
+		auto& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READ;
+		sqe.fd = aFileFd;
+		sqe.addr = reinterpret_cast<uint64_t>(aBuf);
+		sqe.len = aLen;
+		sqe.off = aOffset;
+		sqe.user_data = aUserData;
+
+		sqArray[index] = index;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+		for (;;) {
+			auto ret = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+			if (ret == 1) {
+				break;
+			}
+
+			if (ret == -1 && errno == EINTR) {
+				continue;
+			}
+
+			// The entry stays in the queue, there's no way to recover
+			dcdebug("io_uring_enter failed: %s\n", Util::translateError(errno).c_str());
+			return false;
+		}
+
+		inFlight++;
+		return true;
+	}
+
+	// Wait for the next completed read (in any order)
+	bool waitCompletion(io_uring_cqe& cqe_) noexcept {
+		for (;;) {
+			auto head = *cqHead;
+			if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+				cqe_ = cqes[head & cqMask];
+				__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+				inFlight--;
+				return true;
+			}
+
+			auto ret = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (ret == -1 && errno != EINTR) {
+				dcdebug("io_uring_enter failed: %s\n", Util::translateError(errno).c_str());
+				return false;
+			}
+		}
+	}
+private:
+	int fd = -1;
+	unsigned inFlight = 0;
+	unsigned sqEntries = 0;
+
+	void* sqPtr = MAP_FAILED;
+	void* cqPtr = MAP_FAILED;
+	void* sqes = MAP_FAILED;
+	size_t sqSize = 0;
+	size_t cqSize = 0;
+	size_t sqesSize = 0;
+
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqMask = 0;
+
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	io_uring_cqe* cqes = nullptr;
+	unsigned cqMask = 0;
+};
+
+struct FileHandle : boost::noncopyable {
+	FileHandle(int aFd) : fd(aFd) { }
+	~FileHandle() { ::close(fd); }
+
+	int fd;
+};
+
+}
+
+size_t FileReader::readUring(const string& aPath, const DataCallback& callback) {
+	// Logical block size of the device may be smaller but this is safe for all of them
+	const size_t alignment = 4096;
+
+	auto tmp = open(aPath.c_str(), O_RDONLY | O_DIRECT);
+	if (tmp == -1) {
+		dcdebug("Failed to open unbuffered file %s: %s\n", aPath.c_str(), Util::translateError(errno).c_str());
+		return READ_FAILED;
+	}
+
+	FileHandle f(tmp);
+
+	struct stat statbuf;
+	if (fstat(f.fd, &statbuf) == -1) {
+		dcdebug("Error opening file %s: %s\n", aPath.c_str(), Util::translateError(errno).c_str());
+		return READ_FAILED;
+	}
+
+	const auto size = static_cast<uint64_t>(statbuf.st_size);
+	const auto bufSize = getBlockSize(alignment);
+
+	buffer.resize(bufSize * URING_QUEUE_DEPTH + alignment);
+	auto buf = static_cast<uint8_t*>(align(&buffer[0], alignment));
+
+	// Must be destructed before the buffer is released
+	UringReader ring;
+	if (!ring.init(URING_QUEUE_DEPTH)) {
+		return READ_FAILED;
+	}
+
+	// Blocks are assigned to the slots in file order (block N uses slot N % URING_QUEUE_DEPTH)
+	struct Slot {
+		uint64_t offset;
+		size_t expected;
+		size_t done;
+		bool completed;
+	} slots[URING_QUEUE_DEPTH];
+
+	uint64_t nextOffset = 0;
+	uint64_t total = 0;
+	unsigned nextSlot = 0;
+	unsigned deliverSlot = 0;
+
+	auto queueRead = [&](unsigned aSlot) {
+		auto& s = slots[aSlot];
+		return ring.read(f.fd, buf + aSlot * bufSize + s.done, static_cast<unsigned>(bufSize - s.done), s.offset + s.done, aSlot);
+	};
+
+	// Errors before anything has been passed to the callback will fall back to the other strategies
+	auto fail = [&](int aError) -> size_t {
+		if (total == 0) {
+			dcdebug("Direct read failed for file %s: %s\n", aPath.c_str(), Util::translateError(aError).c_str());
+			return READ_FAILED;
+		}
+
+		throw FileException(Util::translateError(aError));
+	};
+
+	bool go = true;
+	while (go && total < size) {
+		// Keep the queue full
+		while (nextOffset < size && nextOffset - total < bufSize * URING_QUEUE_DEPTH) {
+			auto& s = slots[nextSlot];
+			s.offset = nextOffset;
+			s.expected = static_cast<size_t>(std::min<uint64_t>(bufSize, size - nextOffset));
+			s.done = 0;
+			s.completed = false;
+
+			if (!queueRead(nextSlot)) {
+				return fail(EIO);
+			}
+
+			nextOffset += bufSize;
+			nextSlot = (nextSlot + 1) % URING_QUEUE_DEPTH;
+		}
+
+		// Wait for the next block in file order
+		auto& current = slots[deliverSlot];
+		while (!current.completed) {
+			io_uring_cqe cqe;
+			if (!ring.waitCompletion(cqe)) {
+				return fail(EIO);
+			}
+
+			auto slot = static_cast<unsigned>(cqe.user_data);
+			auto& s = slots[slot];
+			if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+				if (!queueRead(slot)) {
+					return fail(EIO);
+				}
+
+				continue;
+			}
+
+			if (cqe.res < 0) {
+				return fail(-cqe.res);
+			}
+
+			s.done += static_cast<size_t>(cqe.res);
+			if (s.done >= s.expected) {
+				s.completed = true;
+			} else if (cqe.res == 0 || s.done % alignment != 0) {
+				// The file was truncated
+				return fail(EIO);
+			} else if (!queueRead(slot)) {
+				return fail(EIO);
+			}
+		}
+
+		go = callback(buf + deliverSlot * bufSize, current.expected);
+		total += current.expected;
+		deliverSlot = (deliverSlot + 1) % URING_QUEUE_DEPTH;
+	}
+
+	return static_cast<size_t>(total);
+}
+
+#else
+
+size_t FileReader::readUring(const string& /*file*/, const DataCallback& /*callback*/) {
+	return READ_FAILED;
+}
+
+#endif
+
 static const int64_t BUF_SIZE = 0x1000000 - (0x1000000 % getpagesize());
 static sigjmp_buf sb_env;
 
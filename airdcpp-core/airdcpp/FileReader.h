@@ -65,6 +65,9 @@ private:
 	static const size_t DEFAULT_BLOCK_SIZE = 256*1024;
 	static const size_t DEFAULT_MMAP_SIZE = 64*1024*1024;
 
+	// Number of direct reads kept in flight with io_uring
+	static const unsigned URING_QUEUE_DEPTH = 8;
+
 	string file;
 	bool direct;
 	size_t blockSize;
@@ -76,6 +79,7 @@ private:
 	void* align(void* buf, size_t alignment);
 
 	size_t readDirect(const string& aFile, const DataCallback& callback);
+	size_t readUring(const string& aFile, const DataCallback& callback);
 	size_t readMapped(const string& aFile, const DataCallback& callback);
 	size_t readCached(const string& aFile, const DataCallback& callback);
 };
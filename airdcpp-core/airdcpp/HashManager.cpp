@@ -969,11 +969,11 @@ void HashManager::setPriority(Thread::Priority p) noexcept {
 		h->setThreadPriority(p); 
 }
 
-void HashManager::getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int& hasherCount) const noexcept {
+void HashManager::getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int& hasherCount, int64_t& readSpeed, int64_t& hashSpeed) const noexcept {
 	RLock l(Hasher::hcs);
 	hasherCount = hashers.size();
 	for (auto i: hashers)
-		i->getStats(curFile, bytesLeft, filesLeft, speed);
+		i->getStats(curFile, bytesLeft, filesLeft, speed, readSpeed, hashSpeed);
 }
 
 void HashManager::startMaintenance(bool verify){
@@ -1003,6 +1003,7 @@ int HashManager::Optimizer::run() {
 }
 
 void HashManager::startup(StepFunction stepF, ProgressFunction progressF, MessageFunction messageF) {
+	dcdebug("HashManager: using %s Tiger leaf hashing\n", TigerHash::getLeafImplementation());
 	hashers.push_back(new Hasher(false, 0));
 	store.load(stepF, progressF, messageF); 
 }
@@ -1049,11 +1050,14 @@ void HashManager::Hasher::clear() noexcept {
 	totalBytesLeft = 0;
 }
 
-void HashManager::Hasher::getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed) const noexcept {
+void HashManager::Hasher::getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int64_t& readSpeed, int64_t& hashSpeed) const noexcept {
 	curFile = currentFile;
 	filesLeft += w.size();
-	if (running)
+	if (running) {
 		filesLeft++;
+		readSpeed += pipeline.getReadSpeed();
+		hashSpeed += pipeline.getHashSpeed();
+	}
 	bytesLeft += totalBytesLeft;
 	speed += lastSpeed;
 }
@@ -1064,7 +1068,7 @@ void HashManager::Hasher::instantPause() {
 	}
 }
 
-HashManager::Hasher::Hasher(bool isPaused, int aHasherID) : paused(isPaused), hasherID(aHasherID), totalBytesLeft(0), lastSpeed(0) {
+HashManager::Hasher::Hasher(bool isPaused, int aHasherID) : paused(isPaused), hasherID(aHasherID), totalBytesLeft(0), lastSpeed(0), pipeline(SETTING(HASHER_WORKER_THREADS)) {
 	start();
 }
 
@@ -1141,9 +1145,9 @@ int HashManager::Hasher::run() {
 				auto fileCRC = sfv.hasFile(Text::toLower(Util::getFileName(fname)));
 
 				uint64_t lastRead = GET_TICK();
- 
-                FileReader fr(true);
-				fr.read(fname, [&](const void* buf, size_t n) -> bool {
+
+				// Tiger is calculated by the worker threads of the pipeline while the file is being read
+				pipeline.hashFile(fname, tt, [&](const void* buf, size_t n) -> bool {
 					if(SETTING(MAX_HASH_SPEED)> 0) {
 						uint64_t now = GET_TICK();
 						uint64_t minTime = n * 1000LL / Util::convertSize(SETTING(MAX_HASH_SPEED), Util::MB);
@@ -1155,7 +1159,6 @@ int HashManager::Hasher::run() {
 					} else {
 						lastRead = GET_TICK();
 					}
-					tt.update(buf, n);
 				
 					if(fileCRC)
 						crc32(buf, n);
@@ -1171,8 +1174,6 @@ int HashManager::Hasher::run() {
 					return !closing;
 				});
 
-				tt.finalize();
-
 				failed = fileCRC && crc32.getValue() != *fileCRC;
 
 				uint64_t end = GET_TICK();
@@ -25,6 +25,7 @@
 #include "DbHandler.h"
 #include "HashedFile.h"
 #include "HashManagerListener.h"
+#include "HashPipeline.h"
 #include "MerkleTree.h"
 #include "Semaphore.h"
 #include "SFVReader.h"
@@ -69,7 +70,8 @@ public:
 	// Throws HashException
 	void addTree(const TigerTree& tree) { store.addTree(tree); }
 
-	void getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int& hashers) const noexcept;
+	// readSpeed and hashSpeed are the throughputs of the separate reading and hashing stages of the active hashers
+	void getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int& hashers, int64_t& readSpeed, int64_t& hashSpeed) const noexcept;
 
 	// Get TTH for a file synchronously (and optionally stores the hash information)
 	// Throws HashException/FileException
@@ -125,7 +127,7 @@ private:
 
 		void stopHashing(const string& baseDir) noexcept;
 		int run();
-		void getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed) const noexcept;
+		void getStats(string& curFile, int64_t& bytesLeft, size_t& filesLeft, int64_t& speed, int64_t& readSpeed, int64_t& hashSpeed) const noexcept;
 		void shutdown();
 
 		bool hasFile(const string& aPath) const noexcept;
@@ -184,6 +186,8 @@ private:
 
 		DirSFVReader sfv;
 
+		HashPipeline pipeline;
+
 		map<devid, int> devices;
 	};
 
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "HashPipeline.h"
+
+#include "TimerManager.h"
+
+namespace dcpp {
+
+const size_t HashPipeline::BUFFER_SIZE;
+const size_t HashPipeline::BUFFER_ALIGNMENT;
+
+HashPipeline::HashPipeline(int aThreads) noexcept : threads(max(aThreads, 0)), readSpeed(0), hashSpeed(0) {
+
+}
+
+HashPipeline::~HashPipeline() {
+	stopWorkers();
+}
+
+void HashPipeline::startWorkers() noexcept {
+	if (!workers.empty()) {
+		return;
+	}
+
+	{
+		lock_guard<mutex> l(mtx);
+		stopping = false;
+	}
+
+	for (int i = 0; i < threads; ++i) {
+		workers.push_back(make_unique<Worker>(*this));
+	}
+}
+
+void HashPipeline::stopWorkers() noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		stopping = true;
+	}
+
+	taskCond.notify_all();
+	for (auto& w : workers) {
+		w->join();
+	}
+
+	workers.clear();
+}
+
+int HashPipeline::Worker::run() {
+	setThreadPriority(Thread::IDLE);
+
+	for (;;) {
+		Task task;
+
+		{
+			unique_lock<mutex> l(pipeline.mtx);
+			pipeline.taskCond.wait(l, [this] { return pipeline.stopping || !pipeline.tasks.empty(); });
+			if (pipeline.tasks.empty()) {
+				break;
+			}
+
+			task = pipeline.tasks.front();
+			pipeline.tasks.pop_front();
+		}
+
+		auto start = GET_TICK();
+		hashData(task);
+		auto end = GET_TICK();
+
+		{
+			lock_guard<mutex> l(pipeline.mtx);
+			pipeline.hashTime += end - start;
+			pipeline.freeBuffers.push_back(task.bufferIndex);
+		}
+
+		pipeline.freeCond.notify_one();
+	}
+
+	return 0;
+}
+
+void HashPipeline::hashData(const Task& aTask) noexcept {
+	for (size_t pos = 0; pos < aTask.size; pos += static_cast<size_t>(aTask.partSize)) {
+		TigerTree part(aTask.partSize);
+		part.update(aTask.data + pos, min(static_cast<size_t>(aTask.partSize), aTask.size - pos));
+		part.finalize();
+
+		aTask.leaves_->push_back(part.getRoot());
+	}
+}
+
+void HashPipeline::waitFreeBuffers(size_t aCount) noexcept {
+	unique_lock<mutex> l(mtx);
+	freeCond.wait(l, [&] { return freeBuffers.size() >= aCount; });
+}
+
+void HashPipeline::hashFile(const string& aPath, TigerTree& tt_, const FileReader::DataCallback& aDataF) {
+	if (threads == 0) {
+		FileReader fr(true);
+		fr.read(aPath, [&](const void* aBuf, size_t aLen) {
+			tt_.update(aBuf, aLen);
+			return aDataF(aBuf, aLen);
+		});
+
+		tt_.finalize();
+		return;
+	}
+
+	startWorkers();
+
+	// All buffers must be a multiple of the part size
+	const auto partSize = min(tt_.getBlockSize(), static_cast<int64_t>(BUFFER_SIZE));
+	const auto bufferCount = static_cast<size_t>(threads) * 2;
+
+	// The pages are allocated only when the buffers are being used
+	unique_ptr<uint8_t[]> memory(new uint8_t[bufferCount * BUFFER_SIZE + BUFFER_ALIGNMENT]);
+	auto buffers = reinterpret_cast<uint8_t*>(((reinterpret_cast<size_t>(memory.get()) + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT);
+
+	{
+		lock_guard<mutex> l(mtx);
+		freeBuffers.clear();
+		for (int i = static_cast<int>(bufferCount) - 1; i >= 0; --i) {
+			freeBuffers.push_back(i);
+		}
+
+		hashTime = 0;
+	}
+
+	// Leaves for each dispatched buffer (deque won't invalidate the references when adding items)
+	deque<TigerTree::MerkleList> bufferLeaves;
+
+	uint8_t* buffer = nullptr;
+	int bufferIndex = -1;
+	size_t bufferPos = 0;
+
+	int64_t totalSize = 0;
+
+	// Time spent outside of reading
+	uint64_t blockedTime = 0;
+
+	auto acquireBuffer = [&] {
+		auto start = GET_TICK();
+
+		{
+			unique_lock<mutex> l(mtx);
+			freeCond.wait(l, [this] { return !freeBuffers.empty(); });
+			bufferIndex = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+
+		buffer = buffers + bufferIndex * BUFFER_SIZE;
+		bufferPos = 0;
+		blockedTime += GET_TICK() - start;
+	};
+
+	auto dispatchBuffer = [&] {
+		bufferLeaves.emplace_back();
+
+		{
+			lock_guard<mutex> l(mtx);
+			tasks.push_back({ buffer, bufferPos, partSize, &bufferLeaves.back(), bufferIndex });
+		}
+
+		taskCond.notify_one();
+		buffer = nullptr;
+	};
+
+	auto releaseBuffer = [&] {
+		if (!buffer) {
+			return;
+		}
+
+		{
+			lock_guard<mutex> l(mtx);
+			freeBuffers.push_back(bufferIndex);
+		}
+
+		buffer = nullptr;
+	};
+
+	auto start = GET_TICK();
+	try {
+		FileReader fr(true);
+		fr.read(aPath, [&](const void* aBuf, size_t aLen) {
+			auto callbackStart = GET_TICK();
+			auto ret = aDataF(aBuf, aLen);
+			blockedTime += GET_TICK() - callbackStart;
+
+			auto data = static_cast<const uint8_t*>(aBuf);
+			size_t pos = 0;
+			while (pos < aLen) {
+				if (!buffer) {
+					acquireBuffer();
+				}
+
+				auto n = min(aLen - pos, BUFFER_SIZE - bufferPos);
+				memcpy(buffer + bufferPos, data + pos, n);
+				bufferPos += n;
+				pos += n;
+
+				if (bufferPos == BUFFER_SIZE) {
+					dispatchBuffer();
+				}
+			}
+
+			totalSize += aLen;
+			return ret;
+		});
+	} catch (...) {
+		// The buffers must not be in use when they are released
+		releaseBuffer();
+		waitFreeBuffers(bufferCount);
+		throw;
+	}
+
+	auto readEnd = GET_TICK();
+	if (bufferLeaves.empty()) {
+		// Everything fit in a single buffer, there's nothing to parallelize
+		if (buffer) {
+			tt_.update(buffer, bufferPos);
+			releaseBuffer();
+		}
+
+		tt_.finalize();
+		return;
+	}
+
+	if (buffer && bufferPos > 0) {
+		dispatchBuffer();
+	} else {
+		releaseBuffer();
+	}
+
+	waitFreeBuffers(bufferCount);
+
+	TigerTree::MerkleList leaves;
+	for (const auto& l : bufferLeaves) {
+		leaves.insert(leaves.end(), l.begin(), l.end());
+	}
+
+	tt_.setPartLeaves(totalSize, partSize, leaves);
+
+	// Statistics
+	{
+		lock_guard<mutex> l(mtx);
+		if (hashTime > 0) {
+			hashSpeed = totalSize * 1000 * threads / static_cast<int64_t>(hashTime);
+		}
+	}
+
+	auto readTime = readEnd - start > blockedTime ? readEnd - start - blockedTime : 0;
+	if (readTime > 0) {
+		readSpeed = totalSize * 1000 / static_cast<int64_t>(readTime);
+	}
+}
+
+} // namespace dcpp
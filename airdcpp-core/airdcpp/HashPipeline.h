@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_HASH_PIPELINE_H
+#define DCPLUSPLUS_DCPP_HASH_PIPELINE_H
+
+#include "typedefs.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include "FileReader.h"
+#include "MerkleTree.h"
+#include "Thread.h"
+
+namespace dcpp {
+
+/*
+* Calculates the tree for a file with separate reading and hashing stages
+*
+* The calling thread reads the file into a ring of aligned buffers while the worker threads calculate
+* the leaves for the filled buffers (separate ranges of the file) in parallel. The leaves are combined into the final tree
+* after the whole file has been read.
+*/
+class HashPipeline {
+public:
+	// Size of a single buffer passed to the hashing stage
+	static const size_t BUFFER_SIZE = 4 * 1024 * 1024;
+	static const size_t BUFFER_ALIGNMENT = 4096;
+
+	// aThreads is the number of hashing threads, 0 = hash in the reading thread
+	HashPipeline(int aThreads) noexcept;
+	~HashPipeline();
+
+	HashPipeline(HashPipeline&) = delete;
+	HashPipeline& operator=(HashPipeline&) = delete;
+
+	// Read the file and calculate the finalized tree (which must be empty and have the final block size set)
+	// The data callback is called by the reading thread for each read chunk in file order, returning false will stop reading
+	// Throws FileException
+	void hashFile(const string& aPath, TigerTree& tt_, const FileReader::DataCallback& aDataF);
+
+	// Per stage throughput of the last file that was hashed with multiple buffers (bytes/s)
+	int64_t getReadSpeed() const noexcept { return readSpeed; }
+	int64_t getHashSpeed() const noexcept { return hashSpeed; }
+private:
+	struct Task {
+		const uint8_t* data;
+		size_t size;
+		int64_t partSize;
+		TigerTree::MerkleList* leaves_;
+		int bufferIndex;
+	};
+
+	class Worker : public Thread {
+	public:
+		Worker(HashPipeline& aPipeline) : pipeline(aPipeline) { start(); }
+	private:
+		HashPipeline& pipeline;
+		int run() override;
+	};
+
+	void startWorkers() noexcept;
+	void stopWorkers() noexcept;
+
+	// Wait until the workers have returned the wanted number of buffers
+	void waitFreeBuffers(size_t aCount) noexcept;
+
+	// Calculate the part leaves for the data
+	static void hashData(const Task& aTask) noexcept;
+
+	// Worker queue
+	deque<Task> tasks;
+	condition_variable taskCond;
+	bool stopping = false;
+
+	// Indexes of the buffers that are available for the reader
+	vector<int> freeBuffers;
+	condition_variable freeCond;
+
+	mutex mtx;
+
+	const int threads;
+	vector<unique_ptr<Worker>> workers;
+
+	// Total time spent on hashing by the workers during the current file
+	uint64_t hashTime = 0;
+
+	atomic<int64_t> readSpeed;
+	atomic<int64_t> hashSpeed;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_HASH_PIPELINE_H)
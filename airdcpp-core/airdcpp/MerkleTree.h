@@ -106,16 +106,27 @@ public:
 			return;
 		
 		do {
+			// Hash full base blocks in batches (the hasher may process multiple blocks at once)
+			size_t fullBlocks = (len - i) / baseBlockSize;
+			if(baseBlockSize == Hasher::LEAF_SIZE && fullBlocks > 1) {
+				if(fullBlocks > LEAF_BATCH_SIZE)
+					fullBlocks = LEAF_BATCH_SIZE;
+
+				uint8_t hashes[LEAF_BATCH_SIZE * BYTES];
+				Hasher::hashLeaves(buf + i, fullBlocks, hashes);
+				for(size_t j = 0; j < fullBlocks; ++j) {
+					addBaseHash(MerkleValue(hashes + j * BYTES));
+				}
+
+				i += fullBlocks * baseBlockSize;
+				continue;
+			}
+
 			size_t n = min(baseBlockSize, len-i);
 			Hasher h;
 			h.update(&zero, 1);
 			h.update(buf + i, n);
-			if((int64_t)baseBlockSize < blockSize) {
-				blocks.emplace_back(MerkleValue(h.finalize()), baseBlockSize);
-				reduceBlocks();
-			} else {
-				leaves.emplace_back(h.finalize());
-			}
+			addBaseHash(MerkleValue(h.finalize()));
 			i += n;
 		} while(i < len);
 		fileSize += len;
@@ -159,6 +170,38 @@ public:
 		root = getHash(0, fileSize);
 	}
 
+	/**
+	 * Set the leaves from hashes that have been calculated separately for consecutive parts of the data (e.g. in parallel)
+	 * The root is calculated as well, no further updates are allowed
+	 * @param aPartSize Size of the hashed parts. Must be a power of two multiple of baseBlockSize
+	 *                  and not larger than the block size.
+	 */
+	void setPartLeaves(int64_t aFileSize, int64_t aPartSize, const MerkleList& aPartLeaves) {
+		dcassert(aPartSize <= blockSize && (blockSize % aPartSize) == 0);
+		dcassert(calcBlocks(aFileSize, aPartSize) == aPartLeaves.size());
+
+		blocks.clear();
+		leaves.clear();
+		fileSize = aFileSize;
+
+		const auto partsPerBlock = static_cast<size_t>(blockSize / aPartSize);
+		for (size_t i = 0; i < aPartLeaves.size(); i += partsPerBlock) {
+			auto parts = min(partsPerBlock, aPartLeaves.size() - i);
+			if (parts == 1) {
+				leaves.push_back(aPartLeaves[i]);
+				continue;
+			}
+
+			MerkleTree block(aPartSize);
+			block.leaves.assign(aPartLeaves.begin() + i, aPartLeaves.begin() + i + parts);
+			block.fileSize = min(blockSize, aFileSize - static_cast<int64_t>(i) * aPartSize);
+			block.calcRoot();
+			leaves.push_back(block.root);
+		}
+
+		calcRoot();
+	}
+
 	ByteVector getLeafData() {
 		ByteVector buf(getLeaves().size() * BYTES);
 		uint8_t* p = &buf[0];
@@ -205,6 +248,18 @@ private:
 		return MerkleValue(h.finalize());
 	}
 
+	/** Number of base blocks that are hashed at once */
+	static const size_t LEAF_BATCH_SIZE = 32;
+
+	void addBaseHash(const MerkleValue& aHash) {
+		if((int64_t)baseBlockSize < blockSize) {
+			blocks.emplace_back(aHash, baseBlockSize);
+			reduceBlocks();
+		} else {
+			leaves.push_back(aHash);
+		}
+	}
+
 	void reduceBlocks() {
 		while(blocks.size() > 1) {
 			MerkleBlock& a = blocks[blocks.size()-2];
@@ -279,6 +279,8 @@ void QueueItem::getOnlineUsers(HintedUserList& l) const noexcept {
 
 void QueueItem::addSource(const HintedUser& aUser) noexcept {
 	dcassert(!isSource(aUser.user));
+
+	FastLock l(cs);
 	auto i = getBadSource(aUser);
 	if(i != badSources.end()) {
 		sources.push_back(*i);
@@ -291,6 +293,8 @@ void QueueItem::addSource(const HintedUser& aUser) noexcept {
 void QueueItem::blockSourceHub(const HintedUser& aUser) noexcept {
 	dcassert(isSource(aUser.user));
 	auto s = getSource(aUser.user);
+
+	FastLock l(cs);
 	s->blockedHubs.insert(aUser.hint);
 }
 
@@ -299,12 +303,23 @@ bool QueueItem::isHubBlocked(const UserPtr& aUser, const string& aUrl) const noe
 	return !s->blockedHubs.empty() && s->blockedHubs.find(aUrl) != s->blockedHubs.end();
 }
 
+OrderedStringSet QueueItem::getBlockedHubs(const UserPtr& aUser) const noexcept {
+	auto s = getSource(aUser);
+	if (s == sources.end()) {
+		return OrderedStringSet();
+	}
+
+	FastLock l(cs);
+	return s->blockedHubs;
+}
+
 void QueueItem::removeSource(const UserPtr& aUser, Flags::MaskType reason) noexcept {
 	SourceIter i = getSource(aUser);
 	dcassert(i != sources.end());
 	if(i == sources.end())
 		return;
 
+	FastLock l(cs);
 	i->setFlag(reason);
 	badSources.push_back(*i);
 	sources.erase(i);
@@ -412,15 +427,36 @@ Segment QueueItem::getNextSegment(int64_t aBlockSize, int64_t aWantedSize, int64
 	}
 
 	/* added for PFS */
-	vector<int64_t> posArray;
+	vector<Segment> partialParts;
 	vector<Segment> neededParts;
 
 	if(aPartialSource) {
-		posArray.reserve(aPartialSource->getPartialInfo().size());
+		const auto& partialInfo = aPartialSource->getPartialInfo();
+		partialParts.reserve(partialInfo.size() / 2);
+
+		// Convert block indexes to file positions
+		for(auto j = partialInfo.begin(); j + 1 < partialInfo.end(); j += 2) {
+			auto b = min(size, (int64_t)(*j) * aBlockSize);
+			auto e = min(size, (int64_t)(*(j + 1)) * aBlockSize);
+			if (b < e) {
+				partialParts.emplace_back(b, e - b);
+			}
+		}
+
+		// Merge the overlapping ranges so that the ones intersecting a block can be looked up by position
+		sort(partialParts.begin(), partialParts.end());
+		auto last = partialParts.begin();
+		for (auto j = partialParts.begin(); j != partialParts.end(); ++j) {
+			if (last != j && last->getEnd() > j->getStart()) {
+				last->setSize(max(last->getEnd(), j->getEnd()) - last->getStart());
+			} else if (last != j) {
+				*(++last) = *j;
+			}
+		}
 
-		// Convert block index to file position
-		for(auto index: aPartialSource->getPartialInfo())
-			posArray.push_back(min(size, (int64_t)(index) * aBlockSize));
+		if (!partialParts.empty()) {
+			partialParts.erase(last + 1, partialParts.end());
+		}
 	}
 
 	/***************************/
@@ -437,44 +473,71 @@ Segment QueueItem::getNextSegment(int64_t aBlockSize, int64_t aWantedSize, int64
 		targetSize = aBlockSize;
 	}		
 
+	// The finished segments are looked up by position and the blocks that can't be used are skipped at once,
+	// so the time taken doesn't depend on the number of finished segments or blocks
 	int64_t start = 0;
 	int64_t curSize = targetSize;
+	auto nextPart = partialParts.begin();
 
 	while(start < size) {
+		if(aPartialSource) {
+			// Only the blocks that the partial source has can be used
+			while(nextPart != partialParts.end() && nextPart->getEnd() <= start) {
+				++nextPart;
+			}
+
+			if(nextPart == partialParts.end()) {
+				break;
+			}
+
+			if(nextPart->getStart() >= start + curSize) {
+				start += (nextPart->getStart() - start) / curSize * curSize;
+			}
+		}
+
 		int64_t end = std::min(size, start + curSize);
 		Segment block(start, end - start);
+
+		auto d = findDone(start);
 		bool overlaps = false;
-		for(auto i = done.begin(); !overlaps && i != done.end(); ++i) {
-			if(curSize <= aBlockSize) {
-				int64_t dstart = i->getStart();
-				int64_t dend = i->getEnd();
-				// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
-				if(dstart <= start && dend >= end) {
-					overlaps = true;
-				}
-			} else {
-				overlaps = block.overlaps(*i);
+		int64_t skipTo = end;
+		if(curSize <= aBlockSize) {
+			// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
+			if(d != done.end() && d->getStart() <= start && d->getEnd() >= end) {
+				overlaps = true;
+
+				// Blocks inside the same done segment are consumed as well
+				skipTo = max(end, start + (d->getEnd() - start) / curSize * curSize);
 			}
+		} else {
+			overlaps = d != done.end() && d->getStart() < end;
 		}
-		
+
 		for(auto i = downloads.begin(); !overlaps && i != downloads.end(); ++i) {
-			overlaps = block.overlaps((*i)->getSegment());
+			const auto& running = (*i)->getSegment();
+			if(block.overlaps(running)) {
+				overlaps = true;
+				skipTo = max(end, start + Util::roundUp(running.getEnd() - start, curSize));
+			}
 		}
 		
 		if(!overlaps) {
 			if(aPartialSource) {
 				// store all chunks we could need
-				for(auto j = posArray.begin(); j < posArray.end(); j += 2){
-					if( (*j <= start && start < *(j+1)) || (start <= *j && *j < end) ) {
-						int64_t b = max(start, *j);
-						int64_t e = min(end, *(j+1));
+				auto j = upper_bound(partialParts.begin(), partialParts.end(), Segment(start, std::numeric_limits<int64_t>::max()));
+				if (j != partialParts.begin() && prev(j)->getEnd() > start) {
+					--j;
+				}
+
+				for(; j != partialParts.end() && j->getStart() < end; ++j) {
+					int64_t b = max(start, j->getStart());
+					int64_t e = min(end, j->getEnd());
 
-						// segment must be blockSize aligned
-						dcassert(b % aBlockSize == 0);
-						dcassert(e % aBlockSize == 0 || e == size);
+					// segment must be blockSize aligned
+					dcassert(b % aBlockSize == 0);
+					dcassert(e % aBlockSize == 0 || e == size);
 
-						neededParts.emplace_back(b, e - b);
-					}
+					neededParts.emplace_back(b, e - b);
 				}
 			} else {
 				//dcassert(find_if(downloads.begin(), downloads.end(), [&block](const Download* d) { return block.getEnd() == d->getSegment().getEnd(); }) == downloads.end());
@@ -483,9 +546,19 @@ Segment QueueItem::getNextSegment(int64_t aBlockSize, int64_t aWantedSize, int64
 		}
 		
 		if(overlaps && (curSize > aBlockSize)) {
-			curSize -= aBlockSize;
+			// Shrink the block to end before the first used range (the same size that removing one block at a time would give)
+			int64_t firstUsed = d != done.end() ? max(start, d->getStart()) : size;
+			for(auto dl: downloads) {
+				const auto& running = dl->getSegment();
+				if(running.getEnd() > start) {
+					firstUsed = min(firstUsed, max(start, running.getStart()));
+				}
+			}
+
+			auto fitting = (firstUsed - start) / aBlockSize * aBlockSize;
+			curSize = max(aBlockSize, min(curSize - aBlockSize, fitting));
 		} else {
-			start = end;
+			start = overlaps ? skipTo : end;
 			curSize = targetSize;
 		}
 	}
@@ -535,21 +608,11 @@ Segment QueueItem::checkOverlaps(int64_t aBlockSize, int64_t aLastSpeed, const P
 }
 
 uint64_t QueueItem::getDownloadedSegments() const noexcept {
-	uint64_t total = 0;
-	// count done segments
-	for(auto& i: done) {
-		total += i.getSize();
-	}
-	return total;
+	return downloadedSegments;
 }
 
 uint64_t QueueItem::getDownloadedBytes() const noexcept {
-	uint64_t total = 0;
-
-	// count done segments
-	for(auto& i: done) {
-		total += i.getSize();
-	}
+	uint64_t total = downloadedSegments;
 
 	// count running segments
 	for(auto d: downloads) {
@@ -559,6 +622,19 @@ uint64_t QueueItem::getDownloadedBytes() const noexcept {
 	return total;
 }
 
+QueueItem::SegmentConstIter QueueItem::findDone(int64_t aPos) const noexcept {
+	// The segments don't overlap, so only the last one starting before the position may contain it
+	auto i = done.upper_bound(Segment(aPos, std::numeric_limits<int64_t>::max()));
+	if (i != done.begin()) {
+		auto p = prev(i);
+		if (p->getEnd() > aPos) {
+			return p;
+		}
+	}
+
+	return i;
+}
+
 void QueueItem::addFinishedSegment(const Segment& segment) noexcept {
 #ifdef _DEBUG
 	if (bundle)
@@ -566,47 +642,45 @@ void QueueItem::addFinishedSegment(const Segment& segment) noexcept {
 #endif
 
 	dcassert(segment.getOverlapped() == false);
-	done.insert(segment);
-
-	// Consolidate segments
-
-	bool added = false;
-	if(done.size() != 1) {
-		for(auto i = ++done.begin() ; i != done.end(); ) {
-			auto prev = i;
-			prev--;
-			if(prev->getEnd() >= i->getStart()) {
-				Segment big(prev->getStart(), i->getEnd() - prev->getStart());
-				auto newBytes = big.getSize() - (*prev == segment ? i->getSize() : prev->getSize()); //minus the part that has been counted before...
-
-				done.erase(prev);
-				done.erase(i++);
-				done.insert(big);
-				if (bundle && !added) {
-					dcdebug("added " I64_FMT " for the bundle (segments merged)\n", newBytes);
-					bundle->addFinishedSegment(newBytes);
-				}
-				added = true;
-			} else {
-				++i;
-			}
+
+	// Consolidate with the overlapping and adjacent segments
+	auto start = segment.getStart();
+	auto end = segment.getEnd();
+	int64_t newBytes = 0;
+
+	{
+		FastLock l(cs);
+		int64_t mergedBytes = 0;
+
+		auto i = done.lower_bound(Segment(start, 0));
+		if (i != done.begin() && prev(i)->getEnd() >= start) {
+			--i;
 		}
+
+		while (i != done.end() && i->getStart() <= end) {
+			start = min(start, i->getStart());
+			end = max(end, i->getEnd());
+			mergedBytes += i->getSize();
+			i = done.erase(i);
+		}
+
+		done.emplace_hint(i, start, end - start);
+
+		newBytes = (end - start) - mergedBytes;
+		downloadedSegments += newBytes;
 	}
 
-	if (!added && bundle) {
-		dcdebug("added " I64_FMT " for the bundle (no merging)\n", segment.getSize());
-		bundle->addFinishedSegment(segment.getSize());
+	if (bundle) {
+		dcdebug("added " I64_FMT " for the bundle\n", newBytes);
+		bundle->addFinishedSegment(newBytes);
 	}
 }
 
 bool QueueItem::isNeededPart(const PartsInfo& aPartsInfo, int64_t aBlockSize) const noexcept {
 	dcassert(aPartsInfo.size() % 2 == 0);
 	
-	SegmentConstIter i  = done.begin();
 	for(auto j = aPartsInfo.begin(); j != aPartsInfo.end(); j+=2){
-		while(i != done.end() && (*i).getEnd() <= (*j) * aBlockSize)
-			i++;
-
+		auto i = findDone((*j) * aBlockSize);
 		if(i == done.end() || !((*i).getStart() <= (*j) * aBlockSize && (*i).getEnd() >= (*(j+1)) * aBlockSize))
 			return true;
 	}
@@ -733,10 +807,12 @@ QueueItemPtr QueueItem::pickSearchItem(const QueueItemList& aItems) noexcept {
 }
 
 void QueueItem::addDownload(Download* d) noexcept {
+	FastLock l(cs);
 	downloads.push_back(d);
 }
 
 void QueueItem::removeDownload(const string& aToken) noexcept {
+	FastLock l(cs);
 	auto m = find_if(downloads.begin(), downloads.end(), [&](const Download* d) { return compare(d->getToken(), aToken) == 0; });
 	dcassert(m != downloads.end());
 	if (m != downloads.end()) {
@@ -747,6 +823,7 @@ void QueueItem::removeDownload(const string& aToken) noexcept {
 }
 
 void QueueItem::removeDownloads(const UserPtr& aUser) noexcept {
+	FastLock l(cs);
 	for(auto i = downloads.begin(); i != downloads.end();) {
 		if((*i)->getUser() == aUser) {
 			i = downloads.erase(i);
@@ -859,7 +936,9 @@ void QueueItem::resetDownloaded() noexcept {
 		bundle->removeFinishedSegment(getDownloadedSegments());
 	}
 
+	FastLock l(cs);
 	done.clear();
+	downloadedSegments = 0;
 }
 
 }
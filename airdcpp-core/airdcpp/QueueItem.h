@@ -190,6 +190,8 @@ public:
 	bool isSource(const UserPtr& aUser) const noexcept { return getSource(aUser) != sources.end(); }
 	bool isBadSource(const UserPtr& aUser) const noexcept { return getBadSource(aUser) != badSources.end(); }
 	bool isBadSourceExcept(const UserPtr& aUser, Flags::MaskType exceptions, bool& isBad_) const noexcept;
+
+	OrderedStringSet getBlockedHubs(const UserPtr& aUser) const noexcept;
 	
 	void getChunksVisualisation(vector<Segment>& running, vector<Segment>& downloaded, vector<Segment>& done) const noexcept;
 
@@ -252,7 +254,7 @@ public:
 	void setTempTarget(const string& aTempTarget) noexcept;
 
 	GETSET(TTHValue, tthRoot, TTH);
-	GETSET(SegmentSet, done, Done);	
+	const SegmentSet& getDone() const noexcept { return done; }
 	IGETSET(uint64_t, fileBegin, FileBegin, 0);
 	IGETSET(uint64_t, nextPublishingTime, NextPublishingTime, 0);
 	IGETSET(uint8_t, maxSegments, MaxSegments, 1);
@@ -271,12 +273,20 @@ public:
 
 	QueueItem& operator=(const QueueItem&) = delete;
 private:
+	friend class QueueLoader;
 	friend class QueueManager;
 	friend class UserQueue;
 	SourceList sources;
 	SourceList badSources;
 	string tempTarget;
 
+	// Finished segments (merged so that they never overlap or touch each other)
+	SegmentSet done;
+	uint64_t downloadedSegments = 0;
+
+	// Returns the first finished segment that ends after the position
+	SegmentConstIter findDone(int64_t aPos) const noexcept;
+
 	void addSource(const HintedUser& aUser) noexcept;
 	void blockSourceHub(const HintedUser& aUser) noexcept;
 	bool isHubBlocked(const UserPtr& aUser, const string& aUrl) const noexcept;
@@ -22,6 +22,7 @@
 #include <string>
 #include <set>
 
+#include "CriticalSection.h"
 #include "Flags.h"
 #include "forward.h"
 #include "GetSet.h"
@@ -74,9 +75,15 @@ public:
 		string format() const noexcept;
 		static int compare(const SourceCount& a, const SourceCount& b) noexcept;
 	};
+
+	// Guards the sources and the download progress for readers that don't hold the queue lock
+	// The changes are made while holding both locks
+	FastCriticalSection& getCS() const noexcept { return cs; }
 protected:
 	QueueToken token;
 	const string target;
+
+	mutable FastCriticalSection cs;
 };
 
 }
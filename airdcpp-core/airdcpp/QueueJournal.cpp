@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "QueueJournal.h"
+
+#include "ClientManager.h"
+#include "File.h"
+#include "LogManager.h"
+#include "QueueItem.h"
+#include "Streams.h"
+#include "ZUtils.h"
+
+namespace dcpp {
+
+// The file consists of a header, followed by records of the following format:
+//
+// uint32_t length
+// uint8_t type, uint32_t bundle token, type-specific fields
+// uint32_t CRC32 (type, token and fields)
+//
+// Strings are stored with an uint32_t length prefix. All integers use the native byte order.
+
+#define QUEUE_JOURNAL_VERSION 1
+static const char QUEUE_JOURNAL_MAGIC[8] = { 'A', 'D', 'C', 'Q', 'J', 'R', 'N', 'L' };
+static const uint32_t QUEUE_JOURNAL_BYTE_ORDER = 0x01020304;
+
+#pragma pack(push, 1)
+struct QueueJournalHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(QueueJournalHeader) == 16, "Invalid queue journal header size");
+
+class QueueJournal::RecordWriter {
+public:
+	RecordWriter(RecordType aType, QueueToken aBundle) noexcept {
+		add<uint8_t>(aType);
+		add<uint32_t>(aBundle);
+	}
+
+	template<typename T>
+	RecordWriter& add(T aValue) noexcept {
+		data.append(reinterpret_cast<const char*>(&aValue), sizeof(T));
+		return *this;
+	}
+
+	RecordWriter& addString(const string& aValue) noexcept {
+		add<uint32_t>(static_cast<uint32_t>(aValue.size()));
+		data.append(aValue);
+		return *this;
+	}
+
+	// Writes the record with the length and checksum
+	void write(OutputStream& aStream) const {
+		CRC32Filter crc;
+		crc(data.data(), data.size());
+
+		uint32_t length = static_cast<uint32_t>(data.size());
+		uint32_t checksum = crc.getValue();
+
+		aStream.write(&length, sizeof(uint32_t));
+		aStream.write(data);
+		aStream.write(&checksum, sizeof(uint32_t));
+	}
+private:
+	string data;
+};
+
+class RecordReader {
+public:
+	RecordReader(const char* aData, size_t aSize) noexcept : data(aData), size(aSize) { }
+
+	template<typename T>
+	T get() {
+		check(sizeof(T));
+
+		T ret;
+		memcpy(&ret, data + pos, sizeof(T));
+		pos += sizeof(T);
+		return ret;
+	}
+
+	string getString() {
+		auto length = get<uint32_t>();
+		check(length);
+
+		string ret(data + pos, length);
+		pos += length;
+		return ret;
+	}
+private:
+	void check(size_t aBytes) const {
+		if (size - pos < aBytes) {
+			throw Exception("Invalid journal record");
+		}
+	}
+
+	const char* data;
+	const size_t size;
+	size_t pos = 0;
+};
+
+QueueJournal::QueueJournal(const string& aPath) noexcept : path(aPath) {
+
+}
+
+QueueJournal::~QueueJournal() {
+
+}
+
+void QueueJournal::writeHeader(OutputStream& aStream) {
+	QueueJournalHeader header;
+	memcpy(header.magic, QUEUE_JOURNAL_MAGIC, sizeof(QUEUE_JOURNAL_MAGIC));
+	header.version = QUEUE_JOURNAL_VERSION;
+	header.byteOrder = QUEUE_JOURNAL_BYTE_ORDER;
+
+	aStream.write(&header, sizeof(QueueJournalHeader));
+}
+
+QueueJournal::BundleLogMap QueueJournal::load() {
+	BundleLogMap ret;
+
+	Lock l(cs);
+	if (!Util::fileExists(path)) {
+		return ret;
+	}
+
+	const auto data = File(path, File::READ, File::OPEN, File::BUFFER_SEQUENTIAL).read();
+
+	QueueJournalHeader header;
+	if (data.size() >= sizeof(QueueJournalHeader)) {
+		memcpy(&header, data.data(), sizeof(QueueJournalHeader));
+	}
+
+	if (data.size() < sizeof(QueueJournalHeader) || memcmp(header.magic, QUEUE_JOURNAL_MAGIC, sizeof(QUEUE_JOURNAL_MAGIC)) != 0 ||
+		header.byteOrder != QUEUE_JOURNAL_BYTE_ORDER || header.version > QUEUE_JOURNAL_VERSION) {
+
+		// Don't append in a file that we can't read
+		File::renameFile(path, path + ".bak");
+		throw Exception("Invalid queue journal");
+	}
+
+	auto readRecord = [&ret](const char* aData, size_t aSize) {
+		RecordReader r(aData, aSize);
+		auto type = static_cast<RecordType>(r.get<uint8_t>());
+		auto token = r.get<uint32_t>();
+
+		if (type == RECORD_BUNDLE) {
+			auto& log = ret[token];
+			log.snapshot = r.getString();
+			log.records.clear();
+			return;
+		}
+
+		if (type == RECORD_BUNDLE_REMOVED) {
+			ret.erase(token);
+			return;
+		}
+
+		auto log = ret.find(token);
+		if (log == ret.end() || type >= RECORD_LAST) {
+			// Changes made before the first snapshot are included in it
+			return;
+		}
+
+		Record record;
+		record.type = type;
+		switch (type) {
+			case RECORD_BUNDLE_PRIORITY: {
+				record.priority = static_cast<Priority>(r.get<int8_t>());
+				record.autoPriority = r.get<uint8_t>() != 0;
+				record.time = static_cast<time_t>(r.get<int64_t>());
+				break;
+			}
+			case RECORD_ITEM_PRIORITY: {
+				record.target = r.getString();
+				record.priority = static_cast<Priority>(r.get<int8_t>());
+				record.autoPriority = r.get<uint8_t>() != 0;
+				break;
+			}
+			case RECORD_SEGMENT: {
+				record.target = r.getString();
+				record.tempTarget = r.getString();
+				auto start = r.get<int64_t>();
+				record.segment = Segment(start, r.get<int64_t>());
+				break;
+			}
+			case RECORD_FILE_FINISHED: {
+				record.target = r.getString();
+				record.time = static_cast<time_t>(r.get<int64_t>());
+				record.nick = r.getString();
+				break;
+			}
+			case RECORD_SOURCE_ADDED: {
+				record.target = r.getString();
+				record.cid = r.getString();
+				record.nick = r.getString();
+				record.hubHint = r.getString();
+				break;
+			}
+			case RECORD_SOURCE_REMOVED: {
+				record.target = r.getString();
+				record.cid = r.getString();
+				break;
+			}
+			default: break;
+		}
+
+		log->second.records.push_back(std::move(record));
+	};
+
+	auto pos = sizeof(QueueJournalHeader);
+	while (data.size() - pos >= 2 * sizeof(uint32_t)) {
+		uint32_t length;
+		memcpy(&length, data.data() + pos, sizeof(uint32_t));
+		if (length == 0 || data.size() - pos - 2 * sizeof(uint32_t) < length) {
+			break;
+		}
+
+		const auto record = data.data() + pos + sizeof(uint32_t);
+
+		uint32_t checksum;
+		memcpy(&checksum, record + length, sizeof(uint32_t));
+
+		CRC32Filter crc;
+		crc(record, length);
+		if (crc.getValue() != checksum) {
+			break;
+		}
+
+		try {
+			readRecord(record, length);
+		} catch (const Exception&) {
+			break;
+		}
+
+		pos += length + 2 * sizeof(uint32_t);
+	}
+
+	if (pos != data.size()) {
+		// Incomplete record, most likely the application wasn't shut down cleanly
+		LogManager::getInstance()->message("The queue journal contained an incomplete record (" + Util::formatBytes(static_cast<int64_t>(data.size() - pos)) + " were discarded)", LogMessage::SEV_WARNING);
+
+		File f(path, File::WRITE, File::OPEN);
+		f.setPos(pos);
+		f.setEOF();
+	}
+
+	fileSize = pos;
+	compactedSize = sizeof(QueueJournalHeader);
+	for (const auto& log : ret | map_values) {
+		compactedSize += log.snapshot.size();
+	}
+
+	return ret;
+}
+
+void QueueJournal::append(const RecordWriter& aRecord) noexcept {
+	Lock l(cs);
+	StringOutputStream os(pending);
+	aRecord.write(os);
+}
+
+void QueueJournal::appendBundle(Bundle& aBundle) noexcept {
+	string snapshot;
+
+	{
+		StringOutputStream os(snapshot);
+		aBundle.save(os);
+	}
+
+	append(RecordWriter(RECORD_BUNDLE, aBundle.getToken()).addString(snapshot));
+}
+
+void QueueJournal::appendBundleRemoved(QueueToken aBundle) noexcept {
+	append(RecordWriter(RECORD_BUNDLE_REMOVED, aBundle));
+}
+
+void QueueJournal::appendBundlePriority(const Bundle& aBundle) noexcept {
+	append(RecordWriter(RECORD_BUNDLE_PRIORITY, aBundle.getToken())
+		.add<int8_t>(static_cast<int8_t>(aBundle.getPriority()))
+		.add<uint8_t>(aBundle.getAutoPriority())
+		.add<int64_t>(aBundle.getResumeTime()));
+}
+
+void QueueJournal::appendItemPriority(QueueToken aBundle, const QueueItem& aQI) noexcept {
+	append(RecordWriter(RECORD_ITEM_PRIORITY, aBundle)
+		.addString(aQI.getTarget())
+		.add<int8_t>(static_cast<int8_t>(aQI.getPriority()))
+		.add<uint8_t>(aQI.getAutoPriority()));
+}
+
+void QueueJournal::appendSegment(QueueToken aBundle, const string& aTarget, const string& aTempTarget, const Segment& aSegment) noexcept {
+	append(RecordWriter(RECORD_SEGMENT, aBundle)
+		.addString(aTarget)
+		.addString(aTempTarget)
+		.add<int64_t>(aSegment.getStart())
+		.add<int64_t>(aSegment.getSize()));
+}
+
+void QueueJournal::appendFileFinished(QueueToken aBundle, const QueueItem& aQI) noexcept {
+	append(RecordWriter(RECORD_FILE_FINISHED, aBundle)
+		.addString(aQI.getTarget())
+		.add<int64_t>(aQI.getTimeFinished())
+		.addString(aQI.getLastSource()));
+}
+
+void QueueJournal::appendSourceAdded(QueueToken aBundle, const string& aTarget, const HintedUser& aUser) noexcept {
+	append(RecordWriter(RECORD_SOURCE_ADDED, aBundle)
+		.addString(aTarget)
+		.addString(aUser.user->getCID().toBase32())
+		.addString(ClientManager::getInstance()->getNick(aUser.user, aUser.hint))
+		.addString(aUser.hint));
+}
+
+void QueueJournal::appendSourceRemoved(QueueToken aBundle, const string& aTarget, const UserPtr& aUser) noexcept {
+	append(RecordWriter(RECORD_SOURCE_REMOVED, aBundle)
+		.addString(aTarget)
+		.addString(aUser->getCID().toBase32()));
+}
+
+void QueueJournal::flush() {
+	Lock l(cs);
+	if (pending.empty()) {
+		return;
+	}
+
+	if (!file) {
+		file = make_unique<File>(path, File::WRITE, File::OPEN | File::CREATE);
+		fileSize = file->getSize();
+		if (fileSize == 0) {
+			writeHeader(*file);
+			fileSize = sizeof(QueueJournalHeader);
+		} else {
+			file->setEndPos(0);
+		}
+	}
+
+	file->write(pending);
+	fileSize += pending.size();
+	pending.clear();
+}
+
+bool QueueJournal::needsCompaction() const noexcept {
+	Lock l(cs);
+	auto size = fileSize + static_cast<int64_t>(pending.size());
+	return size > COMPACT_MIN_SIZE && size > 2 * compactedSize;
+}
+
+int64_t QueueJournal::getSize() const noexcept {
+	Lock l(cs);
+	return fileSize + static_cast<int64_t>(pending.size());
+}
+
+void QueueJournal::compact(const Bundle::TokenMap& aBundles) {
+	Lock l(cs);
+
+	auto tmpPath = path + ".tmp";
+	int64_t size = 0;
+
+	{
+		File f(tmpPath, File::WRITE, File::CREATE | File::TRUNCATE);
+		BufferedOutputStream<false> os(&f);
+		writeHeader(os);
+
+		string snapshot;
+		for (const auto& b : aBundles | map_values) {
+			if (b->getStatus() == Bundle::STATUS_NEW) {
+				// Saved once it has been added in the queue
+				continue;
+			}
+
+			snapshot.clear();
+			StringOutputStream sos(snapshot);
+			b->save(sos);
+
+			RecordWriter(RECORD_BUNDLE, b->getToken()).addString(snapshot).write(os);
+		}
+
+		os.flushBuffers(true);
+		size = f.getSize();
+	}
+
+	file.reset();
+	File::renameFile(tmpPath, path);
+
+	// The snapshots include everything that is pending
+	pending.clear();
+	fileSize = size;
+	compactedSize = size;
+}
+
+} // namespace dcpp
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_QUEUE_JOURNAL_H
+#define DCPLUSPLUS_DCPP_QUEUE_JOURNAL_H
+
+#include "forward.h"
+#include "typedefs.h"
+
+#include "Bundle.h"
+#include "CriticalSection.h"
+#include "HintedUser.h"
+#include "Priority.h"
+#include "QueueItemBase.h"
+#include "Segment.h"
+
+namespace dcpp {
+
+/*
+* Append-only log of queue changes
+*
+* The journal contains full snapshots of bundles, followed by the smaller changes made to them afterwards (finished segments,
+* priorities, sources). A new snapshot replaces everything that has been logged for the bundle earlier. The file is compacted
+* by rewriting it with the current snapshots of all bundles once enough changes have accumulated.
+*
+* Each record is prefixed with its length and followed by a checksum, so that a partially written record at the end of the file
+* (e.g. after a crash) can be detected and discarded when the journal is loaded.
+*/
+class QueueJournal {
+public:
+	enum RecordType : uint8_t {
+		RECORD_BUNDLE = 1,
+		RECORD_BUNDLE_REMOVED,
+		RECORD_BUNDLE_PRIORITY,
+		RECORD_ITEM_PRIORITY,
+		RECORD_SEGMENT,
+		RECORD_FILE_FINISHED,
+		RECORD_SOURCE_ADDED,
+		RECORD_SOURCE_REMOVED,
+		RECORD_LAST
+	};
+
+	// A change that should be applied to the bundle snapshot when loading the queue
+	struct Record {
+		RecordType type = RECORD_LAST;
+		string target; // Queue item
+
+		Priority priority = Priority::DEFAULT;
+		bool autoPriority = false;
+
+		Segment segment;
+		string tempTarget;
+		time_t time = 0; // Bundle resume time or file finish time
+
+		string cid;
+		string nick; // Source nick or the last source of a finished file
+		string hubHint;
+	};
+
+	struct BundleLog {
+		string snapshot;
+		vector<Record> records;
+	};
+
+	typedef unordered_map<QueueToken, BundleLog> BundleLogMap;
+
+	// Compact when the journal grows over this size and it's at least twice as large as the previous compacted journal
+	static const int64_t COMPACT_MIN_SIZE = 4 * 1024 * 1024;
+
+	QueueJournal(const string& aPath) noexcept;
+	~QueueJournal();
+
+	QueueJournal(QueueJournal&) = delete;
+	QueueJournal& operator=(QueueJournal&) = delete;
+
+	// Reads the current bundle snapshots and the changes logged after them
+	// Records after the last valid one are discarded from the file
+	// Throws Exception
+	BundleLogMap load();
+
+	// Replaces everything that has been logged for the bundle
+	void appendBundle(Bundle& aBundle) noexcept;
+	void appendBundleRemoved(QueueToken aBundle) noexcept;
+
+	void appendBundlePriority(const Bundle& aBundle) noexcept;
+	void appendItemPriority(QueueToken aBundle, const QueueItem& aQI) noexcept;
+
+	void appendSegment(QueueToken aBundle, const string& aTarget, const string& aTempTarget, const Segment& aSegment) noexcept;
+	void appendFileFinished(QueueToken aBundle, const QueueItem& aQI) noexcept;
+
+	void appendSourceAdded(QueueToken aBundle, const string& aTarget, const HintedUser& aUser) noexcept;
+	void appendSourceRemoved(QueueToken aBundle, const string& aTarget, const UserPtr& aUser) noexcept;
+
+	// Writes the pending records on disk
+	// Throws FileException
+	void flush();
+
+	bool needsCompaction() const noexcept;
+
+	// Rewrites the journal with the snapshots of the given bundles
+	// Throws FileException
+	void compact(const Bundle::TokenMap& aBundles);
+
+	int64_t getSize() const noexcept;
+	const string& getPath() const noexcept { return path; }
+private:
+	class RecordWriter;
+
+	void append(const RecordWriter& aRecord) noexcept;
+	void writeHeader(OutputStream& aStream);
+
+	mutable CriticalSection cs;
+
+	const string path;
+	unique_ptr<File> file;
+
+	// Records that haven't been written on disk yet
+	string pending;
+
+	int64_t fileSize = 0;
+	int64_t compactedSize = 0;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_QUEUE_JOURNAL_H)
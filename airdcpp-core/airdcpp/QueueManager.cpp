@@ -38,6 +38,7 @@
 #include "SearchResult.h"
 #include "ShareManager.h"
 #include "SimpleXMLReader.h"
+#include "Streams.h"
 #include "Transfer.h"
 #include "UploadManager.h"
 #include "UserConnection.h"
@@ -66,7 +67,8 @@ using boost::range::for_each;
 
 QueueManager::QueueManager() : 
 	udp(Socket::TYPE_UDP),
-	tasks(true)
+	tasks(true),
+	journal(Util::getPath(Util::PATH_BUNDLES) + "Queue.journal")
 { 
 	//add listeners in loadQueue
 	File::ensureDirectory(Util::getListPath());
@@ -91,7 +93,10 @@ void QueueManager::shutdown() noexcept {
 				bl.push_back(b);
 			}
 		}
-		for_each(bl.begin(), bl.end(), [=](BundlePtr& b) { bundleQueue.removeBundle(b); });
+		for_each(bl.begin(), bl.end(), [=](BundlePtr& b) { 
+			bundleQueue.removeBundle(b);
+			journal.appendBundleRemoved(b->getToken());
+		});
 	}
 
 	saveQueue(false);
@@ -305,6 +310,9 @@ bool QueueManager::recheckFileImpl(const string& aPath, bool isBundleCheck, int6
 		//Clear segments
 		done = q->getDone();
 		q->resetDownloaded();
+		if (q->getBundle()) {
+			q->getBundle()->setDirty();
+		}
 	}
 
 	TigerTree ttFile(tt.getBlockSize());
@@ -468,6 +476,7 @@ void QueueManager::requestPartialSourceInfo(uint64_t aTick) noexcept {
 
 			params.push_back(param);
 
+			FastLock sourceLock(qi->getCS());
 			source->setPendingQueryCount((uint8_t)(source->getPendingQueryCount() + 1));
 			source->setNextQueryTime(aTick + 300000);		// 5 minutes
 		}
@@ -1129,8 +1138,8 @@ bool QueueManager::addSource(const QueueItemPtr& qi, const HintedUser& aUser, Fl
 	if ((!SETTING(SOURCEFILE).empty()) && (!SETTING(SOUNDS_DISABLED)))
 		PlaySound(Text::toT(SETTING(SOURCEFILE)).c_str(), NULL, SND_FILENAME | SND_ASYNC);
 #endif
-	if (qi->getBundle()) {
-		qi->getBundle()->setDirty();
+	if (isJournaled(qi->getBundle())) {
+		journal.appendSourceAdded(qi->getBundle()->getToken(), qi->getTarget(), aUser);
 	}
 
 	return wantConnection;
@@ -1177,6 +1186,9 @@ Download* QueueManager::getDownload(UserConnection& aSource, const QueueTokenSet
 			if (!Util::fileExists(q->getTempTarget())) {
 				// Temp target gone?
 				q->resetDownloaded();
+				if (q->getBundle()) {
+					q->getBundle()->setDirty();
+				}
 			}
 		}
 
@@ -1395,6 +1407,10 @@ void QueueManager::onFileFinished(const QueueItemPtr& aQI, Download* aDownload,
 	}
 
 	aQI->setLastSource(nicks);
+	if (isJournaled(aQI->getBundle())) {
+		journal.appendFileFinished(aQI->getBundle()->getToken(), *aQI);
+	}
+
 	fire(QueueManagerListener::ItemFinished(), aQI, aListDirectory, aDownload->getHintedUser(), aDownload->getAverageSpeed());
 }
 
@@ -1678,15 +1694,15 @@ void QueueManager::onDownloadFailed(QueueItemPtr& aQI, Download* aDownload, bool
 		WLock l(cs);
 		if (aDownload->getType() == Transfer::TYPE_FILE) {
 			// mark partially downloaded chunk, but align it to block size
-			int64_t downloaded = aDownload->getPos();
+			int64_t downloaded = aDownload->getWrittenPos();
 			downloaded -= downloaded % aDownload->getTigerTree().getBlockSize();
 
 			if (downloaded > 0) {
-				aQI->addFinishedSegment(Segment(aDownload->getStartPos(), downloaded));
-			}
-
-			if (aRotateQueue && aQI->getBundle()) {
-				aQI->getBundle()->rotateUserQueue(aQI, aDownload->getUser());
+				Segment segment(aDownload->getStartPos(), downloaded);
+				aQI->addFinishedSegment(segment);
+				if (isJournaled(aQI->getBundle())) {
+					journal.appendSegment(aQI->getBundle()->getToken(), aQI->getTarget(), aQI->getTempTarget(), segment);
+				}
 			}
 		}
 
@@ -1699,6 +1715,11 @@ void QueueManager::onDownloadFailed(QueueItemPtr& aQI, Download* aDownload, bool
 		}
 
 		userQueue.removeDownload(aQI, aDownload->getToken());
+
+		// Only waiting items can be rotated
+		if (aRotateQueue && aDownload->getType() == Transfer::TYPE_FILE && aQI->getBundle()) {
+			aQI->getBundle()->rotateUserQueue(aQI, aDownload->getUser());
+		}
 	}
 
 	for (const auto& u : getConn) {
@@ -1788,6 +1809,9 @@ void QueueManager::onFileDownloadCompleted(QueueItemPtr& aQI, Download* aDownloa
 			}
 		} else {
 			userQueue.removeDownload(aQI, aDownload->getToken());
+			if (isJournaled(aQI->getBundle())) {
+				journal.appendSegment(aQI->getBundle()->getToken(), aQI->getTarget(), aQI->getTempTarget(), aDownload->getSegment());
+			}
 		}
 	}
 
@@ -1921,6 +1945,7 @@ void QueueManager::removeFileSource(QueueItemPtr& q, const UserPtr& aUser, Flags
 		}
 
 		if (aReason == QueueItem::Source::FLAG_NO_TREE) {
+			FastLock sourceLock(q->getCS());
 			q->getSource(aUser)->setFlag(aReason);
 			if (q->getSize() < MAX_SIZE_WO_TREE) {
 				return;
@@ -1936,7 +1961,10 @@ void QueueManager::removeFileSource(QueueItemPtr& q, const UserPtr& aUser, Flags
 	fire(QueueManagerListener::ItemSources(), q);
 
 	if (q->getBundle()) {
-		q->getBundle()->setDirty();
+		if (isJournaled(q->getBundle())) {
+			journal.appendSourceRemoved(q->getBundle()->getToken(), q->getTarget(), aUser);
+		}
+
 		fire(QueueManagerListener::BundleSources(), q->getBundle());
 	}
 endCheck:
@@ -1996,6 +2024,10 @@ void QueueManager::setBundlePriority(BundlePtr& aBundle, Priority p, bool aKeepA
 	if (oldPrio == p) {
 		if (aBundle->getResumeTime() != aResumeTime) {
 			aBundle->setResumeTime(aResumeTime);
+			if (isJournaled(aBundle)) {
+				journal.appendBundlePriority(*aBundle);
+			}
+
 			fire(QueueManagerListener::BundlePriority(), aBundle);
 		}
 		return;
@@ -2030,7 +2062,9 @@ void QueueManager::setBundlePriority(BundlePtr& aBundle, Priority p, bool aKeepA
 
 	fire(QueueManagerListener::BundlePriority(), aBundle);
 
-	aBundle->setDirty();
+	if (isJournaled(aBundle)) {
+		journal.appendBundlePriority(*aBundle);
+	}
 
 	if (p == Priority::PAUSED_FORCE) {
 		DownloadManager::getInstance()->disconnectBundle(aBundle);
@@ -2072,7 +2106,9 @@ void QueueManager::toggleBundleAutoPriority(BundlePtr& aBundle) noexcept {
 	// Recount priorities as soon as possible
 	setLastAutoPrio(0);
 
-	aBundle->setDirty();
+	if (isJournaled(aBundle)) {
+		journal.appendBundlePriority(*aBundle);
+	}
 }
 
 int QueueManager::removeCompletedBundles() noexcept {
@@ -2153,7 +2189,10 @@ void QueueManager::setQIPriority(QueueItemPtr& q, Priority p, bool aKeepAutoPrio
 
 	fire(QueueManagerListener::ItemPriority(), q);
 
-	b->setDirty();
+	if (isJournaled(b)) {
+		journal.appendItemPriority(b->getToken(), *q);
+	}
+
 	if (p == Priority::PAUSED_FORCE && running) {
 		DownloadManager::getInstance()->abortDownload(q->getTarget());
 	} else if (!q->isPausedPrio()) {
@@ -2185,7 +2224,9 @@ void QueueManager::setQIAutoPriority(const string& aTarget) noexcept {
 	q->setAutoPriority(!q->getAutoPriority());
 	fire(QueueManagerListener::ItemPriority(), q);
 
-	q->getBundle()->setDirty();
+	if (isJournaled(q->getBundle())) {
+		journal.appendItemPriority(q->getBundle()->getToken(), *q);
+	}
 
 	if(q->getAutoPriority()) {
 		if (SETTING(AUTOPRIO_TYPE) == SettingsManager::PRIO_PROGRESS) {
@@ -2257,12 +2298,18 @@ void QueueManager::sendRemovePBD(const HintedUser& aUser, const string& aRemoteT
 
 void QueueManager::saveQueue(bool aForce) noexcept {
 	RLock l(cs);	
-	bundleQueue.saveQueue(aForce);
+	bundleQueue.saveQueue(journal, aForce);
+}
+
+bool QueueManager::isJournaled(const BundlePtr& aBundle) const noexcept {
+	// Bundles that haven't been added in the queue yet are logged as a whole afterwards
+	return aBundle && aBundle->getStatus() != Bundle::STATUS_NEW;
 }
 
 class QueueLoader : public SimpleXMLReader::CallBack {
 public:
-	QueueLoader() : qm(QueueManager::getInstance()) { }
+	// The journal records are applied to the bundle after it has been loaded
+	QueueLoader(const vector<QueueJournal::Record>* aJournalRecords = nullptr) : qm(QueueManager::getInstance()), journalRecords(aJournalRecords) { }
 	~QueueLoader() { }
 	void startTag(const string& name, StringPairList& attribs, bool simple);
 	void endTag(const string& name);
@@ -2275,6 +2322,12 @@ public:
 
 	Priority validatePrio(const string& aPrio);
 private:
+	void addSegment(QueueItemPtr& aQI, const Segment& aSegment);
+	void addSource(const QueueItemPtr& aQI, const string& aCID, const string& aNick, const string& aHubHint);
+
+	void replayJournal();
+	void replayFileFinished(QueueItemPtr& aQI, const QueueJournal::Record& aRecord);
+
 	struct FileBundleInfo {
 		QueueToken token = 0;
 		time_t date = 0;
@@ -2291,6 +2344,7 @@ private:
 
 	int bundleVersion = 0;
 	QueueManager* qm;
+	const vector<QueueJournal::Record>* journalRecords;
 };
 
 void QueueManager::loadQueue(function<void (float)> progressF) noexcept {
@@ -2299,10 +2353,40 @@ void QueueManager::loadQueue(function<void (float)> progressF) noexcept {
 	// migrate old bundles
 	Util::migrate(Util::getPath(Util::PATH_BUNDLES), "Bundle*");
 
-	// multithreaded loading
+	QueueJournal::BundleLogMap bundleLogs;
+	try {
+		bundleLogs = journal.load();
+	} catch (const Exception& e) {
+		LogManager::getInstance()->message("Loading the queue journal failed: " + e.getError(), LogMessage::SEV_ERROR);
+	}
+
+	// Bundle files saved by older versions, converted in the journal after loading
 	StringList fileList = File::findFiles(Util::getPath(Util::PATH_BUNDLES), "Bundle*", File::TYPE_FILE);
+
+	vector<pair<QueueToken, const QueueJournal::BundleLog*>> logList;
+	for (const auto& l : bundleLogs) {
+		logList.emplace_back(l.first, &l.second);
+	}
+
+	const auto total = static_cast<float>(logList.size() + fileList.size());
 	atomic<long> loaded(0);
+
+	// multithreaded loading
 	try {
+		parallel_for_each(logList.begin(), logList.end(), [&](const pair<QueueToken, const QueueJournal::BundleLog*>& aLog) {
+			QueueLoader loader(&aLog.second->records);
+			try {
+				MemoryInputStream is(aLog.second->snapshot);
+				SimpleXMLReader(&loader).parse(is);
+			} catch (const Exception& e) {
+				LogManager::getInstance()->message(STRING_F(BUNDLE_LOAD_FAILED, Util::toString(aLog.first) % e.getError().c_str()), LogMessage::SEV_ERROR);
+				journal.appendBundleRemoved(aLog.first);
+			}
+
+			loaded++;
+			progressF(static_cast<float>(loaded) / total);
+		});
+
 		parallel_for_each(fileList.begin(), fileList.end(), [&](const string& path) {
 			if (Util::getFileExt(path) == ".xml") {
 				QueueLoader loader;
@@ -2315,12 +2399,23 @@ void QueueManager::loadQueue(function<void (float)> progressF) noexcept {
 				}
 			}
 			loaded++;
-			progressF(static_cast<float>(loaded) / static_cast<float>(fileList.size()));
+			progressF(static_cast<float>(loaded) / total);
 		});
 	} catch (std::exception& e) {
 		LogManager::getInstance()->message("Loading the queue failed: " + string(e.what()), LogMessage::SEV_INFO);
 	}
 
+	if (!fileList.empty()) {
+		// Convert the old bundle files
+		try {
+			RLock l(cs);
+			journal.compact(bundleQueue.getBundles());
+			for_each(fileList.begin(), fileList.end(), &File::deleteFile);
+		} catch (const FileException& e) {
+			LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, journal.getPath() % e.getError()), LogMessage::SEV_ERROR);
+		}
+	}
+
 	try {
 		//load the old queue file and delete it
 		auto path = Util::getPath(Util::PATH_USER_CONFIG) + "Queue.xml";
@@ -2553,6 +2648,126 @@ void QueueLoader::loadFinishedFile(StringPairList& attribs, bool) {
 	}
 }
 
+void QueueLoader::addSegment(QueueItemPtr& aQI, const Segment& aSegment) {
+	if (aSegment.getSize() <= 0 || aSegment.getStart() < 0 || aSegment.getEnd() > aQI->getSize()) {
+		dcdebug("Invalid segment: " I64_FMT " " I64_FMT "\n", aSegment.getStart(), aSegment.getSize());
+		return;
+	}
+
+	aQI->addFinishedSegment(aSegment);
+	if (aQI->getAutoPriority() && SETTING(AUTOPRIO_TYPE) == SettingsManager::PRIO_PROGRESS) {
+		auto p = aQI->calculateAutoPriority();
+		if (p != aQI->getPriority()) {
+			// Sources may have been added already when replaying the journal
+			qm->userQueue.setQIPriority(aQI, p);
+		}
+	}
+}
+
+void QueueLoader::addSource(const QueueItemPtr& aQI, const string& aCID, const string& aNick, const string& aHubHint) {
+	auto cm = ClientManager::getInstance();
+	auto user = cm->loadUser(aCID, aHubHint, aNick);
+	if (user == nullptr) {
+		return;
+	}
+
+	try {
+		HintedUser hintedUser(user, aHubHint);
+
+		WLock l(qm->cs);
+		qm->addSource(aQI, hintedUser, 0, false);
+	} catch (const Exception&) {
+		return;
+	}
+}
+
+void QueueLoader::replayFileFinished(QueueItemPtr& aQI, const QueueJournal::Record& aRecord) {
+	WLock l(qm->cs);
+	qm->userQueue.removeQI(aQI, false);
+	qm->bundleQueue.removeBundleItem(aQI, false);
+	aQI->setBundle(nullptr);
+
+	if (!Util::fileExists(aQI->getTarget())) {
+		// Same as for finished files in the bundle snapshot
+		qm->fileQueue.remove(aQI);
+		return;
+	}
+
+	aQI->resetDownloaded();
+	aQI->addFinishedSegment(Segment(0, aQI->getSize()));
+	aQI->setStatus(QueueItem::STATUS_COMPLETED);
+	aQI->setTimeFinished(aRecord.time);
+	aQI->setLastSource(aRecord.nick);
+
+	qm->bundleQueue.addBundleItem(aQI, curBundle);
+}
+
+void QueueLoader::replayJournal() {
+	if (!journalRecords || !curBundle) {
+		return;
+	}
+
+	for (const auto& r : *journalRecords) {
+		if (r.type == QueueJournal::RECORD_BUNDLE_PRIORITY) {
+			WLock l(qm->cs);
+			qm->userQueue.setBundlePriority(curBundle, r.priority);
+			curBundle->setAutoPriority(r.autoPriority);
+			curBundle->setResumeTime(r.time);
+
+			if (curBundle->isFileBundle() && !curBundle->getQueueItems().empty()) {
+				auto qi = curBundle->getQueueItems().front();
+				qm->userQueue.setQIPriority(qi, r.priority);
+				qi->setAutoPriority(r.autoPriority);
+			}
+
+			continue;
+		}
+
+		// Finished and removed files aren't found
+		auto qi = curBundle->findQI(r.target);
+		if (!qi) {
+			continue;
+		}
+
+		switch (r.type) {
+			case QueueJournal::RECORD_ITEM_PRIORITY: {
+				WLock l(qm->cs);
+				qm->userQueue.setQIPriority(qi, r.priority);
+				qi->setAutoPriority(r.autoPriority);
+				break;
+			}
+			case QueueJournal::RECORD_SEGMENT: {
+				WLock l(qm->cs);
+				if (!r.tempTarget.empty()) {
+					qi->setTempTarget(r.tempTarget);
+				}
+
+				addSegment(qi, r.segment);
+				break;
+			}
+			case QueueJournal::RECORD_FILE_FINISHED: {
+				replayFileFinished(qi, r);
+				break;
+			}
+			case QueueJournal::RECORD_SOURCE_ADDED: {
+				addSource(qi, r.cid, r.nick, r.hubHint);
+				break;
+			}
+			case QueueJournal::RECORD_SOURCE_REMOVED: {
+				auto user = ClientManager::getInstance()->findUser(CID(r.cid));
+
+				WLock l(qm->cs);
+				if (user && qi->isSource(user)) {
+					qm->userQueue.removeQI(qi, user, false, 0);
+					qi->removeSource(user, 0);
+				}
+				break;
+			}
+			default: break;
+		}
+	}
+}
+
 void QueueLoader::startTag(const string& name, StringPairList& attribs, bool simple) {
 	if(!inLegacyQueue && name == "Downloads") {
 		inLegacyQueue = true;
@@ -2566,34 +2781,12 @@ void QueueLoader::startTag(const string& name, StringPairList& attribs, bool sim
 		} else if(curFile && name == sSegment) {
 			auto start = Util::toInt64(getAttrib(attribs, sStart, 0));
 			auto size = Util::toInt64(getAttrib(attribs, sSize, 1));
-			
-			if(size > 0 && start >= 0 && (start + size) <= curFile->getSize()) {
-				curFile->addFinishedSegment(Segment(start, size));
-				if (curFile->getAutoPriority() && SETTING(AUTOPRIO_TYPE) == SettingsManager::PRIO_PROGRESS) {
-					curFile->setPriority(curFile->calculateAutoPriority());
-				}
-			} else {
-				dcdebug("Invalid segment: " I64_FMT " " I64_FMT "\n", start, size);
-			}
+			addSegment(curFile, Segment(start, size));
 		} else if(curFile && name == sSource) {
 			const string& cid = getAttrib(attribs, sCID, 0);
 			const string& nick = getAttrib(attribs, sNick, 1);
 			const string& hubHint = getAttrib(attribs, sHubHint, 2);
-
-			auto cm = ClientManager::getInstance();
-			auto user = cm->loadUser(cid, hubHint, nick);
-			if (user == nullptr) {
-				return;
-			}
-
-			try {
-				HintedUser hintedUser(user, hubHint);
-			
-				WLock l(qm->cs);
-				qm->addSource(curFile, hintedUser, 0, false);
-			} catch (const Exception&) {
-				return;
-			}
+			addSource(curFile, cid, nick, hubHint);
 		} else if (name == sFinished && (inDirBundle || inFileBundle)) {
 			loadFinishedFile(attribs, simple);
 		} else {
@@ -2610,6 +2803,7 @@ void QueueLoader::endTag(const string& name) {
 			// Directory bundle
 			ScopedFunctor([this] { curBundle = nullptr; });
 			inDirBundle = false;
+			replayJournal();
 			if (!curBundle || curBundle->isEmpty()) {
 				throw Exception(STRING_F(NO_FILES_WERE_LOADED, curBundle->getTarget()));
 			} else {
@@ -2620,6 +2814,7 @@ void QueueLoader::endTag(const string& name) {
 			ScopedFunctor([this] { curBundle = nullptr; });
 			curFileBundleInfo = FileBundleInfo();
 			inFileBundle = false;
+			replayJournal();
 			if (!curBundle || curBundle->isEmpty())
 				throw Exception(STRING(NO_FILES_FROM_FILE));
 
@@ -3136,11 +3331,15 @@ bool QueueManager::handlePartialResult(const HintedUser& aUser, const TTHValue&
 				// add this user as partial file sharing source
 				qi->addSource(aUser);
 				si = qi->getSource(aUser);
-				si->setFlag(QueueItem::Source::FLAG_PARTIAL);
 
 				auto ps = make_shared<QueueItem::PartialSource>(partialSource.getMyNick(),
 					partialSource.getHubIpPort(), partialSource.getIp(), partialSource.getUdpPort());
-				si->setPartialSource(ps);
+
+				{
+					FastLock sourceLock(qi->getCS());
+					si->setFlag(QueueItem::Source::FLAG_PARTIAL);
+					si->setPartialSource(ps);
+				}
 
 				userQueue.addQI(qi, aUser);
 				dcassert(si != qi->getSources().end());
@@ -3149,6 +3348,7 @@ bool QueueManager::handlePartialResult(const HintedUser& aUser, const TTHValue&
 
 		// Update source's parts info
 		if(si->getPartialSource()) {
+			FastLock sourceLock(qi->getCS());
 			si->getPartialSource()->setPartialInfo(partialSource.getPartialInfo());
 		}
 	}
@@ -3513,7 +3713,11 @@ void QueueManager::removeBundleItem(QueueItemPtr& qi, bool aFinished) noexcept{
 		fire(QueueManagerListener::SourceFilesUpdated(), u);
 
 	fire(QueueManagerListener::BundleSources(), bundle);
-	bundle->setDirty();
+
+	// Finished files are logged separately
+	if (!aFinished || emptyBundle) {
+		bundle->setDirty();
+	}
 }
 
 bool QueueManager::removeBundle(QueueToken aBundleToken, bool removeFinishedFiles) noexcept {
@@ -3578,6 +3782,7 @@ void QueueManager::removeBundle(BundlePtr& aBundle, bool aRemoveFinishedFiles) n
 		}
 
 		bundleQueue.removeBundle(aBundle);
+		journal.appendBundleRemoved(aBundle->getToken());
 	}
 
 	//Delete files outside lock range, waking up disks can take a long time.
@@ -35,6 +35,7 @@
 #include "FileQueue.h"
 #include "HashBloom.h"
 #include "MerkleTree.h"
+#include "QueueJournal.h"
 #include "Singleton.h"
 #include "Socket.h"
 #include "StringMatch.h"
@@ -163,19 +164,20 @@ public:
 	// Set the maximum number of segments for the specified target
 	void setSegments(const string& aTarget, uint8_t aSegments) noexcept;
 
-	bool isWaiting(const QueueItemPtr& qi) const noexcept { RLock l(cs); return qi->isWaiting(); }
+	// The following only lock the item so that they won't have to wait for the queue lock
+	bool isWaiting(const QueueItemPtr& qi) const noexcept { FastLock l(qi->getCS()); return qi->isWaiting(); }
 
-	uint64_t getDownloadedBytes(const QueueItemPtr& qi) const noexcept { RLock l(cs); return qi->getDownloadedBytes(); }
-	uint64_t getSecondsLeft(const QueueItemPtr& qi) const noexcept{ RLock l(cs); return qi->getSecondsLeft(); }
-	uint64_t getAverageSpeed(const QueueItemPtr& qi) const noexcept{ RLock l(cs); return qi->getAverageSpeed(); }
+	uint64_t getDownloadedBytes(const QueueItemPtr& qi) const noexcept { FastLock l(qi->getCS()); return qi->getDownloadedBytes(); }
+	uint64_t getSecondsLeft(const QueueItemPtr& qi) const noexcept{ FastLock l(qi->getCS()); return qi->getSecondsLeft(); }
+	uint64_t getAverageSpeed(const QueueItemPtr& qi) const noexcept{ FastLock l(qi->getCS()); return qi->getAverageSpeed(); }
 
-	QueueItem::SourceList getSources(const QueueItemPtr& qi) const noexcept { RLock l(cs); return qi->getSources(); }
-	QueueItem::SourceList getBadSources(const QueueItemPtr& qi) const noexcept { RLock l(cs); return qi->getBadSources(); }
+	QueueItem::SourceList getSources(const QueueItemPtr& qi) const noexcept { FastLock l(qi->getCS()); return qi->getSources(); }
+	QueueItem::SourceList getBadSources(const QueueItemPtr& qi) const noexcept { FastLock l(qi->getCS()); return qi->getBadSources(); }
 
-	Bundle::SourceList getBundleSources(const BundlePtr& b) const noexcept { RLock l(cs); return b->getSources(); }
-	Bundle::SourceList getBadBundleSources(const BundlePtr& b) const noexcept { RLock l(cs); return b->getBadSources(); }
+	Bundle::SourceList getBundleSources(const BundlePtr& b) const noexcept { FastLock l(b->getCS()); return b->getSources(); }
+	Bundle::SourceList getBadBundleSources(const BundlePtr& b) const noexcept { FastLock l(b->getCS()); return b->getBadSources(); }
 
-	void getChunksVisualisation(const QueueItemPtr& qi, vector<Segment>& running, vector<Segment>& downloaded, vector<Segment>& done) const noexcept { RLock l(cs); qi->getChunksVisualisation(running, downloaded, done); }
+	void getChunksVisualisation(const QueueItemPtr& qi, vector<Segment>& running, vector<Segment>& downloaded, vector<Segment>& done) const noexcept { FastLock l(qi->getCS()); qi->getChunksVisualisation(running, downloaded, done); }
 
 
 	// Get information about the next valid file in the queue
@@ -223,6 +225,9 @@ public:
 	void setMatchers() noexcept;
 
 	SharedMutex& getCS() { return cs; }
+
+	// Lock operations of the queue lock that had to wait for other threads
+	InstrumentedSharedMutex::Stats getLockStats() const noexcept { return cs.getStats(); }
 	// Locking must be handled by the caller
 	const Bundle::TokenMap& getBundles() const { return bundleQueue.getBundles(); }
 	// Locking must be handled by the caller
@@ -396,7 +401,11 @@ private:
 	QueueManager();
 	~QueueManager();
 	
-	mutable SharedMutex cs;
+	// The lock types of the class are instrumented for the lock wait statistics
+	typedef InstrumentedRLock RLock;
+	typedef InstrumentedWLock WLock;
+
+	mutable InstrumentedSharedMutex cs;
 
 	Socket udp;
 
@@ -409,6 +418,12 @@ private:
 	/** QueueItems by user */
 	UserQueue userQueue;
 
+	/** Changes to the bundles since they were last saved */
+	QueueJournal journal;
+
+	// Whether changes to the bundle should be logged in the journal
+	bool isJournaled(const BundlePtr& aBundle) const noexcept;
+
 	/** File lists not to delete */
 	StringList protectedFileLists;
 
@@ -19,6 +19,7 @@
 #include "stdinc.h"
 #include "SSLSocket.h"
 
+#include "File.h"
 #include "LogManager.h"
 #include "SettingsManager.h"
 #include "ResourceManager.h"
@@ -27,6 +28,11 @@
 
 #include <openssl/err.h>
 
+// Kernel TLS requires OpenSSL 3.0 built with kTLS support
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+# define USE_KTLS
+#endif
+
 namespace dcpp {
 
 SSLSocket::SSLSocket(CryptoManager::SSLContext context, bool allowUntrusted, const string& expKP) : SSLSocket(context) {
@@ -52,6 +58,8 @@ bool SSLSocket::waitConnected(uint64_t millis) {
 		if(!ssl)
 			checkSSL(-1);
 
+		enableKernelOffload();
+
 		if(!verifyData) {
 			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
 		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
@@ -84,6 +92,8 @@ bool SSLSocket::waitAccepted(uint64_t millis) {
 		if(!ssl)
 			checkSSL(-1);
 
+		enableKernelOffload();
+
 		if(!verifyData) {
 			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
 		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
@@ -147,6 +157,45 @@ int SSLSocket::write(const void* aBuffer, int aLen) {
 	return ret;
 }
 
+void SSLSocket::enableKernelOffload() noexcept {
+#ifdef USE_KTLS
+	if (SETTING(TLS_KERNEL_OFFLOAD)) {
+		// Connections using ciphers that the kernel doesn't support will fall back to user space encryption
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+	}
+#endif
+}
+
+bool SSLSocket::isSendFileSupported() const noexcept {
+#ifdef USE_KTLS
+	return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+	return false;
+#endif
+}
+
+int SSLSocket::sendFile(File& aFile, int64_t& aPos, int aLen) {
+#ifdef USE_KTLS
+	if(!ssl) {
+		return -1;
+	}
+
+	if(aPos >= aFile.getSize()) {
+		return 0;
+	}
+
+	int ret = checkSSL(static_cast<int>(SSL_sendfile(ssl, aFile.getNativeHandle(), aPos, aLen, 0)));
+	if(ret > 0) {
+		aPos += ret;
+		stats.totalUp += ret;
+	}
+	return ret;
+#else
+	dcassert(0);
+	throw SSLSocketException(STRING(TLS_ERROR));
+#endif
+}
+
 int SSLSocket::checkSSL(int ret) {
 	if(!ssl) {
 		return -1;
@@ -236,6 +285,13 @@ std::string SSLSocket::getEncryptionInfo() const noexcept {
 
 	string cipher = SSL_get_cipher_name(ssl);
 	string protocol = SSL_get_version(ssl);
+
+#ifdef USE_KTLS
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl)) || BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+		cipher += " (kTLS)";
+	}
+#endif
+
 	return protocol + " / " + cipher;
 }
 
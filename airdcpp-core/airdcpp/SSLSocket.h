@@ -57,6 +57,10 @@ public:
 	virtual void close() noexcept override;
 
 	virtual bool isSecure() const noexcept override { return true; }
+
+	// Requires kernel TLS offload to be active for the connection
+	virtual int sendFile(File& aFile, int64_t& aPos, int aLen) override;
+	virtual bool isSendFileSupported() const noexcept override;
 	virtual bool isTrusted() const noexcept override;
 	virtual bool isKeyprintMatch() const noexcept override;
 	virtual string getEncryptionInfo() const noexcept override;
@@ -75,6 +79,9 @@ private:
 
 	int checkSSL(int ret);
 	bool waitWant(int ret, uint64_t millis);
+
+	// Let OpenSSL pass the session keys to the kernel after the handshake (if enabled)
+	void enableKernelOffload() noexcept;
 };
 
 } // namespace dcpp
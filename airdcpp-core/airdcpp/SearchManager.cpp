@@ -56,7 +56,7 @@ bool SearchManager::isDefaultTypeStr(const string& type) noexcept {
 	 return type.size() == 1 && type[0] >= '0' && type[0] <= '9';
 }
 
-SearchManager::SearchManager() {
+SearchManager::SearchManager() : incomingSearchDispatcher(true) {
 	setSearchTypeDefaults();
 	TimerManager::getInstance()->addListener(this);
 	SettingsManager::getInstance()->addListener(this);
@@ -475,43 +475,102 @@ void SearchManager::onPSR(const AdcCommand& aCmd, UserPtr from, const string& re
 
 }
 
-void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile) {
-	auto isDirect = adc.getType() == 'D';
-	string path = ADC_ROOT_STR, key;
-	int maxResults = isUdpActive ? 10 : 5;
+SearchManager::IncomingSearch::IncomingSearch(const AdcCommand& aCmd, OnlineUser& aUser, bool aIsUdpActive, const string& aHubIpPort, ProfileToken aProfile) noexcept :
+	cmd(aCmd), user(&aUser), isUdpActive(aIsUdpActive), hubIpPort(aHubIpPort), profile(aProfile), maxResults(aIsUdpActive ? 10 : 5) {
 
-	bool replyDirect = false;
-	if (isDirect) {
-		adc.getParam("PA", 0, path);
-		replyDirect = adc.hasFlag("RE", 0);
+	if (cmd.getType() == 'D') {
+		cmd.getParam("PA", 0, path);
+		replyDirect = cmd.hasFlag("RE", 0);
 
 		string tmp;
-		if (adc.getParam("MR", 0, tmp)) 
+		if (cmd.getParam("MR", 0, tmp)) 
 			maxResults = min(isUdpActive ? 20 : 10, Util::toInt(tmp));
 	}
 
-	SearchResultList results;
-	SearchQuery srch(adc.getParameters(), maxResults);
+	cmd.getParam("TO", 0, token);
+}
 
-	string token;
-	adc.getParam("TO", 0, token);
+void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile) {
+	if (SETTING(BATCH_INCOMING_SEARCHES)) {
+		// Searches received while the previous batch is being matched will be handled together
+		bool dispatch = false;
+
+		{
+			Lock l(incomingSearchCS);
+			dispatch = incomingSearches.empty();
+			incomingSearches.emplace_back(adc, aUser, isUdpActive, hubIpPort, aProfile);
+		}
+
+		if (dispatch) {
+			incomingSearchDispatcher.addTask([this] { handleIncomingSearches(); });
+		}
+
+		return;
+	}
+
+	IncomingSearch search(adc, aUser, isUdpActive, hubIpPort, aProfile);
+
+	SearchResultList results;
+	SearchQuery srch(adc.getParameters(), search.maxResults);
 
 	try {
-		ShareManager::getInstance()->adcSearch(results, srch, aProfile, aUser.getUser()->getCID(), path, token.find("/as") != string::npos);
+		ShareManager::getInstance()->adcSearch(results, srch, aProfile, aUser.getUser()->getCID(), search.path, search.isAutoSearch());
 	} catch(const ShareException& e) {
-		if (replyDirect) {
-			//path not found (direct search)
-			AdcCommand c(AdcCommand::SEV_FATAL, AdcCommand::ERROR_FILE_NOT_AVAILABLE, e.getError(), AdcCommand::TYPE_DIRECT);
-			c.setTo(aUser.getIdentity().getSID());
-			c.addParam("TO", token);
+		sendSearchError(search, e.getError());
+		return;
+	}
 
-			aUser.getClient()->send(c);
+	sendSearchResults(search, results);
+}
+
+void SearchManager::handleIncomingSearches() noexcept {
+	vector<IncomingSearch> searches;
+
+	{
+		Lock l(incomingSearchCS);
+		searches.swap(incomingSearches);
+	}
+
+	// The batch keeps references to the queries
+	deque<SearchQuery> queries;
+
+	ShareManager::SearchBatch batch;
+	batch.reserve(searches.size());
+	for (const auto& s : searches) {
+		queries.emplace_back(s.cmd.getParameters(), s.maxResults);
+		batch.emplace_back(queries.back(), s.profile, s.user->getUser()->getCID(), s.path, s.isAutoSearch());
+	}
+
+	ShareManager::getInstance()->adcSearch(batch);
+
+	for (size_t i = 0; i < searches.size(); ++i) {
+		if (!batch[i].error.empty()) {
+			sendSearchError(searches[i], batch[i].error);
+		} else {
+			sendSearchResults(searches[i], batch[i].results);
 		}
-		return;
 	}
+}
+
+void SearchManager::sendSearchError(const IncomingSearch& aSearch, const string& aError) noexcept {
+	if (aSearch.replyDirect) {
+		//path not found (direct search)
+		AdcCommand c(AdcCommand::SEV_FATAL, AdcCommand::ERROR_FILE_NOT_AVAILABLE, aError, AdcCommand::TYPE_DIRECT);
+		c.setTo(aSearch.user->getIdentity().getSID());
+		c.addParam("TO", aSearch.token);
+
+		aSearch.user->getClient()->send(c);
+	}
+}
+
+void SearchManager::sendSearchResults(const IncomingSearch& aSearch, const SearchResultList& results) noexcept {
+	const auto& adc = aSearch.cmd;
+	auto& aUser = *aSearch.user;
+
+	string key;
 
 	// TODO: don't send replies to passive users
-	if(results.empty() && SETTING(USE_PARTIAL_SHARING) && aProfile != SP_HIDDEN) {
+	if(results.empty() && SETTING(USE_PARTIAL_SHARING) && aSearch.profile != SP_HIDDEN) {
 		string tth;
 		if(!adc.getParam("TR", 0, tth))
 			goto end;
@@ -523,13 +582,13 @@ void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdp
 
 		if (!partialInfo.empty()) {
 			//LogManager::getInstance()->message("SEARCH RESPOND: PARTIALINFO NOT EMPTY");
-			AdcCommand cmd = toPSR(isUdpActive, Util::emptyString, hubIpPort, tth, partialInfo);
+			AdcCommand cmd = toPSR(aSearch.isUdpActive, Util::emptyString, aSearch.hubIpPort, tth, partialInfo);
 			ClientManager::getInstance()->sendUDP(cmd, aUser.getUser()->getCID(), false, true, Util::emptyString, aUser.getHubUrl());
 		}
 		
 		if (!bundle.empty()) {
 			//LogManager::getInstance()->message("SEARCH RESPOND: BUNDLE NOT EMPTY");
-			AdcCommand cmd = toPBD(hubIpPort, bundle, tth, reply, add);
+			AdcCommand cmd = toPBD(aSearch.hubIpPort, bundle, tth, reply, add);
 			ClientManager::getInstance()->sendUDP(cmd, aUser.getUser()->getCID(), false, true, Util::emptyString, aUser.getHubUrl());
 		}
 
@@ -540,17 +599,17 @@ void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdp
 	adc.getParam("KY", 0, key);
 	for(const auto& sr: results) {
 		AdcCommand cmd = sr->toRES(AdcCommand::TYPE_UDP);
-		if(!token.empty())
-			cmd.addParam("TO", token);
+		if(!aSearch.token.empty())
+			cmd.addParam("TO", aSearch.token);
 		ClientManager::getInstance()->sendUDP(cmd, aUser.getUser()->getCID(), false, false, key, aUser.getHubUrl());
 	}
 
 end:
-	if (replyDirect) {
+	if (aSearch.replyDirect) {
 		AdcCommand c(AdcCommand::SEV_SUCCESS, AdcCommand::SUCCESS, "Succeed", AdcCommand::TYPE_DIRECT);
 		c.setTo(aUser.getIdentity().getSID());
 		c.addParam("FC", adc.getFourCC());
-		c.addParam("TO", token);
+		c.addParam("TO", aSearch.token);
 		c.addParam("RC", Util::toString(results.size()));
 
 		aUser.getClient()->send(c);
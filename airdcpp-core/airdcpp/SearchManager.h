@@ -26,6 +26,7 @@
 
 #include "AdcCommand.h"
 #include "CriticalSection.h"
+#include "DispatcherQueue.h"
 #include "Search.h"
 #include "Singleton.h"
 #include "Speaker.h"
@@ -123,6 +124,34 @@ private:
 	SearchTypesIter getSearchType(const string& name);
 
 	UDPServer udpServer;
+
+	struct IncomingSearch {
+		IncomingSearch(const AdcCommand& aCmd, OnlineUser& aUser, bool aIsUdpActive, const string& aHubIpPort, ProfileToken aProfile) noexcept;
+
+		const AdcCommand cmd;
+		const OnlineUserPtr user;
+		const bool isUdpActive;
+		const string hubIpPort;
+		const ProfileToken profile;
+
+		string path = ADC_ROOT_STR;
+		string token;
+		int maxResults;
+		bool replyDirect = false;
+
+		bool isAutoSearch() const noexcept { return token.find("/as") != string::npos; }
+	};
+
+	// Match all searches that have been queued since the previous call with a single share pass
+	void handleIncomingSearches() noexcept;
+
+	void sendSearchResults(const IncomingSearch& aSearch, const SearchResultList& aResults) noexcept;
+	void sendSearchError(const IncomingSearch& aSearch, const string& aError) noexcept;
+
+	CriticalSection incomingSearchCS;
+	vector<IncomingSearch> incomingSearches;
+
+	DispatcherQueue incomingSearchDispatcher;
 };
 
 } // namespace dcpp
@@ -233,6 +233,7 @@ const string SettingsManager::settingTags[] =
 "SearchHistoryMax", "ExcludeHistoryMax", "DirectoryHistoryMax", "MinDupeCheckSize", "DbCacheSize", "DLAutoDisconnectMode", "RemovedTrees", "RemovedFiles", "MultithreadedRefresh", "MonitoringMode",
 "MonitoringDelay", "DelayCountMode", "MaxRunningBundles", "DefaultShareProfile", "UpdateChannel", "ColorStatusFinished", "ColorStatusShared", "ProgressLighten",
 "ConfigBuildNumber", "PmMessageCache", "HubMessageCache", "LogMessageCache", "MaxRecentHubs", "MaxRecentPrivateChats", "MaxRecentFilelists",
+"HasherWorkerThreads", "SocketIOThreads",
 "SENTRY",
 
 // Bools
@@ -281,6 +282,7 @@ const string SettingsManager::settingTags[] =
 	"FilterFLShared", "FilterFLQueued", "FilterFLInversed", "FilterFLTop", "FilterFLPartialDupes", "FilterFLResetChange", "FilterSearchShared", "FilterSearchQueued", "FilterSearchInversed", "FilterSearchTop", "FilterSearchPartialDupes", "FilterSearchResetChange",
 	"SearchAschOnlyMan", "UseUploadBundles", "CloseMinimize", "LogIgnored", "UsersFilterIgnore", "NfoExternal", "SingleClickTray", "QueueShowFinished", "RemoveFinishedBundles", "LogCRCOk",
 	"FilterQueueInverse", "FilterQueueTop", "FilterQueueReset", "AlwaysCCPM", "OpenAutoSearch", "SaveLastState",
+	"ParallelSearchMatching", "BatchIncomingSearches", "IncrementalRefresh", "TLSKernelOffload",
 	"SENTRY",
 	// Int64
 	"TotalUpload", "TotalDownload",
@@ -418,6 +420,7 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(NO_IP_OVERRIDE6, false);
 	setDefault(SOCKET_IN_BUFFER, 64*1024);
 	setDefault(SOCKET_OUT_BUFFER, 64*1024);
+	setDefault(SOCKET_IO_THREADS, 4);
 	setDefault(OPEN_WAITING_USERS, false);
 	setDefault(TLS_TRUSTED_CERTIFICATES_PATH, Util::getPath(Util::PATH_USER_CONFIG) + "Certificates" PATH_SEPARATOR_STR);
 	setDefault(TLS_PRIVATE_KEY_FILE, Util::getPath(Util::PATH_USER_CONFIG) + "Certificates" PATH_SEPARATOR_STR "client.key");
@@ -832,6 +835,7 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(MAX_HASHING_THREADS, std::thread::hardware_concurrency());
 
 	setDefault(HASHERS_PER_VOLUME, 1);
+	setDefault(HASHER_WORKER_THREADS, 2);
 
 	setDefault(MIN_DUPE_CHECK_SIZE, 512);
 	setDefault(WARN_ELEVATED, true);
@@ -848,6 +852,10 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 
 	setDefault(DL_AUTO_DISCONNECT_MODE, QUEUE_FILE);
 	setDefault(REFRESH_THREADING, MULTITHREAD_MANUAL);
+	setDefault(PARALLEL_SEARCH_MATCHING, false);
+	setDefault(BATCH_INCOMING_SEARCHES, false);
+	setDefault(INCREMENTAL_REFRESH, false);
+	setDefault(TLS_KERNEL_OFFLOAD, false);
 
 	setDefault(REMOVE_EXPIRED_AS, false);
 
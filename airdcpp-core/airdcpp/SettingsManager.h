@@ -119,6 +119,7 @@ public:
 		HISTORY_SEARCH_MAX, HISTORY_DIR_MAX, HISTORY_EXCLUDE_MAX, MIN_DUPE_CHECK_SIZE, DB_CACHE_SIZE, DL_AUTO_DISCONNECT_MODE, CUR_REMOVED_TREES, CUR_REMOVED_FILES, REFRESH_THREADING, MONITORING_MODE,
 		MONITORING_DELAY, DELAY_COUNT_MODE, MAX_RUNNING_BUNDLES, DEFAULT_SP, UPDATE_CHANNEL, COLOR_STATUS_FINISHED, COLOR_STATUS_SHARED, PROGRESS_LIGHTEN,
 		CONFIG_BUILD_NUMBER, PM_MESSAGE_CACHE, HUB_MESSAGE_CACHE, LOG_MESSAGE_CACHE, MAX_RECENT_HUBS, MAX_RECENT_PRIVATE_CHATS, MAX_RECENT_FILELISTS,
+		HASHER_WORKER_THREADS, SOCKET_IO_THREADS,
 		INT_LAST };
 
 	enum BoolSetting { BOOL_FIRST = INT_LAST + 1,
@@ -168,6 +169,7 @@ public:
 		FILTER_FL_SHARED, FILTER_FL_QUEUED, FILTER_FL_INVERSED, FILTER_FL_TOP, FILTER_FL_PARTIAL_DUPES, FILTER_FL_RESET_CHANGE, FILTER_SEARCH_SHARED, FILTER_SEARCH_QUEUED, FILTER_SEARCH_INVERSED, FILTER_SEARCH_TOP, FILTER_SEARCH_PARTIAL_DUPES, FILTER_SEARCH_RESET_CHANGE,
 		SEARCH_ASCH_ONLY, USE_UPLOAD_BUNDLES, CLOSE_USE_MINIMIZE, LOG_IGNORED, USERS_FILTER_IGNORE, NFO_EXTERNAL, SINGLE_CLICK_TRAY, QUEUE_SHOW_FINISHED, REMOVE_FINISHED_BUNDLES, LOG_CRC_OK,
 		FILTER_QUEUE_INVERSED, FILTER_QUEUE_TOP, FILTER_QUEUE_RESET_CHANGE, ALWAYS_CCPM, OPEN_AUTOSEARCH, SAVE_LAST_STATE,
+		PARALLEL_SEARCH_MATCHING, BATCH_INCOMING_SEARCHES, INCREMENTAL_REFRESH, TLS_KERNEL_OFFLOAD,
 		BOOL_LAST };
 
 	enum Int64Setting { INT64_FIRST = BOOL_LAST + 1,
@@ -46,6 +46,8 @@
 
 #include "concurrency.h"
 
+#include <thread>
+
 namespace dcpp {
 
 using std::string;
@@ -122,7 +124,7 @@ void ShareManager::abortRefresh() noexcept {
 }
 
 void ShareManager::shutdown(function<void(float)> progressF) noexcept {
-	saveXmlList(progressF);
+	saveShareCache(progressF);
 
 	try {
 		RLock l (cs);
@@ -159,16 +161,70 @@ void ShareManager::setProfilesDirty(const ProfileTokenSet& aProfiles, bool aIsMa
 	}
 }
 
+static atomic<uint64_t> directoryRevisionCounter(0);
+
 ShareManager::Directory::Directory(DualString&& aRealName, const ShareManager::Directory::Ptr& aParent, time_t aLastWrite, const RootDirectory::Ptr& aRoot) :
 	parent(aParent.get()),
 	root(aRoot),
+	revision(++directoryRevisionCounter),
 	lastWrite(aLastWrite),
 	realName(move(aRealName))
 {
 }
 
+void ShareManager::Directory::increaseRevision() noexcept {
+	for (auto d = this; d; d = d->parent) {
+		d->revision = ++directoryRevisionCounter;
+	}
+}
+
 ShareManager::Directory::~Directory() { 
-	for_each(files, DeleteFunction());
+	for (auto f : files) {
+		fileStorage.destroy(f);
+	}
+}
+
+void ShareManager::Directory::FileStorage::addBlock(size_t aSize) {
+	dcassert(aSize > 0);
+	blocks.emplace_back(new Slot[aSize]);
+
+	// Hand out the slots in order so that the records added together stay next to each other
+	auto block = blocks.back().get();
+	for (auto i = aSize; i > 0; --i) {
+		block[i - 1].next = freeSlots;
+		freeSlots = &block[i - 1];
+	}
+
+	freeCount += aSize;
+	capacity += aSize;
+}
+
+void ShareManager::Directory::FileStorage::reserve(size_t aCount) {
+	if (aCount > freeCount) {
+		addBlock(aCount - freeCount);
+	}
+}
+
+ShareManager::Directory::File* ShareManager::Directory::FileStorage::create(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) {
+	if (!freeSlots) {
+		addBlock(min(max(capacity / 2, static_cast<size_t>(4)), MAX_GROW_BLOCK));
+	}
+
+	auto slot = freeSlots;
+	auto f = new (&slot->record) File(move(aName), aParent, aFileInfo);
+
+	freeSlots = slot->next;
+	freeCount--;
+	return f;
+}
+
+void ShareManager::Directory::FileStorage::destroy(File* aFile) noexcept {
+	aFile->~File();
+
+	auto slot = reinterpret_cast<Slot*>(aFile);
+	slot->next = freeSlots;
+	freeSlots = slot;
+	freeCount++;
 }
 
 void ShareManager::Directory::updateModifyDate() {
@@ -292,7 +348,11 @@ bool ShareManager::Directory::hasProfile(const ProfileTokenSet& aProfiles) const
 }
 
 
-void ShareManager::Directory::copyRootProfiles(ProfileTokenSet& profiles_, bool aSetCacheDirty) const noexcept {
+void ShareManager::Directory::copyRootProfiles(ProfileTokenSet& profiles_, bool aSetCacheDirty) noexcept {
+	if (aSetCacheDirty) {
+		revision = ++directoryRevisionCounter;
+	}
+
 	if (root) {
 		boost::copy(root->getRootProfiles(), inserter(profiles_, profiles_.begin()));
 		if (aSetCacheDirty)
@@ -708,7 +768,7 @@ void ShareManager::loadProfile(SimpleXML& aXml, const string& aName, ProfileToke
 
 			// Validate in case we have changed the rules
 			auto vName = validateVirtualName(loadedVirtualName.empty() ? Util::getLastDir(realPath) : loadedVirtualName);
-			Directory::createRoot(realPath, vName, { aToken }, incoming, 0, rootPaths, lowerDirNameMap, *bloom.get(), lastRefreshTime);
+			Directory::createRoot(realPath, vName, { aToken }, incoming, 0, rootPaths, lowerDirNameMap, searchIndex, *bloom.get(), lastRefreshTime);
 		}
 	}
 
@@ -763,7 +823,7 @@ void ShareManager::on(SettingsManagerListener::LoadCompleted, bool) noexcept {
 			if (find_if(rootPathsCopy | map_keys, [&dp](const string& aPath) {
 				return AirUtil::isSubLocal(dp.first, aPath);
 			}).base() != rootPathsCopy.end()) {
-				removeDirName(*dp.second.get(), lowerDirNameMap);
+				removeDirName(*dp.second.get(), lowerDirNameMap, searchIndex);
 				rootPaths.erase(dp.first);
 
 				LogManager::getInstance()->message("The directory " + dp.first + " was not loaded: parent of this directory is shared in another profile, which is not supported in this client version.", LogMessage::SEV_WARNING);
@@ -796,7 +856,7 @@ OptionalProfileToken ShareManager::getProfileByName(const string& aName) const n
 	return (*p)->getToken();
 }
 
-ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom) noexcept {
+ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, SearchIndex& searchIndex_, ShareBloom& bloom) noexcept {
 	auto dir = Ptr(new Directory(move(aRealName), aParent, aLastWrite, nullptr));
 
 	if (aParent) {
@@ -804,21 +864,23 @@ ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&&
 		if (!added) {
 			return nullptr;
 		}
+
+		aParent->increaseRevision();
 	}
 
-	addDirName(dir, dirNameMap_, bloom);
+	addDirName(dir, dirNameMap_, searchIndex_, bloom);
 	return dir;
 }
 
 ShareManager::Directory::Ptr ShareManager::Directory::createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, 
-	time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom, time_t aLastRefreshTime) noexcept
+	time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, SearchIndex& searchIndex_, ShareBloom& bloom, time_t aLastRefreshTime) noexcept
 {
 	auto dir = Ptr(new Directory(Util::getLastDir(aRootPath), nullptr, aLastWrite, RootDirectory::create(aRootPath, aVname, aProfiles, aIncoming, aLastRefreshTime)));
 
 	dcassert(rootPaths_.find(dir->getRealPath()) == rootPaths_.end());
 	rootPaths_[dir->getRealPath()] = dir;
 
-	addDirName(dir, dirNameMap_, bloom);
+	addDirName(dir, dirNameMap_, searchIndex_, bloom);
 	return dir;
 }
 
@@ -832,46 +894,50 @@ bool ShareManager::Directory::setParent(const Directory::Ptr& aDirectory, const
 		}
 
 		aParent->updateModifyDate();
+		aParent->increaseRevision();
 	}
 
 	return true;
 }
 
-void ShareManager::Directory::cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept {
-	aDirectory.cleanIndices(sharedSize_, tthIndex_, dirNames_);
+void ShareManager::Directory::cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_, SearchIndex& searchIndex_) noexcept {
+	aDirectory.cleanIndices(sharedSize_, tthIndex_, dirNames_, searchIndex_);
 
 	if (aDirectory.parent) {
 		aDirectory.parent->directories.erase_key(aDirectory.realName.getLower());
+		aDirectory.parent->increaseRevision();
 		aDirectory.parent = nullptr;
 	}
 }
 
-void ShareManager::Directory::File::updateIndices(ShareBloom& bloom_, int64_t& sharedSize_, TTHMap& tthIndex_) noexcept {
+void ShareManager::Directory::File::updateIndices(ShareBloom& bloom_, int64_t& sharedSize_, TTHMap& tthIndex_, SearchIndex& searchIndex_) noexcept {
 	parent->increaseSize(size, sharedSize_);
 #ifdef _DEBUG
 	checkAddedTTHDebug(this, tthIndex_);
 #endif
 
 	tthIndex_.emplace(const_cast<TTHValue*>(&tth), this);
+	searchIndex_.addFile(name.getLower(), this);
 	bloom_.add(name.getLower());
 }
 
-void ShareManager::Directory::cleanIndices(int64_t& sharedSize_, HashFileMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept {
+void ShareManager::Directory::cleanIndices(int64_t& sharedSize_, HashFileMap& tthIndex_, Directory::MultiMap& dirNames_, SearchIndex& searchIndex_) noexcept {
 	for (auto& d : directories) {
-		d->cleanIndices(sharedSize_, tthIndex_, dirNames_);
+		d->cleanIndices(sharedSize_, tthIndex_, dirNames_, searchIndex_);
 	}
 
 	//remove from the name map
-	removeDirName(*this, dirNames_);
+	removeDirName(*this, dirNames_, searchIndex_);
 
 	//remove all files
 	for (const auto& f : files) {
-		f->cleanIndices(sharedSize_, tthIndex_);
+		f->cleanIndices(sharedSize_, tthIndex_, searchIndex_);
 	}
 }
 
-void ShareManager::Directory::File::cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_) noexcept {
+void ShareManager::Directory::File::cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_, SearchIndex& searchIndex_) noexcept {
 	parent->decreaseSize(size, sharedSize_);
+	searchIndex_.removeFile(name.getLower(), this);
 
 	auto flst = tthIndex_.equal_range(const_cast<TTHValue*>(&tth));
 	auto p = find(flst | map_values, this);
@@ -889,16 +955,36 @@ static const string DATE = "Date";
 static const string SHARE = "Share";
 static const string SVERSION = "Version";
 
-struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, public ShareManager::RefreshInfo {
+struct ShareManager::ShareCacheLoader : public ShareManager::RefreshInfo {
+	ShareCacheLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom, const string& aCachePath) :
+		ShareManager::RefreshInfo(aPath, aOldRoot, 0, aBloom), cachePath(aCachePath) { }
+
+	virtual ~ShareCacheLoader() { }
+
+	// Throws Exception
+	virtual void load() = 0;
+
+	const string cachePath;
+};
+
+// Loader for the XML cache files of older versions
+struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, public ShareManager::ShareCacheLoader {
 	ShareLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom) :
-		ShareManager::RefreshInfo(aPath, aOldRoot, 0, aBloom),
 		ThreadedCallBack(aOldRoot->getRoot()->getCacheXmlPath()),
-		curDirPath(aOldRoot->getRoot()->getPath()),
-		curDirPathLower(Text::toLower(aOldRoot->getRoot()->getPath()))
+		ShareManager::ShareCacheLoader(aPath, aOldRoot, aBloom, aOldRoot->getRoot()->getCacheXmlPath()),
+		curDirPathLower(Text::toLower(aOldRoot->getRoot()->getPath())),
+		curDirPath(aOldRoot->getRoot()->getPath())
 	{ 
 		cur = newShareDirectory;
 	}
 
+	void load() override {
+		SimpleXMLReader(this).parse(*file);
+
+		// Convert to the binary format
+		newShareDirectory->getRoot()->setCacheDirty(true);
+	}
+
 
 	void startTag(const string& aName, StringPairList& attribs, bool simple) {
 		if(compare(aName, SDIRECTORY) == 0) {
@@ -908,7 +994,7 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 			if(!name.empty()) {
 				curDirPath += name + PATH_SEPARATOR;
 
-				cur = ShareManager::Directory::createNormal(name, cur, Util::toTimeT(date), lowerDirNameMapNew, bloom);
+				cur = ShareManager::Directory::createNormal(name, cur, Util::toTimeT(date), lowerDirNameMapNew, searchIndexNew, bloom);
 				if (!cur) {
 					throw Exception("Duplicate directory name");
 				}
@@ -932,9 +1018,10 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 				DualString name(fname);
 				HashedFile fi;
 				HashManager::getInstance()->getFileInfo(curDirPathLower + name.getLower(), curDirPath + fname, fi);
-				addFile(move(name), cur, fi, tthIndexNew, bloom, addedSize);
+				addFile(move(name), cur, fi, tthIndexNew, searchIndexNew, bloom, addedSize);
 			} catch(Exception& e) {
 				hashSize += File::getSize(curDirPath + fname);
+				cur->setHashPending(true);
 				dcdebug("Error loading file list %s \n", e.getError().c_str());
 			}
 		} else if (compare(aName, SHARE) == 0) {
@@ -948,10 +1035,16 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 	void endTag(const string& name) {
 		if(compare(name, SDIRECTORY) == 0) {
 			if(cur) {
+				cur->compact();
+
 				curDirPath = Util::getParentDir(curDirPath);
 				curDirPathLower = Util::getParentDir(curDirPathLower);
 				cur = cur->getParent();
 			}
+		} else if (compare(name, SHARE) == 0) {
+			if (cur) {
+				cur->compact();
+			}
 		}
 	}
 
@@ -964,7 +1057,174 @@ private:
 	string curDirPath;
 };
 
-typedef shared_ptr<ShareManager::ShareLoader> ShareLoaderPtr;
+// Binary share cache
+//
+// The file consists of a header, followed by the directory table, the file table and the string pool. All records
+// have a fixed size so that the file could be mapped in memory as is; names are stored as offsets in the string pool.
+// Directories are stored in pre-order (the first record being the root) and each directory record is followed by 
+// its files in the file table. The hash information of the files is taken from the hash database when loading the cache
+// (same as with the XML cache) so that files with no valid hash information will be hashed again. The file records
+// therefore contain only the name and size (the size is needed for reporting the files that are queued for hashing).
+
+#define SHARE_CACHE_BINARY_VERSION 1
+static const char SHARE_CACHE_MAGIC[8] = { 'A', 'D', 'C', 'S', 'H', 'R', 'C', 'H' };
+static const uint32_t SHARE_CACHE_BYTE_ORDER = 0x01020304;
+
+#pragma pack(push, 1)
+struct ShareCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t directoryCount;
+	uint32_t fileCount;
+	uint32_t stringPoolSize;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+	uint32_t reserved;
+};
+
+struct ShareCacheDirectory {
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	int64_t lastWrite;
+	uint32_t parent;
+	uint32_t fileCount;
+};
+
+struct ShareCacheFile {
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	int64_t size;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ShareCacheHeader) == 40 && sizeof(ShareCacheDirectory) == 24 && sizeof(ShareCacheFile) == 16, "Invalid share cache record size");
+
+struct ShareManager::BinaryShareLoader : public ShareManager::ShareCacheLoader {
+	BinaryShareLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom) :
+		ShareManager::ShareCacheLoader(aPath, aOldRoot, aBloom, aOldRoot->getRoot()->getCacheBinaryPath()) {
+
+	}
+
+	void load() override {
+		const auto data = File(cachePath, File::READ, File::OPEN, File::BUFFER_SEQUENTIAL).read();
+		if (data.size() < sizeof(ShareCacheHeader)) {
+			throw Exception("Invalid cache file");
+		}
+
+		ShareCacheHeader header;
+		memcpy(&header, data.data(), sizeof(ShareCacheHeader));
+		if (memcmp(header.magic, SHARE_CACHE_MAGIC, sizeof(SHARE_CACHE_MAGIC)) != 0 || header.byteOrder != SHARE_CACHE_BYTE_ORDER) {
+			throw Exception("Invalid cache file");
+		}
+
+		if (header.version > SHARE_CACHE_BINARY_VERSION) {
+			throw Exception("Newer cache version");
+		}
+
+		const auto directoryTable = sizeof(ShareCacheHeader);
+		const auto fileTable = directoryTable + static_cast<size_t>(header.directoryCount) * sizeof(ShareCacheDirectory);
+		const auto stringPool = fileTable + static_cast<size_t>(header.fileCount) * sizeof(ShareCacheFile);
+		if (header.directoryCount == 0 || stringPool + header.stringPoolSize != data.size()) {
+			throw Exception("Invalid cache file");
+		}
+
+		auto getString = [&](uint32_t aOffset, uint32_t aLength) {
+			if (static_cast<uint64_t>(aOffset) + aLength > header.stringPoolSize) {
+				throw Exception("Invalid cache file");
+			}
+
+			return string(data.data() + stringPool + aOffset, aLength);
+		};
+
+		auto getName = [&](uint32_t aOffset, uint32_t aLength) {
+			auto name = getString(aOffset, aLength);
+			if (name.empty() || name == "." || name == ".." || name.find_first_of("/" PATH_SEPARATOR_STR) != string::npos) {
+				throw Exception("Invalid cache file");
+			}
+
+			return name;
+		};
+
+		if (Util::stricmp(getString(header.pathOffset, header.pathLength), newShareDirectory->getRoot()->getPath()) != 0) {
+			throw Exception("Invalid cache file");
+		}
+
+		ShareManager::Directory::List directories;
+		directories.reserve(header.directoryCount);
+
+		// Real paths of the loaded directories (with a trailing separator)
+		StringList paths, pathsLower;
+		paths.reserve(header.directoryCount);
+		pathsLower.reserve(header.directoryCount);
+
+		size_t curFile = 0;
+		for (uint32_t i = 0; i < header.directoryCount; ++i) {
+			ShareCacheDirectory d;
+			memcpy(&d, data.data() + directoryTable + i * sizeof(ShareCacheDirectory), sizeof(ShareCacheDirectory));
+
+			ShareManager::Directory::Ptr cur;
+			string curPath, curPathLower;
+			if (i == 0) {
+				cur = newShareDirectory;
+				cur->setLastWrite(static_cast<time_t>(d.lastWrite));
+
+				curPath = cur->getRoot()->getPath();
+				curPathLower = Text::toLower(curPath);
+			} else {
+				if (d.parent >= i) {
+					throw Exception("Invalid cache file");
+				}
+
+				const auto name = getName(d.nameOffset, d.nameLength);
+				cur = ShareManager::Directory::createNormal(name, directories[d.parent], static_cast<time_t>(d.lastWrite), lowerDirNameMapNew, searchIndexNew, bloom);
+				if (!cur) {
+					throw Exception("Duplicate directory name");
+				}
+
+				curPath = paths[d.parent] + name + PATH_SEPARATOR;
+				curPathLower = pathsLower[d.parent] + cur->realName.getLower() + PATH_SEPARATOR;
+			}
+
+			if (curFile + d.fileCount > header.fileCount) {
+				throw Exception("Invalid cache file");
+			}
+
+			cur->fileStorage.reserve(d.fileCount);
+			for (uint32_t j = 0; j < d.fileCount; ++j, ++curFile) {
+				ShareCacheFile f;
+				memcpy(&f, data.data() + fileTable + curFile * sizeof(ShareCacheFile), sizeof(ShareCacheFile));
+
+				const auto name = getName(f.nameOffset, f.nameLength);
+				DualString dualName(name);
+
+				try {
+					HashedFile fi;
+					HashManager::getInstance()->getFileInfo(curPathLower + dualName.getLower(), curPath + name, fi);
+					addFile(move(dualName), cur, fi, tthIndexNew, searchIndexNew, bloom, addedSize);
+				} catch (const HashException&) {
+					// Queued for hashing
+					hashSize += f.size;
+					cur->setHashPending(true);
+				}
+			}
+
+			directories.push_back(cur);
+			paths.push_back(move(curPath));
+			pathsLower.push_back(move(curPathLower));
+		}
+
+		if (curFile != header.fileCount) {
+			throw Exception("Invalid cache file");
+		}
+
+		for (const auto& d : directories) {
+			d->compact();
+		}
+	}
+};
+
+typedef shared_ptr<ShareManager::ShareCacheLoader> ShareLoaderPtr;
 typedef vector<ShareLoaderPtr> LoaderList;
 
 bool ShareManager::loadCache(function<void(float)> progressF) noexcept{
@@ -972,7 +1232,7 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept{
 
 	Util::migrate(Util::getPath(Util::PATH_SHARECACHE), "ShareCache_*");
 
-	// Get all cache XMLs
+	// Get all cache files
 	StringList fileList = File::findFiles(Util::getPath(Util::PATH_SHARECACHE), "ShareCache_*", File::TYPE_FILE);
 
 	if (fileList.empty()) {
@@ -983,17 +1243,25 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept{
 
 	// Create loaders
 	for (const auto& p : fileList) {
-		if (Util::getFileExt(p) == ".xml") {
+		const auto ext = Util::getFileExt(p);
+		if (ext == ".bin" || ext == ".xml") {
 			// Find the corresponding directory pointer for this path
-			auto rp = find_if(rootPaths | map_values, [&p](const Directory::Ptr& aDir) {
-				return Util::stricmp(aDir->getRoot()->getCacheXmlPath(), p) == 0; 
+			auto rp = find_if(rootPaths | map_values, [&](const Directory::Ptr& aDir) {
+				return Util::stricmp(ext == ".bin" ? aDir->getRoot()->getCacheBinaryPath() : aDir->getRoot()->getCacheXmlPath(), p) == 0; 
 			});
 
 			if (rp.base() != rootPaths.end()) {
 				try {
-					auto loader = std::make_shared<ShareLoader>(rp.base()->first, *rp, *bloom.get());
-					cacheLoaders.emplace_back(loader);
-					continue;
+					if (ext == ".bin") {
+						cacheLoaders.push_back(std::make_shared<BinaryShareLoader>(rp.base()->first, *rp, *bloom.get()));
+						continue;
+					}
+
+					// XML caches from older versions are imported only if there is no binary cache for the directory
+					if (!Util::fileExists((*rp)->getRoot()->getCacheBinaryPath())) {
+						cacheLoaders.push_back(std::make_shared<ShareLoader>(rp.base()->first, *rp, *bloom.get()));
+						continue;
+					}
 				} catch (...) {}
 			}
 		}
@@ -1016,14 +1284,14 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept{
 				//LogManager::getInstance()->message("Thread: " + Util::toString(::GetCurrentThreadId()) + "Size " + Util::toString(loader.size), LogMessage::SEV_INFO);
 				auto& loader = *i;
 				try {
-					SimpleXMLReader(&loader).parse(*loader.file);
-				} catch (SimpleXMLException& e) {
-					LogManager::getInstance()->message(STRING_F(LOAD_FAILED_X, loader.xmlPath % e.getError()), LogMessage::SEV_ERROR);
+					loader.load();
+				} catch (const Exception& e) {
+					LogManager::getInstance()->message(STRING_F(LOAD_FAILED_X, loader.cachePath % e.getError()), LogMessage::SEV_ERROR);
 					hasFailedCaches = true;
-					File::deleteFile(loader.xmlPath);
+					File::deleteFile(loader.cachePath);
 				} catch (...) {
 					hasFailedCaches = true;
-					File::deleteFile(loader.xmlPath);
+					File::deleteFile(loader.cachePath);
 				}
 
 				if (progressF) {
@@ -1104,6 +1372,29 @@ void ShareManager::Directory::countStats(time_t& totalAge_, size_t& totalDirs_,
 	totalFiles_ += files.size();
 }
 
+void ShareManager::Directory::countMemoryUsage(ShareMemoryStats& stats_) const noexcept {
+	for (const auto& d : directories) {
+		d->countMemoryUsage(stats_);
+	}
+
+	stats_.directoryRecordBytes += sizeof(Directory);
+	stats_.nameBytes += realName.getAllocatedSize();
+	stats_.itemListBytes += files.capacity() * sizeof(File*) + directories.capacity() * sizeof(Directory::Ptr);
+
+	for (const auto& f : files) {
+		stats_.nameBytes += f->name.getAllocatedSize();
+	}
+
+	stats_.fileCount += files.size();
+	stats_.fileRecordCapacity += fileStorage.getCapacity();
+	stats_.fileRecordBytes += fileStorage.getCapacity() * sizeof(File);
+}
+
+void ShareManager::Directory::compact() noexcept {
+	files.shrink_to_fit();
+	directories.shrink_to_fit();
+}
+
 void ShareManager::countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles_, size_t& lowerCaseFiles_, size_t& totalStrLen_, size_t& roots_) const noexcept{
 	RLock l(cs);
 	for (const auto& d : rootPaths | map_values) {
@@ -1139,6 +1430,21 @@ optional<ShareManager::ShareItemStats> ShareManager::getShareItemStats() const n
 	return stats;
 }
 
+ShareManager::ShareMemoryStats ShareManager::getMemoryStats() const noexcept {
+	ShareMemoryStats stats;
+
+	RLock l(cs);
+	for (const auto& d : rootPaths | map_values) {
+		d->countMemoryUsage(stats);
+	}
+
+	// Node (key, value, next pointer) + bucket
+	stats.tthIndexBytes = tthIndex.size() * (sizeof(HashFileMap::value_type) + sizeof(void*)) + tthIndex.bucket_count() * sizeof(void*);
+	stats.directoryNameIndexBytes = lowerDirNameMap.size() * (sizeof(Directory::MultiMap::value_type) + sizeof(void*)) + lowerDirNameMap.bucket_count() * sizeof(void*);
+	stats.searchIndexBytes = searchIndex.getMemoryUsage();
+	return stats;
+}
+
 ShareManager::ShareSearchStats ShareManager::getSearchMatchingStats() const noexcept {
 	auto upseconds = static_cast<double>(GET_TICK()) / 1000.00;
 
@@ -1158,6 +1464,41 @@ ShareManager::ShareSearchStats ShareManager::getSearchMatchingStats() const noex
 	stats.autoSearches = autoSearches;
 	stats.tthSearches = tthSearches;
 
+	stats.indexedSearches = indexedSearches;
+	stats.averageIndexCandidateCount = Util::countAverage(indexCandidateCount, indexedSearches);
+
+	{
+		RLock l(cs);
+		stats.indexTokenCount = searchIndex.getTokenCount();
+	}
+
+	return stats;
+}
+
+ShareManager::ShareFilelistStats ShareManager::getFilelistStats() const noexcept {
+	ShareFilelistStats stats;
+	stats.generatedLists = generatedLists;
+	stats.averageGenerationMs = static_cast<uint64_t>(Util::countAverage(listGenerationTime, generatedLists));
+	stats.lastGenerationMs = lastListGenerationTime;
+	stats.lastPeakMemory = lastListPeakMemory;
+	stats.reusedFragments = reusedListFragments;
+	stats.compressedFragments = compressedListFragments;
+
+	{
+		RLock l(cs);
+		for (const auto& sp : shareProfiles) {
+			stats.cachedFragmentBytes += sp->getProfileList()->getFragmentCacheSize();
+		}
+	}
+
+	{
+		Lock l(partialListCS);
+		stats.partialListCacheHits = partialListCacheHits;
+		stats.partialListCacheMisses = partialListCacheMisses;
+		stats.cachedPartialLists = partialListCache.size();
+		stats.cachedPartialListBytes = partialListCacheSize;
+	}
+
 	return stats;
 }
 
@@ -1200,6 +1541,7 @@ Filtered text searches: %d%% (%d%% of the matched ones returned results)\r\n\
 Average search tokens (non-filtered only): %d (%d bytes per token)\r\n\
 Auto searches (text, ADC only): %d%%\r\n\
 Average time for matching a recursive search: %d ms\r\n\
+Text searches matched from the name index: %d%% (%d candidates per search, %d indexed tokens)\r\n\
 TTH searches: %d%% (hash bloom mode: %s)")
 
 		% searchStats.totalSearches % searchStats.totalSearchesPerSecond
@@ -1208,10 +1550,50 @@ TTH searches: %d%% (hash bloom mode: %s)")
 		% searchStats.averageSearchTokenCount  % searchStats.averageSearchTokenLength
 		% Util::countAverage(searchStats.autoSearches, searchStats.recursiveSearches)
 		% searchStats.averageSearchMatchMs
+		% Util::countPercentage(searchStats.indexedSearches, searchStats.recursiveSearches - searchStats.filteredSearches) % searchStats.averageIndexCandidateCount % searchStats.indexTokenCount
 		% Util::countPercentage(searchStats.tthSearches, searchStats.totalSearches)
 		% (SETTING(BLOOM_MODE) != SettingsManager::BLOOM_DISABLED ? "Enabled" : "Disabled") // bloom mode
 	);
 
+	auto memoryStats = getMemoryStats();
+	ret += boost::str(boost::format(
+"\r\n\r\n-=[ Memory usage (estimated) ]=-\r\n\r\n\
+(computed from the item counts and record sizes, not measured from the allocator or compared with the earlier share layout)\r\n\
+File records: %s (%d bytes per record, %d records allocated for %d files)\r\n\
+Directory records: %s\r\n\
+Item names: %s\r\n\
+Directory item lists: %s\r\n\
+TTH index: %s\r\n\
+Directory name index: %s\r\n\
+Name search index: %s\r\n\
+Total: %s")
+
+		% Util::formatBytes(memoryStats.fileRecordBytes) % sizeof(Directory::File) % memoryStats.fileRecordCapacity % memoryStats.fileCount
+		% Util::formatBytes(memoryStats.directoryRecordBytes)
+		% Util::formatBytes(memoryStats.nameBytes)
+		% Util::formatBytes(memoryStats.itemListBytes)
+		% Util::formatBytes(memoryStats.tthIndexBytes)
+		% Util::formatBytes(memoryStats.directoryNameIndexBytes)
+		% Util::formatBytes(memoryStats.searchIndexBytes)
+		% Util::formatBytes(memoryStats.getTotal())
+	);
+
+	auto listStats = getFilelistStats();
+	ret += boost::str(boost::format(
+"\r\n\r\n-=[ File list generation ]=-\r\n\r\n\
+Generated full file lists: %d (average time %d ms, last %d ms)\r\n\
+Directories compressed: %d (%d%% reused from the cache)\r\n\
+Cached compressed directories: %s\r\n\
+Peak memory usage of the last generation: %s\r\n\
+Partial lists returned from the cache: %d%% (%d cached lists, %s)")
+
+		% listStats.generatedLists % listStats.averageGenerationMs % listStats.lastGenerationMs
+		% listStats.compressedFragments % Util::countPercentage(listStats.reusedFragments, listStats.reusedFragments + listStats.compressedFragments)
+		% Util::formatBytes(listStats.cachedFragmentBytes)
+		% Util::formatBytes(listStats.lastPeakMemory)
+		% Util::countPercentage(listStats.partialListCacheHits, listStats.partialListCacheHits + listStats.partialListCacheMisses) % listStats.cachedPartialLists % Util::formatBytes(listStats.cachedPartialListBytes)
+	);
+
 	return ret;
 }
 
@@ -1418,21 +1800,21 @@ bool ShareManager::isFileShared(const TTHValue& aTTH, ProfileToken aProfile) con
 bool ShareManager::RefreshInfo::checkContent(const Directory::Ptr& aDirectory) noexcept {
 	if (SETTING(SKIP_EMPTY_DIRS_SHARE) && aDirectory->getDirectories().empty() && aDirectory->files.empty()) {
 		// Remove from parent
-		Directory::cleanIndices(*aDirectory.get(), addedSize, tthIndexNew, lowerDirNameMapNew);
+		Directory::cleanIndices(*aDirectory.get(), addedSize, tthIndexNew, lowerDirNameMapNew, searchIndexNew);
 		return false;
 	}
 
 	return true;
 }
 
-ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, bool& shutdown_, SharePathValidator& aPathValidator) :
-	shutdown(shutdown_), pathValidator(aPathValidator), RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_) {
+ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, bool& shutdown_, SharePathValidator& aPathValidator, SharedMutex& aCS, bool aIncremental) :
+	RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_), shutdown(shutdown_), pathValidator(aPathValidator), cs(aCS), incremental(aIncremental) {
 
 }
 
 bool ShareManager::ShareBuilder::buildTree() noexcept {
 	try {
-		buildTree(path, Text::toLower(path), newShareDirectory);
+		buildTree(path, Text::toLower(path), newShareDirectory, incremental ? oldShareDirectory : nullptr);
 	} catch (const std::bad_alloc&) {
 		LogManager::getInstance()->message(STRING_F(DIR_REFRESH_FAILED, path % STRING(OUT_OF_MEMORY)), LogMessage::SEV_ERROR);
 		return false;
@@ -1444,7 +1826,26 @@ bool ShareManager::ShareBuilder::buildTree() noexcept {
 	return true;
 }
 
-void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent) {
+void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent, const Directory::Ptr& aOldDirectory) {
+	if (aOldDirectory) {
+		bool modified;
+
+		{
+			RLock l(cs);
+			modified = aOldDirectory->getLastWrite() != aParent->getLastWrite() || aOldDirectory->getHashPending();
+		}
+
+		if (!modified) {
+			copyTree(aPath, aPathLower, aParent, aOldDirectory);
+			return;
+		}
+	}
+
+	scannedDirectories++;
+
+	// Files are added after the directory has been read so that their records can be allocated in a single block
+	vector<pair<DualString, HashedFile>> files;
+
 	ErrorCollector errors;
 	FileFindIter end;
 	for(FileFindIter i(aPath, "*"); i != end && !shutdown; ++i) {
@@ -1479,9 +1880,15 @@ void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aP
 		}
 
 		if (isDirectory) {
-			auto curDir = Directory::createNormal(move(dualName), aParent, i->getLastWriteTime(), lowerDirNameMapNew, bloom);
+			Directory::Ptr oldDir = nullptr;
+			if (aOldDirectory) {
+				RLock l(cs);
+				oldDir = aOldDirectory->findDirectoryByName(name);
+			}
+
+			auto curDir = Directory::createNormal(move(dualName), aParent, i->getLastWriteTime(), lowerDirNameMapNew, searchIndexNew, bloom);
 			if (curDir) {
-				buildTree(curPath, curPathLower, curDir);
+				buildTree(curPath, curPathLower, curDir, oldDir);
 				checkContent(curDir);
 			}
 		} else {
@@ -1490,15 +1897,121 @@ void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aP
 			try {
 				HashedFile fi(i->getLastWriteTime(), size);
 				if(HashManager::getInstance()->checkTTH(aPathLower + dualName.getLower(), aPath + name, fi)) {
-					addFile(move(dualName), aParent, fi, tthIndexNew, bloom, addedSize);
+					files.emplace_back(move(dualName), fi);
 				} else {
 					hashSize += size;
+					aParent->setHashPending(true);
 				}
 			} catch(const HashException&) {
 			}
 		}
 	}
 
+	aParent->fileStorage.reserve(files.size());
+	for (auto& f : files) {
+		addFile(move(f.first), aParent, f.second, tthIndexNew, searchIndexNew, bloom, addedSize);
+	}
+
+	aParent->compact();
+
+	auto msg = errors.getMessage();
+	if (!msg.empty()) {
+		LogManager::getInstance()->message(STRING_F(SHARE_FILES_BLOCKED, aPath % msg), LogMessage::SEV_INFO);
+	}
+}
+
+void ShareManager::ShareBuilder::copyTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent, const Directory::Ptr& aOldDirectory) {
+	skippedDirectories++;
+
+	vector<pair<string, HashedFile>> oldFiles;
+	Directory::List oldDirectories;
+
+	{
+		RLock l(cs);
+		oldFiles.reserve(aOldDirectory->files.size());
+		for (const auto& f : aOldDirectory->files) {
+			oldFiles.emplace_back(f->name.getNormal(), HashedFile(f->getLastWrite(), f->getSize()));
+		}
+
+		oldDirectories.assign(aOldDirectory->getDirectories().begin(), aOldDirectory->getDirectories().end());
+	}
+
+	// The share settings may have changed since the directory was read
+	// The hash information is also checked so that files missing from the hash database get hashed again
+	vector<pair<DualString, HashedFile>> files;
+
+	ErrorCollector errors;
+	for (auto& f : oldFiles) {
+		errors.increaseTotal();
+
+		DualString dualName(f.first);
+		auto curPath = aPath + f.first;
+
+		try {
+			pathValidator.validateCached(curPath, false, f.second.getSize(), false);
+		} catch (const ShareException& e) {
+			if (SETTING(REPORT_BLOCKED_SHARE)) {
+				errors.add(e.getError(), f.first, false);
+			}
+
+			continue;
+		} catch (...) {
+			continue;
+		}
+
+		try {
+			if (HashManager::getInstance()->checkTTH(aPathLower + dualName.getLower(), curPath, f.second)) {
+				files.emplace_back(move(dualName), f.second);
+			} else {
+				hashSize += f.second.getSize();
+				aParent->setHashPending(true);
+			}
+		} catch (const HashException&) {
+		}
+	}
+
+	aParent->fileStorage.reserve(files.size());
+	for (auto& f : files) {
+		addFile(move(f.first), aParent, f.second, tthIndexNew, searchIndexNew, bloom, addedSize);
+	}
+
+	for (const auto& oldDir : oldDirectories) {
+		if (shutdown) {
+			break;
+		}
+
+		string name;
+
+		{
+			RLock l(cs);
+			name = oldDir->realName.getNormal();
+		}
+
+		DualString dualName(name);
+		auto curPath = aPath + name + PATH_SEPARATOR;
+		auto curPathLower = aPathLower + dualName.getLower() + PATH_SEPARATOR;
+
+		try {
+			pathValidator.validateCached(curPath, true, 0, false);
+		} catch (const ShareException& e) {
+			if (SETTING(REPORT_BLOCKED_SHARE)) {
+				LogManager::getInstance()->message(STRING_F(SHARE_DIRECTORY_BLOCKED, curPath % e.getError()), LogMessage::SEV_INFO);
+			}
+
+			continue;
+		} catch (...) {
+			continue;
+		}
+
+		auto curDir = Directory::createNormal(move(dualName), aParent, File::getLastModified(curPath), lowerDirNameMapNew, searchIndexNew, bloom);
+		if (curDir) {
+			buildTree(curPath, curPathLower, curDir, oldDir);
+			checkContent(curDir);
+		}
+	}
+
+	aParent->compact();
+
 	auto msg = errors.getMessage();
 	if (!msg.empty()) {
 		LogManager::getInstance()->message(STRING_F(SHARE_FILES_BLOCKED, aPath % msg), LogMessage::SEV_INFO);
@@ -1847,7 +2360,7 @@ bool ShareManager::addRootDirectory(const ShareDirectoryInfoPtr& aDirectoryInfo)
 			dcassert(find_if(rootPaths | map_keys, IsParentOrExact(path, PATH_SEPARATOR)).base() == rootPaths.end());
 
 			// It's a new parent, will be handled in the task thread
-			Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, *bloom.get(), 0);
+			Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, searchIndex, *bloom.get(), 0);
 		}
 	}
 
@@ -1880,8 +2393,9 @@ bool ShareManager::removeRootDirectory(const string& aPath) noexcept {
 		rootPaths.erase(k);
 
 		// Remove the root
-		Directory::cleanIndices(*sd, sharedSize, tthIndex, lowerDirNameMap);
+		Directory::cleanIndices(*sd, sharedSize, tthIndex, lowerDirNameMap, searchIndex);
 		File::deleteFile(sd->getRoot()->getCacheXmlPath());
+		File::deleteFile(sd->getRoot()->getCacheBinaryPath());
 	}
 
 	HashManager::getInstance()->stopHashing(aPath);
@@ -1920,9 +2434,10 @@ bool ShareManager::updateRootDirectory(const ShareDirectoryInfoPtr& aDirectoryIn
 			// Make sure that all removed profiles are set dirty as well
 			dirtyProfiles.insert(rootDirectory->getRootProfiles().begin(), rootDirectory->getRootProfiles().end());
 
-			removeDirName(*p->second, lowerDirNameMap);
+			removeDirName(*p->second, lowerDirNameMap, searchIndex);
 			rootDirectory->setName(vName);
-			addDirName(p->second, lowerDirNameMap, *bloom.get());
+			addDirName(p->second, lowerDirNameMap, searchIndex, *bloom.get());
+			p->second->increaseRevision();
 
 			rootDirectory->setIncoming(aDirectoryInfo->incoming);
 			rootDirectory->setRootProfiles(aDirectoryInfo->profiles);
@@ -1948,7 +2463,7 @@ void ShareManager::updateRootDirectories(const ShareDirectoryInfoList& changedDi
 #endif
 }
 
-void ShareManager::reportTaskStatus(uint8_t aTask, const RefreshPathList& directories, bool finished, int64_t aHashSize, const string& displayName, RefreshType aRefreshType) const noexcept {
+void ShareManager::reportTaskStatus(uint8_t aTask, const RefreshPathList& directories, bool finished, int64_t aHashSize, const string& displayName, RefreshType aRefreshType, size_t aSkippedDirectories, size_t aScannedDirectories) const noexcept {
 	string msg;
 	switch (aTask) {
 		case(REFRESH_ALL):
@@ -1980,6 +2495,10 @@ void ShareManager::reportTaskStatus(uint8_t aTask, const RefreshPathList& direct
 	};
 
 	if (!msg.empty()) {
+		if (aSkippedDirectories > 0) {
+			msg += " " + STRING_F(REFRESH_DIRECTORIES_SKIPPED, aSkippedDirectories % aScannedDirectories);
+		}
+
 		if (aHashSize > 0) {
 			msg += " " + STRING_F(FILES_ADDED_FOR_HASH, Util::formatBytes(aHashSize));
 		} else if (aRefreshType == TYPE_SCHEDULED && !SETTING(LOG_SCHEDULED_REFRESHES)) {
@@ -2004,10 +2523,10 @@ ShareManager::RefreshInfo::RefreshInfo(const string& aPath, const Directory::Ptr
 	// Use a different directory for building the tree
 	if (aOldShareDirectory && aOldShareDirectory->getRoot()) {
 		newShareDirectory = Directory::createRoot(aPath, aOldShareDirectory->getVirtualName(), aOldShareDirectory->getRoot()->getRootProfiles(), aOldShareDirectory->getRoot()->getIncoming(),
-			aLastWrite, rootPathsNew, lowerDirNameMapNew, bloom_, aOldShareDirectory->getRoot()->getLastRefreshTime());
+			aLastWrite, rootPathsNew, lowerDirNameMapNew, searchIndexNew, bloom_, aOldShareDirectory->getRoot()->getLastRefreshTime());
 	} else {
 		// We'll set the parent later
-		newShareDirectory = Directory::createNormal(Util::getLastDir(aPath), nullptr, aLastWrite, lowerDirNameMapNew, bloom_);
+		newShareDirectory = Directory::createNormal(Util::getLastDir(aPath), nullptr, aLastWrite, lowerDirNameMapNew, searchIndexNew, bloom_);
 	}
 }
 
@@ -2057,12 +2576,15 @@ void ShareManager::runTasks(function<void (float)> progressF /*nullptr*/) noexce
 
 		ShareBloom* refreshBloom = t.first == REFRESH_ALL ? new ShareBloom(1 << 20) : bloom.get();
 
+		// Manual refreshes will always scan everything so that modified files inside unchanged directories can be detected
+		const auto incremental = SETTING(INCREMENTAL_REFRESH) && task->type != TYPE_MANUAL;
+
 		// Get refresh infos for each path
 		{
 			RLock l (cs);
 			for(auto& refreshPath: dirs) {
 				auto directory = findDirectory(refreshPath);
-				refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, aShutdown, *validator.get()));
+				refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, aShutdown, *validator.get(), cs, incremental));
 			}
 		}
 
@@ -2078,6 +2600,7 @@ void ShareManager::runTasks(function<void (float)> progressF /*nullptr*/) noexce
 		atomic<long> progressCounter(0);
 
 		int64_t totalHash = 0;
+		atomic<size_t> skippedDirectories(0), scannedDirectories(0);
 		ProfileTokenSet dirtyProfiles;
 
 		auto doRefresh = [&](const ShareBuilderPtr& i) {
@@ -2087,6 +2610,8 @@ void ShareManager::runTasks(function<void (float)> progressF /*nullptr*/) noexce
 
 			// Build the tree
 			auto succeed = ri.buildTree();
+			skippedDirectories += ri.skippedDirectories;
+			scannedDirectories += ri.scannedDirectories;
 
 			// Don't save cache with an incomplete tree
 			if (aShutdown)
@@ -2128,7 +2653,7 @@ void ShareManager::runTasks(function<void (float)> progressF /*nullptr*/) noexce
 		}
 
 		setProfilesDirty(dirtyProfiles, task->type == TYPE_MANUAL || t.first == REFRESH_ALL || t.first == ADD_BUNDLE);
-		reportTaskStatus(t.first, dirs, true, totalHash, task->displayName, task->type);
+		reportTaskStatus(t.first, dirs, true, totalHash, task->displayName, task->type, skippedDirectories, scannedDirectories);
 
 		fire(ShareManagerListener::RefreshCompleted(), t.first, dirs);
 	}
@@ -2138,7 +2663,7 @@ void ShareManager::runTasks(function<void (float)> progressF /*nullptr*/) noexce
 #endif
 }
 
-void ShareManager::RefreshInfo::mergeRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& totalHash_, int64_t& totalAdded_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::RefreshInfo::mergeRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, SearchIndex& searchIndex_, int64_t& totalHash_, int64_t& totalAdded_, ProfileTokenSet* dirtyProfiles_) noexcept {
 #ifdef _DEBUG
 	for (const auto& d: lowerDirNameMapNew | map_values) {
 		checkAddedDirNameDebug(d, lowerDirNameMap_);
@@ -2151,6 +2676,7 @@ void ShareManager::RefreshInfo::mergeRefreshChanges(Directory::MultiMap& lowerDi
 
 	lowerDirNameMap_.insert(lowerDirNameMapNew.begin(), lowerDirNameMapNew.end());
 	tthIndex_.insert(tthIndexNew.begin(), tthIndexNew.end());
+	searchIndex_.merge(searchIndexNew);
 
 	for (const auto& rp : rootPathsNew) {
 		//dcassert(rootPaths_.find(rp.first) == rootPaths_.end());
@@ -2212,7 +2738,7 @@ bool ShareManager::applyRefreshChanges(RefreshInfo& ri, int64_t& totalHash_, Pro
 		parent = ri.oldShareDirectory->getParent();
 
 		// Remove the old directory
-		Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, tthIndex, lowerDirNameMap);
+		Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, tthIndex, lowerDirNameMap, searchIndex);
 	}
 
 	// Set the parent for refreshed subdirectories
@@ -2237,14 +2763,14 @@ bool ShareManager::applyRefreshChanges(RefreshInfo& ri, int64_t& totalHash_, Pro
 		}
 	}
 
-	ri.mergeRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, totalHash_, sharedSize, aDirtyProfiles);
+	ri.mergeRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, searchIndex, totalHash_, sharedSize, aDirtyProfiles);
 	dcdebug("Share changes applied for the directory %s\n", ri.path.c_str());
 	return true;
 }
 
 void ShareManager::on(TimerManagerListener::Minute, uint64_t aTick) noexcept {
 	if(lastSave == 0 || lastSave + 15*60*1000 <= aTick) {
-		saveXmlList();
+		saveShareCache();
 	}
 
 	if(SETTING(AUTO_REFRESH_TIME) > 0 && lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= aTick) {
@@ -2329,30 +2855,8 @@ FileList* ShareManager::generateXmlList(ProfileToken aProfile, bool forced /*fal
 	{
 		Lock lFl(fl->cs);
 		if (fl->allowGenerateNew(forced)) {
-			auto tmpName = fl->getFileName().substr(0, fl->getFileName().length() - 4);
 			try {
-				{
-					File f(tmpName, File::RW, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
-
-					toFilelist(f, ADC_ROOT_STR, aProfile, true);
-
-					fl->setXmlListLen(f.getSize());
-
-					File bz(fl->getFileName(), File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
-					// We don't care about the leaves...
-					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> bzTree(&bz);
-					FilteredOutputStream<BZFilter, false> bzipper(&bzTree);
-					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> newXmlFile(&bzipper);
-
-					newXmlFile.write(f.read());
-					newXmlFile.flushBuffers(false);
-
-					newXmlFile.getFilter().getTree().finalize();
-					bzTree.getFilter().getTree().finalize();
-
-					fl->setXmlRoot(newXmlFile.getFilter().getTree().getRoot());
-					fl->setBzXmlRoot(bzTree.getFilter().getTree().getRoot());
-				}
+				writeXmlList(*fl, aProfile);
 
 				fl->saveList();
 				fl->generationFinished(false);
@@ -2366,49 +2870,328 @@ FileList* ShareManager::generateXmlList(ProfileToken aProfile, bool forced /*fal
 					throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
 				}
 			}
-
-			File::deleteFile(tmpName);
 		}
 	}
 	return fl;
 }
 
-MemoryInputStream* ShareManager::generatePartialList(const string& aVirtualPath, bool aRecursive, const OptionalProfileToken& aProfile) const noexcept {
-	if (aVirtualPath.front() != ADC_SEPARATOR || aVirtualPath.back() != ADC_SEPARATOR) {
-		return 0;
+// Pad the XML with whitespace so that it fills complete tiger tree leaves
+static void padXmlLeaves(string& xml_) noexcept {
+	auto remainder = xml_.size() % TigerTree::BASE_BLOCK_SIZE;
+	if (remainder == 0) {
+		return;
 	}
 
-	string xml = Util::emptyString;
-
-	{
-		StringOutputStream sos(xml);
-		toFilelist(sos, aVirtualPath, aProfile, aRecursive);
-	}
+	// Keep the line feed at the end
+	auto pos = xml_.size() >= 2 && xml_.compare(xml_.size() - 2, 2, "\r\n") == 0 ? xml_.size() - 2 : xml_.size();
+	xml_.insert(pos, TigerTree::BASE_BLOCK_SIZE - remainder, ' ');
+}
 
-	if (xml.empty()) {
-		dcdebug("Partial NULL");
-		return nullptr;
-	} else {
-		dcdebug("Partial list generated (%s)\n", aVirtualPath.c_str());
-		return new MemoryInputStream(xml);
-	}
+static TigerTree::MerkleList getXmlLeaves(const string& aXml) noexcept {
+	TigerTree tree(TigerTree::BASE_BLOCK_SIZE);
+	tree.update(aXml.data(), aXml.size());
+	return move(tree.getLeaves());
 }
 
-void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const {
-	FilelistDirectory listRoot(Util::emptyString, 0);
-	Directory::List childDirectories;
+void ShareManager::writeXmlList(FileList& aList, ProfileToken aProfile) {
+	const auto start = GET_TICK();
 
-	RLock l(cs);
-	dcdebug("Generating filelist for %s \n", aVirtualPath.c_str());
+	struct FragmentTask {
+		FileList::Fragment* fragment;
+		Directory::List roots;
+		string xml;
+	};
 
-	// Get the directories
-	if (aVirtualPath == ADC_ROOT_STR) {
-		getRoots(aProfile, childDirectories);
-	} else {
-		try {
-			// We need to save the root directories as well for listing the files directly inside them
-			findVirtuals<OptionalProfileToken>(aVirtualPath, aProfile, listRoot.shareDirs);
-		} catch (...) {
+	struct CompressTask {
+		FragmentTask* task;
+		size_t pos;
+		BZBlockList blocks;
+	};
+
+	FileList::FragmentMap fragments;
+	vector<FragmentTask> fragmentTasks;
+	time_t baseDate = 0;
+
+	size_t peakMemory = aList.getFragmentCacheSize();
+
+	{
+		RLock l(cs);
+
+		// Roots with the same virtual name are merged in the list
+		map<string, Directory::List> rootGroups;
+
+		Directory::List roots;
+		getRoots(aProfile, roots);
+		for (const auto& d : roots) {
+			rootGroups[d->getVirtualNameLower()].push_back(d);
+			baseDate = max(baseDate, d->getLastWrite());
+		}
+
+		for (auto& g : rootGroups) {
+			vector<uint64_t> revisions;
+			for (const auto& d : g.second) {
+				revisions.push_back(d->getRevision());
+			}
+
+			sort(revisions.begin(), revisions.end());
+
+			auto& fragment = fragments[g.first];
+
+			auto old = aList.fragments.find(g.first);
+			if (old != aList.fragments.end() && old->second.rootRevisions == revisions) {
+				fragment = move(old->second);
+				reusedListFragments++;
+				continue;
+			}
+
+			fragment.rootRevisions = move(revisions);
+			fragmentTasks.push_back({ &fragment, std::move(g.second), Util::emptyString });
+		}
+
+		// Generate the XML for modified directories
+		parallel_for_each(fragmentTasks.begin(), fragmentTasks.end(), [](FragmentTask& aTask) {
+			FilelistDirectory listRoot(Util::emptyString, 0);
+			for (const auto& d : aTask.roots) {
+				d->toFileList(listRoot, true);
+			}
+
+			string tmp, indent = "\t";
+			StringOutputStream xmlFile(aTask.xml);
+			for (const auto ld : listRoot.listDirs | map_values) {
+				ld->toXml(xmlFile, indent, tmp, true);
+			}
+		});
+	}
+
+	// Compress the modified directories (large directories are split in multiple blocks that can be compressed in parallel)
+	vector<CompressTask> compressTasks;
+	for (auto& t : fragmentTasks) {
+		t.roots.clear();
+		padXmlLeaves(t.xml);
+		peakMemory += t.xml.size();
+
+		for (size_t pos = 0; pos < t.xml.size(); pos += BZBlockList::MAX_BLOCK_INPUT) {
+			compressTasks.push_back({ &t, pos, BZBlockList() });
+		}
+	}
+
+	parallel_for_each(compressTasks.begin(), compressTasks.end(), [](CompressTask& aTask) {
+		const auto& xml = aTask.task->xml;
+		aTask.blocks.compress(xml.data() + aTask.pos, min(xml.size() - aTask.pos, BZBlockList::MAX_BLOCK_INPUT));
+	});
+
+	parallel_for_each(fragmentTasks.begin(), fragmentTasks.end(), [](FragmentTask& aTask) {
+		aTask.fragment->leaves = getXmlLeaves(aTask.xml);
+		aTask.fragment->xmlSize = aTask.xml.size();
+	});
+
+	for (auto& t : compressTasks) {
+		t.task->fragment->blocks.append(move(t.blocks));
+	}
+
+	compressedListFragments += fragmentTasks.size();
+	fragmentTasks.clear();
+
+	// Header and footer
+	string header, tmp;
+	header += SimpleXML::utf8Header;
+	header += "<FileListing Version=\"1\" CID=\"" + ClientManager::getInstance()->getMe()->getCID().toBase32() +
+		"\" Base=\"" + SimpleXML::escape(ADC_ROOT_STR, tmp, false) +
+		"\" BaseDate=\"" + Util::toString(baseDate) +
+		"\" Generator=\"" + shortVersionString + "\">\r\n";
+	padXmlLeaves(header);
+
+	const string footer = "</FileListing>";
+
+	BZBlockList headerBlocks, footerBlocks;
+	headerBlocks.compress(header.data(), header.size());
+	footerBlocks.compress(footer.data(), footer.size());
+
+	// Write the compressed list
+	{
+		File bz(aList.getFileName(), File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
+		CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> bzTree(&bz);
+
+		BZBlockWriter bzipper(&bzTree);
+		bzipper.write(headerBlocks);
+		for (const auto& f : fragments | map_values) {
+			bzipper.write(f.blocks);
+		}
+
+		bzipper.write(footerBlocks);
+		bzipper.finish();
+
+		bzTree.flushBuffers(false);
+		bzTree.getFilter().getTree().finalize();
+		aList.setBzXmlRoot(bzTree.getFilter().getTree().getRoot());
+	}
+
+	// Tiger tree of the uncompressed list can be calculated from the leaves of each part
+	TigerTree xmlTree(TigerTree::BASE_BLOCK_SIZE);
+	auto& leaves = xmlTree.getLeaves();
+
+	int64_t xmlSize = header.size() + footer.size();
+	boost::copy(getXmlLeaves(header), back_inserter(leaves));
+	for (const auto& f : fragments | map_values) {
+		boost::copy(f.leaves, back_inserter(leaves));
+		xmlSize += f.xmlSize;
+	}
+
+	boost::copy(getXmlLeaves(footer), back_inserter(leaves));
+
+	xmlTree.setFileSize(xmlSize);
+	xmlTree.calcRoot();
+
+	aList.setXmlRoot(xmlTree.getRoot());
+	aList.setXmlListLen(xmlSize);
+
+	// Update the cache
+	size_t cacheSize = 0;
+	for (const auto& f : fragments | map_values) {
+		cacheSize += f.blocks.getCompressedSize() + f.leaves.size() * TigerTree::BYTES;
+	}
+
+	aList.fragments.swap(fragments);
+	aList.setFragmentCacheSize(cacheSize);
+
+	generatedLists++;
+	lastListGenerationTime = GET_TICK() - start;
+	listGenerationTime += lastListGenerationTime;
+	lastListPeakMemory = peakMemory + cacheSize;
+}
+
+MemoryInputStream* ShareManager::generatePartialList(const string& aVirtualPath, bool aRecursive, const OptionalProfileToken& aProfile) const noexcept {
+	if (aVirtualPath.front() != ADC_SEPARATOR || aVirtualPath.back() != ADC_SEPARATOR) {
+		return 0;
+	}
+
+	vector<uint64_t> revisions;
+	if (!getPartialListRevisions(aVirtualPath, aProfile, revisions)) {
+		return nullptr;
+	}
+
+	auto key = (aProfile ? Util::toString(*aProfile) : "*") + (aRecursive ? "R" : "N") + Text::toLower(aVirtualPath);
+
+	string xml = Util::emptyString;
+	if (getCachedPartialList(key, revisions, xml)) {
+		dcdebug("Partial list returned from cache (%s)\n", aVirtualPath.c_str());
+		return new MemoryInputStream(xml);
+	}
+
+	{
+		StringOutputStream sos(xml);
+		toFilelist(sos, aVirtualPath, aProfile, aRecursive);
+	}
+
+	// The tree may have changed after the revisions were fetched but the entry would be invalidated by the next request in that case
+	addCachedPartialList(key, move(revisions), xml);
+
+	if (xml.empty()) {
+		dcdebug("Partial NULL");
+		return nullptr;
+	} else {
+		dcdebug("Partial list generated (%s)\n", aVirtualPath.c_str());
+		return new MemoryInputStream(xml);
+	}
+}
+
+// Limits for the partial list cache
+static const size_t PARTIAL_LIST_CACHE_MAX_SIZE = 32 * 1024 * 1024;
+static const size_t PARTIAL_LIST_CACHE_MAX_ITEM_SIZE = 4 * 1024 * 1024;
+
+bool ShareManager::getPartialListRevisions(const string& aVirtualPath, const OptionalProfileToken& aProfile, vector<uint64_t>& revisions_) const noexcept {
+	Directory::List directories;
+
+	{
+		RLock l(cs);
+		if (aVirtualPath == ADC_ROOT_STR) {
+			getRoots(aProfile, directories);
+		} else {
+			try {
+				findVirtuals<OptionalProfileToken>(aVirtualPath, aProfile, directories);
+			} catch (...) {
+				return false;
+			}
+		}
+
+		for (const auto& d : directories) {
+			revisions_.push_back(d->getRevision());
+		}
+	}
+
+	sort(revisions_.begin(), revisions_.end());
+	return true;
+}
+
+bool ShareManager::getCachedPartialList(const string& aKey, const vector<uint64_t>& aRevisions, string& xml_) const noexcept {
+	Lock l(partialListCS);
+	auto i = partialListCacheIndex.find(aKey);
+	if (i == partialListCacheIndex.end()) {
+		partialListCacheMisses++;
+		return false;
+	}
+
+	if (i->second->revisions != aRevisions) {
+		// Modified
+		partialListCacheSize -= i->second->xml.size();
+		partialListCache.erase(i->second);
+		partialListCacheIndex.erase(i);
+
+		partialListCacheMisses++;
+		return false;
+	}
+
+	// Move to front
+	partialListCache.splice(partialListCache.begin(), partialListCache, i->second);
+
+	xml_ = i->second->xml;
+	partialListCacheHits++;
+	return true;
+}
+
+void ShareManager::addCachedPartialList(const string& aKey, vector<uint64_t>&& aRevisions, const string& aXml) const noexcept {
+	if (aXml.empty() || aXml.size() > PARTIAL_LIST_CACHE_MAX_ITEM_SIZE) {
+		return;
+	}
+
+	Lock l(partialListCS);
+
+	// Another thread may have added it already
+	auto i = partialListCacheIndex.find(aKey);
+	if (i != partialListCacheIndex.end()) {
+		partialListCacheSize -= i->second->xml.size();
+		partialListCache.erase(i->second);
+		partialListCacheIndex.erase(i);
+	}
+
+	partialListCache.push_front({ aKey, move(aRevisions), aXml });
+	partialListCacheIndex.emplace(aKey, partialListCache.begin());
+	partialListCacheSize += aXml.size();
+
+	// Remove the least recently used items
+	while (partialListCacheSize > PARTIAL_LIST_CACHE_MAX_SIZE) {
+		const auto& item = partialListCache.back();
+		partialListCacheSize -= item.xml.size();
+		partialListCacheIndex.erase(item.key);
+		partialListCache.pop_back();
+	}
+}
+
+void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const {
+	FilelistDirectory listRoot(Util::emptyString, 0);
+	Directory::List childDirectories;
+
+	RLock l(cs);
+	dcdebug("Generating filelist for %s \n", aVirtualPath.c_str());
+
+	// Get the directories
+	if (aVirtualPath == ADC_ROOT_STR) {
+		getRoots(aProfile, childDirectories);
+	} else {
+		try {
+			// We need to save the root directories as well for listing the files directly inside them
+			findVirtuals<OptionalProfileToken>(aVirtualPath, aProfile, listRoot.shareDirs);
+		} catch (...) {
 			return;
 		}
 
@@ -2547,15 +3330,6 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 	}
 }
 
-void ShareManager::Directory::filesToXmlList(OutputStream& xmlFile, string& indent, string& tmp2) const {
-	for(const auto& f: files) {
-		xmlFile.write(indent);
-		xmlFile.write(LITERAL("<File Name=\""));
-		xmlFile.write(SimpleXML::escape(f->name.lowerCaseOnly() ? f->name.getLower() : f->name.getNormal(), tmp2, true));
-		xmlFile.write(LITERAL("\"/>\r\n"));
-	}
-}
-
 ShareManager::Directory::File::File(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) : 
 	size(aFileInfo.getSize()), parent(aParent.get()), tth(aFileInfo.getRoot()), lastWrite(aFileInfo.getTimeStamp()), name(move(aName)) {
 	
@@ -2586,13 +3360,17 @@ string ShareManager::RootDirectory::getCacheXmlPath() const noexcept {
 	return Util::getPath(Util::PATH_SHARECACHE) + "ShareCache_" + Util::validateFileName(path) + ".xml";
 }
 
+string ShareManager::RootDirectory::getCacheBinaryPath() const noexcept {
+	return Util::getPath(Util::PATH_SHARECACHE) + "ShareCache_" + Util::validateFileName(path) + ".bin";
+}
+
 void ShareManager::RootDirectory::setName(const string& aName) noexcept {
 	virtualName.reset(new DualString(aName));
 }
 
 #define LITERAL(n) n, sizeof(n)-1
 
-void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noexcept {
+void ShareManager::saveShareCache(function<void(float)> progressF /*nullptr*/) noexcept {
 
 	if(xml_saving)
 		return;
@@ -2611,35 +3389,16 @@ void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noex
 
 		try {
 			parallel_for_each(dirtyDirs.begin(), dirtyDirs.end(), [&](const Directory::Ptr& d) {
-				string path = d->getRoot()->getCacheXmlPath();
+				string path = d->getRoot()->getCacheBinaryPath();
 				try {
-					{
-						string indent, tmp;
-
-						//create a backup first in case we get interrupted on creation.
-						File ff(path + ".tmp", File::WRITE, File::TRUNCATE | File::CREATE);
-						BufferedOutputStream<false> xmlFile(&ff);
-
-						xmlFile.write(SimpleXML::utf8Header);
-						xmlFile.write(LITERAL("<Share Version=\"" SHARE_CACHE_VERSION));
-						xmlFile.write(LITERAL("\" Path=\""));
-						xmlFile.write(SimpleXML::escape(d->getRoot()->getPath(), tmp, true));
-
-						xmlFile.write(LITERAL("\" Date=\""));
-						xmlFile.write(SimpleXML::escape(Util::toString(d->getLastWrite()), tmp, true));
-						xmlFile.write(LITERAL("\">\r\n"));
-						indent += '\t';
-
-						for (const auto& child : d->getDirectories()) {
-							child->toXmlList(xmlFile, indent, tmp);
-						}
-						d->filesToXmlList(xmlFile, indent, tmp);
-
-						xmlFile.write(LITERAL("</Share>"));
-					}
+					//create a backup first in case we get interrupted on creation.
+					saveBinaryCache(d, path + ".tmp");
 
 					File::deleteFile(path);
 					File::renameFile(path + ".tmp", path);
+
+					// Remove the cache from older versions
+					File::deleteFile(d->getRoot()->getCacheXmlPath());
 				} catch (Exception& e) {
 					LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, path % e.getError()), LogMessage::SEV_WARNING);
 				}
@@ -2659,25 +3418,63 @@ void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noex
 	lastSave = GET_TICK();
 }
 
-void ShareManager::Directory::toXmlList(OutputStream& xmlFile, string& indent, string& tmp) {
-	xmlFile.write(indent);
-	xmlFile.write(LITERAL("<Directory Name=\""));
-	xmlFile.write(SimpleXML::escape(realName.lowerCaseOnly() ? realName.getLower() : realName.getNormal(), tmp, true));
+void ShareManager::saveBinaryCache(const Directory::Ptr& aRoot, const string& aPath) {
+	vector<ShareCacheDirectory> directories;
+	vector<ShareCacheFile> files;
+	string stringPool;
 
-	xmlFile.write(LITERAL("\" Date=\""));
-	xmlFile.write(SimpleXML::escape(Util::toString(lastWrite), tmp, true));
-	xmlFile.write(LITERAL("\">\r\n"));
+	auto addString = [&stringPool](const string& aStr, uint32_t& offset_, uint32_t& length_) {
+		offset_ = static_cast<uint32_t>(stringPool.size());
+		length_ = static_cast<uint32_t>(aStr.size());
+		stringPool += aStr;
+	};
 
-	indent += '\t';
-	filesToXmlList(xmlFile, indent, tmp);
+	// Pre-order traversal, the parent index is always lower than the index of the directory
+	function<void(const Directory::Ptr&, uint32_t)> addDirectory = [&](const Directory::Ptr& aDir, uint32_t aParent) {
+		const auto index = static_cast<uint32_t>(directories.size());
 
-	for(const auto& d: directories) {
-		d->toXmlList(xmlFile, indent, tmp);
-	}
+		ShareCacheDirectory d;
+		memset(&d, 0, sizeof(ShareCacheDirectory));
+		if (aDir != aRoot) {
+			addString(aDir->realName.getNormal(), d.nameOffset, d.nameLength);
+		}
 
-	indent.erase(indent.length()-1);
-	xmlFile.write(indent);
-	xmlFile.write(LITERAL("</Directory>\r\n"));
+		d.lastWrite = aDir->getLastWrite();
+		d.parent = aParent;
+		d.fileCount = static_cast<uint32_t>(aDir->files.size());
+		directories.push_back(d);
+
+		for (const auto& f : aDir->files) {
+			ShareCacheFile fc;
+			addString(f->name.getNormal(), fc.nameOffset, fc.nameLength);
+			fc.size = f->getSize();
+			files.push_back(fc);
+		}
+
+		for (const auto& child : aDir->getDirectories()) {
+			addDirectory(child, index);
+		}
+	};
+
+	addDirectory(aRoot, 0);
+
+	ShareCacheHeader header;
+	memset(&header, 0, sizeof(ShareCacheHeader));
+	memcpy(header.magic, SHARE_CACHE_MAGIC, sizeof(SHARE_CACHE_MAGIC));
+	header.version = SHARE_CACHE_BINARY_VERSION;
+	header.byteOrder = SHARE_CACHE_BYTE_ORDER;
+	header.directoryCount = static_cast<uint32_t>(directories.size());
+	header.fileCount = static_cast<uint32_t>(files.size());
+	addString(aRoot->getRoot()->getPath(), header.pathOffset, header.pathLength);
+	header.stringPoolSize = static_cast<uint32_t>(stringPool.size());
+
+	File f(aPath, File::WRITE, File::TRUNCATE | File::CREATE);
+	BufferedOutputStream<false> os(&f);
+	os.write(&header, sizeof(ShareCacheHeader));
+	os.write(directories.data(), directories.size() * sizeof(ShareCacheDirectory));
+	os.write(files.data(), files.size() * sizeof(ShareCacheFile));
+	os.write(stringPool);
+	os.flushBuffers(true);
 }
 
 MemoryInputStream* ShareManager::generateTTHList(const string& dir, bool recurse, ProfileToken aProfile) const noexcept {
@@ -2783,23 +3580,108 @@ void ShareManager::nmdcSearch(SearchResultList& l, const string& nmdcString, int
 * but not the parents...
 */
 
-void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel) const noexcept{
-	const auto& dirName = getVirtualNameLower();
-	if (aStrings.isExcludedLower(dirName)) {
+void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel, bool aRecursive) const noexcept{
+	auto old = aStrings.recursion;
+
+	unique_ptr<SearchQuery::Recursion> rec = nullptr;
+	if (!enterSearch(&results_, aStrings, aLevel, rec)) {
 		return;
 	}
 
-	auto old = aStrings.recursion;
+	// Moving up
+	aLevel++;
 
-	unique_ptr<SearchQuery::Recursion> rec = nullptr;
+	// Match files
+	if(aStrings.itemType != SearchQuery::TYPE_DIRECTORY) {
+		for(const auto& f: files) {
+			if (!searchFile(results_, aStrings, aLevel, f)) {
+				break;
+			}
+		}
+	}
+
+	// Match directories
+	if (aRecursive) {
+		for(const auto& d: directories) {
+			d->search(results_, aStrings, aLevel);
+		}
+	}
+
+	leaveSearch(aStrings, old);
+}
+
+void ShareManager::Directory::searchBatch(const BatchSearchList& aSearches, int aLevel) const noexcept {
+	// Searches that continue in this directory
+	BatchSearchList entered;
+	vector<unique_ptr<SearchQuery::Recursion>> recursions(aSearches.size());
+	vector<SearchQuery::Recursion*> oldRecursions;
+
+	for (const auto& s : aSearches) {
+		auto old = s->search.recursion;
+		if (enterSearch(&s->results, s->search, aLevel, recursions[entered.size()])) {
+			entered.push_back(s);
+			oldRecursions.push_back(old);
+		}
+	}
+
+	if (entered.empty()) {
+		return;
+	}
+
+	// Moving up
+	aLevel++;
+
+	// Match files
+	BatchSearchList fileSearches;
+	boost::algorithm::copy_if(entered, back_inserter(fileSearches), [](const BatchSearch* s) { return s->search.itemType != SearchQuery::TYPE_DIRECTORY; });
+	for (const auto& f : files) {
+		if (fileSearches.empty()) {
+			break;
+		}
+
+		for (auto i = fileSearches.begin(); i != fileSearches.end();) {
+			if (!searchFile((*i)->results, (*i)->search, aLevel, f)) {
+				i = fileSearches.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+
+	// Match directories
+	for (const auto& d : directories) {
+		d->searchBatch(entered, aLevel);
+	}
+
+	for (size_t i = 0; i < entered.size(); ++i) {
+		leaveSearch(entered[i]->search, oldRecursions[i]);
+	}
+}
+
+bool ShareManager::Directory::searchFile(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel, const File* aFile) const noexcept {
+	if (!aStrings.matchesFileLower(aFile->name.getLower(), aFile->getSize(), aFile->getLastWrite())) {
+		return true;
+	}
+
+	results_.insert(Directory::SearchResultInfo(aFile, aStrings, aLevel));
+
+	// One file is enough when returning parents
+	return !aStrings.addParents;
+}
+
+bool ShareManager::Directory::enterSearch(SearchResultInfo::Set* results_, SearchQuery& aStrings, int aLevel, unique_ptr<SearchQuery::Recursion>& rec_) const noexcept {
+	const auto& dirName = getVirtualNameLower();
+	if (aStrings.isExcludedLower(dirName)) {
+		return false;
+	}
 
 	// Find any matches in the directory name
 	// Subdirectories of fully matched items won't match anything
 	if (aStrings.matchesAnyDirectoryLower(dirName)) {
 		bool positionsComplete = aStrings.positionsComplete();
-		if (aStrings.itemType != SearchQuery::TYPE_FILE && positionsComplete && aStrings.gt == 0 && aStrings.matchesDate(lastWrite)) {
+		if (results_ && aStrings.itemType != SearchQuery::TYPE_FILE && positionsComplete && aStrings.gt == 0 && aStrings.matchesDate(lastWrite)) {
 			// Full match
-			results_.insert(Directory::SearchResultInfo(this, aStrings, aLevel));
+			results_->insert(Directory::SearchResultInfo(this, aStrings, aLevel));
 			//if (aStrings.matchType == SearchQuery::MATCH_FULL_PATH) {
 			//	return;
 			//}
@@ -2819,60 +3701,198 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 			}
 
 			if (hasValidResult) {
-				rec.reset(new SearchQuery::Recursion(aStrings, dirName));
-				aStrings.recursion = rec.get();
+				rec_.reset(new SearchQuery::Recursion(aStrings, dirName));
+				aStrings.recursion = rec_.get();
 			}
 		}
 	}
 
 	// Moving up
-	aLevel++;
 	if (aStrings.recursion) {
 		aStrings.recursion->increase(dirName.length());
 	}
 
-	// Match files
-	if(aStrings.itemType != SearchQuery::TYPE_DIRECTORY) {
-		for(const auto& f: files) {
-			if (!aStrings.matchesFileLower(f->name.getLower(), f->getSize(), f->getLastWrite())) {
+	return true;
+}
+
+void ShareManager::Directory::leaveSearch(SearchQuery& aStrings, SearchQuery::Recursion* aOldRecursion) const noexcept {
+	// Moving to a lower level
+	if (aStrings.recursion) {
+		aStrings.recursion->decrease(getVirtualNameLower().length());
+	}
+
+	aStrings.recursion = aOldRecursion;
+}
+
+bool ShareManager::searchIndexed(Directory::SearchResultInfo::Set& results_, SearchQuery& aStrings, const Directory::List& aRoots, size_t& candidates_) const noexcept {
+	if (aStrings.include.empty()) {
+		return false;
+	}
+
+	// Walking through the candidate chains is more expensive than matching the items directly
+	SearchIndex::FileSet files;
+	SearchIndex::DirectorySet directories;
+	if (!searchIndex.findCandidates(aStrings.include.getPatterns(), searchIndex.getItemCount() / 4, files, directories)) {
+		return false;
+	}
+
+	candidates_ = files.size() + directories.size();
+
+	unordered_set<const Directory*> roots;
+	for (const auto& d : aRoots) {
+		roots.insert(d.get());
+	}
+
+	// Get the directory chain from the search root (returns an empty list if the item isn't located under the search roots)
+	// Items that are located inside other candidate directories will be matched when searching those directories
+	auto getChain = [&](const Directory* aDir, bool aIncludeSelf, vector<const Directory*>& chain_) {
+		for (auto cur = aDir; cur; cur = cur->getParent()) {
+			if ((cur != aDir || aIncludeSelf) && directories.find(cur) != directories.end()) {
+				break;
+			}
+
+			chain_.push_back(cur);
+			if (roots.find(cur) != roots.end()) {
+				reverse(chain_.begin(), chain_.end());
+				return;
+			}
+		}
+
+		chain_.clear();
+	};
+
+	vector<const Directory*> chain;
+	for (const auto& d : directories) {
+		chain.clear();
+		getChain(d, false, chain);
+		if (chain.empty()) {
+			continue;
+		}
+
+		chain.pop_back();
+		searchParents(chain, aStrings, [&](int aLevel) {
+			d->search(results_, aStrings, aLevel);
+		});
+	}
+
+	if (aStrings.itemType != SearchQuery::TYPE_DIRECTORY) {
+		// Group by directory so that the parents are walked through only once
+		unordered_map<const Directory*, vector<const Directory::File*>> filesByDirectory;
+		for (const auto& f : files) {
+			filesByDirectory[f->getParent()].push_back(f);
+		}
+
+		for (const auto& p : filesByDirectory) {
+			chain.clear();
+			getChain(p.first, true, chain);
+			if (chain.empty()) {
 				continue;
 			}
 
-			results_.insert(Directory::SearchResultInfo(f, aStrings, aLevel));
-			if (aStrings.addParents)
-				break;
+			searchParents(chain, aStrings, [&](int aLevel) {
+				for (const auto& f : p.second) {
+					if (!p.first->searchFile(results_, aStrings, aLevel, f)) {
+						break;
+					}
+				}
+			});
 		}
 	}
 
-	// Match directories
-	for(const auto& d: directories) {
-		d->search(results_, aStrings, aLevel);
+	return true;
+}
+
+void ShareManager::searchParents(const vector<const Directory*>& aParents, SearchQuery& aStrings, const function<void(int)>& aMatcher) noexcept {
+	vector<unique_ptr<SearchQuery::Recursion>> recursions(aParents.size());
+	vector<SearchQuery::Recursion*> oldRecursions;
+
+	int level = 0;
+	for (const auto& d : aParents) {
+		oldRecursions.push_back(aStrings.recursion);
+		if (!d->enterSearch(nullptr, aStrings, level, recursions[level])) {
+			oldRecursions.pop_back();
+			break;
+		}
+
+		level++;
 	}
 
-	// Moving to a lower level
-	if (aStrings.recursion) {
-		aStrings.recursion->decrease(dirName.length());
+	if (static_cast<size_t>(level) == aParents.size()) {
+		aMatcher(level);
 	}
 
-	aStrings.recursion = old;
+	while (level > 0) {
+		level--;
+		aParents[level]->leaveSearch(aStrings, oldRecursions[level]);
+	}
 }
 
-void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const OptionalProfileToken& aProfile, const CID& cid, const string& aDir, bool aIsAutoSearch) {
-	dcassert(!aDir.empty());
+void ShareManager::searchParallel(Directory::SearchResultInfo::Set& results_, const SearchQuery& aStrings, const Directory::List& aRoots) const noexcept {
+	struct SearchTask {
+		SearchTask(vector<const Directory*>&& aParents, const Directory* aDirectory, bool aRecursive) noexcept : 
+			parents(move(aParents)), directory(aDirectory), recursive(aRecursive) { }
+
+		vector<const Directory*> parents;
+		const Directory* directory;
+		bool recursive;
+
+		Directory::SearchResultInfo::Set results;
+	};
 
+	vector<SearchTask> tasks;
+	for (const auto& d : aRoots) {
+		tasks.emplace_back(vector<const Directory*>(), d.get(), true);
+	}
+
+	// Split the subtrees until there are enough tasks for all threads
+	// Files of a split directory are matched with a separate non-recursive task
+	const size_t minTasks = max(std::thread::hardware_concurrency(), 1U) * 4;
+	for (int depth = 0; depth < 3 && tasks.size() < minTasks; depth++) {
+		vector<SearchTask> split;
+		for (auto& t : tasks) {
+			if (!t.recursive || t.directory->getDirectories().empty()) {
+				split.push_back(move(t));
+				continue;
+			}
+
+			auto parents = t.parents;
+			parents.push_back(t.directory);
+			for (const auto& d : t.directory->getDirectories()) {
+				split.emplace_back(vector<const Directory*>(parents), d.get(), true);
+			}
+
+			split.emplace_back(move(t.parents), t.directory, false);
+		}
+
+		tasks.swap(split);
+	}
+
+	parallel_for_each(tasks.begin(), tasks.end(), [&](SearchTask& t) {
+		// Each task needs its own matching positions
+		auto search = aStrings;
+		searchParents(t.parents, search, [&](int aLevel) {
+			t.directory->search(t.results, search, aLevel, t.recursive);
+		});
+	});
+
+	for (const auto& t : tasks) {
+		results_.insert(t.results.begin(), t.results.end());
+	}
+}
+
+bool ShareManager::prepareSearch(SearchResultList& results, SearchQuery& srch, const OptionalProfileToken& aProfile, const CID& cid, const string& aDir, bool aIsAutoSearch, Directory::List& roots_) {
 	totalSearches++;
 	if (aProfile == SP_HIDDEN) {
-		return;
+		return false;
 	}
 
-	RLock l(cs);
 	if(srch.root) {
 		tthSearches++;
 		const auto i = tthIndex.equal_range(const_cast<TTHValue*>(&(*srch.root)));
 		for(auto& f: i | map_values) {
 			if (f->hasProfile(aProfile) && AirUtil::isParentOrExactAdc(aDir, f->getAdcPath())) {
 				f->addSR(results, srch.addParents);
-				return;
+				return false;
 			}
 		}
 
@@ -2884,7 +3904,7 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 				results.push_back(sr);
 			}
 		}
-		return;
+		return false;
 	}
 
 	recursiveSearches++;
@@ -2894,29 +3914,23 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 	for (const auto& p : srch.include.getPatterns()) {
 		if (!bloom->match(p.str())) {
 			filteredSearches++;
-			return;
+			return false;
 		}
 	}
 
 	// Get the search roots
-	Directory::List roots;
 	if (aDir == ADC_ROOT_STR) {
-		getRoots(aProfile, roots);
+		getRoots(aProfile, roots_);
 	} else {
-		findVirtuals<OptionalProfileToken>(aDir, aProfile, roots);
+		findVirtuals<OptionalProfileToken>(aDir, aProfile, roots_);
 	}
 
-	auto start = GET_TICK();
-
-	// go them through recursively
-	Directory::SearchResultInfo::Set resultInfos;
-	for (const auto& d: roots) {
-		d->search(resultInfos, srch, 0);
-	}
+	return true;
+}
 
+void ShareManager::completeSearch(SearchResultList& results, SearchQuery& srch, const OptionalProfileToken& aProfile, const Directory::SearchResultInfo::Set& resultInfos, uint64_t aMatchTime) noexcept {
 	// update statistics
-	auto end = GET_TICK();
-	recursiveSearchTime += end - start;
+	recursiveSearchTime += aMatchTime;
 	searchTokenCount += srch.include.count();
 	for (const auto& p : srch.include.getPatterns()) 
 		searchTokenLength += p.size();
@@ -2936,17 +3950,106 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 		recursiveSearchesResponded++;
 }
 
-void ShareManager::addDirName(const Directory::Ptr& aDir, Directory::MultiMap& aDirNames, ShareBloom& aBloom) noexcept {
+void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const OptionalProfileToken& aProfile, const CID& cid, const string& aDir, bool aIsAutoSearch) {
+	dcassert(!aDir.empty());
+
+	RLock l(cs);
+
+	Directory::List roots;
+	if (!prepareSearch(results, srch, aProfile, cid, aDir, aIsAutoSearch, roots)) {
+		return;
+	}
+
+	auto start = GET_TICK();
+
+	Directory::SearchResultInfo::Set resultInfos;
+
+	size_t candidates = 0;
+	if (searchIndexed(resultInfos, srch, roots, candidates)) {
+		indexedSearches++;
+		indexCandidateCount += candidates;
+	} else if (SETTING(PARALLEL_SEARCH_MATCHING)) {
+		searchParallel(resultInfos, srch, roots);
+	} else {
+		// go them through recursively
+		for (const auto& d: roots) {
+			d->search(resultInfos, srch, 0);
+		}
+	}
+
+	completeSearch(results, srch, aProfile, resultInfos, GET_TICK() - start);
+}
+
+void ShareManager::adcSearch(SearchBatch& aSearches) noexcept {
+	RLock l(cs);
+
+	// Searches that need to go through the whole tree, grouped by the search roots
+	map<Directory::List, vector<QueuedSearch*>> treeSearches;
+	for (auto& s : aSearches) {
+		dcassert(!s.dir.empty());
+
+		Directory::List roots;
+		try {
+			if (!prepareSearch(s.results, s.search, s.profile, s.cid, s.dir, s.isAutoSearch, roots)) {
+				continue;
+			}
+		} catch (const ShareException& e) {
+			s.error = e.getError();
+			continue;
+		}
+
+		auto start = GET_TICK();
+
+		Directory::SearchResultInfo::Set resultInfos;
+
+		size_t candidates = 0;
+		if (searchIndexed(resultInfos, s.search, roots, candidates)) {
+			indexedSearches++;
+			indexCandidateCount += candidates;
+			completeSearch(s.results, s.search, s.profile, resultInfos, GET_TICK() - start);
+			continue;
+		}
+
+		treeSearches[roots].push_back(&s);
+	}
+
+	for (const auto& p : treeSearches) {
+		auto start = GET_TICK();
+
+		vector<Directory::BatchSearch> batch;
+		batch.reserve(p.second.size());
+
+		Directory::BatchSearchList batchSearches;
+		for (const auto& s : p.second) {
+			batch.emplace_back(s->search);
+			batchSearches.push_back(&batch.back());
+		}
+
+		for (const auto& d : p.first) {
+			d->searchBatch(batchSearches, 0);
+		}
+
+		// The time is shared between the searches
+		auto matchTime = (GET_TICK() - start) / batch.size();
+		for (size_t i = 0; i < batch.size(); ++i) {
+			auto& s = *p.second[i];
+			completeSearch(s.results, s.search, s.profile, batch[i].results, matchTime);
+		}
+	}
+}
+
+void ShareManager::addDirName(const Directory::Ptr& aDir, Directory::MultiMap& aDirNames, SearchIndex& aSearchIndex, ShareBloom& aBloom) noexcept {
 	const auto& nameLower = aDir->getVirtualNameLower();
 
 #ifdef _DEBUG
 	checkAddedDirNameDebug(aDir, aDirNames);
 #endif
 	aDirNames.emplace(const_cast<string*>(&nameLower), aDir);
+	aSearchIndex.addDirectory(nameLower, aDir.get());
 	aBloom.add(nameLower);
 }
 
-void ShareManager::removeDirName(const Directory& aDir, Directory::MultiMap& aDirNames) noexcept {
+void ShareManager::removeDirName(const Directory& aDir, Directory::MultiMap& aDirNames, SearchIndex& aSearchIndex) noexcept {
 	auto directories = aDirNames.equal_range(const_cast<string*>(&aDir.getVirtualNameLower()));
 	auto p = find_if(directories | map_values, [&aDir](const Directory::Ptr& d) { return d.get() == &aDir; });
 	if (p.base() == aDirNames.end()) {
@@ -2955,6 +4058,7 @@ void ShareManager::removeDirName(const Directory& aDir, Directory::MultiMap& aDi
 	}
 
 	aDirNames.erase(p.base());
+	aSearchIndex.removeDirectory(aDir.getVirtualNameLower(), &aDir);
 }
 
 void ShareManager::shareBundle(const BundlePtr& aBundle) noexcept {
@@ -3047,7 +4151,7 @@ ShareManager::Directory::Ptr ShareManager::getDirectory(const string& aRealPath)
 	// Create missing directories
 	for (const auto& curName : tokens) {
 		curDir->updateModifyDate();
-		curDir = Directory::createNormal(DualString(curName), curDir, File::getLastModified(curDir->getRealPath()), lowerDirNameMap, *bloom.get());
+		curDir = Directory::createNormal(DualString(curName), curDir, File::getLastModified(curDir->getRealPath()), lowerDirNameMap, searchIndex, *bloom.get());
 	}
 
 	return curDir;
@@ -3068,25 +4172,25 @@ void ShareManager::onFileHashed(const string& fname, HashedFile& fileInfo) noexc
 			return;
 		}
 
-		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, *bloom.get(), sharedSize, &dirtyProfiles);
+		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, searchIndex, *bloom.get(), sharedSize, &dirtyProfiles);
 	}
 
 	setProfilesDirty(dirtyProfiles, false);
 }
 
-void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, SearchIndex& searchIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_) noexcept {
 	{
 		auto i = aDir->files.find(aName.getLower());
 		if (i != aDir->files.end()) {
 			// Get rid of false constness...
-			(*i)->cleanIndices(sharedSize_, tthIndex_);
-			delete *i;
+			(*i)->cleanIndices(sharedSize_, tthIndex_, searchIndex_);
+			aDir->fileStorage.destroy(*i);
 			aDir->files.erase(i);
 		}
 	}
 
-	auto it = aDir->files.insert_sorted(new Directory::File(move(aName), aDir, aFileInfo)).first;
-	(*it)->updateIndices(aBloom_, sharedSize_, tthIndex_);
+	auto it = aDir->files.insert_sorted(aDir->fileStorage.create(move(aName), aDir, aFileInfo)).first;
+	(*it)->updateIndices(aBloom_, sharedSize_, tthIndex_, searchIndex_);
 
 	if (dirtyProfiles_) {
 		aDir->copyRootProfiles(*dirtyProfiles_, true);
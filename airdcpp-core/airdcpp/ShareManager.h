@@ -37,6 +37,7 @@
 #include "SearchQuery.h"
 #include "ShareDirectoryInfo.h"
 #include "ShareProfile.h"
+#include "ShareSearchIndex.h"
 #include "Singleton.h"
 #include "SortedVector.h"
 #include "StringSearch.h"
@@ -153,6 +154,27 @@ public:
 	// Throws ShareException in case an invalid path is provided
 	void adcSearch(SearchResultList& l, SearchQuery& aSearch, const OptionalProfileToken& aProfile, const CID& cid, const string& aDir, bool isAutoSearch = false);
 
+	struct QueuedSearch {
+		QueuedSearch(SearchQuery& aSearch, const OptionalProfileToken& aProfile, const CID& aCid, const string& aDir, bool aIsAutoSearch) noexcept :
+			search(aSearch), profile(aProfile), cid(aCid), dir(aDir), isAutoSearch(aIsAutoSearch) { }
+
+		SearchQuery& search;
+		const OptionalProfileToken profile;
+		const CID cid;
+		const string dir;
+		const bool isAutoSearch;
+
+		SearchResultList results;
+
+		// Set if an invalid path was provided
+		string error;
+	};
+	typedef vector<QueuedSearch> SearchBatch;
+
+	// Match multiple searches at once
+	// Recursive searches with identical search roots are matched with a single pass through the directory tree
+	void adcSearch(SearchBatch& aSearches) noexcept;
+
 	// Check if a directory is shared
 	// You may also give a path in NMDC format and the relevant 
 	// directory (+ possible subdirectories) are detected automatically
@@ -181,7 +203,7 @@ public:
 	MemoryInputStream* getTree(const string& virtualFile, ProfileToken aProfile) const noexcept;
 	void toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const;
 
-	void saveXmlList(function<void (float)> progressF = nullptr) noexcept;	//for filelist caching
+	void saveShareCache(function<void (float)> progressF = nullptr) noexcept;	//for filelist caching
 
 	// Throws ShareException
 	AdcCommand getFileInfo(const string& aFile, ProfileToken aProfile);
@@ -258,9 +280,48 @@ public:
 		double averageSearchTokenLength = 0;
 
 		uint64_t autoSearches = 0, tthSearches = 0;
+
+		uint64_t indexedSearches = 0;
+		double averageIndexCandidateCount = 0;
+		size_t indexTokenCount = 0;
 	};
 	ShareSearchStats getSearchMatchingStats() const noexcept;
 
+	// Approximate memory usage of the share tree and its indexes
+	struct ShareMemoryStats {
+		size_t fileCount = 0;
+		size_t fileRecordCapacity = 0;
+		size_t fileRecordBytes = 0;
+		size_t directoryRecordBytes = 0;
+		size_t nameBytes = 0;
+		size_t itemListBytes = 0;
+		size_t tthIndexBytes = 0;
+		size_t directoryNameIndexBytes = 0;
+		size_t searchIndexBytes = 0;
+
+		size_t getTotal() const noexcept { return fileRecordBytes + directoryRecordBytes + nameBytes + itemListBytes + tthIndexBytes + directoryNameIndexBytes + searchIndexBytes; }
+	};
+	ShareMemoryStats getMemoryStats() const noexcept;
+
+	struct ShareFilelistStats {
+		uint64_t generatedLists = 0;
+		uint64_t averageGenerationMs = 0;
+		uint64_t lastGenerationMs = 0;
+
+		// Estimated peak memory usage of the last generation (including the cached fragments)
+		size_t lastPeakMemory = 0;
+
+		uint64_t reusedFragments = 0;
+		uint64_t compressedFragments = 0;
+		size_t cachedFragmentBytes = 0;
+
+		uint64_t partialListCacheHits = 0;
+		uint64_t partialListCacheMisses = 0;
+		size_t cachedPartialLists = 0;
+		size_t cachedPartialListBytes = 0;
+	};
+	ShareFilelistStats getFilelistStats() const noexcept;
+
 	void addRootDirectories(const ShareDirectoryInfoList& aNewDirs) noexcept;
 	void updateRootDirectories(const ShareDirectoryInfoList& renameDirs) noexcept;
 	void removeRootDirectories(const StringList& removeDirs) noexcept;
@@ -298,7 +359,9 @@ public:
 
 	mutable SharedMutex cs;
 
+	struct ShareCacheLoader;
 	struct ShareLoader;
+	struct BinaryShareLoader;
 
 	void setDefaultProfile(ProfileToken aNewDefault) noexcept;
 
@@ -331,6 +394,8 @@ private:
 	uint64_t searchTokenCount = 0;
 	uint64_t searchTokenLength = 0;
 	uint64_t autoSearches = 0;
+	uint64_t indexedSearches = 0;
+	uint64_t indexCandidateCount = 0;
 	typedef BloomFilter<5> ShareBloom;
 
 	class RootDirectory : boost::noncopyable {
@@ -365,6 +430,7 @@ private:
 
 			void setName(const string& aName) noexcept;
 			string getCacheXmlPath() const noexcept;
+			string getCacheBinaryPath() const noexcept;
 		private:
 			RootDirectory(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept;
 
@@ -388,6 +454,9 @@ private:
 			const string& operator()(const Ptr& a) const noexcept { return a->realName.getLower(); }
 		};
 
+		class File;
+		typedef ShareSearchIndex<File, Directory> SearchIndex;
+
 		class File {
 		public:
 			struct NameLower {
@@ -415,8 +484,43 @@ private:
 
 			DualString name;
 
-			void updateIndices(ShareBloom& aBloom_, int64_t& sharedSize_, File::TTHMap& tthIndex_) noexcept;
-			void cleanIndices(int64_t& sharedSize_, TTHMap& tthIndex_) noexcept;
+			void updateIndices(ShareBloom& aBloom_, int64_t& sharedSize_, File::TTHMap& tthIndex_, SearchIndex& searchIndex_) noexcept;
+			void cleanIndices(int64_t& sharedSize_, TTHMap& tthIndex_, SearchIndex& searchIndex_) noexcept;
+		};
+
+		// Storage for the file records of a single directory
+		// Records are allocated in contiguous blocks owned by the directory and they are never moved (the indexes refer to them by pointer)
+		// The directory must be locked (or private to the refreshing thread) when records are added or removed
+		class FileStorage {
+		public:
+			FileStorage() { }
+
+			// Allocate a block that fits the given number of new records
+			void reserve(size_t aCount);
+
+			File* create(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
+			void destroy(File* aFile) noexcept;
+
+			// Number of records that fit in the allocated blocks
+			size_t getCapacity() const noexcept { return capacity; }
+
+			FileStorage(FileStorage&) = delete;
+			FileStorage& operator=(FileStorage&) = delete;
+		private:
+			union Slot {
+				Slot* next;
+				typename std::aligned_storage<sizeof(File), alignof(File)>::type record;
+			};
+
+			void addBlock(size_t aSize);
+
+			// Maximum size for blocks that are allocated when the number of files isn't known beforehand
+			static const size_t MAX_GROW_BLOCK = 64;
+
+			vector<unique_ptr<Slot[]>> blocks;
+			Slot* freeSlots = nullptr;
+			size_t freeCount = 0;
+			size_t capacity = 0;
 		};
 
 		class SearchResultInfo {
@@ -454,16 +558,17 @@ private:
 
 		typedef SortedVector<Ptr, std::vector, string, Compare, NameLower> Set;
 		File::Set files;
+		FileStorage fileStorage;
 
-		static Ptr createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom) noexcept;
-		static Ptr createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom_, time_t aLastRefreshTime) noexcept;
+		static Ptr createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, SearchIndex& searchIndex_, ShareBloom& bloom) noexcept;
+		static Ptr createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, SearchIndex& searchIndex_, ShareBloom& bloom_, time_t aLastRefreshTime) noexcept;
 
 		// Set a new parent for the directory
 		// Possible directories with the same name must be removed from the parent first
 		static bool setParent(const Directory::Ptr& aDirectory, const Directory::Ptr& aParent) noexcept;
 
 		// Remove directory from possible parent and all shared containers
-		static void cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& aDirNames_) noexcept;
+		static void cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& aDirNames_, SearchIndex& searchIndex_) noexcept;
 
 		struct HasRootProfile {
 			HasRootProfile(const OptionalProfileToken& aProfile) : profile(aProfile) { }
@@ -494,25 +599,50 @@ private:
 
 		void getProfileInfo(ProfileToken aProfile, int64_t& totalSize, size_t& filesCount) const noexcept;
 
-		void search(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel) const noexcept;
+		// Subdirectories are skipped if aRecursive is false
+		void search(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel, bool aRecursive = true) const noexcept;
+
+		struct BatchSearch {
+			BatchSearch(SearchQuery& aSearch) noexcept : search(aSearch) { }
+
+			SearchQuery& search;
+			SearchResultInfo::Set results;
+		};
+		typedef vector<BatchSearch*> BatchSearchList;
+
+		// Match all searches while walking through the tree once
+		void searchBatch(const BatchSearchList& aSearches, int aLevel) const noexcept;
+
+		// Match the directory name and step into the directory (a full match is added in the results if the list is provided)
+		// The previous recursion must be restored with leaveSearch afterwards (unless false is returned for excluded directories)
+		bool enterSearch(SearchResultInfo::Set* aResults, SearchQuery& aStrings, int aLevel, unique_ptr<SearchQuery::Recursion>& recursion_) const noexcept;
+		void leaveSearch(SearchQuery& aStrings, SearchQuery::Recursion* aOldRecursion) const noexcept;
+
+		// Returns false if the search should not continue in this directory
+		bool searchFile(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel, const File* aFile) const noexcept;
 
 		void toFileList(FilelistDirectory& aListDir, bool aRecursive);
 		void toTTHList(OutputStream& tthList, string& tmp2, bool recursive) const;
 
-		//for file list caching
-		void toXmlList(OutputStream& xmlFile, string& indent, string& tmp);
-		void filesToXmlList(OutputStream& xmlFile, string& indent, string& tmp2) const;
-
 		GETSET(time_t, lastWrite, LastWrite);
 
+		// Some files were queued for hashing when the directory was read (the content can't be copied in incremental refreshes)
+		IGETSET(bool, hashPending, HashPending, false);
+
 		~Directory();
 
-		void copyRootProfiles(ProfileTokenSet& profiles_, bool setCacheDirty) const noexcept;
+		// Marks the directory and its parents as modified if setCacheDirty is true
+		void copyRootProfiles(ProfileTokenSet& profiles_, bool setCacheDirty) noexcept;
 		bool isRoot() const noexcept;
 
 		//void addBloom(ShareBloom& aBloom) const noexcept;
 
 		void countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles, size_t& lowerCaseFiles, size_t& totalStrLen_) const noexcept;
+		void countMemoryUsage(ShareMemoryStats& stats_) const noexcept;
+
+		// Release the unused capacity of the item lists after the directory content has been built
+		void compact() noexcept;
+
 		DualString realName;
 
 		// check for an updated modify date from filesystem
@@ -538,8 +668,14 @@ private:
 		Directory::Ptr findDirectoryByPath(const string& aPath, char separator) const noexcept;
 
 		Directory::Ptr findDirectoryByName(const string& aName) const noexcept;
+
+		// Changes whenever the content of the directory or any of its subdirectories is modified (unique across all directories)
+		uint64_t getRevision() const noexcept { return revision; }
+
+		// Update the revision of the directory and its parents
+		void increaseRevision() noexcept;
 	private:
-		void cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept;
+		void cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_, SearchIndex& searchIndex_) noexcept;
 
 		Directory* parent;
 		Set directories;
@@ -548,6 +684,8 @@ private:
 		int64_t size = 0;
 		RootDirectory::Ptr root;
 
+		uint64_t revision;
+
 		Directory(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, const RootDirectory::Ptr& aRoot = nullptr);
 		friend void intrusive_ptr_release(intrusive_ptr_base<Directory>*);
 
@@ -581,6 +719,27 @@ private:
 
 	typedef Directory::File::TTHMap HashFileMap;
 	HashFileMap tthIndex;
+
+	// Name tokens of all shared files and directories
+	typedef Directory::SearchIndex SearchIndex;
+	SearchIndex searchIndex;
+
+	// Search the candidates from the name index instead of walking through the whole tree
+	// Returns false if the index can't be used for this query
+	bool searchIndexed(Directory::SearchResultInfo::Set& aResults, SearchQuery& aStrings, const Directory::List& aRoots, size_t& candidates_) const noexcept;
+
+	// Split the roots (and their subtrees if there aren't enough roots) between the worker threads
+	// Each task matches a copy of the query and the results are merged afterwards
+	void searchParallel(Directory::SearchResultInfo::Set& aResults, const SearchQuery& aStrings, const Directory::List& aRoots) const noexcept;
+
+	// Step into the parent directories without adding them in the results before calling the matcher
+	// The recursion must be set for partial matches in the parent directory names
+	static void searchParents(const vector<const Directory*>& aParents, SearchQuery& aStrings, const function<void(int)>& aMatcher) noexcept;
+
+	// Handles TTH searches and collects the search roots for recursive searches (the caller must hold the lock)
+	// Returns false if there is nothing to match recursively
+	bool prepareSearch(SearchResultList& results_, SearchQuery& aSearch, const OptionalProfileToken& aProfile, const CID& aCid, const string& aDir, bool aIsAutoSearch, Directory::List& roots_);
+	void completeSearch(SearchResultList& results_, SearchQuery& aSearch, const OptionalProfileToken& aProfile, const Directory::SearchResultInfo::Set& aResultInfos, uint64_t aMatchTime) noexcept;
 	
 	ShareManager();
 	~ShareManager();
@@ -601,11 +760,48 @@ private:
 	// Throws ShareException
 	FileList* generateXmlList(ProfileToken aProfile, bool aForced = false);
 
+	// Writes the full compressed list of a profile, only the top-level directories with modified roots are compressed again
+	// Throws Exception
+	void writeXmlList(FileList& aList, ProfileToken aProfile);
+
+	uint64_t generatedLists = 0;
+	uint64_t listGenerationTime = 0;
+	uint64_t lastListGenerationTime = 0;
+	size_t lastListPeakMemory = 0;
+	uint64_t reusedListFragments = 0;
+	uint64_t compressedListFragments = 0;
+
+	// LRU cache for generated partial lists
+	// The entries are validated against the revisions of the listed directories when they are being accessed
+	struct PartialListCacheItem {
+		string key;
+		vector<uint64_t> revisions;
+		string xml;
+	};
+
+	typedef list<PartialListCacheItem> PartialListCacheList;
+	mutable PartialListCacheList partialListCache;
+	mutable unordered_map<string, PartialListCacheList::iterator> partialListCacheIndex;
+	mutable size_t partialListCacheSize = 0;
+	mutable uint64_t partialListCacheHits = 0;
+	mutable uint64_t partialListCacheMisses = 0;
+	mutable CriticalSection partialListCS;
+
+	// Returns false if the path doesn't exist in the profile
+	bool getPartialListRevisions(const string& aVirtualPath, const OptionalProfileToken& aProfile, vector<uint64_t>& revisions_) const noexcept;
+
+	bool getCachedPartialList(const string& aKey, const vector<uint64_t>& aRevisions, string& xml_) const noexcept;
+	void addCachedPartialList(const string& aKey, vector<uint64_t>&& aRevisions, const string& aXml) const noexcept;
+
 	// Throws ShareException
 	FileList* getFileList(ProfileToken aProfile) const;
 
 	bool loadCache(function<void(float)> progressF) noexcept;
 
+	// Write the binary cache file for a root directory
+	// Throws FileException
+	static void saveBinaryCache(const Directory::Ptr& aRoot, const string& aPath);
+
 	bool aShutdown = false;
 	
 	static atomic_flag refreshing;
@@ -635,26 +831,42 @@ private:
 		Directory::Map rootPathsNew;
 		Directory::MultiMap lowerDirNameMapNew;
 		HashFileMap tthIndexNew;
+		SearchIndex searchIndexNew;
 
 		string path;
 
 		ShareManager::ShareBloom& bloom;
 
-		void mergeRefreshChanges(Directory::MultiMap& aDirNameMap, Directory::Map& aRootPaths, HashFileMap& aTTHIndex, int64_t& totalHash, int64_t& totalAdded, ProfileTokenSet* dirtyProfiles) noexcept;
+		void mergeRefreshChanges(Directory::MultiMap& aDirNameMap, Directory::Map& aRootPaths, HashFileMap& aTTHIndex, SearchIndex& aSearchIndex, int64_t& totalHash, int64_t& totalAdded, ProfileTokenSet* dirtyProfiles) noexcept;
 		bool checkContent(const Directory::Ptr& aDirectory) noexcept;
 	};
 
 	class ShareBuilder : public RefreshInfo {
 	public:
-		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, bool& shutdown_, SharePathValidator& aPathValidator);
+		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, bool& shutdown_, SharePathValidator& aPathValidator, SharedMutex& aCS, bool aIncremental);
 
 		// Recursive function for building a new share tree from a path
 		bool buildTree() noexcept;
+
+		// Directories whose content was copied from the old tree (incremental refreshes only)
+		size_t skippedDirectories = 0;
+
+		// Directories that were read from disk
+		size_t scannedDirectories = 0;
 	private:
-		void buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory);
+		void buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory, const Directory::Ptr& aOldDirectory);
+
+		// Copy the content of an unmodified directory from the old tree
+		// The copied items are validated again and the files must have valid hash information (the file attributes aren't read from disk)
+		// Subdirectories are still checked individually because the modification date of a directory doesn't change when its subdirectories are modified
+		void copyTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory, const Directory::Ptr& aOldDirectory);
 
 		bool& shutdown;
 		SharePathValidator& pathValidator;
+
+		// Lock for reading the old tree
+		SharedMutex& cs;
+		const bool incremental;
 	};
 
 	typedef shared_ptr<ShareBuilder> ShareBuilderPtr;
@@ -675,10 +887,10 @@ private:
 	// Safe to call with non-root directories
 	void setRefreshState(const string& aPath, RefreshState aState, bool aUpdateRefreshTime) noexcept;
 
-	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr) noexcept;
+	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, SearchIndex& searchIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr) noexcept;
 
-	static void addDirName(const Directory::Ptr& dir, Directory::MultiMap& aDirNames, ShareBloom& aBloom) noexcept;
-	static void removeDirName(const Directory& dir, Directory::MultiMap& aDirNames) noexcept;
+	static void addDirName(const Directory::Ptr& dir, Directory::MultiMap& aDirNames, SearchIndex& aSearchIndex, ShareBloom& aBloom) noexcept;
+	static void removeDirName(const Directory& dir, Directory::MultiMap& aDirNames, SearchIndex& aSearchIndex) noexcept;
 
 #ifdef _DEBUG
 	// Checks that duplicate/incorrect directories/files won't get through
@@ -782,7 +994,7 @@ private:
 	void loadProfile(SimpleXML& aXml, const string& aName, ProfileToken aToken);
 	void save(SimpleXML& aXml);
 
-	void reportTaskStatus(uint8_t aTask, const RefreshPathList& aDirectories, bool finished, int64_t aHashSize, const string& displayName, RefreshType aRefreshType) const noexcept;
+	void reportTaskStatus(uint8_t aTask, const RefreshPathList& aDirectories, bool finished, int64_t aHashSize, const string& displayName, RefreshType aRefreshType, size_t aSkippedDirectories = 0, size_t aScannedDirectories = 0) const noexcept;
 	
 	ShareProfileList shareProfiles;
 }; //sharemanager end
@@ -195,7 +195,22 @@ void SharePathValidator::validate(FileFindIter& aIter, const string& aPath, bool
 		throw FileException("File is a symbolic link");
 	}
 
-	if (aIter->isDirectory()) {
+	validateItem(aPath, aIter->isDirectory(), aIter->isDirectory() ? 0 : aIter->getSize(), aSkipQueueCheck);
+}
+
+void SharePathValidator::validateCached(const string& aPath, bool aIsDirectory, int64_t aSize, bool aSkipQueueCheck) const {
+	if (!SETTING(SHARE_HIDDEN)) {
+		const auto name = aIsDirectory ? Util::getLastDir(aPath) : Util::getFileName(aPath);
+		if (name.size() > 1 && name.front() == '.') {
+			throw FileException("File is hidden");
+		}
+	}
+
+	validateItem(aPath, aIsDirectory, aSize, aSkipQueueCheck);
+}
+
+void SharePathValidator::validateItem(const string& aPath, bool aIsDirectory, int64_t aSize, bool aSkipQueueCheck) const {
+	if (aIsDirectory) {
 		checkSharedName(aPath, true);
 
 		if (!aSkipQueueCheck) {
@@ -214,10 +229,9 @@ void SharePathValidator::validate(FileFindIter& aIter, const string& aPath, bool
 			throw ShareException(error->formatError(error));
 		}
 	} else {
-		auto size = aIter->getSize();
-		checkSharedName(aPath, false, size);
+		checkSharedName(aPath, false, aSize);
 
-		auto error = fileValidationHook.runHooksError(aPath, size);
+		auto error = fileValidationHook.runHooksError(aPath, aSize);
 		if (error) {
 			throw ShareException(error->formatError(error));
 		}
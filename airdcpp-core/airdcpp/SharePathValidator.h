@@ -52,6 +52,10 @@ public:
 
 	void validate(FileFindIter& aIter, const string& aPath, bool aSkipQueueCheck) const;
 
+	// Validate an item whose attributes haven't been read from disk (e.g. content copied from the previous share tree)
+	// Names starting with a dot are considered hidden; symbolic links can't be detected
+	void validateCached(const string& aPath, bool aIsDirectory, int64_t aSize, bool aSkipQueueCheck) const;
+
 	void saveExcludes(SimpleXML& xml) const noexcept;
 	void loadExcludes(SimpleXML& xml) noexcept;
 
@@ -69,6 +73,9 @@ private:
 
 	bool isExcluded(const string& aPath) const noexcept;
 
+	// Checks that don't depend on the file attributes
+	void validateItem(const string& aPath, bool aIsDirectory, int64_t aSize, bool aSkipQueueCheck) const;
+
 	StringMatch skipList;
 	string winDir;
 
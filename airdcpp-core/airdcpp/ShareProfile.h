@@ -22,9 +22,11 @@
 #include <string>
 #include "forward.h"
 
+#include "BZUtils.h"
 #include "File.h"
 #include "GetSet.h"
 #include "HashValue.h"
+#include "MerkleTree.h"
 #include "TigerHash.h"
 #include "Util.h"
 
@@ -50,6 +52,10 @@ class FileList {
 		IGETSET(bool, xmlDirty, XmlDirty, true);
 		IGETSET(bool, forceXmlRefresh, ForceXmlRefresh, true); /// bypass the 15-minutes guard
 
+		// Size of the cached fragments (may be read without holding the lock)
+		size_t getFragmentCacheSize() const noexcept { return fragmentCacheSize; }
+		void setFragmentCacheSize(size_t aSize) noexcept { fragmentCacheSize = aSize; }
+
 		unique_ptr<File> bzXmlRef;
 		string getFileName() const noexcept;
 
@@ -58,8 +64,25 @@ class FileList {
 		void saveList();
 		CriticalSection cs;
 		int getCurrentNumber() const noexcept { return listN; }
+
+		// Compressed XML of a top-level directory, reused until any of its root directories is modified
+		struct Fragment {
+			// Revisions of the root directories that were used for generating the fragment
+			vector<uint64_t> rootRevisions;
+
+			BZBlockList blocks;
+
+			// Tiger tree leaves of the uncompressed XML (which is padded to full leaves)
+			TigerTree::MerkleList leaves;
+			int64_t xmlSize = 0;
+		};
+
+		// Lowercase virtual name -> fragment (should only be accessed while holding the lock)
+		typedef map<string, Fragment> FragmentMap;
+		FragmentMap fragments;
 	private:
 		int listN = 0;
+		atomic<size_t> fragmentCacheSize { 0 };
 };
 
 class ShareProfileInfo;
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SHARE_SEARCH_INDEX_H
+#define DCPLUSPLUS_DCPP_SHARE_SEARCH_INDEX_H
+
+#include "typedefs.h"
+
+#include "StringSearch.h"
+#include "Text.h"
+
+namespace dcpp {
+
+/*
+* Inverted index for mapping name tokens (parts of lowercase names separated by the separator characters) to the shared items.
+*
+* A search pattern that doesn't contain separators can only be matched inside a single token, so the tokens
+* containing the pattern are looked up through a secondary trigram index and the items are collected from their posting lists.
+*/
+template<class FileT, class DirectoryT>
+class ShareSearchIndex {
+public:
+	typedef unordered_set<const FileT*> FileSet;
+	typedef unordered_set<const DirectoryT*> DirectorySet;
+
+	// Patterns shorter than this can't be matched with the index
+	static const size_t MIN_TOKEN_LENGTH = 3;
+
+	ShareSearchIndex() { }
+	ShareSearchIndex(ShareSearchIndex&) = delete;
+	ShareSearchIndex& operator=(ShareSearchIndex&) = delete;
+
+	void addFile(const string& aNameLower, const FileT* aFile) noexcept {
+		for (const auto& t : tokenize(aNameLower)) {
+			getPostings(t).files.add(aFile);
+		}
+
+		fileCount++;
+	}
+
+	void removeFile(const string& aNameLower, const FileT* aFile) noexcept {
+		for (const auto& t : tokenize(aNameLower)) {
+			auto i = tokens.find(t);
+			if (i == tokens.end()) {
+				dcassert(0);
+				continue;
+			}
+
+			i->second.files.remove(aFile);
+			removeUnused(i);
+		}
+
+		fileCount--;
+	}
+
+	void addDirectory(const string& aNameLower, const DirectoryT* aDirectory) noexcept {
+		for (const auto& t : tokenize(aNameLower)) {
+			getPostings(t).directories.add(aDirectory);
+		}
+
+		directoryCount++;
+	}
+
+	void removeDirectory(const string& aNameLower, const DirectoryT* aDirectory) noexcept {
+		for (const auto& t : tokenize(aNameLower)) {
+			auto i = tokens.find(t);
+			if (i == tokens.end()) {
+				dcassert(0);
+				continue;
+			}
+
+			i->second.directories.remove(aDirectory);
+			removeUnused(i);
+		}
+
+		directoryCount--;
+	}
+
+	// Move all items from another index (the other index will be cleared)
+	void merge(ShareSearchIndex& aIndex) noexcept {
+		for (auto& p : aIndex.tokens) {
+			auto& postings = getPostings(p.first);
+			postings.files.merge(p.second.files);
+			postings.directories.merge(p.second.directories);
+		}
+
+		fileCount += aIndex.fileCount;
+		directoryCount += aIndex.directoryCount;
+		aIndex.clear();
+	}
+
+	void clear() noexcept {
+		trigrams.clear();
+		tokens.clear();
+		fileCount = 0;
+		directoryCount = 0;
+	}
+
+	// Returns true if the (lowercase) pattern can be looked up from the index
+	static bool isIndexable(const string& aPatternLower) noexcept {
+		return aPatternLower.size() >= MIN_TOKEN_LENGTH && none_of(aPatternLower.begin(), aPatternLower.end(), [](char c) { return Text::isSeparator(c); });
+	}
+
+	// Collects the items matching the most selective indexable pattern
+	// Each item in the share that matches all patterns must either be in the returned sets or be located inside one of the returned directories
+	// Returns false if none of the patterns can be used or the candidate count would exceed aMaxCandidates
+	bool findCandidates(const StringSearch::PatternList& aPatterns, size_t aMaxCandidates, FileSet& files_, DirectorySet& directories_) const noexcept {
+		TokenList bestTokens, curTokens;
+		size_t bestCount = 0;
+		bool hasIndexable = false;
+
+		for (const auto& p : aPatterns) {
+			if (!isIndexable(p.str())) {
+				continue;
+			}
+
+			curTokens.clear();
+			auto count = findTokens(p.str(), curTokens);
+			if (!hasIndexable || count < bestCount) {
+				bestCount = count;
+				bestTokens.swap(curTokens);
+				hasIndexable = true;
+			}
+
+			if (bestCount == 0) {
+				break;
+			}
+		}
+
+		if (!hasIndexable || bestCount > aMaxCandidates) {
+			return false;
+		}
+
+		for (const auto& t : bestTokens) {
+			t->files.forEach([&](const FileT* aFile) { files_.insert(aFile); });
+			t->directories.forEach([&](const DirectoryT* aDirectory) { directories_.insert(aDirectory); });
+		}
+
+		return true;
+	}
+
+	size_t getTokenCount() const noexcept { return tokens.size(); }
+	size_t getItemCount() const noexcept { return fileCount + directoryCount; }
+
+	// Approximate memory usage of the index (allocator overhead isn't included)
+	size_t getMemoryUsage() const noexcept {
+		size_t ret = (tokens.bucket_count() + trigrams.bucket_count()) * sizeof(void*);
+		for (const auto& t : tokens) {
+			ret += sizeof(typename TokenMap::value_type) + sizeof(void*) + t.first.capacity();
+			ret += t.second.files.getMemoryUsage() + t.second.directories.getMemoryUsage();
+		}
+
+		for (const auto& t : trigrams) {
+			ret += sizeof(typename TrigramMap::value_type) + sizeof(void*) + t.second.getMemoryUsage();
+		}
+
+		return ret;
+	}
+private:
+	// Compact list of item pointers (a single array instead of a hash node per item)
+	//
+	// New items are appended to an unsorted tail that is merged in the sorted part before items are removed.
+	// Removed items are marked in place (the items are aligned so that the lowest pointer bit is always free)
+	// and the list is compacted once half of it consists of removed items.
+	template<class ItemT>
+	class PostingList {
+	public:
+		void add(const ItemT* aItem) noexcept {
+			items.push_back(reinterpret_cast<uintptr_t>(aItem));
+		}
+
+		void remove(const ItemT* aItem) noexcept {
+			sort();
+
+			// The address may have been used by an earlier item that was removed
+			auto value = reinterpret_cast<uintptr_t>(aItem);
+			for (auto i = lower_bound(items.begin(), items.end(), value, compareItems); i != items.end() && (*i & ~REMOVED) == value; ++i) {
+				if (!(*i & REMOVED)) {
+					*i |= REMOVED;
+					removed++;
+
+					if (removed * 2 > items.size()) {
+						compact();
+					}
+
+					return;
+				}
+			}
+
+			dcassert(0);
+		}
+
+		// Move all items from another list
+		void merge(PostingList& aList) noexcept {
+			items.reserve(items.size() + aList.size());
+			aList.forEach([this](const ItemT* aItem) { add(aItem); });
+			aList.items.clear();
+			aList.items.shrink_to_fit();
+			aList.sortedCount = 0;
+			aList.removed = 0;
+		}
+
+		template<class F>
+		void forEach(F&& aF) const {
+			for (auto i : items) {
+				if (!(i & REMOVED)) {
+					aF(reinterpret_cast<const ItemT*>(i));
+				}
+			}
+		}
+
+		size_t size() const noexcept { return items.size() - removed; }
+		bool empty() const noexcept { return size() == 0; }
+		size_t getMemoryUsage() const noexcept { return items.capacity() * sizeof(uintptr_t); }
+	private:
+		static const uintptr_t REMOVED = 1;
+
+		static bool compareItems(uintptr_t a, uintptr_t b) noexcept {
+			return (a & ~REMOVED) < (b & ~REMOVED);
+		}
+
+		void sort() noexcept {
+			if (sortedCount == items.size()) {
+				return;
+			}
+
+			std::sort(items.begin() + sortedCount, items.end(), compareItems);
+			std::inplace_merge(items.begin(), items.begin() + sortedCount, items.end(), compareItems);
+			sortedCount = items.size();
+		}
+
+		void compact() noexcept {
+			items.erase(remove_if(items.begin(), items.end(), [](uintptr_t i) { return (i & REMOVED) != 0; }), items.end());
+			if (items.capacity() > items.size() * 2) {
+				items.shrink_to_fit();
+			}
+
+			sortedCount = items.size();
+			removed = 0;
+		}
+
+		vector<uintptr_t> items;
+		size_t sortedCount = 0;
+		size_t removed = 0;
+	};
+
+	struct Postings {
+		PostingList<FileT> files;
+		PostingList<DirectoryT> directories;
+	};
+
+	typedef unordered_map<string, Postings> TokenMap;
+	typedef vector<const Postings*> TokenList;
+	typedef unordered_map<uint32_t, PostingList<string>> TrigramMap;
+
+	TokenMap tokens;
+	TrigramMap trigrams;
+
+	size_t fileCount = 0;
+	size_t directoryCount = 0;
+
+	static uint32_t toTrigram(const string& aStr, size_t aPos) noexcept {
+		return static_cast<uint8_t>(aStr[aPos]) | static_cast<uint8_t>(aStr[aPos + 1]) << 8 | static_cast<uint8_t>(aStr[aPos + 2]) << 16;
+	}
+
+	// Split the name into unique tokens that are long enough to be indexed
+	static StringList tokenize(const string& aNameLower) noexcept {
+		StringList ret;
+
+		string::size_type start = 0;
+		for (string::size_type i = 0; i <= aNameLower.size(); ++i) {
+			if (i == aNameLower.size() || Text::isSeparator(aNameLower[i])) {
+				if (i - start >= MIN_TOKEN_LENGTH) {
+					auto token = aNameLower.substr(start, i - start);
+					if (find(ret.begin(), ret.end(), token) == ret.end()) {
+						ret.push_back(move(token));
+					}
+				}
+
+				start = i + 1;
+			}
+		}
+
+		return ret;
+	}
+
+	Postings& getPostings(const string& aToken) noexcept {
+		auto i = tokens.find(aToken);
+		if (i != tokens.end()) {
+			return i->second;
+		}
+
+		i = tokens.emplace(aToken, Postings()).first;
+		for (size_t j = 0; j + MIN_TOKEN_LENGTH <= aToken.size(); ++j) {
+			trigrams[toTrigram(aToken, j)].add(&i->first);
+		}
+
+		return i->second;
+	}
+
+	void removeUnused(typename TokenMap::iterator i) noexcept {
+		if (!i->second.files.empty() || !i->second.directories.empty()) {
+			return;
+		}
+
+		const auto& token = i->first;
+		for (size_t j = 0; j + MIN_TOKEN_LENGTH <= token.size(); ++j) {
+			auto t = trigrams.find(toTrigram(token, j));
+			if (t != trigrams.end()) {
+				t->second.remove(&token);
+				if (t->second.empty()) {
+					trigrams.erase(t);
+				}
+			}
+		}
+
+		tokens.erase(i);
+	}
+
+	// Find tokens containing the pattern, returns the total number of items in their posting lists
+	size_t findTokens(const string& aPatternLower, TokenList& tokens_) const noexcept {
+		// Use the least common trigram of the pattern for getting the possible tokens
+		const PostingList<string>* tokenPtrs = nullptr;
+		for (size_t j = 0; j + MIN_TOKEN_LENGTH <= aPatternLower.size(); ++j) {
+			auto t = trigrams.find(toTrigram(aPatternLower, j));
+			if (t == trigrams.end()) {
+				return 0;
+			}
+
+			if (!tokenPtrs || t->second.size() < tokenPtrs->size()) {
+				tokenPtrs = &t->second;
+			}
+		}
+
+		size_t count = 0;
+		tokenPtrs->forEach([&](const string* aToken) {
+			if (aToken->find(aPatternLower) == string::npos) {
+				return;
+			}
+
+			const auto& postings = tokens.find(*aToken)->second;
+			count += postings.files.size() + postings.directories.size();
+			tokens_.push_back(&postings);
+		});
+
+		return count;
+	}
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_SEARCH_INDEX_H)
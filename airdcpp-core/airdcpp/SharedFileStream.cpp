@@ -20,6 +20,7 @@
 #include "stdinc.h"
 
 #include "SharedFileStream.h"
+#include "TimerManager.h"
 
 #ifdef _WIN32
 # include "Winioctl.h"
@@ -30,15 +31,83 @@ namespace dcpp {
 CriticalSection SharedFileStream::cs;
 SharedFileStream::SharedFileHandleMap SharedFileStream::readpool;
 SharedFileStream::SharedFileHandleMap SharedFileStream::writepool;
+SharedFileCache SharedFileStream::readCache;
+list<SharedFileHandle*> SharedFileStream::idleReadHandles;
+
+const size_t SharedFileStream::MAX_IDLE_HANDLES;
+const uint64_t SharedFileStream::IDLE_HANDLE_TIMEOUT;
 
 SharedFileHandle::SharedFileHandle(const string& aPath, int aAccess, int aMode) : 
-	File(aPath, aAccess, aMode), ref_cnt(1), path(aPath), mode(aMode)
+	File(aPath, aAccess, aMode), ref_cnt(1), path(aPath), access(aAccess), mode(aMode)
 { }
 
+size_t SharedFileCache::read(SharedFileHandle& aHandle, void* buf, size_t len, int64_t aPos) {
+	BlockKey key(&aHandle, aPos / BLOCK_SIZE);
+	BlockPtr block;
+
+	{
+		Lock l(cs);
+		auto i = blocks.find(key);
+		if (i != blocks.end()) {
+			lru.splice(lru.begin(), lru, i->second.second);
+			block = i->second.first;
+		}
+	}
+
+	if (block) {
+		hits++;
+	} else {
+		misses++;
+
+		// read the whole block (other streams are likely to need it soon)
+		auto data = make_shared<ByteVector>(BLOCK_SIZE);
+		data->resize(aHandle.readAt(&(*data)[0], BLOCK_SIZE, key.second * BLOCK_SIZE));
+		block = data;
+
+		Lock l(cs);
+		if (blocks.find(key) == blocks.end()) {
+			lru.push_front(key);
+			blocks.emplace(key, make_pair(block, lru.begin()));
+
+			if (blocks.size() > MAX_BLOCKS) {
+				blocks.erase(lru.back());
+				lru.pop_back();
+			}
+		}
+	}
+
+	auto offset = static_cast<size_t>(aPos - key.second * BLOCK_SIZE);
+	if (offset >= block->size()) {
+		return 0;
+	}
+
+	len = min(len, block->size() - offset);
+	memcpy(buf, &(*block)[offset], len);
+	return len;
+}
+
+void SharedFileCache::remove(const SharedFileHandle* aHandle) noexcept {
+	Lock l(cs);
+	for (auto i = blocks.lower_bound(BlockKey(aHandle, 0)); i != blocks.end() && i->first.first == aHandle; ) {
+		lru.erase(i->second.second);
+		i = blocks.erase(i);
+	}
+}
+
 SharedFileStream::SharedFileStream(const string& aFileName, int aAccess, int aMode) {
 	Lock l(cs);
 	auto& pool = aAccess == File::READ ? readpool : writepool;
 	auto p = pool.find(aFileName);
+	if (p != pool.end() && p->second->ref_cnt == 0) {
+		// Idle read handle, make sure that the file hasn't been replaced or modified meanwhile
+		auto handle = p->second.get();
+		idleReadHandles.remove(handle);
+		if (File::getLastModified(aFileName) != handle->lastModified || File::getSize(aFileName) != handle->getSize()) {
+			removeReadHandle(handle);
+			p = pool.end();
+		}
+	}
+
 	if (p != pool.end()) {
 		sfh = p->second.get();
 		sfh->ref_cnt++;
@@ -53,11 +122,37 @@ SharedFileStream::~SharedFileStream() {
 
 	sfh->ref_cnt--;
 	if(sfh->ref_cnt == 0) {
-		auto& pool = sfh->mode == File::READ ? readpool : writepool;
-		pool.erase(sfh->path);
+		if (sfh->access == File::READ) {
+			readCache.remove(sfh);
+
+			sfh->idleSince = GET_TICK();
+			sfh->lastModified = sfh->getLastModified();
+			idleReadHandles.push_back(sfh);
+			if (idleReadHandles.size() > MAX_IDLE_HANDLES) {
+				auto oldest = idleReadHandles.front();
+				idleReadHandles.pop_front();
+				removeReadHandle(oldest);
+			}
+		} else {
+			writepool.erase(sfh->path);
+		}
     }
 }
 
+void SharedFileStream::removeReadHandle(SharedFileHandle* aHandle) noexcept {
+	// Deletes the handle
+	readpool.erase(aHandle->path);
+}
+
+void SharedFileStream::closeIdleHandles(uint64_t aTick) noexcept {
+	Lock l(cs);
+	while (!idleReadHandles.empty() && idleReadHandles.front()->idleSince + IDLE_HANDLE_TIMEOUT <= aTick) {
+		auto handle = idleReadHandles.front();
+		idleReadHandles.pop_front();
+		removeReadHandle(handle);
+	}
+}
+
 size_t SharedFileStream::write(const void* buf, size_t len) {
 	Lock l(sfh->cs);
 
@@ -69,15 +164,33 @@ size_t SharedFileStream::write(const void* buf, size_t len) {
 }
 
 size_t SharedFileStream::read(void* buf, size_t& len) {
-	Lock l(sfh->cs);
+	if (sfh->access == File::READ) {
+		// no need to lock as the file position isn't used
+		if (sfh->ref_cnt > 1) {
+			len = readCache.read(*sfh, buf, len, pos);
+		} else {
+			len = sfh->readAt(buf, len, pos);
+		}
+	} else {
+		Lock l(sfh->cs);
 
-	sfh->setPos(pos);
-	len = sfh->read(buf, len);
+		sfh->setPos(pos);
+		len = sfh->read(buf, len);
+	}
 
     pos += len;
 	return len;
 }
 
+File* SharedFileStream::getSourceFile(int64_t& pos_, int64_t& bytesLeft_) noexcept {
+	if (sfh->access != File::READ) {
+		return nullptr;
+	}
+
+	pos_ = pos;
+	bytesLeft_ = min(bytesLeft_, sfh->getSize() - pos);
+	return sfh;
+}
 int64_t SharedFileStream::getSize() const noexcept {
 	Lock l(sfh->cs);
 	return sfh->getSize();
@@ -24,6 +24,8 @@
 #include "Thread.h"
 #include "GetSet.h"
 
+#include <list>
+
 namespace dcpp {
 
 struct SharedFileHandle : File {
@@ -31,16 +33,58 @@ struct SharedFileHandle : File {
 	~SharedFileHandle() noexcept { }
 
 	CriticalSection cs;
-	int	ref_cnt;
+	atomic<int> ref_cnt;
 	string path;
+	int access;
 	int mode;
+
+	// Read handles without streams are kept open for a while (see SharedFileStream::closeIdleHandles)
+	uint64_t idleSince = 0;
+	time_t lastModified = 0;
+};
+
+/**
+ * Bounded LRU cache for blocks of files that are being read by multiple streams at the same time
+ * (e.g. popular files that are uploaded to several users). Reading whole blocks reduces disk seeks
+ * when the streams are reading different parts of the same file.
+ */
+class SharedFileCache {
+public:
+	static const size_t BLOCK_SIZE = 1024 * 1024;
+	static const size_t MAX_BLOCKS = 64;
+
+	// Reads data from the block containing aPos (the data won't span multiple blocks)
+	size_t read(SharedFileHandle& aHandle, void* buf, size_t len, int64_t aPos);
+
+	// Removes all blocks of the handle
+	void remove(const SharedFileHandle* aHandle) noexcept;
+
+	int64_t getHits() const noexcept { return hits; }
+	int64_t getMisses() const noexcept { return misses; }
+private:
+	typedef pair<const SharedFileHandle*, int64_t> BlockKey;
+	typedef shared_ptr<const ByteVector> BlockPtr;
+
+	// Most recently used blocks first
+	list<BlockKey> lru;
+	map<BlockKey, pair<BlockPtr, list<BlockKey>::iterator>> blocks;
+
+	atomic<int64_t> hits { 0 };
+	atomic<int64_t> misses { 0 };
+
+	CriticalSection cs;
 };
 
 class SharedFileStream : public IOStream
 {
 
 public:
+#ifdef _WIN32
 	typedef unordered_map<string, unique_ptr<SharedFileHandle>, noCaseStringHash, noCaseStringEq> SharedFileHandleMap;
+#else
+	// Paths that differ only by case are different files on case-sensitive file systems
+	typedef unordered_map<string, unique_ptr<SharedFileHandle>> SharedFileHandleMap;
+#endif
 
     SharedFileStream(const string& aFileName, int access, int mode);
     ~SharedFileStream();
@@ -53,14 +97,32 @@ public:
 
 	size_t flushBuffers(bool aForce) override;
 
+	File* getSourceFile(int64_t& pos_, int64_t& bytesLeft_) noexcept override;
+
     static CriticalSection cs;
 	static SharedFileHandleMap readpool;
 	static SharedFileHandleMap writepool;
 
+	// Read handles are kept open after the last stream has been closed so that consecutive segment requests
+	// for the same file don't need to reopen it
+	static const size_t MAX_IDLE_HANDLES = 32;
+	static const uint64_t IDLE_HANDLE_TIMEOUT = 30 * 1000;
+
+	// Close the read handles that have been idle for longer than IDLE_HANDLE_TIMEOUT
+	static void closeIdleHandles(uint64_t aTick) noexcept;
+
+	// Used by the read handles that have multiple streams
+	static SharedFileCache readCache;
+
 	void setPos(int64_t aPos) noexcept override;
 private:
+	// Least recently used first
+	static list<SharedFileHandle*> idleReadHandles;
+
+	static void removeReadHandle(SharedFileHandle* aHandle) noexcept;
+
 	SharedFileHandle* sfh;
-	int64_t pos;
+	int64_t pos = 0;
 };
 
 }
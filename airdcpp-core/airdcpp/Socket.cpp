@@ -20,6 +20,7 @@
 #include "Socket.h"
 
 #include "ConnectivityManager.h"
+#include "File.h"
 #include "format.h"
 #include "SettingsManager.h"
 #include "TimerManager.h"
@@ -32,6 +33,10 @@
 #endif
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #ifndef AI_ADDRCONFIG
 #define AI_ADDRCONFIG 0
 #endif
@@ -617,6 +622,29 @@ int Socket::write(const void* aBuffer, int aLen) {
 	return sent;
 }
 
+int Socket::sendFile(File& aFile, int64_t& aPos, int aLen) {
+#ifdef HAVE_SYS_SENDFILE_H
+	off_t offset = static_cast<off_t>(aPos);
+	auto sent = check([&] { return static_cast<int>(::sendfile(getSock(), aFile.getNativeHandle(), &offset, aLen)); }, true);
+	if(sent > 0) {
+		aPos += sent;
+		stats.totalUp += sent;
+	}
+	return sent;
+#else
+	dcassert(0);
+	throw SocketException(ENOTSUP);
+#endif
+}
+
+bool Socket::isSendFileSupported() const noexcept {
+#ifdef HAVE_SYS_SENDFILE_H
+	return true;
+#else
+	return false;
+#endif
+}
+
 /**
  * Sends data, will block until all data has been sent or an exception occurs
  * @param aBuffer Buffer with data
@@ -827,6 +855,29 @@ Socket::addrinfo_p Socket::resolveAddr(const string& name, const string& port, i
 	return addrinfo_p(result, &freeaddrinfo);
 }
 
+Socket::AddressInfo Socket::resolveHost(const string& aHost, const string& aPort) const {
+	auto result = resolveAddr(aHost, aPort);
+
+	string v4, v6;
+	for (auto ai = result.get(); ai; ai = ai->ai_next) {
+		if (ai->ai_family == AF_INET && v4.empty()) {
+			v4 = resolveName(ai->ai_addr, ai->ai_addrlen);
+		} else if (ai->ai_family == AF_INET6 && v6.empty()) {
+			v6 = resolveName(ai->ai_addr, ai->ai_addrlen);
+		}
+	}
+
+	if (!v4.empty() && !v6.empty()) {
+		return AddressInfo(v4, v6);
+	} else if (!v4.empty()) {
+		return AddressInfo(v4, AddressInfo::TYPE_V4);
+	} else if (!v6.empty()) {
+		return AddressInfo(v6, AddressInfo::TYPE_V6);
+	}
+
+	throw SocketException(EAI_NONAME);
+}
+
 string Socket::resolveName(const sockaddr* sa, socklen_t sa_len, int flags) {
 	char buf[1024];
 
@@ -923,6 +974,19 @@ void Socket::close() noexcept {
 	sock6.reset();
 }
 
+vector<socket_t> Socket::getHandles() const noexcept {
+	vector<socket_t> ret;
+	if(sock4.valid()) {
+		ret.push_back(sock4);
+	}
+
+	if(sock6.valid()) {
+		ret.push_back(sock6);
+	}
+
+	return ret;
+}
+
 void Socket::disconnect() noexcept {
 	shutdown();
 	close();
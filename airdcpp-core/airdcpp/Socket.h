@@ -170,6 +170,17 @@ public:
 	int write(const string& aData) { return write(aData.data(), (int)aData.length()); }
 	virtual void writeTo(const string& aIp, const string& aPort, const void* aBuffer, int aLen, bool proxy = true);
 	void writeTo(const string& aIp, const string& aPort, const string& aData) { writeTo(aIp, aPort, aData.data(), (int)aData.length()); }
+
+	/**
+	 * Sends data from the file position aPos without copying it to user space
+	 * aPos is advanced by the number of bytes sent (the file position of aFile isn't used)
+	 * @return Number of bytes sent, 0 if the end of file was reached and -1 if the call would block.
+	 * @throw SocketException On any failure.
+	 */
+	virtual int sendFile(File& aFile, int64_t& aPos, int aLen);
+
+	// Whether sendFile can be used with this socket
+	virtual bool isSendFileSupported() const noexcept;
 	virtual void shutdown() noexcept;
 	virtual void close() noexcept;
 	void disconnect() noexcept;
@@ -207,6 +218,12 @@ public:
 	static string resolve(const string& aDns, int af = AF_UNSPEC) noexcept;
 	addrinfo_p resolveAddr(const string& name, const string& port, int family = AF_UNSPEC, int flags = 0) const;
 
+	/**
+	 * Resolves a host name to numeric addresses (one for each address family)
+	 * @throw SocketException If the name couldn't be resolved.
+	 */
+	AddressInfo resolveHost(const string& aHost, const string& aPort) const;
+
 	static uint64_t getTotalDown() { return stats.totalDown; }
 	static uint64_t getTotalUp() { return stats.totalUp; }
 
@@ -247,6 +264,9 @@ public:
 	}
 
 	bool isV6Valid() const noexcept;
+
+	/** Currently open handles (both IPv4 and IPv6 handles are open while connecting to a dual-stack address) */
+	std::vector<socket_t> getHandles() const noexcept;
 protected:
 	typedef union {
 		sockaddr sa;
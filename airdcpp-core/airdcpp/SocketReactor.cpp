@@ -0,0 +1,442 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "SocketReactor.h"
+
+#include "BufferedSocket.h"
+#include "SettingsManager.h"
+#include "TimerManager.h"
+
+#include <chrono>
+
+#ifdef USE_EPOLL
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <unistd.h>
+#elif defined(_WIN32)
+# define POLL_SOCKETS ::WSAPoll
+typedef WSAPOLLFD PollFd;
+#else
+# include <poll.h>
+# define POLL_SOCKETS ::poll
+typedef pollfd PollFd;
+#endif
+
+namespace dcpp {
+
+// How often the socket deadlines are being checked
+#define TIMER_INTERVAL 50
+
+#ifdef USE_EPOLL
+# define MAX_EVENTS 256
+
+// Event data for the wakeup event (socket IDs start from 1)
+# define WAKEUP_ID 0
+#else
+// There's no wakeup mechanism when polling so new tasks may be delayed by this much
+# define POLL_INTERVAL 20
+#endif
+
+SocketReactor::SocketReactor() noexcept {
+
+}
+
+SocketReactor::~SocketReactor() {
+	// The loops wait for the blocking calls of their sockets when they are stopped
+	for (auto& l : loops) {
+		l->stop();
+	}
+
+	stopWorkers();
+}
+
+void SocketReactor::callBlocking(function<void ()>&& aF) noexcept {
+	{
+		unique_lock<mutex> l(workerMtx);
+		dcassert(!workersStopping);
+		blockingCalls.push_back(move(aF));
+
+		if (idleWorkers < static_cast<int>(blockingCalls.size()) && static_cast<int>(workers.size()) < MAX_WORKERS) {
+			auto worker = make_unique<Worker>(*this);
+			try {
+				worker->start();
+				workers.push_back(move(worker));
+			} catch (const ThreadException& e) {
+				dcdebug("SocketReactor: failed to start a worker: %s\n", e.getError().c_str());
+			}
+		}
+
+		if (!workers.empty()) {
+			l.unlock();
+			workerCondition.notify_one();
+			return;
+		}
+
+		// No threads can be started, don't leave the socket waiting
+		aF = move(blockingCalls.back());
+		blockingCalls.pop_back();
+	}
+
+	aF();
+}
+
+void SocketReactor::stopWorkers() noexcept {
+	{
+		lock_guard<mutex> l(workerMtx);
+		workersStopping = true;
+	}
+
+	workerCondition.notify_all();
+	for (auto& w : workers) {
+		w->join();
+	}
+
+	dcassert(blockingCalls.empty());
+}
+
+int SocketReactor::Worker::run() {
+	for (;;) {
+		function<void ()> f;
+
+		{
+			unique_lock<mutex> l(reactor.workerMtx);
+			reactor.idleWorkers++;
+			reactor.workerCondition.wait(l, [this] { return reactor.workersStopping || !reactor.blockingCalls.empty(); });
+			reactor.idleWorkers--;
+
+			if (reactor.blockingCalls.empty()) {
+				// Stopping
+				return 0;
+			}
+
+			f = move(reactor.blockingCalls.front());
+			reactor.blockingCalls.pop_front();
+		}
+
+		f();
+	}
+}
+
+void SocketReactor::startLoops() noexcept {
+	auto threads = max(SETTING(SOCKET_IO_THREADS), 1);
+	for (int i = 0; i < threads; ++i) {
+		loops.push_back(make_unique<Loop>());
+		loops.back()->start();
+	}
+
+	dcdebug("SocketReactor: %d loops started\n", threads);
+}
+
+SocketReactor::Loop* SocketReactor::addSocket(BufferedSocket* aSocket) noexcept {
+	Loop* loop = nullptr;
+
+	{
+		lock_guard<mutex> l(mtx);
+		if (loops.empty()) {
+			startLoops();
+		}
+
+		for (const auto& l : loops) {
+			if (!loop || l->getSocketCount() < loop->getSocketCount()) {
+				loop = l.get();
+			}
+		}
+	}
+
+	loop->add(aSocket);
+	return loop;
+}
+
+SocketReactor::Stats SocketReactor::getStats() const noexcept {
+	Stats ret;
+
+	lock_guard<mutex> l(mtx);
+	ret.threads = static_cast<int>(loops.size());
+	for (const auto& loop : loops) {
+		ret.sockets += loop->getSocketCount();
+		ret.averageLatency += loop->getAverageLatency();
+		ret.maxLatency = max(ret.maxLatency, loop->getMaxLatency());
+	}
+
+	if (!loops.empty()) {
+		ret.averageLatency /= loops.size();
+	}
+
+	lock_guard<mutex> wl(workerMtx);
+	ret.workerThreads = static_cast<int>(workers.size());
+	ret.queuedCalls = blockingCalls.size();
+
+	return ret;
+}
+
+SocketReactor::Loop::Loop() noexcept : socketCount(0), averageLatency(0), maxLatency(0) {
+#ifdef USE_EPOLL
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKEUP_ID;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &ev) == -1) {
+		dcdebug("SocketReactor: failed to add the wakeup event: %s\n", Util::translateError(errno).c_str());
+	}
+#endif
+}
+
+SocketReactor::Loop::~Loop() {
+#ifdef USE_EPOLL
+	::close(eventFd);
+	::close(epollFd);
+#endif
+}
+
+void SocketReactor::Loop::stop() noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		stopping = true;
+	}
+
+	wakeup();
+	join();
+}
+
+void SocketReactor::Loop::add(BufferedSocket* aSocket) noexcept {
+	socketCount++;
+
+	{
+		lock_guard<mutex> l(mtx);
+		added.push_back(aSocket);
+	}
+}
+
+void SocketReactor::Loop::schedule(uint64_t aSocketId) noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		scheduled.push_back(aSocketId);
+		if (notified) {
+			return;
+		}
+
+		notified = true;
+	}
+
+	wakeup();
+}
+
+#ifdef USE_EPOLL
+
+void SocketReactor::Loop::wakeup() noexcept {
+	uint64_t value = 1;
+	if (::write(eventFd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+		dcdebug("SocketReactor: wakeup failed: %s\n", Util::translateError(errno).c_str());
+	}
+}
+
+void SocketReactor::Loop::addHandle(socket_t aHandle, uint64_t aSocketId) noexcept {
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.u64 = aSocketId;
+
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, aHandle, &ev) == -1) {
+		if (errno != EEXIST || epoll_ctl(epollFd, EPOLL_CTL_MOD, aHandle, &ev) == -1) {
+			dcdebug("SocketReactor: failed to add socket %d: %s\n", aHandle, Util::translateError(errno).c_str());
+		}
+	}
+}
+
+void SocketReactor::Loop::waitEvents(vector<uint64_t>& ready_, uint64_t aTimeout) noexcept {
+	epoll_event events[MAX_EVENTS];
+
+	auto n = epoll_wait(epollFd, events, MAX_EVENTS, static_cast<int>(aTimeout));
+	for (int i = 0; i < n; ++i) {
+		if (events[i].data.u64 == WAKEUP_ID) {
+			uint64_t value;
+			while (::read(eventFd, &value, sizeof(value)) > 0) { }
+			continue;
+		}
+
+		ready_.push_back(events[i].data.u64);
+	}
+}
+
+#else
+
+void SocketReactor::Loop::wakeup() noexcept {
+	// The loop will notice the scheduled sockets within POLL_INTERVAL
+}
+
+void SocketReactor::Loop::addHandle(socket_t /*aHandle*/, uint64_t /*aSocketId*/) noexcept {
+	// The handles are retrieved from the sockets before each poll
+}
+
+void SocketReactor::Loop::waitEvents(vector<uint64_t>& ready_, uint64_t aTimeout) noexcept {
+	auto timeout = static_cast<int>(min<uint64_t>(aTimeout, POLL_INTERVAL));
+
+	vector<PollFd> fds;
+	vector<uint64_t> ids;
+	for (const auto& s : sockets) {
+		short events = (s.second->wantRead ? POLLIN : 0) | (s.second->wantWrite ? POLLOUT : 0);
+		if (events == 0) {
+			continue;
+		}
+
+		for (auto h : s.second->handles) {
+			PollFd fd;
+			memset(&fd, 0, sizeof(fd));
+			fd.fd = h;
+			fd.events = events;
+
+			fds.push_back(fd);
+			ids.push_back(s.first);
+		}
+	}
+
+	if (fds.empty()) {
+		Thread::sleep(timeout);
+		return;
+	}
+
+	if (POLL_SOCKETS(&fds[0], static_cast<unsigned long>(fds.size()), timeout) <= 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < fds.size(); ++i) {
+		if (fds[i].revents != 0) {
+			ready_.push_back(ids[i]);
+		}
+	}
+}
+
+#endif
+
+void SocketReactor::Loop::process(uint64_t aSocketId) noexcept {
+	auto i = sockets.find(aSocketId);
+	if (i == sockets.end()) {
+		// Deleted already
+		return;
+	}
+
+	auto socket = i->second;
+	socket->deadline = 0;
+	if (!socket->process()) {
+		sockets.erase(i);
+		socketCount--;
+
+		delete socket;
+	}
+}
+
+void SocketReactor::Loop::updateLatency(uint64_t aMicroseconds) noexcept {
+	averageLatency = (averageLatency * 15 + aMicroseconds) / 16;
+
+	// Maximum of the previous second
+	windowMaxLatency = max(windowMaxLatency, aMicroseconds);
+
+	auto tick = GET_TICK();
+	if (tick >= windowStart + 1000) {
+		maxLatency = windowMaxLatency;
+		windowMaxLatency = 0;
+		windowStart = tick;
+	}
+}
+
+int SocketReactor::Loop::run() {
+	vector<uint64_t> ready;
+	uint64_t nextTimerCheck = 0;
+
+	for (;;) {
+		auto tick = GET_TICK();
+
+		ready.clear();
+		waitEvents(ready, nextTimerCheck > tick ? nextTimerCheck - tick : 0);
+
+		auto start = std::chrono::steady_clock::now();
+
+		{
+			lock_guard<mutex> l(mtx);
+			if (stopping) {
+				break;
+			}
+
+			for (auto s : added) {
+				sockets.emplace(s->id, s);
+			}
+
+			added.clear();
+
+			ready.insert(ready.end(), scheduled.begin(), scheduled.end());
+			scheduled.clear();
+			notified = false;
+		}
+
+		tick = GET_TICK();
+		if (tick >= nextTimerCheck) {
+			for (const auto& s : sockets) {
+				if (s.second->deadline != 0 && s.second->deadline <= tick) {
+					ready.push_back(s.first);
+				}
+			}
+
+			nextTimerCheck = tick + TIMER_INTERVAL;
+		}
+
+		if (ready.empty()) {
+			continue;
+		}
+
+		sort(ready.begin(), ready.end());
+		ready.erase(unique(ready.begin(), ready.end()), ready.end());
+
+		for (auto id : ready) {
+			process(id);
+		}
+
+		updateLatency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	abortSockets();
+	return 0;
+}
+
+void SocketReactor::Loop::abortSockets() noexcept {
+	{
+		lock_guard<mutex> l(mtx);
+		for (auto s : added) {
+			sockets.emplace(s->id, s);
+		}
+
+		added.clear();
+	}
+
+	if (!sockets.empty()) {
+		dcdebug("SocketReactor: deleting %d sockets that haven't been shut down\n", static_cast<int>(sockets.size()));
+	}
+
+	for (const auto& s : sockets) {
+		s.second->abort();
+		delete s.second;
+	}
+
+	sockets.clear();
+	socketCount = 0;
+}
+
+} // namespace dcpp
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+#define DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+
+#include "typedefs.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include "Singleton.h"
+#include "Socket.h"
+#include "Thread.h"
+
+#ifdef __linux__
+# define USE_EPOLL
+#endif
+
+namespace dcpp {
+
+class BufferedSocket;
+
+/*
+* Event loops that perform the I/O and tasks of all buffered sockets
+*
+* Each socket is assigned to a single loop thread for its whole lifetime so that all its tasks and listener events
+* are still being run from the same thread. epoll (edge-triggered) is used on Linux, other platforms fall back to polling.
+*/
+class SocketReactor : public Singleton<SocketReactor> {
+public:
+	class Loop;
+
+	struct Stats {
+		int threads = 0;
+		size_t sockets = 0;
+
+		// Threads for the blocking calls and the calls waiting for a free thread
+		int workerThreads = 0;
+		size_t queuedCalls = 0;
+
+		// Time spent on processing the ready sockets during a single loop iteration (microseconds)
+		uint64_t averageLatency = 0;
+		uint64_t maxLatency = 0;
+	};
+
+	// Assign the socket for the least busy loop (the loops are started when the first socket is added)
+	Loop* addSocket(BufferedSocket* aSocket) noexcept;
+
+	Stats getStats() const noexcept;
+
+	// Maximum number of worker threads for the blocking calls
+	static const int MAX_WORKERS = 8;
+
+	// Run a blocking function (such as a DNS lookup or a file request) in a worker thread so that the loops won't be blocked
+	// The workers are shared by all sockets and started when needed, calls are run in the order they were added (thread-safe)
+	void callBlocking(function<void ()>&& aF) noexcept;
+
+	class Loop : public Thread {
+	public:
+		Loop() noexcept;
+		~Loop();
+
+		// Process the socket from the loop thread as soon as possible (thread-safe)
+		void schedule(uint64_t aSocketId) noexcept;
+
+		// Start receiving events for a new socket handle (loop thread only)
+		// Closed handles are removed automatically
+		void addHandle(socket_t aHandle, uint64_t aSocketId) noexcept;
+
+		// Stop the loop thread, the sockets that are still assigned to the loop are deleted
+		void stop() noexcept;
+
+		size_t getSocketCount() const noexcept { return socketCount; }
+		uint64_t getAverageLatency() const noexcept { return averageLatency; }
+		uint64_t getMaxLatency() const noexcept { return maxLatency; }
+	private:
+		friend class SocketReactor;
+
+		int run() override;
+
+		void add(BufferedSocket* aSocket) noexcept;
+
+		// Wait for socket events, returns the IDs of the sockets that have received events
+		void waitEvents(vector<uint64_t>& ready_, uint64_t aTimeout) noexcept;
+		void wakeup() noexcept;
+
+		void process(uint64_t aSocketId) noexcept;
+
+		// Run the pending shutdown callbacks and delete the remaining sockets after the loop has been stopped
+		void abortSockets() noexcept;
+		void updateLatency(uint64_t aMicroseconds) noexcept;
+
+		unordered_map<uint64_t, BufferedSocket*> sockets;
+
+		// Shared with other threads
+		mutable std::mutex mtx;
+		vector<BufferedSocket*> added;
+		vector<uint64_t> scheduled;
+		bool notified = false;
+		bool stopping = false;
+
+		atomic<size_t> socketCount;
+		atomic<uint64_t> averageLatency;
+		atomic<uint64_t> maxLatency;
+
+		uint64_t windowMaxLatency = 0;
+		uint64_t windowStart = 0;
+
+#ifdef USE_EPOLL
+		int epollFd = -1;
+		int eventFd = -1;
+#endif
+	};
+private:
+	friend class Singleton<SocketReactor>;
+
+	SocketReactor() noexcept;
+	~SocketReactor();
+
+	void startLoops() noexcept;
+
+	mutable std::mutex mtx;
+	vector<unique_ptr<Loop>> loops;
+
+	class Worker : public Thread {
+	public:
+		Worker(SocketReactor& aReactor) noexcept : reactor(aReactor) { }
+	private:
+		int run() override;
+
+		SocketReactor& reactor;
+	};
+
+	// Let the workers finish the queued calls and stop them
+	void stopWorkers() noexcept;
+
+	mutable std::mutex workerMtx;
+	std::condition_variable workerCondition;
+	deque<function<void ()>> blockingCalls;
+	vector<unique_ptr<Worker>> workers;
+	int idleWorkers = 0;
+	bool workersStopping = false;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SOCKET_REACTOR_H)
@@ -86,6 +86,13 @@ public:
 	/* This only works for file streams */
 	virtual void setPos(int64_t /*pos*/) noexcept { }
 	virtual InputStream* releaseRootStream() { return this; }
+
+	/**
+	 * Returns the file if the data is read from it without modifications (allows sending it without copying)
+	 * pos_ is set to the file position where the data starts (the file position may be shared with other streams)
+	 * bytesLeft_ is limited to the number of bytes that can still be read from the stream
+	 */
+	virtual File* getSourceFile(int64_t& /*pos_*/, int64_t& /*bytesLeft_*/) noexcept { return nullptr; }
 };
 
 class MemoryInputStream : public InputStream {
@@ -173,6 +180,11 @@ public:
 		auto as = s.release();
 		return as->releaseRootStream();
 	}
+
+	File* getSourceFile(int64_t& pos_, int64_t& bytesLeft_) noexcept override {
+		bytesLeft_ = min(bytesLeft_, maxBytes);
+		return s->getSourceFile(pos_, bytesLeft_);
+	}
 private:
 	unique_ptr<InputStream> s;
 	int64_t maxBytes;
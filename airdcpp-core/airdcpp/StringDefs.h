@@ -112,6 +112,7 @@ enum Strings { // @DontAdd
 	BAD_REGEXP, // "Badly formatted regular expression"
 	BALLOON_POPUPS, // "Popups"
 	BAR_DEPTH, // "3d depth"
+	BATCH_INCOMING_SEARCHES, // "Process queued incoming searches in batches"
 	BEGIN, // "Begin"
 	BIG_FILE_NOT_SHARED, // "File size exceeds the configured maximum limit"
 	BIND_ADDRESS_MISSING, // "The %1% bind address %2% doesn't appear to be available. Do you want to switch to listen to all interfaces?"
@@ -531,6 +532,7 @@ enum Strings { // @DontAdd
 	HASHDB_MAINTENANCE_NO_UNUSED, // "Hash database maintenance finished, no unused entries were found"
 	HASHDB_MAINTENANCE_STARTED, // "Hash database maintenance started..."
 	HASHDB_MAINTENANCE_UNUSED, // "Hash database maintenance completed: %1% unused file entries and %2% unused tree entries have been removed"
+	HASHER_WORKER_THREADS, // "Number of hashing threads per hasher (0 = hash in the reading thread)"
 	HASHER_X, // "Hasher #%1%"
 	HASHER_X_CREATED, // "Hasher #%1% created"
 	HASHING, // "Hashing"
@@ -610,6 +612,7 @@ enum Strings { // @DontAdd
 	INCOMING_REFRESH_QUEUED, // "Incoming directories have been queued for refreshing"
 	INCOMPLETE_FAV_HUB, // "Hub address cannot be empty."
 	INCREASE_NUM, // "Increase current number"
+	INCREMENTAL_REFRESH, // "Skip directories that haven't been modified during automatic refreshes"
 	INCREMENTING_NUMBERS, // "Incrementing numbers"
 	INFO, // "Info"
 	INSERT_EMOTICON, // "Insert emoticon"
@@ -972,6 +975,7 @@ enum Strings { // @DontAdd
 	OWN_CERTIFICATE_FILE, // "Own certificate file"
 	OWN_FILELIST, // "Own file list"
 	OWN_LIST_ADL, // "Match own list with ADL search"
+	PARALLEL_SEARCH_MATCHING, // "Match incoming searches using multiple threads"
 	PARAMS, // "Params"
 	PARTIAL_DUPES_EQUAL, // "Treat partial dupes similar to exact dupes"
 	PARTIAL_FILELIST, // "Partial file list"
@@ -1125,6 +1129,7 @@ enum Strings { // @DontAdd
 	REDIRECT_USER, // "Redirect user(s)"
 	REFRESH, // "Refresh"
 	REFRESHING_SHARE, // "Refreshing share"
+	REFRESH_DIRECTORIES_SKIPPED, // "(%1% unchanged directories were skipped, %2% directories were scanned)"
 	REFRESH_FILE_LIST, // "Refresh file list"
 	REFRESH_IN_SHARE, // "Refresh in share"
 	REFRESH_OPTIONS, // "Refreshing options"
@@ -1595,6 +1600,7 @@ enum Strings { // @DontAdd
 	SLOW_USER, // "Slow user"
 	SMALL_FILE_SIZE_SET, // "Small file size set"
 	SMALL_UP_SLOTS, // "Small upload slots (slots for file lists and small files)"
+	SOCKET_IO_THREADS, // "Number of threads for handling socket I/O (requires restart)"
 	SOCKS_AUTH_FAILED, // "Socks server authentication failed (bad login / password?)"
 	SOCKS_AUTH_UNSUPPORTED, // "The socks server doesn't support login / password authentication"
 	SOCKS_FAILED, // "The socks server failed establish a connection"
@@ -1667,6 +1673,7 @@ enum Strings { // @DontAdd
 	TIME_LEFT, // "Time left"
 	TITLE, // "Title"
 	TLS_ERROR, // "TLS error"
+	TLS_KERNEL_OFFLOAD, // "Use kernel TLS offload for encrypted connections when supported"
 	TOGGLE_TBSTATUS, // "Toolbar progressbar\tCtrl+5"
 	TOGGLE_TOOLBAR, // "Media toolbar\tCtrl+4"
 	TOOLBAR_ORDER, // "Toolbar Order"
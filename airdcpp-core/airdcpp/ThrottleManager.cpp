@@ -19,20 +19,26 @@
 #include "stdinc.h"
 #include "ThrottleManager.h"
 
-#include "DownloadManager.h"
 #include "Socket.h"
 #include "TimerManager.h"
-#include "UploadManager.h"
 
 namespace dcpp {
 	// The actual limiting code is from StrongDC++
 	// Bandwidth limiting in DC++ is broken: https://www.airdcpp.net/forum/viewtopic.php?f=7&t=4485&p=8856#p8856
 
-	#define CONDWAIT_TIMEOUT		250
+	// Relative bandwidth shares of the throttle classes
+	static const int64_t CLASS_WEIGHTS[ThrottleManager::CLASS_LAST] = { 4, 2, 1 };
+
+	// Tokens of skipped intervals are added only up to this limit
+	static const uint64_t MAX_BURST_INTERVALS = 2;
+
+	// Streams won't be limited to smaller chunks than this
+	static const int64_t MIN_SLICE = 1024;
 
 	// constructor
 	ThrottleManager::ThrottleManager(void)
 	{
+		updateLimits();
 		TimerManager::getInstance()->addListener(this);
 	}
 
@@ -40,80 +46,170 @@ namespace dcpp {
 	ThrottleManager::~ThrottleManager()
 	{
 		TimerManager::getInstance()->removeListener(this);
+	}
 
-		// release conditional variables on exit
-		downCond.notify_all();
-		upCond.notify_all();
+	ThrottleManager::ThrottleClass ThrottleManager::getDownloadClass(Priority aBundlePriority) noexcept {
+		switch (aBundlePriority) {
+			case Priority::HIGHEST:
+			case Priority::HIGH:
+				return CLASS_HIGH;
+			case Priority::DEFAULT:
+			case Priority::NORMAL:
+				return CLASS_NORMAL;
+			default:
+				return CLASS_LOW;
+		}
 	}
 
 	/*
 	 * Limits a traffic and reads a packet from the network
 	 */
-	int ThrottleManager::read(Socket* sock, void* buffer, size_t len)
+	int ThrottleManager::read(Socket* sock, Stream& aStream, void* buffer, size_t len)
 	{
-		size_t downs = DownloadManager::getInstance()->getTotalDownloadConnectionCount();
-		if (getDownLimit() == 0 || downs == 0)
+		if (down.limit.load(memory_order_relaxed) == 0)
 			return sock->read(buffer, len);
 
-		unique_lock<mutex> lock(downMutex);
-
-
-		if(downTokens > 0)
-		{
-			size_t slice = (getDownLimit() * 1024) / downs;
-			size_t readSize = min(slice, min(len, downTokens));
-				
-			// read from socket
-			readSize = sock->read(buffer, readSize);
-				
-			if(readSize > 0)
-				downTokens -= readSize;
+		auto throttleClass = static_cast<ThrottleClass>(aStream.throttleClass.load(memory_order_relaxed));
+		auto readSize = down.take(aStream.readInterval, throttleClass, len);
+		if (readSize == 0) {
+			// no tokens, the socket will retry later
+			return -1;	// from BufferedSocket: -1 = retry, 0 = connection close
+		}
 
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
+		// read from socket (-1 is returned when there's nothing to read)
+		auto read = sock->read(buffer, static_cast<int>(readSize));
 
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return readSize;
+		auto unused = readSize - static_cast<size_t>(max(read, 0));
+		if (unused > 0) {
+			down.giveBack(throttleClass, unused);
 		}
 
-		// no tokens, wait for them
-		downCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return -1;	// from BufferedSocket: -1 = retry, 0 = connection close
+		return read;
 	}
 	
 	/*
 	 * Limits a traffic and writes a packet to the network
 	 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
 	 */		
-	int ThrottleManager::write(Socket* sock, void* buffer, size_t& len)
+	int ThrottleManager::write(Socket* sock, Stream& aStream, void* buffer, size_t& len)
 	{
-		size_t ups = UploadManager::getInstance()->getUploadCount();
-		if(getUpLimit() == 0 || ups == 0)
-			return sock->write(buffer, len);
-		
-		unique_lock<mutex> lock(upMutex);
-		
-		if(upTokens > 0)
-		{
-			size_t slice = (getUpLimit() * 1024) / ups;
-			len = min(slice, min(len, upTokens));
-			upTokens -= len;
-
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
-
-			// write to socket			
-			int sent = sock->write(buffer, len);
-
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return sent;
+		if (up.limit.load(memory_order_relaxed) > 0) {
+			// the tokens are taken before sending as a failed write must be retried with the same length
+			len = up.take(aStream.writeInterval, static_cast<ThrottleClass>(aStream.throttleClass.load(memory_order_relaxed)), len);
+			if (len == 0)
+				return 0;	// from BufferedSocket: -1 = failed, 0 = retry
+		}
+
+		// write to socket
+		return sock->write(buffer, static_cast<int>(len));
+	}
+
+	/*
+	 * Limits a traffic and sends data directly from a file
+	 */
+	int ThrottleManager::sendFile(Socket* sock, Stream& aStream, File& aFile, int64_t& aPos, size_t& len)
+	{
+		if (up.limit.load(memory_order_relaxed) == 0)
+			return sock->sendFile(aFile, aPos, static_cast<int>(len));
+
+		auto throttleClass = static_cast<ThrottleClass>(aStream.throttleClass.load(memory_order_relaxed));
+		len = up.take(aStream.writeInterval, throttleClass, len);
+		if (len == 0)
+			return 0;
+
+		auto sent = sock->sendFile(aFile, aPos, static_cast<int>(len));
+
+		// unlike with OpenSSL, the remaining data doesn't have to be retried with the same length
+		auto unused = len - static_cast<size_t>(max(sent, 0));
+		if (unused > 0) {
+			up.giveBack(throttleClass, unused);
+		}
+
+		return sent;
+	}
+
+	size_t ThrottleManager::Limiter::take(uint64_t& lastInterval_, ThrottleClass aClass, size_t aLen) noexcept {
+		// the thread that notices the interval change first will add the new tokens
+		auto now = GET_TICK() / TOKEN_INTERVAL;
+		auto prev = interval.load(memory_order_acquire);
+		if (prev != now && interval.compare_exchange_strong(prev, now)) {
+			refill(prev == 0 ? 1 : now - prev);
+		}
+
+		auto& bucket = classes[aClass];
+		if (lastInterval_ != now) {
+			lastInterval_ = now;
+			bucket.streams.fetch_add(1, memory_order_relaxed);
+		}
+
+		auto slice = bucket.slice.load(memory_order_relaxed);
+		if (slice > 0) {
+			aLen = min(aLen, static_cast<size_t>(slice));
 		}
-		
-		// no tokens, wait for them
-		upCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return 0;	// from BufferedSocket: -1 = failed, 0 = retry
+
+		// use the share of the class first and borrow the rest from bandwidth that was left unused by other classes
+		auto taken = takeTokens(bucket.tokens, aLen);
+		if (taken < aLen) {
+			taken += takeTokens(spare, aLen - taken);
+		}
+
+		return taken;
+	}
+
+	void ThrottleManager::Limiter::giveBack(ThrottleClass aClass, size_t aTokens) noexcept {
+		classes[aClass].tokens.fetch_add(static_cast<int64_t>(aTokens), memory_order_relaxed);
+	}
+
+	size_t ThrottleManager::Limiter::takeTokens(atomic<int64_t>& tokens_, size_t aLen) noexcept {
+		auto available = tokens_.load(memory_order_relaxed);
+		while (available > 0) {
+			auto amount = min(static_cast<int64_t>(aLen), available);
+			if (tokens_.compare_exchange_weak(available, available - amount, memory_order_relaxed)) {
+				return static_cast<size_t>(amount);
+			}
+		}
+
+		return 0;
+	}
+
+	void ThrottleManager::Limiter::refill(uint64_t aElapsedIntervals) noexcept {
+		auto rate = max(limit.load(memory_order_relaxed) * static_cast<int64_t>(TOKEN_INTERVAL) / 1000, static_cast<int64_t>(1));
+		auto amount = rate * static_cast<int64_t>(min(aElapsedIntervals, MAX_BURST_INTERVALS));
+
+		// collect the tokens that weren't used during the previous interval
+		auto unused = spare.exchange(0, memory_order_relaxed);
+
+		uint32_t streams[CLASS_LAST];
+		int64_t totalWeight = 0;
+		for (int i = 0; i < CLASS_LAST; ++i) {
+			streams[i] = classes[i].streams.exchange(0, memory_order_relaxed);
+			unused += max(classes[i].tokens.exchange(0, memory_order_relaxed), static_cast<int64_t>(0));
+			if (streams[i] > 0) {
+				totalWeight += CLASS_WEIGHTS[i];
+			}
+		}
+
+		// split the new tokens between the active classes
+		int64_t assigned = 0;
+		for (int i = 0; i < CLASS_LAST; ++i) {
+			if (streams[i] == 0) {
+				classes[i].slice.store(rate, memory_order_relaxed);
+				continue;
+			}
+
+			auto share = amount * CLASS_WEIGHTS[i] / totalWeight;
+			classes[i].slice.store(max(share / streams[i], MIN_SLICE), memory_order_relaxed);
+			classes[i].tokens.fetch_add(share, memory_order_relaxed);
+			assigned += share;
+		}
+
+		// the remaining tokens can be used by any class
+		spare.fetch_add(min(unused, rate) + amount - assigned, memory_order_relaxed);
+	}
+
+	void ThrottleManager::updateLimits() noexcept {
+		down.limit.store(static_cast<int64_t>(getDownLimit()) * 1024, memory_order_relaxed);
+		up.limit.store(static_cast<int64_t>(getUpLimit()) * 1024, memory_order_relaxed);
 	}
 
 	void ThrottleManager::setSetting(SettingsManager::IntSetting setting, int value) noexcept {
@@ -165,23 +261,8 @@ namespace dcpp {
 
 	// TimerManagerListener
 	void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept {
-		auto downLimit = getDownLimit() * 1024;
-		auto upLimit = getUpLimit() * 1024;
-		
-		// readd tokens
-		if(downLimit > 0)
-		{
-			lock_guard<mutex> lock(downMutex);
-			downTokens = downLimit;
-			downCond.notify_all();
-		}
-			
-		if(upLimit > 0)
-		{
-			lock_guard<mutex> lock(upMutex);
-			upTokens = upLimit;
-			upCond.notify_all();
-		}
+		// the limits may depend on the current time
+		updateLimits();
 	}
 
 
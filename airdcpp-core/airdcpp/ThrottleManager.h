@@ -19,12 +19,12 @@
 #ifndef DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 #define DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 
+#include "Priority.h"
 #include "Singleton.h"
 #include "SettingsManager.h"
 #include "TimerManagerListener.h"
 
-#include <condition_variable>
-#include <mutex>
+#include <atomic>
 
 
 namespace dcpp
@@ -33,22 +33,58 @@ namespace dcpp
 	/**
 	 * Manager for throttling traffic flow speed.
 	 * Inspired by Token Bucket algorithm: http://en.wikipedia.org/wiki/Token_bucket
+	 *
+	 * The bandwidth of each direction is shared hierarchically: the global limit is split between
+	 * the throttle classes by their weights and the share of each class is split evenly between the
+	 * connections of that class. Tokens that a class leaves unused are moved to a spare pool that
+	 * can be borrowed by any class.
+	 *
+	 * Tokens are added in short intervals and all token counters are atomic so that
+	 * no locks are needed when reading from/writing to the sockets.
 	 */
 	class ThrottleManager :
 		public Singleton<ThrottleManager>, private TimerManagerListener
 	{
 	public:
+		enum ThrottleClass : uint8_t {
+			CLASS_HIGH,		// Small slots, file lists and bundles with high priority
+			CLASS_NORMAL,
+			CLASS_LOW,		// Bundles with low priority
+			CLASS_LAST
+		};
+
+		/*
+		 * Limiter state of a single connection
+		 */
+		struct Stream {
+			atomic<uint8_t> throttleClass { CLASS_NORMAL };
+
+			// The last token interval when the stream has been active
+			// (accessed only from the thread that performs the socket I/O)
+			uint64_t readInterval = 0;
+			uint64_t writeInterval = 0;
+		};
+
+		static ThrottleClass getDownloadClass(Priority aBundlePriority) noexcept;
 
 		/*
 		 * Limits a traffic and reads a packet from the network
+		 * Returns -1 if there are no tokens available (the call won't block as the sockets are run in shared threads)
 		 */
-		int read(Socket* sock, void* buffer, size_t len);
+		int read(Socket* sock, Stream& aStream, void* buffer, size_t len);
 		
 		/*
 		 * Limits a traffic and writes a packet to the network
 		 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
+		 * Returns 0 if there are no tokens available
 		 */		
-		int write(Socket* sock, void* buffer, size_t& len);
+		int write(Socket* sock, Stream& aStream, void* buffer, size_t& len);
+
+		/*
+		 * Limits a traffic and sends data directly from a file (see Socket::sendFile)
+		 * Returns 0 and sets len to 0 if there are no tokens available
+		 */
+		int sendFile(Socket* sock, Stream& aStream, File& aFile, int64_t& aPos, size_t& len);
 
 		/*
 		 * Returns current download limit.
@@ -64,17 +100,46 @@ namespace dcpp
 		static void setSetting(SettingsManager::IntSetting setting, int value) noexcept;
 
 		static const int MAX_LIMIT = 1024 * 1024; // 1 GiB/s
+
+		// Interval for adding new tokens (ms)
+		static const uint64_t TOKEN_INTERVAL = 100;
 	private:
-		
-		// download limiter
-		size_t						downTokens = 0;
-		condition_variable	downCond;
-		mutex				downMutex;
-		
-		// upload limiter
-		size_t						upTokens = 0;
-		condition_variable	upCond;
-		mutex				upMutex;
+		class Limiter {
+		public:
+			// Returns the number of bytes that may be transferred (0 if there are no tokens available)
+			size_t take(uint64_t& lastInterval_, ThrottleClass aClass, size_t aLen) noexcept;
+
+			// Returns tokens that weren't used after a successful take
+			void giveBack(ThrottleClass aClass, size_t aTokens) noexcept;
+
+			// Limit in bytes per second, 0 = unlimited
+			atomic<int64_t> limit { 0 };
+		private:
+			struct ClassBucket {
+				atomic<int64_t> tokens { 0 };
+
+				// Maximum number of bytes that a single stream may take at once
+				atomic<int64_t> slice { 0 };
+
+				// Streams that have taken tokens during the current interval
+				atomic<uint32_t> streams { 0 };
+			};
+
+			ClassBucket classes[CLASS_LAST];
+
+			// Tokens left unused by the classes
+			atomic<int64_t> spare { 0 };
+
+			atomic<uint64_t> interval { 0 };
+
+			void refill(uint64_t aElapsedIntervals) noexcept;
+			static size_t takeTokens(atomic<int64_t>& tokens_, size_t aLen) noexcept;
+		};
+
+		Limiter down;
+		Limiter up;
+
+		void updateLimits() noexcept;
 			
 		friend class Singleton<ThrottleManager>;
 		
@@ -33,6 +33,11 @@
 #include "TigerHash.h"
 
 #include "debug.h"
+#include "TigerHashLanes.h"
+
+#if defined(TIGER_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #ifdef BOOST_BIG_ENDIAN
 #define TIGER_BIG_ENDIAN
@@ -249,6 +254,98 @@ uint8_t* TigerHash::finalize() {
 	return getResult();
 }
 
+/*
+ * Leaf hashing
+ *
+ * The SIMD implementations (TigerHashAVX2.cpp and TigerHashAVX512.cpp) are compiled with the respective
+ * instruction sets enabled so they must only be called after checking that the CPU supports them.
+ */
+
+namespace {
+
+#ifdef TIGER_SIMD
+enum class SimdLevel {
+	NONE,
+	AVX2,
+	AVX512
+};
+
+SimdLevel detectSimdLevel() noexcept {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return SimdLevel::NONE;
+	}
+
+	// The extended registers must be enabled by the OS as well
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+		return SimdLevel::NONE;
+	}
+
+	auto xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6) {
+		return SimdLevel::NONE;
+	}
+
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6) {
+		return SimdLevel::AVX512;
+	}
+
+	return (info[1] & (1 << 5)) != 0 ? SimdLevel::AVX2 : SimdLevel::NONE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SimdLevel::AVX512;
+	}
+
+	return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::NONE;
+#endif
+}
+
+SimdLevel getSimdLevel() noexcept {
+	static const auto level = detectSimdLevel();
+	return level;
+}
+#endif
+
+}
+
+void TigerHash::hashLeaves(const uint8_t* aData, size_t aCount, uint8_t* result_) noexcept {
+	size_t hashed = 0;
+
+#ifdef TIGER_SIMD
+	switch (getSimdLevel()) {
+		case SimdLevel::AVX512: hashed = hashLeavesAVX512(aData, aCount, result_, table); break;
+		case SimdLevel::AVX2: hashed = hashLeavesAVX2(aData, aCount, result_, table); break;
+		default: break;
+	}
+#endif
+
+	// Remaining leaves
+	const uint8_t zero = 0;
+	for (size_t i = hashed; i < aCount; ++i) {
+		TigerHash h;
+		h.update(&zero, 1);
+		h.update(aData + i * LEAF_SIZE, LEAF_SIZE);
+		memcpy(result_ + i * BYTES, h.finalize(), BYTES);
+	}
+}
+
+const char* TigerHash::getLeafImplementation() noexcept {
+#ifdef TIGER_SIMD
+	switch (getSimdLevel()) {
+		case SimdLevel::AVX512: return "AVX-512";
+		case SimdLevel::AVX2: return "AVX2";
+		default: break;
+	}
+#endif
+
+	return "scalar";
+}
+
 uint64_t TigerHash::table[4*256] = {
 	_ULL(0x02AAB17CF7E90C5E)   /*    0 */,    _ULL(0xAC424B03E243A8EC)   /*    1 */,
 		_ULL(0x72CD5BE30DD5FCD3)   /*    2 */,    _ULL(0x6D019B93F6F97F3A)   /*    3 */,
@@ -42,6 +42,9 @@ public:
 	static const size_t BITS = 192;
 	static const size_t BYTES = BITS / 8;
 
+	/** Size of the Tiger tree leaves that can be hashed with hashLeaves */
+	static const size_t LEAF_SIZE = 1024;
+
 	TigerHash() {
 		res[0]=_ULL(0x0123456789ABCDEF);
 		res[1]=_ULL(0xFEDCBA9876543210);
@@ -57,6 +60,16 @@ public:
 	uint8_t* finalize();
 
 	uint8_t* getResult() const noexcept { return (uint8_t*) res; }
+
+	/**
+	 * Calculates the Tiger tree leaf hashes (hash of 0x00 + data) for consecutive leaves of LEAF_SIZE bytes.
+	 * Multiple leaves are compressed at once with SIMD instructions if the CPU supports them.
+	 * @param result_ Buffer for aCount hashes
+	 */
+	static void hashLeaves(const uint8_t* aData, size_t aCount, uint8_t* result_) noexcept;
+
+	/** Name of the leaf hash implementation used on this CPU */
+	static const char* getLeafImplementation() noexcept;
 private:
 	enum { BLOCK_SIZE = 512/8 };
 	/** 512 bit blocks for the compress function */
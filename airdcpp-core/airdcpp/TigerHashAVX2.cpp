@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+// This file is compiled with AVX2 enabled (nothing else than the leaf hashing should be added here)
+
+#include "stdinc.h"
+#include "TigerHashLanes.h"
+
+#ifdef TIGER_SIMD
+
+#include <immintrin.h>
+
+namespace dcpp {
+
+namespace {
+
+struct AVX2Ops {
+	typedef __m256i V;
+	static const size_t LANES = 4;
+
+	static TIGER_INLINE V set1(uint64_t aValue) { return _mm256_set1_epi64x(static_cast<long long>(aValue)); }
+	static TIGER_INLINE V zero() { return _mm256_setzero_si256(); }
+	static TIGER_INLINE V add(V a, V b) { return _mm256_add_epi64(a, b); }
+	static TIGER_INLINE V sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+	static TIGER_INLINE V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+	static TIGER_INLINE V and_(V a, V b) { return _mm256_and_si256(a, b); }
+	static TIGER_INLINE V or_(V a, V b) { return _mm256_or_si256(a, b); }
+	template<int N> static TIGER_INLINE V shl(V a) { return _mm256_slli_epi64(a, N); }
+	template<int N> static TIGER_INLINE V shr(V a) { return _mm256_srli_epi64(a, N); }
+
+	// S-box lookup for each lane
+	static TIGER_INLINE V lookup(const uint64_t* aTable, V aIndex) {
+		return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(aTable), aIndex, 8);
+	}
+
+	// Load the (unaligned) message word at the same position of each leaf
+	static TIGER_INLINE V load(const uint8_t* aPos) {
+		const auto offsets = _mm256_set_epi64x(3 * TigerHash::LEAF_SIZE, 2 * TigerHash::LEAF_SIZE, TigerHash::LEAF_SIZE, 0);
+		return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(aPos), offsets, 1);
+	}
+
+	static TIGER_INLINE void store(uint64_t* aDest, V a) { _mm256_storeu_si256(reinterpret_cast<V*>(aDest), a); }
+};
+
+}
+
+size_t hashLeavesAVX2(const uint8_t* aData, size_t aCount, uint8_t* result_, const uint64_t* aTable) noexcept {
+	return TigerLanes::hashAll<AVX2Ops>(aData, aCount, result_, aTable);
+}
+
+} // namespace dcpp
+
+#endif
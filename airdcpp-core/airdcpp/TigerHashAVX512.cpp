@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+// This file is compiled with AVX-512 enabled (nothing else than the leaf hashing should be added here)
+
+#include "stdinc.h"
+#include "TigerHashLanes.h"
+
+#ifdef TIGER_SIMD
+
+#include <immintrin.h>
+
+namespace dcpp {
+
+namespace {
+
+struct AVX512Ops {
+	typedef __m512i V;
+	static const size_t LANES = 8;
+
+	static TIGER_INLINE V set1(uint64_t aValue) { return _mm512_set1_epi64(static_cast<long long>(aValue)); }
+	static TIGER_INLINE V zero() { return _mm512_setzero_si512(); }
+	static TIGER_INLINE V add(V a, V b) { return _mm512_add_epi64(a, b); }
+	static TIGER_INLINE V sub(V a, V b) { return _mm512_sub_epi64(a, b); }
+	static TIGER_INLINE V xor_(V a, V b) { return _mm512_xor_si512(a, b); }
+	static TIGER_INLINE V and_(V a, V b) { return _mm512_and_si512(a, b); }
+	static TIGER_INLINE V or_(V a, V b) { return _mm512_or_si512(a, b); }
+	template<int N> static TIGER_INLINE V shl(V a) { return _mm512_slli_epi64(a, N); }
+	template<int N> static TIGER_INLINE V shr(V a) { return _mm512_srli_epi64(a, N); }
+
+	// S-box lookup for each lane
+	static TIGER_INLINE V lookup(const uint64_t* aTable, V aIndex) {
+		return _mm512_i64gather_epi64(aIndex, aTable, 8);
+	}
+
+	// Load the (unaligned) message word at the same position of each leaf
+	static TIGER_INLINE V load(const uint8_t* aPos) {
+		const auto offsets = _mm512_set_epi64(7 * TigerHash::LEAF_SIZE, 6 * TigerHash::LEAF_SIZE, 5 * TigerHash::LEAF_SIZE, 4 * TigerHash::LEAF_SIZE,
+			3 * TigerHash::LEAF_SIZE, 2 * TigerHash::LEAF_SIZE, TigerHash::LEAF_SIZE, 0);
+		return _mm512_i64gather_epi64(offsets, aPos, 1);
+	}
+
+	static TIGER_INLINE void store(uint64_t* aDest, V a) { _mm512_storeu_si512(aDest, a); }
+};
+
+}
+
+size_t hashLeavesAVX512(const uint8_t* aData, size_t aCount, uint8_t* result_, const uint64_t* aTable) noexcept {
+	return TigerLanes::hashAll<AVX512Ops>(aData, aCount, result_, aTable);
+}
+
+} // namespace dcpp
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2011-2019 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_TIGER_HASH_LANES_H
+#define DCPLUSPLUS_DCPP_TIGER_HASH_LANES_H
+
+#include "TigerHash.h"
+
+// Multi-lane leaf hashing is available on x86-64 only
+#if defined(_M_X64) || defined(__amd64__) || defined(__x86_64__)
+#define TIGER_SIMD
+#endif
+
+#ifdef _MSC_VER
+#define TIGER_INLINE __forceinline
+#else
+#define TIGER_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace dcpp {
+
+#ifdef TIGER_SIMD
+
+// Hash as many leaves as possible with the given instruction set, returns the number of hashed leaves
+// The caller must ensure that the CPU supports the instruction set
+size_t hashLeavesAVX2(const uint8_t* aData, size_t aCount, uint8_t* result_, const uint64_t* aTable) noexcept;
+size_t hashLeavesAVX512(const uint8_t* aData, size_t aCount, uint8_t* result_, const uint64_t* aTable) noexcept;
+
+#endif
+
+/*
+ * Generic Tiger compression for multiple leaves at once
+ *
+ * Each lane of the vector type contains the state of a separate leaf. Ops provides the vector operations
+ * for the instruction set. These must only be instantiated in translation units that are compiled with
+ * the respective instruction set enabled.
+ */
+namespace TigerLanes {
+
+template<class Ops, int Mul>
+TIGER_INLINE void round(typename Ops::V& a, typename Ops::V& b, typename Ops::V& c, typename Ops::V x, const uint64_t* aTable) {
+	const auto mask = Ops::set1(0xFF);
+	c = Ops::xor_(c, x);
+	a = Ops::sub(a, Ops::xor_(
+		Ops::xor_(Ops::lookup(aTable, Ops::and_(c, mask)), Ops::lookup(aTable + 256, Ops::and_(Ops::template shr<16>(c), mask))),
+		Ops::xor_(Ops::lookup(aTable + 256 * 2, Ops::and_(Ops::template shr<32>(c), mask)), Ops::lookup(aTable + 256 * 3, Ops::and_(Ops::template shr<48>(c), mask)))
+	));
+	b = Ops::add(b, Ops::xor_(
+		Ops::xor_(Ops::lookup(aTable + 256 * 3, Ops::and_(Ops::template shr<8>(c), mask)), Ops::lookup(aTable + 256 * 2, Ops::and_(Ops::template shr<24>(c), mask))),
+		Ops::xor_(Ops::lookup(aTable + 256, Ops::and_(Ops::template shr<40>(c), mask)), Ops::lookup(aTable, Ops::template shr<56>(c)))
+	));
+
+	// There are no 64 bit multiplications in AVX2
+	if (Mul == 5) {
+		b = Ops::add(Ops::template shl<2>(b), b);
+	} else if (Mul == 7) {
+		b = Ops::sub(Ops::template shl<3>(b), b);
+	} else {
+		b = Ops::add(Ops::template shl<3>(b), b);
+	}
+}
+
+template<class Ops, int Mul>
+TIGER_INLINE void pass(typename Ops::V& a, typename Ops::V& b, typename Ops::V& c, const typename Ops::V* x, const uint64_t* aTable) {
+	round<Ops, Mul>(a, b, c, x[0], aTable);
+	round<Ops, Mul>(b, c, a, x[1], aTable);
+	round<Ops, Mul>(c, a, b, x[2], aTable);
+	round<Ops, Mul>(a, b, c, x[3], aTable);
+	round<Ops, Mul>(b, c, a, x[4], aTable);
+	round<Ops, Mul>(c, a, b, x[5], aTable);
+	round<Ops, Mul>(a, b, c, x[6], aTable);
+	round<Ops, Mul>(b, c, a, x[7], aTable);
+}
+
+template<class Ops>
+TIGER_INLINE void keySchedule(typename Ops::V* x) {
+	const auto ones = Ops::set1(~0ULL);
+	x[0] = Ops::sub(x[0], Ops::xor_(x[7], Ops::set1(0xA5A5A5A5A5A5A5A5ULL)));
+	x[1] = Ops::xor_(x[1], x[0]);
+	x[2] = Ops::add(x[2], x[1]);
+	x[3] = Ops::sub(x[3], Ops::xor_(x[2], Ops::template shl<19>(Ops::xor_(x[1], ones))));
+	x[4] = Ops::xor_(x[4], x[3]);
+	x[5] = Ops::add(x[5], x[4]);
+	x[6] = Ops::sub(x[6], Ops::xor_(x[5], Ops::template shr<23>(Ops::xor_(x[4], ones))));
+	x[7] = Ops::xor_(x[7], x[6]);
+	x[0] = Ops::add(x[0], x[7]);
+	x[1] = Ops::sub(x[1], Ops::xor_(x[0], Ops::template shl<19>(Ops::xor_(x[7], ones))));
+	x[2] = Ops::xor_(x[2], x[1]);
+	x[3] = Ops::add(x[3], x[2]);
+	x[4] = Ops::sub(x[4], Ops::xor_(x[3], Ops::template shr<23>(Ops::xor_(x[2], ones))));
+	x[5] = Ops::xor_(x[5], x[4]);
+	x[6] = Ops::add(x[6], x[5]);
+	x[7] = Ops::sub(x[7], Ops::xor_(x[6], Ops::set1(0x0123456789ABCDEFULL)));
+}
+
+// Note: the message words are modified by the key schedule
+template<class Ops>
+TIGER_INLINE void compress(typename Ops::V& a, typename Ops::V& b, typename Ops::V& c, typename Ops::V* x, const uint64_t* aTable) {
+	auto aa = a, bb = b, cc = c;
+
+	pass<Ops, 5>(a, b, c, x, aTable);
+	keySchedule<Ops>(x);
+	pass<Ops, 7>(c, a, b, x, aTable);
+	keySchedule<Ops>(x);
+	pass<Ops, 9>(b, c, a, x, aTable);
+
+	a = Ops::xor_(a, aa);
+	b = Ops::sub(b, bb);
+	c = Ops::add(c, cc);
+}
+
+// Hash Ops::LANES consecutive leaves (the hashed message is 0x00 + leaf data)
+template<class Ops>
+TIGER_INLINE void hashLeaves(const uint8_t* aData, uint8_t* result_, const uint64_t* aTable) {
+	typedef typename Ops::V V;
+
+	V a = Ops::set1(0x0123456789ABCDEFULL);
+	V b = Ops::set1(0xFEDCBA9876543210ULL);
+	V c = Ops::set1(0xF096A5B4C3B2E187ULL);
+	V x[8];
+
+	// The prefix byte offsets all message words by one byte
+	x[0] = Ops::template shl<8>(Ops::load(aData));
+	for (int i = 1; i < 8; ++i) {
+		x[i] = Ops::load(aData + 8 * i - 1);
+	}
+
+	compress<Ops>(a, b, c, x, aTable);
+
+	for (size_t pos = 64; pos < TigerHash::LEAF_SIZE; pos += 64) {
+		for (int i = 0; i < 8; ++i) {
+			x[i] = Ops::load(aData + pos + 8 * i - 1);
+		}
+
+		compress<Ops>(a, b, c, x, aTable);
+	}
+
+	// Final block: the last data byte, padding and the message length in bits
+	x[0] = Ops::or_(Ops::template shr<56>(Ops::load(aData + TigerHash::LEAF_SIZE - 8)), Ops::set1(0x100));
+	for (int i = 1; i < 7; ++i) {
+		x[i] = Ops::zero();
+	}
+	x[7] = Ops::set1((TigerHash::LEAF_SIZE + 1) << 3);
+
+	compress<Ops>(a, b, c, x, aTable);
+
+	uint64_t res[3][Ops::LANES];
+	Ops::store(res[0], a);
+	Ops::store(res[1], b);
+	Ops::store(res[2], c);
+
+	for (size_t lane = 0; lane < Ops::LANES; ++lane) {
+		for (int i = 0; i < 3; ++i) {
+			memcpy(result_ + lane * TigerHash::BYTES + i * sizeof(uint64_t), &res[i][lane], sizeof(uint64_t));
+		}
+	}
+}
+
+template<class Ops>
+TIGER_INLINE size_t hashAll(const uint8_t* aData, size_t aCount, uint8_t* result_, const uint64_t* aTable) {
+	size_t i = 0;
+	for (; i + Ops::LANES <= aCount; i += Ops::LANES) {
+		hashLeaves<Ops>(aData + i * TigerHash::LEAF_SIZE, result_ + i * TigerHash::BYTES, aTable);
+	}
+
+	return i;
+}
+
+} // namespace TigerLanes
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_TIGER_HASH_LANES_H)
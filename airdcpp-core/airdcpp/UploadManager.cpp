@@ -32,6 +32,8 @@
 #include "QueueManager.h"
 #include "ResourceManager.h"
 #include "ShareManager.h"
+#include "SharedFileStream.h"
+#include "ThrottleManager.h"
 #include "Upload.h"
 #include "UploadBundle.h"
 #include "UserConnection.h"
@@ -302,10 +304,19 @@ checkslots:
 					fileSize = size = xml.size();
 				} else {
 					countFilePositions();
-					auto f = make_unique<File>(sourceFile, File::READ, File::OPEN | File::SHARED_WRITE); // write for partial sharing
-			
-					f->setPos(start);
-					is = move(f);
+					if (type == Transfer::TYPE_FILE && !partialFileSharing) {
+						// Share the handle (and the cached data) with other uploads of the same file
+						// Partial files are still being written so the data can't be cached
+						// The handle may stay open after the upload, don't prevent the file from being renamed or deleted
+						auto f = make_unique<SharedFileStream>(sourceFile, File::READ, File::OPEN | File::SHARED_WRITE | File::SHARED_DELETE);
+						f->setPos(start);
+						is = move(f);
+					} else {
+						auto f = make_unique<File>(sourceFile, File::READ, File::OPEN | File::SHARED_WRITE); // write for partial sharing
+						f->setPos(start);
+						is = move(f);
+					}
+
 					if((start + size) < fileSize) {
 						is.reset(new LimitedInputStream<true>(is.release(), size));
 					}
@@ -435,6 +446,7 @@ void UploadManager::UpdateSlotCounts(UserConnection& aSource, uint8_t slotType){
 		
 		// user got a slot
 		aSource.setSlotType(slotType);
+		aSource.setThrottleClass(slotType == UserConnection::SMALLSLOT ? ThrottleManager::CLASS_HIGH : ThrottleManager::CLASS_NORMAL);
 
 		// set new slot count
 		switch(slotType) {
@@ -913,6 +925,10 @@ void UploadManager::unreserveSlot(const UserPtr& aUser) {
 }
 
 void UploadManager::on(UserConnectionListener::Get, UserConnection* aSource, const string& aFile, int64_t aResume) noexcept {
+	aSource->callBlocking([=] { handleGet(aSource, aFile, aResume); });
+}
+
+void UploadManager::handleGet(UserConnection* aSource, const string& aFile, int64_t aResume) noexcept {
 	if(aSource->getState() != UserConnection::STATE_GET) {
 		dcdebug("UM::onGet Bad state, ignoring\n");
 		return;
@@ -942,6 +958,10 @@ void UploadManager::on(UserConnectionListener::Send, UserConnection* aSource) no
 }
 
 void UploadManager::on(AdcCommand::GET, UserConnection* aSource, const AdcCommand& c) noexcept {
+	aSource->callBlocking([=] { handleGET(aSource, c); });
+}
+
+void UploadManager::handleGET(UserConnection* aSource, const AdcCommand& c) noexcept {
 	if(aSource->getState() != UserConnection::STATE_GET) {
 		dcdebug("UM::onGET Bad state, ignoring\n");
 		return;
@@ -1232,7 +1252,9 @@ void UploadManager::on(AdcCommand::GFI, UserConnection* aSource, const AdcComman
 }
 
 // TimerManagerListener
-void UploadManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept {
+void UploadManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept {
+	SharedFileStream::closeIdleHandles(aTick);
+
 	UploadList ticks;
 	UploadBundleList tickBundles;
 	{
@@ -205,6 +205,10 @@ private:
 	void on(AdcCommand::GET, UserConnection*, const AdcCommand&) noexcept;
 	void on(AdcCommand::GFI, UserConnection*, const AdcCommand&) noexcept;
 
+	// The requests are handled outside the socket thread (opening the file or generating the list may access the disk)
+	void handleGet(UserConnection* aSource, const string& aFile, int64_t aResume) noexcept;
+	void handleGET(UserConnection* aSource, const AdcCommand& c) noexcept;
+
 	bool prepareFile(UserConnection& aSource, const string& aType, const string& aFile, int64_t aResume, int64_t& aBytes, const string& userSID, bool listRecursive=false, bool tthList=false);
 };
 
@@ -175,10 +175,6 @@ int64_t UserConnection::getChunkSize() const noexcept {
 	}
 }
 
-void UserConnection::setThreadPriority(Thread::Priority aPriority) {
-	socket->setThreadPriority(aPriority);
-}
-
 void UserConnection::setUser(const UserPtr& aUser) noexcept {
 	user = aUser;
 	if (aUser && socket) {
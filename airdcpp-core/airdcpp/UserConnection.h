@@ -152,8 +152,14 @@ public:
 
 	template<typename F>
 	void callAsync(F f) { if(socket) socket->callAsync(f); }
+	template<typename F>
+	void callBlocking(F f) { if(socket) socket->callBlocking(f); }
 
 	void disconnect(bool graceless = false) { if(socket) socket->disconnect(graceless); }
+
+	// Backpressure for received data (see BufferedSocket)
+	void pauseReading() noexcept { if(socket) socket->pauseReading(); }
+	void resumeReading() noexcept { if(socket) socket->resumeReading(); }
 	void transmitFile(InputStream* f) { socket->transmitFile(f); }
 
 	const string& getDirectionString() const noexcept {
@@ -206,7 +212,7 @@ public:
 	
 	const BufferedSocket* getSocket() const noexcept { return socket; }
 
-	void setThreadPriority(Thread::Priority aPriority) ;
+	void setThrottleClass(ThrottleManager::ThrottleClass aClass) noexcept { if(socket) socket->setThrottleClass(aClass); }
 private:
 	int64_t chunkSize = 0;
 	BufferedSocket* socket = nullptr;
@@ -75,13 +75,21 @@ QueueItemPtr UserQueue::getNext(const UserPtr& aUser, const QueueTokenSet& runni
 
 	/* Using the PAUSED priority will list all files */
 	auto qi = getNextPrioQI(aUser, onlineHubs, 0, 0, aType, allowOverlap, lastError_);
-	if(!qi) {
+
+	// Bundle items never use the small slot
+	if(!qi && aType != QueueItem::TYPE_SMALL) {
 		qi = getNextBundleQI(aUser, runningBundles, onlineHubs, (Priority)minPrio, wantedSize, lastSpeed, aType, allowOverlap, lastError_, hasDownload);
 	}
 
 	if (!qi && !allowOverlap) {
 		//no free segments. let's do another round and now check if there are slow sources which can be overlapped
+		auto firstError = lastError_;
 		qi = getNext(aUser, runningBundles, onlineHubs, lastError_, hasDownload, minPrio, wantedSize, lastSpeed, aType, true);
+
+		// The overlapping round checks only the running bundle items, report the reason from the first round if there's nothing more specific
+		if (!qi && lastError_.empty()) {
+			lastError_ = firstError;
+		}
 	}
 
 	if (qi)
@@ -136,11 +144,21 @@ QueueItemPtr UserQueue::getNextBundleQI(const UserPtr& aUser, const QueueTokenSe
 }
 
 void UserQueue::addDownload(QueueItemPtr& qi, Download* d) noexcept {
+	auto wasRunning = qi->isRunning();
 	qi->addDownload(d);
+
+	if (!wasRunning && qi->getBundle()) {
+		qi->getBundle()->addRunningItem(qi);
+	}
 }
 
 void UserQueue::removeDownload(QueueItemPtr& qi, const string& aToken) noexcept {
+	auto wasRunning = qi->isRunning();
 	qi->removeDownload(aToken);
+
+	if (wasRunning && qi->isWaiting() && qi->getBundle()) {
+		qi->getBundle()->removeRunningItem(qi);
+	}
 }
 
 void UserQueue::setQIPriority(QueueItemPtr& qi, Priority p) noexcept {
@@ -158,7 +176,12 @@ void UserQueue::removeQI(QueueItemPtr& qi, bool removeRunning /*true*/) noexcept
 void UserQueue::removeQI(QueueItemPtr& qi, const UserPtr& aUser, bool removeRunning /*true*/, Flags::MaskType reason) noexcept{
 
 	if(removeRunning) {
+		auto wasRunning = qi->isRunning();
 		qi->removeDownloads(aUser);
+
+		if (wasRunning && qi->isWaiting() && qi->getBundle()) {
+			qi->getBundle()->removeRunningItem(qi);
+		}
 	}
 
 	dcassert(qi->isSource(aUser));
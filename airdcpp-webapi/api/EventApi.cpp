@@ -75,7 +75,9 @@ namespace webserver {
 
 	void EventApi::on(LogManagerListener::Message, const LogMessagePtr& aMessageData) noexcept {
 		if (subscriptionActive("event_message")) {
-			send("event_message", Serializer::serializeLogMessage(aMessageData));
+			sendShared("event_message", aMessageData->getId(), [&] {
+				return Serializer::serializeLogMessage(aMessageData);
+			});
 		}
 
 		onMessagesChanged();
@@ -77,14 +77,16 @@ namespace webserver {
 			return;
 
 		string curFile;
-		int64_t bytesLeft = 0, speed = 0;
+		int64_t bytesLeft = 0, speed = 0, readSpeed = 0, hashSpeed = 0;
 		size_t filesLeft = 0;
 		int hashers = 0;
 
-		HashManager::getInstance()->getStats(curFile, bytesLeft, filesLeft, speed, hashers);
+		HashManager::getInstance()->getStats(curFile, bytesLeft, filesLeft, speed, hashers, readSpeed, hashSpeed);
 
 		json j = {
 			{ "hash_speed", speed },
+			{ "hash_read_speed", readSpeed },
+			{ "hash_compute_speed", hashSpeed },
 			{ "hash_bytes_left", bytesLeft },
 			{ "hash_files_left", filesLeft },
 			{ "hashers", hashers },
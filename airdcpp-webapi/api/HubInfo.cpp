@@ -64,7 +64,55 @@ namespace webserver {
 		client->removeListener(this);
 	}
 
+	atomic<uint64_t> HubInfo::UserEventCounter::nextId = { 0 };
+	std::map<ClientToken, std::weak_ptr<HubInfo::UserEventCounter>> HubInfo::UserEventCounter::counters;
+	FastCriticalSection HubInfo::UserEventCounter::cs;
+
+	HubInfo::UserEventCounter::Ptr HubInfo::UserEventCounter::get(const ClientPtr& aClient) noexcept {
+		FastLock l(cs);
+		auto& counter = counters[aClient->getClientId()];
+
+		auto ret = counter.lock();
+		if (!ret) {
+			ret = make_shared<UserEventCounter>(aClient);
+			counter = ret;
+		}
+
+		return ret;
+	}
+
+	HubInfo::UserEventCounter::UserEventCounter(const ClientPtr& aClient) noexcept : client(aClient) {
+		client->addListener(this);
+	}
+
+	HubInfo::UserEventCounter::~UserEventCounter() {
+		client->removeListener(this);
+
+		FastLock l(cs);
+		auto i = counters.find(client->getClientId());
+		if (i != counters.end() && i->second.expired()) {
+			counters.erase(i);
+		}
+	}
+
+	void HubInfo::UserEventCounter::on(ClientListener::UserConnected, const Client*, const OnlineUserPtr&) noexcept {
+		eventId = ++nextId;
+	}
+
+	void HubInfo::UserEventCounter::on(ClientListener::UserUpdated, const Client*, const OnlineUserPtr&) noexcept {
+		eventId = ++nextId;
+	}
+
+	void HubInfo::UserEventCounter::on(ClientListener::UsersUpdated, const Client*, const OnlineUserList& aUsers) noexcept {
+		eventId = nextId.fetch_add(aUsers.size()) + 1;
+	}
+
+	void HubInfo::UserEventCounter::on(ClientListener::UserRemoved, const Client*, const OnlineUserPtr&) noexcept {
+		eventId = ++nextId;
+	}
+
 	void HubInfo::init() noexcept {
+		userEventCounter = UserEventCounter::get(client);
 		client->addListener(this);
 
 		timer->start(false);
@@ -202,6 +250,7 @@ namespace webserver {
 	void HubInfo::on(ClientListener::Redirected, const string&, const ClientPtr& aNewClient) noexcept {
 		client->removeListener(this);
 		client = aNewClient;
+		userEventCounter = UserEventCounter::get(aNewClient);
 		aNewClient->addListener(this);
 
 		sendConnectState();
@@ -280,10 +329,20 @@ namespace webserver {
 			view.onItemAdded(aUser);
 		}
 
-		maybeSend("hub_user_connected", [&] { return Serializer::serializeItem(aUser, OnlineUserUtils::propertyHandler); });
+		sendUserEvent("hub_user_connected", aUser, userEventCounter->getEventId());
 	}
 
-	void HubInfo::onUserUpdated(const OnlineUserPtr& ou) noexcept {
+	void HubInfo::sendUserEvent(const string& aSubscription, const OnlineUserPtr& aUser, uint64_t aEventId) noexcept {
+		if (!subscriptionActive(aSubscription)) {
+			return;
+		}
+
+		sendShared(aSubscription, aEventId, [&] {
+			return Serializer::serializeItem(aUser, OnlineUserUtils::propertyHandler);
+		});
+	}
+
+	void HubInfo::onUserUpdated(const OnlineUserPtr& ou, uint64_t aEventId) noexcept {
 		// Don't update all properties to avoid unneeded sorting
 		onUserUpdated(ou, { 
 			OnlineUserUtils::PROP_SHARED, OnlineUserUtils::PROP_DESCRIPTION, 
@@ -291,24 +350,25 @@ namespace webserver {
 			OnlineUserUtils::PROP_DOWNLOAD_SPEED, OnlineUserUtils::PROP_EMAIL, 
 			OnlineUserUtils::PROP_FILES, OnlineUserUtils::PROP_FLAGS,
 			OnlineUserUtils::PROP_UPLOAD_SLOTS
-		});
+		}, aEventId);
 	}
 
-	void HubInfo::onUserUpdated(const OnlineUserPtr& aUser, const PropertyIdSet& aUpdatedProperties) noexcept {
+	void HubInfo::onUserUpdated(const OnlineUserPtr& aUser, const PropertyIdSet& aUpdatedProperties, uint64_t aEventId) noexcept {
 		if (!aUser->isHidden()) {
 			view.onItemUpdated(aUser, aUpdatedProperties);
 		}
 
-		maybeSend("hub_user_updated", [&] { return Serializer::serializeItem(aUser, OnlineUserUtils::propertyHandler); });
+		sendUserEvent("hub_user_updated", aUser, aEventId);
 	}
 
 	void HubInfo::on(ClientListener::UserUpdated, const Client*, const OnlineUserPtr& aUser) noexcept {
-		onUserUpdated(aUser);
+		onUserUpdated(aUser, userEventCounter->getEventId());
 	}
 
 	void HubInfo::on(ClientListener::UsersUpdated, const Client*, const OnlineUserList& aUsers) noexcept {
+		auto eventId = userEventCounter->getEventId();
 		for (auto& u : aUsers) {
-			onUserUpdated(u);
+			onUserUpdated(u, eventId++);
 		}
 	}
 
@@ -317,6 +377,6 @@ namespace webserver {
 			view.onItemRemoved(aUser);
 		}
 
-		maybeSend("hub_user_disconnected", [&] { return Serializer::serializeItem(aUser, OnlineUserUtils::propertyHandler); });
+		sendUserEvent("hub_user_disconnected", aUser, userEventCounter->getEventId());
 	}
 }
\ No newline at end of file
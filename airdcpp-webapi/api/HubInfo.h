@@ -55,6 +55,38 @@ namespace webserver {
 		void init() noexcept override;
 		ClientToken getId() const noexcept override;
 	private:
+		// Assigns an unique id for each user event of a hub so that the serialized
+		// event data can be shared between the sessions (see SubscribableApiModule::sendShared)
+		// The counter listener must be added before the hub modules so that it receives the events first
+		class UserEventCounter : private ClientListener {
+		public:
+			typedef shared_ptr<UserEventCounter> Ptr;
+
+			// Returns the existing counter for the client or adds a new one
+			static Ptr get(const ClientPtr& aClient) noexcept;
+
+			UserEventCounter(const ClientPtr& aClient) noexcept;
+			~UserEventCounter();
+
+			// Id of the event that is currently being fired
+			// Users of UsersUpdated have consecutive ids starting from this one
+			uint64_t getEventId() const noexcept { return eventId; }
+		private:
+			void on(ClientListener::UserConnected, const Client*, const OnlineUserPtr&) noexcept override;
+			void on(ClientListener::UserUpdated, const Client*, const OnlineUserPtr&) noexcept override;
+			void on(ClientListener::UsersUpdated, const Client*, const OnlineUserList&) noexcept override;
+			void on(ClientListener::UserRemoved, const Client*, const OnlineUserPtr&) noexcept override;
+
+			const ClientPtr client;
+			atomic<uint64_t> eventId = { 0 };
+
+			// Unique for all hubs as the shared events are stored by the subscription name
+			static atomic<uint64_t> nextId;
+
+			static std::map<ClientToken, std::weak_ptr<UserEventCounter>> counters;
+			static FastCriticalSection cs;
+		};
+
 		api_return handleReconnect(ApiRequest& aRequest);
 		api_return handleFavorite(ApiRequest& aRequest);
 		api_return handlePassword(ApiRequest& aRequest);
@@ -93,8 +125,10 @@ namespace webserver {
 		}
 
 		OnlineUserList getUsers() noexcept;
-		void onUserUpdated(const OnlineUserPtr& ou) noexcept;
-		void onUserUpdated(const OnlineUserPtr& ou, const PropertyIdSet& aUpdatedProperties) noexcept;
+		void onUserUpdated(const OnlineUserPtr& ou, uint64_t aEventId) noexcept;
+		void onUserUpdated(const OnlineUserPtr& ou, const PropertyIdSet& aUpdatedProperties, uint64_t aEventId) noexcept;
+
+		void sendUserEvent(const string& aSubscription, const OnlineUserPtr& aUser, uint64_t aEventId) noexcept;
 
 		json previousCounts;
 
@@ -105,6 +139,7 @@ namespace webserver {
 
 		ChatController<ClientPtr> chatHandler;
 		ClientPtr client;
+		UserEventCounter::Ptr userEventCounter;
 
 		typedef ListViewController<OnlineUserPtr, OnlineUserUtils::PROP_LAST> UserView;
 		UserView view;
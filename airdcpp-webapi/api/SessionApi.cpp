@@ -97,6 +97,7 @@ namespace webserver {
 
 		auto grantType = JsonUtil::getOptionalFieldDefault<string>("grant_type", reqJson, "password");
 		auto inactivityMinutes = JsonUtil::getOptionalFieldDefault<uint64_t>("max_inactivity", reqJson, WEBCFG(DEFAULT_SESSION_IDLE_TIMEOUT).uint64());
+		auto encoding = parseSocketEncoding(reqJson);
 
 
 		SessionPtr session = nullptr;
@@ -129,6 +130,7 @@ namespace webserver {
 		if (aSocket) {
 			session->onSocketConnected(aSocket);
 			aSocket->setSession(session);
+			aSocket->setEncoding(encoding);
 		}
 
 
@@ -152,6 +154,18 @@ namespace webserver {
 		return ret;
 	}
 
+	WebSocket::Encoding SessionApi::parseSocketEncoding(const json& aRequestJson) {
+		auto encoding = JsonUtil::getOptionalFieldDefault<string>("encoding", aRequestJson, "json");
+
+		try {
+			return WebSocket::parseEncoding(encoding);
+		} catch (const std::invalid_argument& e) {
+			JsonUtil::throwError("encoding", JsonUtil::ERROR_INVALID, e.what());
+		}
+
+		return WebSocket::Encoding::JSON;
+	}
+
 	api_return SessionApi::handleSocketConnect(ApiRequest& aRequest, bool aIsSecure, const WebSocketPtr& aSocket) {
 		if (!aSocket) {
 			aRequest.setResponseErrorStr("This method may be called only via a websocket");
@@ -159,6 +173,7 @@ namespace webserver {
 		}
 
 		auto sessionToken = JsonUtil::getField<string>("auth_token", aRequest.getRequestBody(), false);
+		auto encoding = parseSocketEncoding(aRequest.getRequestBody());
 
 		auto session = WebServerManager::getInstance()->getUserManager().getSession(sessionToken);
 		if (!session) {
@@ -173,6 +188,7 @@ namespace webserver {
 
 		session->onSocketConnected(aSocket);
 		aSocket->setSession(session);
+		aSocket->setEncoding(encoding);
 
 		aRequest.setResponseBody(serializeLoginInfo(session, Util::emptyString));
 		return websocketpp::http::status_code::no_content;
@@ -19,6 +19,7 @@
 #ifndef DCPLUSPLUS_DCPP_SESSIONAPI_H
 #define DCPLUSPLUS_DCPP_SESSIONAPI_H
 
+#include <web-server/WebSocket.h>
 #include <web-server/WebUserManagerListener.h>
 
 #include <api/base/ApiModule.h>
@@ -49,6 +50,9 @@ namespace webserver {
 		api_return logout(ApiRequest& aRequest, const SessionPtr& aSession);
 
 		static json serializeLoginInfo(const SessionPtr& aSession, const string& aRefreshToken);
+
+		// Message encoding requested by the client (the response to the authentication request is already sent using it)
+		static WebSocket::Encoding parseSocketEncoding(const json& aRequestJson);
 		static json serializeSession(const SessionPtr& aSession) noexcept;
 		static string getSessionType(const SessionPtr& aSession) noexcept;
 
@@ -322,6 +322,7 @@ namespace webserver {
 
 		auto itemStats = *optionalItemStats;
 		auto searchStats = ShareManager::getInstance()->getSearchMatchingStats();
+		auto listStats = ShareManager::getInstance()->getFilelistStats();
 
 		json j = {
 			{ "total_file_count", itemStats.totalFileCount },
@@ -347,6 +348,23 @@ namespace webserver {
 
 			{ "average_search_token_count", searchStats.averageSearchTokenCount },
 			{ "average_search_token_length", searchStats.averageSearchTokenLength },
+
+			{ "indexed_searches", searchStats.indexedSearches },
+			{ "average_index_candidate_count", searchStats.averageIndexCandidateCount },
+			{ "index_token_count", searchStats.indexTokenCount },
+
+			{ "generated_filelists", listStats.generatedLists },
+			{ "average_filelist_generation_ms", listStats.averageGenerationMs },
+			{ "last_filelist_generation_ms", listStats.lastGenerationMs },
+			{ "last_filelist_peak_memory", listStats.lastPeakMemory },
+			{ "reused_filelist_fragments", listStats.reusedFragments },
+			{ "compressed_filelist_fragments", listStats.compressedFragments },
+			{ "cached_filelist_fragment_bytes", listStats.cachedFragmentBytes },
+
+			{ "partial_list_cache_hits", listStats.partialListCacheHits },
+			{ "partial_list_cache_misses", listStats.partialListCacheMisses },
+			{ "cached_partial_lists", listStats.cachedPartialLists },
+			{ "cached_partial_list_bytes", listStats.cachedPartialListBytes },
 		};
 
 		aRequest.setResponseBody(j);
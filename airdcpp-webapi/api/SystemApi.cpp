@@ -25,6 +25,7 @@
 #include <web-server/WebServerManager.h>
 #include <web-server/WebServerSettings.h>
 #include <web-server/WebUserManager.h>
+#include <web-server/WebSocket.h>
 
 #include <api/SystemApi.h>
 #include <api/common/Serializer.h>
@@ -32,6 +33,8 @@
 #include <airdcpp/ActivityManager.h>
 #include <airdcpp/ClientManager.h>
 #include <airdcpp/Localization.h>
+#include <airdcpp/QueueManager.h>
+#include <airdcpp/SocketReactor.h>
 #include <airdcpp/Thread.h>
 #include <airdcpp/TimerManager.h>
 
@@ -127,10 +130,35 @@ namespace webserver {
 
 	api_return SystemApi::handleGetStats(ApiRequest& aRequest) {
 		auto server = session->getServer();
+		auto socketStats = SocketReactor::getInstance()->getStats();
+		auto queueLockStats = QueueManager::getInstance()->getLockStats();
+
+		// Compare the encoded message sizes and encoding times of the socket encodings
+		auto serializeEncodingStats = [](WebSocket::Encoding aEncoding) {
+			auto stats = WebSocket::getEncodingStats(aEncoding);
+			return json({
+				{ "messages", stats.messages },
+				{ "bytes", stats.bytes },
+				{ "encode_time", stats.encodeTime },
+			});
+		};
 
 		aRequest.setResponseBody({
 			{ "server_threads", WEBCFG(SERVER_THREADS).num() },
 			{ "active_sessions", server->getUserManager().getUserSessionCount() },
+			{ "socket_threads", socketStats.threads },
+			{ "socket_worker_threads", socketStats.workerThreads },
+			{ "socket_queued_calls", socketStats.queuedCalls },
+			{ "sockets", socketStats.sockets },
+			{ "socket_loop_latency", socketStats.averageLatency },
+			{ "socket_loop_latency_max", socketStats.maxLatency },
+			{ "queue_lock_count", queueLockStats.locks },
+			{ "queue_lock_waits", queueLockStats.waits },
+			{ "queue_lock_wait_time", queueLockStats.waitTime },
+			{ "queue_lock_wait_max", queueLockStats.maxWaitTime },
+			{ "encoding_json", serializeEncodingStats(WebSocket::Encoding::JSON) },
+			{ "encoding_cbor", serializeEncodingStats(WebSocket::Encoding::CBOR) },
+			{ "encoding_msgpack", serializeEncodingStats(WebSocket::Encoding::MSGPACK) },
 		});
 		return websocketpp::http::status_code::ok;
 	}
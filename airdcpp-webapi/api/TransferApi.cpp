@@ -26,8 +26,10 @@
 #include <airdcpp/Upload.h>
 
 #include <airdcpp/DownloadManager.h>
+#include <airdcpp/DownloadWriter.h>
 #include <airdcpp/ConnectionManager.h>
 #include <airdcpp/QueueManager.h>
+#include <airdcpp/SharedFileStream.h>
 #include <airdcpp/ThrottleManager.h>
 #include <airdcpp/UploadManager.h>
 
@@ -211,29 +213,70 @@ namespace webserver {
 			{ "speed_up", upSpeed },
 			{ "limit_down", ThrottleManager::getDownLimit() },
 			{ "limit_up", ThrottleManager::getUpLimit() },
-			{ "upload_bundles", lastUploadBundles },
-			{ "download_bundles", lastDownloadBundles },
+			{ "upload_bundles", lastUploadBundles.load() },
+			{ "download_bundles", lastDownloadBundles.load() },
 			{ "uploads", uploads },
 			{ "downloads", downloads },
 			{ "queued_bytes", QueueManager::getInstance()->getTotalQueueSize() },
 			{ "session_downloaded", Socket::getTotalDown() },
 			{ "session_uploaded", Socket::getTotalUp() },
+			{ "upload_cache_hits", SharedFileStream::readCache.getHits() },
+			{ "upload_cache_misses", SharedFileStream::readCache.getMisses() },
+			{ "download_write_queue", DownloadWriter::getInstance()->getQueuedBytes() },
 		};
 	}
 
+	json TransferApi::previousStats;
+	json TransferApi::previousStatsDiff;
+	uint64_t TransferApi::statsVersion = 0;
+	uint64_t TransferApi::statsUpdateTick = 0;
+	FastCriticalSection TransferApi::statsCs;
+
+	atomic<int> TransferApi::lastUploadBundles = { 0 };
+	atomic<int> TransferApi::lastDownloadBundles = { 0 };
+
 	void TransferApi::onTimer() {
 		if (!subscriptionActive("transfer_statistics"))
 			return;
 
-		auto newStats = serializeTransferStats();
-		if (previousStats == newStats)
-			return;
+		json data;
+		uint64_t version;
+
+		{
+			FastLock l(statsCs);
+
+			// Timers of the other sessions may have updated the statistics during this round already
+			auto tick = GET_TICK();
+			if (tick >= statsUpdateTick + 500) {
+				statsUpdateTick = tick;
+
+				auto newStats = serializeTransferStats();
+				if (previousStats != newStats) {
+					lastUploadBundles = 0;
+					lastDownloadBundles = 0;
+
+					previousStatsDiff = JsonUtil::filterExactValues(newStats, previousStats);
+					previousStats.swap(newStats);
+					statsVersion++;
+				}
+			}
+
+			if (statsVersion == sentStatsVersion)
+				return;
 
-		lastUploadBundles = 0;
-		lastDownloadBundles = 0;
+			version = statsVersion;
+
+			// Sessions that have missed updates (or subscribed just now) will receive all values
+			data = version == sentStatsVersion + 1 ? previousStatsDiff : previousStats;
+		}
 
-		send("transfer_statistics", JsonUtil::filterExactValues(newStats, previousStats));
-		previousStats.swap(newStats);
+		if (version == sentStatsVersion + 1) {
+			sendShared("transfer_statistics", version, [&] { return data; });
+		} else {
+			send("transfer_statistics", data);
+		}
+
+		sentStatsVersion = version;
 	}
 
 	void TransferApi::onTick(const Transfer* aTransfer, bool aIsDownload) noexcept {
@@ -245,6 +288,10 @@ namespace webserver {
 		t->setSpeed(aTransfer->getAverageSpeed());
 		t->setBytesTransferred(aTransfer->getPos());
 		t->setTimeLeft(aTransfer->getSecondsLeft());
+		if (aIsDownload) {
+			// Data that is waiting to be verified and written
+			t->setQueuedBytes(static_cast<const Download*>(aTransfer)->getQueuedBytes());
+		}
 
 		uint64_t timeSinceStarted = GET_TICK() - t->getStarted();
 		if (timeSinceStarted < 1000) {
@@ -255,7 +302,7 @@ namespace webserver {
 
 		onTransferUpdated(t, {
 			TransferUtils::PROP_STATUS, TransferUtils::PROP_BYTES_TRANSFERRED, 
-			TransferUtils::PROP_SPEED, TransferUtils::PROP_SECONDS_LEFT
+			TransferUtils::PROP_SPEED, TransferUtils::PROP_SECONDS_LEFT, TransferUtils::PROP_QUEUED_BYTES
 		}, Util::emptyString);
 	}
 
@@ -88,10 +88,18 @@ namespace webserver {
 		void on(UploadManagerListener::Complete, const Upload* aUpload) noexcept override;
 
 
-		json previousStats;
-
-		int lastUploadBundles = 0;
-		int lastDownloadBundles = 0;
+		// The statistics are shared by all sessions so that the identical events are serialized only once
+		static json previousStats;
+		static json previousStatsDiff;
+		static uint64_t statsVersion;
+		static uint64_t statsUpdateTick;
+		static FastCriticalSection statsCs;
+
+		static atomic<int> lastUploadBundles;
+		static atomic<int> lastDownloadBundles;
+
+		// Last statistics version that was sent to this session
+		uint64_t sentStatsVersion = 0;
 
 		TimerPtr timer;
 
@@ -62,6 +62,7 @@ namespace webserver {
 		IGETSET(int64_t, started, Started, 0);
 		IGETSET(int64_t, bytesTransferred, BytesTransferred, -1);
 		IGETSET(int64_t, speed, Speed, 0);
+		IGETSET(int64_t, queuedBytes, QueuedBytes, 0);
 		IGETSET(ItemState, state, State, STATE_WAITING);
 
 		IGETSET(QueueToken, queueToken, QueueToken, 0);
@@ -41,6 +41,7 @@ namespace webserver {
 		{ PROP_FLAGS, "flags", TYPE_LIST_TEXT, SERIALIZE_CUSTOM, SORT_CUSTOM },
 		{ PROP_ENCRYPTION, "encryption", TYPE_TEXT, SERIALIZE_CUSTOM, SORT_TEXT },
 		{ PROP_QUEUE_ID, "queue_file_id", TYPE_NUMERIC_OTHER, SERIALIZE_CUSTOM, SORT_NUMERIC },
+		{ PROP_QUEUED_BYTES, "queued_bytes", TYPE_SIZE, SERIALIZE_NUMERIC, SORT_NUMERIC },
 	};
 
 	const PropertyItemHandler<TransferInfoPtr> TransferUtils::propertyHandler = {
@@ -71,6 +72,7 @@ namespace webserver {
 		case PROP_SPEED: return (double)aItem->getSpeed();
 		case PROP_SECONDS_LEFT: return (double)aItem->getTimeLeft();
 		case PROP_QUEUE_ID: return (double)aItem->getQueueToken();
+		case PROP_QUEUED_BYTES: return (double)aItem->getQueuedBytes();
 		default: dcassert(0); return 0;
 		}
 	}
@@ -45,6 +45,7 @@ namespace webserver {
 			PROP_FLAGS,
 			PROP_ENCRYPTION,
 			PROP_QUEUE_ID,
+			PROP_QUEUED_BYTES,
 			PROP_LAST
 		};
 
@@ -202,10 +202,112 @@ namespace webserver {
 	}
 
 	bool SubscribableApiModule::send(const string& aSubscription, const json& aData) {
-		return send({
+		// Ensure that the socket won't be deleted while sending the message...
+		auto s = socket;
+		if (!s) {
+			return false;
+		}
+
+		try {
+			auto encoding = s->getEncoding();
+			if (encoding == WebSocket::Encoding::JSON) {
+				s->sendEvent(getEventProperties(aSubscription), WebSocket::encodeJson(aData));
+			} else {
+				s->sendEvent(getEventProperties(aSubscription), WebSocket::encodeBinary(aData, encoding), encoding);
+			}
+		} catch (const std::exception& e) {
+			s->logError("Failed to encode data: " + string(e.what()), websocketpp::log::elevel::fatal);
+			return false;
+		}
+
+		return true;
+	}
+
+	// The data is encoded when it's needed for the first time with each encoding
+	struct SubscribableApiModule::SharedEvent {
+		uint64_t key = 0;
+		shared_ptr<const json> data;
+		shared_ptr<const string> jsonData;
+		std::map<WebSocket::Encoding, shared_ptr<const vector<uint8_t>>> binaryData;
+	};
+
+	SubscribableApiModule::SharedEventMap SubscribableApiModule::sharedEvents;
+	FastCriticalSection SubscribableApiModule::sharedEventCs;
+
+	bool SubscribableApiModule::sendShared(const string& aSubscription, uint64_t aKey, JsonCallback aCallback) {
+		// Ensure that the socket won't be deleted while sending the message...
+		auto s = socket;
+		if (!s) {
+			return false;
+		}
+
+		auto encoding = s->getEncoding();
+
+		shared_ptr<const json> data;
+		shared_ptr<const string> jsonData;
+		shared_ptr<const vector<uint8_t>> binaryData;
+
+		{
+			FastLock l(sharedEventCs);
+			auto i = sharedEvents.find(aSubscription);
+			if (i != sharedEvents.end() && i->second.key == aKey) {
+				data = i->second.data;
+				jsonData = i->second.jsonData;
+
+				auto b = i->second.binaryData.find(encoding);
+				if (b != i->second.binaryData.end()) {
+					binaryData = b->second;
+				}
+			}
+		}
+
+		try {
+			if (!data) {
+				data = make_shared<const json>(aCallback());
+
+				FastLock l(sharedEventCs);
+				auto& event = sharedEvents[aSubscription];
+				event = SharedEvent();
+				event.key = aKey;
+				event.data = data;
+			}
+
+			// Encode the data unless another session has done it already
+			if (encoding == WebSocket::Encoding::JSON && !jsonData) {
+				jsonData = make_shared<const string>(WebSocket::encodeJson(*data));
+
+				FastLock l(sharedEventCs);
+				auto i = sharedEvents.find(aSubscription);
+				if (i != sharedEvents.end() && i->second.key == aKey) {
+					i->second.jsonData = jsonData;
+				}
+			} else if (encoding != WebSocket::Encoding::JSON && !binaryData) {
+				binaryData = make_shared<const vector<uint8_t>>(WebSocket::encodeBinary(*data, encoding));
+
+				FastLock l(sharedEventCs);
+				auto i = sharedEvents.find(aSubscription);
+				if (i != sharedEvents.end() && i->second.key == aKey) {
+					i->second.binaryData[encoding] = binaryData;
+				}
+			}
+
+			if (encoding == WebSocket::Encoding::JSON) {
+				s->sendEvent(getEventProperties(aSubscription), *jsonData);
+			} else {
+				s->sendEvent(getEventProperties(aSubscription), *binaryData, encoding);
+			}
+		} catch (const std::exception& e) {
+			s->logError("Failed to encode data: " + string(e.what()), websocketpp::log::elevel::fatal);
+			return false;
+		}
+
+		return true;
+	}
+
+	json SubscribableApiModule::getEventProperties(const string& aSubscription) const {
+		return {
 			{ "event", aSubscription },
-			{ "data", aData },
-		});
+		};
 	}
 
 	bool SubscribableApiModule::maybeSend(const string& aSubscription, JsonCallback aCallback) {
@@ -23,6 +23,8 @@
 #include <web-server/ApiRequest.h>
 #include <web-server/SessionListener.h>
 
+#include <airdcpp/CriticalSection.h>
+
 namespace webserver {
 	using boost::regex;
 
@@ -124,6 +126,11 @@ namespace webserver {
 		typedef std::function<json()> JsonCallback;
 		virtual bool maybeSend(const string& aSubscription, JsonCallback aCallback);
 
+		// Send an event with data that is identical for all sessions (e.g. a new message)
+		// The data is serialized only once when the same event is sent for multiple sessions
+		// aKey must identify the data within the subscription
+		bool sendShared(const string& aSubscription, uint64_t aKey, JsonCallback aCallback);
+
 		// All custom async tasks should be run inside this to
 		// ensure that the session won't get deleted
 
@@ -162,9 +169,18 @@ namespace webserver {
 
 		virtual api_return handleSubscribe(ApiRequest& aRequest);
 		virtual api_return handleUnsubscribe(ApiRequest& aRequest);
+
+		// Properties of the event message in addition to the data
+		virtual json getEventProperties(const string& aSubscription) const;
 	private:
 		WebSocketPtr socket = nullptr;
 		SubscriptionMap subscriptions;
+
+		// The last shared event of each subscription (defined in the source file)
+		struct SharedEvent;
+		typedef std::map<string, SharedEvent> SharedEventMap;
+		static SharedEventMap sharedEvents;
+		static FastCriticalSection sharedEventCs;
 	};
 
 	typedef std::unique_ptr<ApiModule> HandlerPtr;
@@ -183,14 +183,6 @@ namespace webserver {
 		SubApiModule(ParentType* aParentModule, const IdJsonType& aJsonId, const StringList& aSubscriptions) :
 			SubscribableApiModule(aParentModule->getSession(), aParentModule->getSubscriptionAccess(), aSubscriptions), parentModule(aParentModule), jsonId(aJsonId) { }
 
-		bool send(const string& aSubscription, const json& aJson) override {
-			return SubscribableApiModule::send({
-				{ "event", aSubscription },
-				{ "data", aJson },
-				{ "id", jsonId }
-			});
-		}
-
 		bool maybeSend(const string& aSubscription, SubscribableApiModule::JsonCallback aCallback) override {
 			if (!subscriptionActive(aSubscription)) {
 				return false;
@@ -199,6 +191,13 @@ namespace webserver {
 			return send(aSubscription, aCallback());
 		}
 
+		json getEventProperties(const string& aSubscription) const override {
+			return {
+				{ "event", aSubscription },
+				{ "id", jsonId },
+			};
+		}
+
 		bool subscriptionActive(const string& aSubscription) const noexcept override {
 			// Enabled across all entities?
 			if (parentModule->subscriptionActive(aSubscription)) {
@@ -49,7 +49,9 @@ namespace webserver {
 				return;
 			}
 
-			module->send(s, Serializer::serializeChatMessage(aMessage));
+			module->sendShared(s, aMessage->getId(), [&] {
+				return Serializer::serializeChatMessage(aMessage);
+			});
 		}
 
 		void onStatusMessage(const LogMessagePtr& aMessage) noexcept {
@@ -60,7 +62,9 @@ namespace webserver {
 				return;
 			}
 
-			module->send(s, Serializer::serializeLogMessage(aMessage));
+			module->sendShared(s, aMessage->getId(), [&] {
+				return Serializer::serializeLogMessage(aMessage);
+			});
 		}
 
 		void onMessagesUpdated() {
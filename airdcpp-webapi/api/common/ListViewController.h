@@ -26,6 +26,8 @@
 
 #include <airdcpp/TimerManager.h>
 
+#include <chrono>
+
 #include <api/base/ApiModule.h>
 #include <api/common/PropertyFilter.h>
 #include <api/common/Serializer.h>
@@ -36,6 +38,9 @@ namespace webserver {
 	template<class T, int PropertyCount>
 	class ListViewController : private SessionListener {
 	public:
+		// Updated items are moved to their new positions individually up to this count, the whole list is sorted otherwise
+		static const size_t MAX_REPOSITIONED_ITEMS = 100;
+
 		typedef typename PropertyItemHandler<T>::ItemList ItemList;
 		typedef typename PropertyItemHandler<T>::ItemListFunction ItemListF;
 		typedef std::function<void(bool aActive)> StateChangeFunction;
@@ -57,6 +62,7 @@ namespace webserver {
 			MODULE_METHOD_HANDLER(aModule, access, METHOD_DELETE, (EXACT_PARAM(viewName)), ListViewController::handleReset);
 
 			MODULE_METHOD_HANDLER(aModule, access, METHOD_GET, (EXACT_PARAM(viewName), EXACT_PARAM("items"), RANGE_START_PARAM, RANGE_MAX_PARAM), ListViewController::handleGetItems);
+			MODULE_METHOD_HANDLER(aModule, access, METHOD_GET, (EXACT_PARAM(viewName), EXACT_PARAM("stats")), ListViewController::handleGetStats);
 		}
 
 		~ListViewController() {
@@ -257,6 +263,7 @@ namespace webserver {
 			{
 				WLock l(cs);
 				matchingItems.swap(itemsNew);
+				matchingItemSet = std::set<T, std::less<T>>(matchingItems.begin(), matchingItems.end());
 				itemListChanged = true;
 				currentValues.set(IntCollector::TYPE_RANGE_START, 0);
 			}
@@ -380,6 +387,7 @@ namespace webserver {
 			}
 
 			sourceItems.insert(matchingItems.begin(), matchingItems.end());
+			matchingItemSet.insert(matchingItems.begin(), matchingItems.end());
 
 			itemListChanged = true;
 			return static_cast<int>(matchingItems.size());
@@ -390,6 +398,7 @@ namespace webserver {
 			tasks.clear();
 			currentViewportItems.clear();
 			matchingItems.clear();
+			matchingItemSet.clear();
 			sourceItems.clear();
 			prevTotalItemCount = -1;
 			prevMatchingItemCount = -1;
@@ -418,20 +427,42 @@ namespace webserver {
 			return aSortAscending == 1 ? res < 0 : res > 0;
 		}
 
+		api_return handleGetStats(ApiRequest& aRequest) {
+			aRequest.setResponseBody({
+				{ "sort", sortTimer.serialize() },
+				{ "tasks", taskTimer.serialize() },
+				{ "viewport", viewportTimer.serialize() },
+				{ "fetch", fetchTimer.serialize() },
+			});
+
+			return websocketpp::http::status_code::ok;
+		}
+
 		api_return handleGetItems(ApiRequest& aRequest) {
+			auto fetchStart = std::chrono::steady_clock::now();
 			auto start = aRequest.getRangeParam(START_POS);
 			auto end = aRequest.getRangeParam(MAX_COUNT);
-			decltype(matchingItems) matchingItemsCopy;
+			ItemList items;
 
 			{
+				// Copy the requested range only
 				RLock l(cs);
-				matchingItemsCopy = matchingItems;
+				auto listSize = static_cast<int>(matchingItems.size());
+				if (listSize > 0) {
+					if (start >= listSize || end - start <= 0) {
+						throw std::domain_error("Invalid range");
+					}
+
+					items.assign(matchingItems.begin() + start, matchingItems.begin() + min(listSize, end));
+				}
 			}
 
-			auto j = Serializer::serializeFromPosition(start, end - start, matchingItemsCopy, [&](const T& i) {
+			auto j = Serializer::serializeList(items, [&](const T& i) {
 				return Serializer::serializeItem(i, itemHandler);
 			});
 
+			fetchTimer.add(fetchStart);
+
 			aRequest.setResponseBody(j);
 			return websocketpp::http::status_code::ok;
 		}
@@ -440,21 +471,27 @@ namespace webserver {
 			return find(aItems.begin(), aItems.end(), aItem);
 		}
 
-		typename ItemList::const_iterator findItem(const T& aItem, const ItemList& aItems) const noexcept {
-			return find(aItems.begin(), aItems.end(), aItem);
-		}
+		// Items are located with a binary search by using the current sort order
+		// Items whose sort values have changed after the list was sorted won't be found that way and require a full scan
+		typename ItemList::iterator findMatchingItem(const T& aItem, int aSortProperty, int aSortAscending) noexcept {
+			if (matchingItemSet.find(aItem) == matchingItemSet.end()) {
+				return matchingItems.end();
+			}
 
-		bool isInList(const T& aItem, const ItemList& aItems) const noexcept {
-			return findItem(aItem, aItems) != aItems.end();
-		}
+			auto range = std::equal_range(matchingItems.begin(), matchingItems.end(), aItem,
+				std::bind(&ListViewController::itemSort, std::placeholders::_1, std::placeholders::_2, std::cref(itemHandler), aSortProperty, aSortAscending)
+			);
 
-		int64_t getPosition(const T& aItem, const ItemList& aItems) const noexcept {
-			auto i = findItem(aItem, aItems);
-			if (i == aItems.end()) {
-				return -1;
+			auto i = find(range.first, range.second, aItem);
+			if (i != range.second) {
+				return i;
 			}
 
-			return distance(aItems.begin(), i);
+			return findItem(aItem, matchingItems);
+		}
+
+		bool isMatchingItem(const T& aItem) const noexcept {
+			return matchingItemSet.find(aItem) != matchingItemSet.end();
 		}
 
 		// TASKS START
@@ -483,7 +520,7 @@ namespace webserver {
 				return;
 			}
 
-			maybeSort(updatedProperties, sortProperty, sortAscending);
+			maybeSort(currentTasks, updatedProperties, sortProperty, sortAscending);
 
 			// Start position
 			auto newStart = updateValues[IntCollector::TYPE_RANGE_START];
@@ -491,12 +528,19 @@ namespace webserver {
 			json j;
 
 			// Go through the tasks
+			auto tasksStart = std::chrono::steady_clock::now();
 			auto updatedItems = handleTasks(currentTasks, sortProperty, sortAscending, newStart);
+			if (!currentTasks.empty()) {
+				auto duration = taskTimer.add(tasksStart);
+				dcdebug("Table %s: " SIZET_FMT " tasks handled in " U64_FMT " us\n", viewName.c_str(), currentTasks.size(), duration);
+			}
 
 			ItemList nextViewportItems;
 			if (newStart >= 0) {
 				// Get the new visible items
+				auto viewportStart = std::chrono::steady_clock::now();
 				updateViewItems(updatedItems, j, newStart, updateValues[IntCollector::TYPE_MAX_COUNT], nextViewportItems);
+				viewportTimer.add(viewportStart);
 
 				// Append other changed properties
 				auto startOffset = newStart - updateValues[IntCollector::TYPE_RANGE_START];
@@ -538,7 +582,7 @@ namespace webserver {
 					break;
 				}
 				case REMOVE_ITEM: {
-					handleRemoveItem(t.first, rangeStart_);
+					handleRemoveItem(t.first, aSortProperty, aSortAscending, rangeStart_);
 					break;
 				}
 				case UPDATE_ITEM: {
@@ -555,7 +599,7 @@ namespace webserver {
 
 		void updateViewItems(const ItemPropertyIdMap& aUpdatedItems, json& json_, int& newStart_, int aMaxCount, ItemList& nextViewportItems_) {
 			// Get the new visible items
-			ItemList currentItemsCopy;
+			std::set<T, std::less<T>> currentItems;
 			{
 				RLock l(cs);
 				if (newStart_ >= static_cast<int>(sourceItems.size())) {
@@ -575,7 +619,7 @@ namespace webserver {
 				std::advance(endIter, count);
 
 				std::copy(startIter, endIter, back_inserter(nextViewportItems_));
-				currentItemsCopy = currentViewportItems;
+				currentItems.insert(currentViewportItems.begin(), currentViewportItems.end());
 			}
 
 			json_["items"] = json::array();
@@ -583,7 +627,7 @@ namespace webserver {
 			// List items
 			int pos = 0;
 			for (const auto& item : nextViewportItems_) {
-				if (!isInList(item, currentItemsCopy)) {
+				if (currentItems.find(item) == currentItems.end()) {
 					appendItemFull(item, json_, pos);
 				} else {
 					// append position
@@ -599,29 +643,100 @@ namespace webserver {
 			}
 		}
 
-		void maybeSort(const PropertyIdSet& aUpdatedProperties, int aSortProperty, int aSortAscending) {
-			bool needSort = aUpdatedProperties.find(aSortProperty) != aUpdatedProperties.end() ||
-				prevValues[IntCollector::TYPE_SORT_ASCENDING] != aSortAscending ||
-				prevValues[IntCollector::TYPE_SORT_PROPERTY] != aSortProperty ||
-				itemListChanged;
+		// Sort keys are extracted only once for each item instead of generating them for every comparison
+		template<typename KeyT, typename KeyF, typename CompareF>
+		static void sortByKey(ItemList& items_, int aSortAscending, KeyF aKeyF, CompareF aCompareF) {
+			vector<pair<KeyT, T>> keyedItems;
+			keyedItems.reserve(items_.size());
+			for (const auto& item : items_) {
+				keyedItems.emplace_back(aKeyF(item), item);
+			}
 
-			itemListChanged = false;
+			std::stable_sort(keyedItems.begin(), keyedItems.end(), [&](const pair<KeyT, T>& a, const pair<KeyT, T>& b) {
+				auto res = aCompareF(a.first, b.first);
+				return aSortAscending == 1 ? res < 0 : res > 0;
+			});
 
-			if (needSort) {
-				auto start = GET_TICK();
+			for (size_t i = 0; i < keyedItems.size(); i++) {
+				items_[i] = std::move(keyedItems[i].second);
+			}
+		}
 
-				WLock l(cs);
-				std::stable_sort(matchingItems.begin(), matchingItems.end(),
+		void sortItems(ItemList& items_, int aSortProperty, int aSortAscending) const {
+			switch (itemHandler.properties[aSortProperty].sortMethod) {
+			case SORT_NUMERIC: {
+				sortByKey<double>(items_, aSortAscending,
+					[&](const T& aItem) { return itemHandler.numberF(aItem, aSortProperty); },
+					[](double a, double b) { return compare(a, b); }
+				);
+				break;
+			}
+			case SORT_TEXT: {
+				sortByKey<string>(items_, aSortAscending,
+					[&](const T& aItem) { return itemHandler.stringF(aItem, aSortProperty); },
+					[](const string& a, const string& b) { return Util::DefaultSort(a.c_str(), b.c_str()); }
+				);
+				break;
+			}
+			default: {
+				std::stable_sort(items_.begin(), items_.end(),
 					std::bind(&ListViewController::itemSort,
 						std::placeholders::_1,
 						std::placeholders::_2,
-						itemHandler,
+						std::cref(itemHandler),
 						aSortProperty,
 						aSortAscending
 						));
+			}
+			}
+		}
 
-				dcdebug("Table %s sorted in " U64_FMT " ms\n", viewName.c_str(), GET_TICK() - start);
+		// Moves the items to their new sorted positions (the list must be sorted otherwise)
+		void repositionItems(const std::set<T, std::less<T>>& aItems, int aSortProperty, int aSortAscending) {
+			matchingItems.erase(remove_if(matchingItems.begin(), matchingItems.end(), [&](const T& aItem) {
+				return aItems.find(aItem) != aItems.end();
+			}), matchingItems.end());
+
+			auto sorter = std::bind(&ListViewController::itemSort, std::placeholders::_1, std::placeholders::_2, std::cref(itemHandler), aSortProperty, aSortAscending);
+			for (const auto& item : aItems) {
+				matchingItems.insert(std::upper_bound(matchingItems.begin(), matchingItems.end(), item, sorter), item);
+			}
+		}
+
+		void maybeSort(const typename ItemTasks<T>::TaskMap& aTasks, const PropertyIdSet& aUpdatedProperties, int aSortProperty, int aSortAscending) {
+			bool sortChanged = prevValues[IntCollector::TYPE_SORT_ASCENDING] != aSortAscending ||
+				prevValues[IntCollector::TYPE_SORT_PROPERTY] != aSortProperty ||
+				itemListChanged;
+
+			itemListChanged = false;
+
+			if (!sortChanged && aUpdatedProperties.find(aSortProperty) == aUpdatedProperties.end()) {
+				return;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+
+			WLock l(cs);
+			if (!sortChanged) {
+				// Only the items with an updated sort value need to be moved
+				std::set<T, std::less<T>> updatedItems;
+				for (const auto& t : aTasks) {
+					if (t.second.type == UPDATE_ITEM && t.second.updatedProperties.find(aSortProperty) != t.second.updatedProperties.end() && isMatchingItem(t.first)) {
+						updatedItems.insert(t.first);
+					}
+				}
+
+				if (updatedItems.size() <= MAX_REPOSITIONED_ITEMS) {
+					repositionItems(updatedItems, aSortProperty, aSortAscending);
+					auto duration = sortTimer.add(start);
+					dcdebug("Table %s: " SIZET_FMT " items repositioned in " U64_FMT " us\n", viewName.c_str(), updatedItems.size(), duration);
+					return;
+				}
 			}
+
+			sortItems(matchingItems, aSortProperty, aSortAscending);
+			auto duration = sortTimer.add(start);
+			dcdebug("Table %s sorted in " U64_FMT " us\n", viewName.c_str(), duration);
 		}
 
 		void appendItemCounts(json& json_) {
@@ -659,12 +774,12 @@ namespace webserver {
 				WLock l(cs);
 				sourceItems.emplace(aItem);
 
-				if (matches) {
+				if (matches && matchingItemSet.insert(aItem).second) {
 					auto iter = matchingItems.insert(std::upper_bound(
 						matchingItems.begin(),
 						matchingItems.end(),
 						aItem,
-						std::bind(&ListViewController::itemSort, std::placeholders::_1, std::placeholders::_2, itemHandler, aSortProperty, aSortAscending)
+						std::bind(&ListViewController::itemSort, std::placeholders::_1, std::placeholders::_2, std::cref(itemHandler), aSortProperty, aSortAscending)
 					), aItem);
 
 					auto pos = static_cast<int>(std::distance(matchingItems.begin(), iter));
@@ -676,9 +791,9 @@ namespace webserver {
 			}
 		}
 
-		void handleRemoveItem(const T& aItem, int& rangeStart_) {
+		void handleRemoveItem(const T& aItem, int aSortProperty, int aSortAscending, int& rangeStart_) {
 			WLock l(cs);
-			auto iter = findItem(aItem, matchingItems);
+			auto iter = findMatchingItem(aItem, aSortProperty, aSortAscending);
 			if (iter == matchingItems.end()) {
 				//dcassert(0);
 				return;
@@ -687,6 +802,7 @@ namespace webserver {
 			auto pos = static_cast<int>(std::distance(matchingItems.begin(), iter));
 
 			matchingItems.erase(iter);
+			matchingItemSet.erase(aItem);
 			sourceItems.erase(aItem);
 
 			if (rangeStart_ > 0 && pos > rangeStart_) {
@@ -701,7 +817,7 @@ namespace webserver {
 
 			{
 				RLock l(cs);
-				inList = isInList(aItem, matchingItems);
+				inList = isMatchingItem(aItem);
 
 				// A delayed update for a removed item?
 				if (!inList && sourceItems.find(aItem) == sourceItems.end()) {
@@ -712,7 +828,7 @@ namespace webserver {
 			auto matchers = getFilterMatcherList();
 			if (!matchesFilter(aItem, matchers)) {
 				if (inList) {
-					handleRemoveItem(aItem, rangeStart_);
+					handleRemoveItem(aItem, aSortProperty, aSortAscending, rangeStart_);
 				}
 
 				return false;
@@ -762,6 +878,9 @@ namespace webserver {
 		// All items matching the list of dynamic filters
 		ItemList matchingItems;
 
+		// Same as matchingItems for fast lookups
+		std::set<T, std::less<T>> matchingItemSet;
+
 		bool active = false;
 
 		mutable SharedMutex cs;
@@ -820,6 +939,54 @@ namespace webserver {
 			ValueMap values;
 		};
 
+		// Durations of the list operations in microseconds (available via the stats method)
+		class OperationTimer {
+		public:
+			// Returns the duration of the operation
+			uint64_t add(const std::chrono::steady_clock::time_point& aStart) noexcept {
+				uint64_t duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - aStart).count();
+
+				FastLock l(cs);
+				count++;
+				last = duration;
+				total += duration;
+				if (duration > longest) {
+					longest = duration;
+				}
+
+				return duration;
+			}
+
+			json serialize() const noexcept {
+				FastLock l(cs);
+				return {
+					{ "count", count },
+					{ "last", last },
+					{ "max", longest },
+					{ "average", count > 0 ? total / count : 0 },
+				};
+			}
+		private:
+			uint64_t count = 0;
+			uint64_t last = 0;
+			uint64_t longest = 0;
+			uint64_t total = 0;
+
+			mutable FastCriticalSection cs;
+		};
+
+		// Sorting and repositioning of the matching items
+		OperationTimer sortTimer;
+
+		// Handling of the queued item tasks
+		OperationTimer taskTimer;
+
+		// Collecting the items for the current viewport
+		OperationTimer viewportTimer;
+
+		// Item range requests
+		OperationTimer fetchTimer;
+
 		bool itemListChanged = false;
 		IntCollector currentValues;
 
@@ -50,6 +50,7 @@
 
 #include <websocketpp/http/constants.hpp>
 #include <websocketpp/config/asio.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <websocketpp/server.hpp>
 
 #include <boost/range/algorithm/copy.hpp>
@@ -60,10 +61,20 @@
 #define CODE_UNPROCESSABLE_ENTITY 422
 
 namespace webserver {
+	// Endpoint config with permessage-deflate compression enabled
+	// Compression is used only if the client offers it in the handshake
+	template <typename BaseConfig>
+	struct deflate_config : public BaseConfig {
+		typedef deflate_config type;
+
+		struct permessage_deflate_config {};
+		typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+	};
+
 	// define types for two different server endpoints, one for each config we are
 	// using
-	typedef websocketpp::server<websocketpp::config::asio> server_plain;
-	typedef websocketpp::server<websocketpp::config::asio_tls> server_tls;
+	typedef websocketpp::server<deflate_config<websocketpp::config::asio>> server_plain;
+	typedef websocketpp::server<deflate_config<websocketpp::config::asio_tls>> server_tls;
 	typedef websocketpp::http::status_code::value api_return;
 
 	using namespace dcpp;
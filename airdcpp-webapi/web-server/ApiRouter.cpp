@@ -42,16 +42,16 @@ namespace webserver {
 
 	}
 
-	void ApiRouter::handleSocketRequest(const string& aMessage, WebSocketPtr& aSocket, bool aIsSecure) noexcept {
+	void ApiRouter::handleSocketRequest(const string& aMessage, bool aIsBinary, WebSocketPtr& aSocket, bool aIsSecure) noexcept {
 
-		dcdebug("Received socket request: %s\n", aMessage.size() > 500 ? (aMessage.substr(0, 500) + "...").c_str() : aMessage.c_str());
+		dcdebug("Received socket request: %s\n", aIsBinary ? "(binary)" : aMessage.size() > 500 ? (aMessage.substr(0, 500) + "...").c_str() : aMessage.c_str());
 
 		json responseJsonData, errorJson;
 		websocketpp::http::status_code::value code;
 		int callbackId = -1;
 
 		try {
-			const auto requestJson = json::parse(aMessage);
+			const auto requestJson = aSocket->parseMessage(aMessage, aIsBinary);
 
 			callbackId = JsonUtil::getOptionalFieldDefault<int>("callback_id", requestJson, -1);
 
@@ -139,6 +139,16 @@ namespace webserver {
 		return nullptr;
 	}
 
+	bool FileServer::isMediaFile(const string& aFileName) noexcept {
+		auto type = getMimeType(aFileName);
+		if (!type) {
+			return false;
+		}
+
+		string str(type);
+		return str.compare(0, 6, "audio/") == 0 || str.compare(0, 6, "video/") == 0;
+	}
+
 	string FileServer::getExtension(const string& aResource) noexcept {
 		auto extension = Util::getFileExt(aResource);
 		if (!extension.empty()) {
@@ -244,7 +254,7 @@ namespace webserver {
 
 	// Support partial requests will enhance media file playback
 	// This will only support simple range values (unsupported range types will be ignored)
-	bool FileServer::parsePartialRange(const string& aHeaderData, int64_t& start_, int64_t& end_) noexcept {
+	bool FileServer::parsePartialRange(const string& aHeaderData, bool aIsMedia, int64_t& start_, int64_t& end_) noexcept {
 		if (aHeaderData.find("bytes=") != 0) {
 			return false;
 		}
@@ -267,7 +277,9 @@ namespace webserver {
 
 		const auto& endToken = tokenizer.getTokens().at(1);
 		if (endToken.empty()) {
-			end_ = end_ - start_;
+			if (aIsMedia) {
+				end_ = min(end_, parsedStart + MAX_MEDIA_RANGE_SIZE - 1);
+			}
 		} else {
 			auto parsedEnd = Util::toInt64(endToken);
 			if (parsedEnd > end_ || parsedEnd <= parsedStart) {
@@ -359,20 +371,28 @@ namespace webserver {
 		auto fileSize = File::getSize(filePath);
 		int64_t startPos = 0, endPos = fileSize - 1;
 
-		auto partialContent = parsePartialRange(aRequest.get_header("Range"), startPos, endPos);
+		auto partialContent = parsePartialRange(aRequest.get_header("Range"), isMediaFile(filePath), startPos, endPos);
 
-		// Read file
+		// Read file (only the requested range)
+		// websocketpp needs the complete response body so the whole range is read in memory
 		try {
 			File f(filePath, File::READ, File::OPEN);
 			f.setPos(startPos);
-			output_ = f.read(static_cast<size_t>(endPos) + 1);
+			output_ = f.read(static_cast<size_t>(max(endPos - startPos + 1, static_cast<int64_t>(0))));
 		} catch (const FileException& e) {
 			dcdebug("Failed to serve the file %s: %s\n", filePath.c_str(), e.getError().c_str());
 			output_ = e.getError();
 			return websocketpp::http::status_code::not_found;
 		} catch (const std::bad_alloc&) {
-			output_ = "Not enough memory on the server to serve this request";
-			return websocketpp::http::status_code::internal_server_error;
+			// Let the client know that the file can still be fetched in smaller parts
+			output_ = "Not enough memory on the server to serve this request (use range requests to fetch the file in parts)";
+			headers_.emplace_back("Accept-Ranges", "bytes");
+			if (partialContent) {
+				headers_.emplace_back("Content-Range", "bytes */" + Util::toString(fileSize));
+				return websocketpp::http::status_code::request_range_not_satisfiable;
+			}
+
+			return websocketpp::http::status_code::request_entity_too_large;
 		}
 
 		{
@@ -401,9 +421,11 @@ namespace webserver {
 			}
 		}
 
+		// Let the clients know that large files can be fetched in smaller parts
+		headers_.emplace_back("Accept-Ranges", "bytes");
+
 		if (partialContent) {
 			headers_.emplace_back("Content-Range", formatPartialRange(startPos, endPos, fileSize));
-			headers_.emplace_back("Accept-Ranges", "bytes");
 			return websocketpp::http::status_code::partial_content;
 		}
 
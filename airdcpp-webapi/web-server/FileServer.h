@@ -40,6 +40,11 @@ namespace webserver {
 		static const char* getMimeType(const string& aFileName) noexcept;
 
 		string getTempFilePath(const string& fileId) const noexcept;
+
+		// Maximum size of the response for media file range requests without an end position (e.g. "bytes=0-")
+		// Media players request the following ranges when needed so that the whole file doesn't need to be read in memory
+		// (other clients, such as download managers resuming a download, expect to receive the rest of the file)
+		static const int64_t MAX_MEDIA_RANGE_SIZE = 10 * 1024 * 1024;
 	private:
 		websocketpp::http::status_code::value handleGetRequest(const websocketpp::http::parser::request& aRequest,
 			std::string& output_, StringPairList& headers_, const SessionPtr& aSession) noexcept;
@@ -53,11 +58,13 @@ namespace webserver {
 		string parseViewFilePath(const string& aResource, StringPairList& headers_, const SessionPtr& aSession) const;
 
 		static string getExtension(const string& aResource) noexcept;
+		static bool isMediaFile(const string& aFileName) noexcept;
 
 		// Parses start and end position from a range HTTP request field
-		// Initial value of end_ should be the file size
+		// Initial value of end_ should be the last position of the file
+		// Open-ended ranges are limited to MAX_MEDIA_RANGE_SIZE bytes if aIsMedia is set
 		// Returns true if the partial range was parsed successfully
-		static bool parsePartialRange(const string& aHeaderData, int64_t& start_, int64_t& end_) noexcept;
+		static bool parsePartialRange(const string& aHeaderData, bool aIsMedia, int64_t& start_, int64_t& end_) noexcept;
 
 		static string formatPartialRange(int64_t aStart, int64_t aEnd, int64_t aFileSize) noexcept;
 
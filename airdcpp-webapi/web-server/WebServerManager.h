@@ -155,7 +155,8 @@ namespace webserver {
 				return;
 			}
 
-			onData(msg->get_payload(), TransportType::TYPE_SOCKET, Direction::INCOMING, socket->getIp());
+			auto isBinary = msg->get_opcode() == websocketpp::frame::opcode::binary;
+			onData(isBinary ? "(binary message, " + Util::formatBytes(msg->get_payload().size()) + ")" : msg->get_payload(), TransportType::TYPE_SOCKET, Direction::INCOMING, socket->getIp());
 
 			// Messages received from each socket will always use the same thread
 			// This will also help with hooks getting timed out when they are being run and
@@ -163,7 +164,7 @@ namespace webserver {
 			// TODO: use different threads for handling requests that involve running of hooks
 			addAsyncTask([=] {
 				auto s = socket;
-				api.handleSocketRequest(msg->get_payload(), s, aIsSecure); 
+				api.handleSocketRequest(msg->get_payload(), isBinary, s, aIsSecure);
 			});
 		}
 
@@ -113,22 +113,168 @@ namespace webserver {
 		dcdebug(string(aMessage + " (%s)\n").c_str(), session ? session->getAuthToken().c_str() : "no session");
 	}
 
+	WebSocket::Encoding WebSocket::parseEncoding(const string& aStr) {
+		if (aStr == "json") {
+			return Encoding::JSON;
+		} else if (aStr == "cbor") {
+			return Encoding::CBOR;
+		} else if (aStr == "msgpack") {
+			return Encoding::MSGPACK;
+		}
+
+		throw std::invalid_argument("Invalid encoding " + aStr);
+	}
+
+	atomic<uint64_t> WebSocket::encodedMessages[3];
+	atomic<uint64_t> WebSocket::encodedBytes[3];
+	atomic<uint64_t> WebSocket::encodeTime[3];
+
+	void WebSocket::addEncodingStats(Encoding aEncoding, size_t aBytes, const std::chrono::steady_clock::time_point& aStart) noexcept {
+		auto index = static_cast<int>(aEncoding);
+		encodedMessages[index]++;
+		encodedBytes[index] += aBytes;
+		encodeTime[index] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - aStart).count();
+	}
+
+	WebSocket::EncodingStats WebSocket::getEncodingStats(Encoding aEncoding) noexcept {
+		auto index = static_cast<int>(aEncoding);
+		return { encodedMessages[index], encodedBytes[index], encodeTime[index] };
+	}
+
+	string WebSocket::encodeJson(const json& aJson) {
+		auto start = std::chrono::steady_clock::now();
+		auto ret = aJson.dump();
+		addEncodingStats(Encoding::JSON, ret.size(), start);
+		return ret;
+	}
+
+	vector<uint8_t> WebSocket::encodeBinary(const json& aJson, Encoding aEncoding) {
+		dcassert(aEncoding != Encoding::JSON);
+
+		auto start = std::chrono::steady_clock::now();
+		auto ret = aEncoding == Encoding::CBOR ? json::to_cbor(aJson) : json::to_msgpack(aJson);
+		addEncodingStats(aEncoding, ret.size(), start);
+		return ret;
+	}
+
+	json WebSocket::parseMessage(const string& aMessage, bool aIsBinary) const {
+		if (!aIsBinary) {
+			return json::parse(aMessage);
+		}
+
+		switch (encoding.load()) {
+			case Encoding::CBOR: return json::from_cbor(aMessage);
+			case Encoding::MSGPACK: return json::from_msgpack(aMessage);
+			default: throw std::invalid_argument("Binary messages can't be used with the JSON encoding");
+		}
+	}
+
 	void WebSocket::sendPlain(const json& aJson) {
+		if (encoding != Encoding::JSON) {
+			sendBinary(aJson);
+			return;
+		}
+
 		string str;
 		try {
-			str = aJson.dump();
+			str = encodeJson(aJson);
 		} catch (const std::exception& e) {
 			logError("Failed to convert data to JSON: " + string(e.what()), websocketpp::log::elevel::fatal);
 			throw e;
 		}
 
-		wsm->onData(str, TransportType::TYPE_SOCKET, Direction::OUTGOING, getIp());
+		sendPlain(str);
+	}
+
+	void WebSocket::sendPlain(const string& aData) {
+		if (encoding != Encoding::JSON) {
+			sendBinary(json::parse(aData));
+			return;
+		}
+
+		wsm->onData(aData, TransportType::TYPE_SOCKET, Direction::OUTGOING, getIp());
+		sendFrame(aData.data(), aData.size(), websocketpp::frame::opcode::text);
+	}
+
+	void WebSocket::sendEvent(const json& aProperties, const string& aJsonData) {
+		// Same as serializing the object with the "data" property added
+		auto properties = aProperties.dump();
+		dcassert(properties.size() > 2);
+
+		sendPlain("{\"data\":" + aJsonData + "," + properties.substr(1));
+	}
+
+	void WebSocket::sendEvent(const json& aProperties, const vector<uint8_t>& aBinaryData, Encoding aEncoding) {
+		// Map entries are written one after another with both encodings so the encoded data
+		// can be inserted after the header of the encoded property map
+		auto properties = aEncoding == Encoding::CBOR ? json::to_cbor(aProperties) : json::to_msgpack(aProperties);
+		auto key = aEncoding == Encoding::CBOR ? json::to_cbor("data") : json::to_msgpack("data");
+
+		// Small maps only have a single header byte (CBOR: 0xA0 + size, MessagePack: 0x80 + size)
+		auto mapHeader = aEncoding == Encoding::CBOR ? 0xA0 : 0x80;
+		dcassert(aProperties.size() < 15 && properties[0] == mapHeader + aProperties.size());
+
+		vector<uint8_t> data;
+		data.reserve(properties.size() + key.size() + aBinaryData.size());
+		data.push_back(static_cast<uint8_t>(mapHeader + aProperties.size() + 1));
+		data.insert(data.end(), key.begin(), key.end());
+		data.insert(data.end(), aBinaryData.begin(), aBinaryData.end());
+		data.insert(data.end(), properties.begin() + 1, properties.end());
+
+		sendBinary(data);
+	}
+
+	void WebSocket::sendBinary(const json& aJson) {
+		vector<uint8_t> data;
+		try {
+			data = encodeBinary(aJson, encoding);
+		} catch (const std::exception& e) {
+			logError("Failed to encode data: " + string(e.what()), websocketpp::log::elevel::fatal);
+			throw e;
+		}
+
+		sendBinary(data);
+	}
+
+	void WebSocket::sendBinary(const vector<uint8_t>& aData) {
+		// The encoded data isn't readable in the data listeners
+		wsm->onData("(binary message, " + Util::formatBytes(aData.size()) + ")", TransportType::TYPE_SOCKET, Direction::OUTGOING, getIp());
+		sendFrame(aData.data(), aData.size(), websocketpp::frame::opcode::binary);
+	}
+
+	size_t WebSocket::getBufferedAmount() const noexcept {
+		try {
+			if (secure) {
+				return tlsServer->get_con_from_hdl(hdl)->get_buffered_amount();
+			} else {
+				return plainServer->get_con_from_hdl(hdl)->get_buffered_amount();
+			}
+		} catch (const std::exception& e) {
+			dcdebug("WebSocket::getBufferedAmount failed: %s\n", e.what());
+		}
+
+		return 0;
+	}
+
+	void WebSocket::sendFrame(const void* aData, size_t aLen, websocketpp::frame::opcode::value aOpCode) {
+		if (closing) {
+			return;
+		}
+
+		// Don't let the send queue grow without limits if the client can't process the data fast enough
+		// The client will fetch the current state again after reconnecting
+		if (getBufferedAmount() > MAX_BUFFERED_BYTES) {
+			logError("Client doesn't receive data fast enough, closing the connection", websocketpp::log::elevel::warn);
+			closing = true;
+			close(websocketpp::close::status::try_again_later, "Too much data queued");
+			return;
+		}
 
 		try {
 			if (secure) {
-				tlsServer->send(hdl, str, websocketpp::frame::opcode::text);
+				tlsServer->send(hdl, aData, aLen, aOpCode);
 			} else {
-				plainServer->send(hdl, str, websocketpp::frame::opcode::text);
+				plainServer->send(hdl, aData, aLen, aOpCode);
 			}
 		} catch (const std::exception& e) {
 			logError("Failed to send data: " + string(e.what()), websocketpp::log::elevel::fatal);
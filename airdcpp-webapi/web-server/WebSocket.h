@@ -26,11 +26,37 @@
 
 #include <airdcpp/GetSet.h>
 
+#include <chrono>
+
 namespace webserver {
 	// WebSockets are owned by WebServerManager and API modules
 
 	class WebSocket {
 	public:
+		// Encoding of the messages sent to the client
+		// Binary encodings are selected by the client when authenticating
+		enum class Encoding {
+			JSON,
+			CBOR,
+			MSGPACK
+		};
+
+		// Throws std::invalid_argument for unknown encodings
+		static Encoding parseEncoding(const string& aStr);
+
+		// Encode data for sending, throws on conversion errors
+		// Encoded sizes and times are collected per encoding
+		static string encodeJson(const json& aJson);
+		static vector<uint8_t> encodeBinary(const json& aJson, Encoding aEncoding);
+
+		struct EncodingStats {
+			uint64_t messages;
+			uint64_t bytes;
+			uint64_t encodeTime; // microseconds
+		};
+
+		static EncodingStats getEncodingStats(Encoding aEncoding) noexcept;
+
 		WebSocket(bool aIsSecure, websocketpp::connection_hdl aHdl, const websocketpp::http::parser::request& aRequest, server_plain* aServer, WebServerManager* aWsm);
 		WebSocket(bool aIsSecure, websocketpp::connection_hdl aHdl, const websocketpp::http::parser::request& aRequest, server_tls* aServer, WebServerManager* aWsm);
 		~WebSocket();
@@ -39,6 +65,13 @@ namespace webserver {
 
 		IGETSET(SessionPtr, session, Session, nullptr);
 
+		Encoding getEncoding() const noexcept { return encoding; }
+		void setEncoding(Encoding aEncoding) noexcept { encoding = aEncoding; }
+
+		// Parses a received request (binary messages use the current encoding)
+		// Throws on parsing errors
+		json parseMessage(const string& aMessage, bool aIsBinary) const;
+
 		// Send raw data
 		// Throws on JSON conversion errors (possibly because of failing UTF-8 validation...)
 		//
@@ -46,11 +79,25 @@ namespace webserver {
 		// NMDC code can't be trusted to parse the incoming messages without incorrectly 
 		// splitting multibyte character sequences in malformed received data...
 		void sendPlain(const json& aJson);
+
+		// Send serialized JSON
+		// The data is converted if a binary encoding is used
+		void sendPlain(const string& aData);
+
+		// Send an event message with data that has been encoded already
+		// aProperties contains the other properties of the message (such as the event name)
+		// Throws on encoding errors
+		void sendEvent(const json& aProperties, const string& aJsonData);
+		void sendEvent(const json& aProperties, const vector<uint8_t>& aBinaryData, Encoding aEncoding);
+
 		void sendApiResponse(const json& aJsonResponse, const json& aErrorJson, websocketpp::http::status_code::value aCode, int aCallbackId) noexcept;
 
 		WebSocket(WebSocket&) = delete;
 		WebSocket& operator=(WebSocket&) = delete;
 
+		// Maximum amount of outgoing data that may wait for being sent before the connection is closed
+		static const size_t MAX_BUFFERED_BYTES = 64 * 1024 * 1024;
+
 		string getIp() const noexcept;
 		void ping() noexcept;
 
@@ -77,6 +124,22 @@ namespace webserver {
 		const bool secure;
 		const time_t timeCreated;
 		string url;
+
+		size_t getBufferedAmount() const noexcept;
+		atomic<bool> closing = { false };
+		atomic<Encoding> encoding = { Encoding::JSON };
+
+		void sendBinary(const json& aJson);
+		void sendBinary(const vector<uint8_t>& aData);
+
+		static void addEncodingStats(Encoding aEncoding, size_t aBytes, const std::chrono::steady_clock::time_point& aStart) noexcept;
+
+		static atomic<uint64_t> encodedMessages[3];
+		static atomic<uint64_t> encodedBytes[3];
+		static atomic<uint64_t> encodeTime[3];
+
+		// The connection is closed if the client doesn't keep up with receiving the data
+		void sendFrame(const void* aData, size_t aLen, websocketpp::frame::opcode::value aOpCode);
 	};
 }
 